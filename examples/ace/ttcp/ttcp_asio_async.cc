@@ -144,7 +144,7 @@ typedef std::shared_ptr<TtcpServerConnection> TtcpServerConnectionPtr;
 void doAccept(tcp::acceptor& acceptor)
 {
   // no need to pre-create new_connection if we use asio 1.12 or boost 1.66+
-  TtcpServerConnectionPtr new_connection(new TtcpServerConnection(acceptor.get_io_service()));
+  TtcpServerConnectionPtr new_connection(new TtcpServerConnection(static_cast<boost::asio::io_context&>(acceptor.get_executor().context())));
   acceptor.async_accept(
       new_connection->socket(),
       [&acceptor, new_connection](boost::system::error_code error)  // move new_connection in C++14
@@ -0,0 +1,63 @@
+#include "muduo/base/Logging.h"
+#include "muduo/net/EventLoop.h"
+#include "muduo/net/TcpServer.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// Like download3, but the kernel copies the file to the socket with
+// sendfile(2), no fread() and no buffer in user space.
+
+const char* g_file = NULL;
+
+void onConnection(const TcpConnectionPtr& conn)
+{
+  LOG_INFO << "FileServer - " << conn->peerAddress().toIpPort() << " -> "
+           << conn->localAddress().toIpPort() << " is "
+           << (conn->connected() ? "UP" : "DOWN");
+  if (conn->connected())
+  {
+    LOG_INFO << "FileServer - Sending file " << g_file
+             << " to " << conn->peerAddress().toIpPort();
+    int fd = ::open(g_file, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd >= 0 && ::fstat(fd, &st) == 0)
+    {
+      conn->sendFile(fd, 0, static_cast<size_t>(st.st_size));
+    }
+    else
+    {
+      LOG_INFO << "FileServer - no such file";
+    }
+    if (fd >= 0)
+    {
+      ::close(fd);  // sendFile() keeps a dup
+    }
+    conn->shutdown();
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  LOG_INFO << "pid = " << getpid();
+  if (argc > 1)
+  {
+    g_file = argv[1];
+
+    EventLoop loop;
+    InetAddress listenAddr(2021);
+    TcpServer server(&loop, listenAddr, "FileServer");
+    server.setConnectionCallback(onConnection);
+    server.start();
+    loop.loop();
+  }
+  else
+  {
+    fprintf(stderr, "Usage: %s file_for_downloading\n", argv[0]);
+  }
+}
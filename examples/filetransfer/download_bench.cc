@@ -0,0 +1,158 @@
+// Throughput of serving a file as download3 does, fread() 64KiB chunks
+// and send() them on write complete, against download4, sendFile().
+//
+// Usage: filetransfer_download_bench [megabytes [clients]]
+
+#include "muduo/base/CountDownLatch.h"
+#include "muduo/base/Logging.h"
+#include "muduo/base/Timestamp.h"
+#include "muduo/net/EventLoop.h"
+#include "muduo/net/EventLoopThread.h"
+#include "muduo/net/TcpClient.h"
+#include "muduo/net/TcpServer.h"
+
+#include <memory>
+#include <vector>
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+const int kBufSize = 64*1024;
+char g_file[] = "/tmp/download_bench.XXXXXX";
+size_t g_fileSize = 0;
+typedef std::shared_ptr<FILE> FilePtr;
+
+// download3
+void onConnectionRead(const TcpConnectionPtr& conn)
+{
+  if (conn->connected())
+  {
+    FILE* fp = ::fopen(g_file, "rb");
+    FilePtr ctx(fp, ::fclose);
+    conn->setContext(ctx);
+    char buf[kBufSize];
+    size_t nread = ::fread(buf, 1, sizeof buf, fp);
+    conn->send(buf, static_cast<int>(nread));
+  }
+}
+
+void onWriteCompleteRead(const TcpConnectionPtr& conn)
+{
+  const FilePtr& fp = boost::any_cast<const FilePtr&>(conn->getContext());
+  char buf[kBufSize];
+  size_t nread = ::fread(buf, 1, sizeof buf, get_pointer(fp));
+  if (nread > 0)
+  {
+    conn->send(buf, static_cast<int>(nread));
+  }
+  else
+  {
+    conn->shutdown();
+  }
+}
+
+// download4
+void onConnectionSendFile(const TcpConnectionPtr& conn)
+{
+  if (conn->connected())
+  {
+    int fd = ::open(g_file, O_RDONLY | O_CLOEXEC);
+    conn->sendFile(fd, 0, g_fileSize);
+    ::close(fd);
+    conn->shutdown();
+  }
+}
+
+void bench(const char* name, uint16_t port, int numClients,
+           const ConnectionCallback& onConnection,
+           const WriteCompleteCallback& onWriteComplete)
+{
+  EventLoop loop;
+  InetAddress listenAddr(port, true);
+  TcpServer server(&loop, listenAddr, name);
+  server.setConnectionCallback(onConnection);
+  server.setWriteCompleteCallback(onWriteComplete);
+  server.start();
+
+  EventLoopThread clientThread;
+  EventLoop* clientLoop = clientThread.startLoop();
+  std::vector<std::unique_ptr<TcpClient>> clients;
+  int64_t received = 0;
+  int done = 0;
+  Timestamp start(Timestamp::now());
+  clientLoop->runInLoop([&]
+      {
+        for (int i = 0; i < numClients; ++i)
+        {
+          clients.emplace_back(new TcpClient(clientLoop, listenAddr, name));
+          clients.back()->setMessageCallback(
+              [&received](const TcpConnectionPtr&, Buffer* buf, Timestamp)
+              {
+                received += static_cast<int64_t>(buf->readableBytes());
+                buf->retrieveAll();
+              });
+          clients.back()->setConnectionCallback(
+              [&](const TcpConnectionPtr& conn)
+              {
+                if (conn->disconnected() && ++done == numClients)
+                {
+                  loop.quit();
+                }
+              });
+          clients.back()->connect();
+        }
+      });
+  loop.loop();
+  double seconds = timeDifference(Timestamp::now(), start);
+
+  CountDownLatch latch(1);
+  clientLoop->runInLoop([&]
+      {
+        clients.clear();
+        latch.countDown();
+      });
+  latch.wait();
+  if (received != static_cast<int64_t>(g_fileSize) * numClients)
+  {
+    printf("%s received %" PRId64 " bytes, wrong\n", name, received);
+    abort();
+  }
+  printf("%-10s %8.1f MiB/s\n", name,
+         static_cast<double>(received) / seconds / 1024 / 1024);
+}
+
+int main(int argc, char* argv[])
+{
+  int megabytes = argc > 1 ? atoi(argv[1]) : 256;
+  int numClients = argc > 2 ? atoi(argv[2]) : 4;
+  Logger::setLogLevel(Logger::WARN);
+
+  int fd = ::mkstemp(g_file);
+  if (fd < 0)
+  {
+    perror("mkstemp");
+    return 1;
+  }
+  std::vector<char> block(1024 * 1024, 'x');
+  for (int i = 0; i < megabytes; ++i)
+  {
+    if (::write(fd, block.data(), block.size()) != static_cast<ssize_t>(block.size()))
+    {
+      perror("write");
+      return 1;
+    }
+  }
+  ::close(fd);
+  g_fileSize = static_cast<size_t>(megabytes) * block.size();
+  printf("%d clients download %d MiB each\n", numClients, megabytes);
+
+  bench("download3", 12021, numClients, onConnectionRead, onWriteCompleteRead);
+  bench("download4", 12022, numClients, onConnectionSendFile, WriteCompleteCallback());
+  ::unlink(g_file);
+}
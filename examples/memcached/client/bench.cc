@@ -1,18 +1,52 @@
 #include "muduo/base/CountDownLatch.h"
 #include "muduo/base/Logging.h"
+#include "muduo/net/Endian.h"
 #include "muduo/net/EventLoop.h"
 #include "muduo/net/EventLoopThreadPool.h"
 #include "muduo/net/TcpClient.h"
 
 #include <boost/program_options.hpp>
+#include <algorithm>
 #include <iostream>
 
 #include <stdio.h>
+#include <string.h>
 
 namespace po = boost::program_options;
 using namespace muduo;
 using namespace muduo::net;
 
+namespace binary
+{
+
+// memcached binary protocol
+const uint8_t kRequestMagic = 0x80;
+const size_t kHeaderLength = 24;
+const uint8_t kCmdGet = 0x00;
+const uint8_t kCmdSet = 0x01;
+const uint8_t kCmdNoop = 0x0a;
+const uint8_t kCmdGetKQ = 0x0d;
+
+void appendRequest(Buffer* buf, uint8_t opcode, StringPiece extras,
+                   StringPiece key, StringPiece value)
+{
+  char header[kHeaderLength] = { 0 };
+  header[0] = static_cast<char>(kRequestMagic);
+  header[1] = static_cast<char>(opcode);
+  uint16_t keylen = sockets::hostToNetwork16(static_cast<uint16_t>(key.size()));
+  memcpy(header + 2, &keylen, sizeof keylen);
+  header[4] = static_cast<char>(extras.size());
+  uint32_t bodylen = sockets::hostToNetwork32(
+      static_cast<uint32_t>(extras.size() + key.size() + value.size()));
+  memcpy(header + 8, &bodylen, sizeof bodylen);
+  buf->append(header, sizeof header);
+  buf->append(extras);
+  buf->append(key);
+  buf->append(value);
+}
+
+}  // namespace binary
+
 class Client : noncopyable
 {
  public:
@@ -25,25 +59,33 @@ class Client : noncopyable
   Client(const string& name,
          EventLoop* loop,
          const InetAddress& serverAddr,
-         Operation op,
+         int setPercent,
          int requests,
          int keys,
          int valuelen,
+         bool binary,
+         int multiget,
          CountDownLatch* connected,
          CountDownLatch* finished)
     : name_(name),
       client_(loop, serverAddr, name),
-      op_(op),
+      setPercent_(setPercent),
+      op_(kGet),
       sent_(0),
       acked_(0),
       requests_(requests),
       keys_(keys),
       valuelen_(valuelen),
       value_(valuelen_, 'a'),
+      binary_(binary),
+      multiget_(multiget),
       connected_(connected),
       finished_(finished)
   {
-    value_ += "\r\n";
+    if (!binary_)
+    {
+      value_ += "\r\n";
+    }
     client_.setConnectionCallback(std::bind(&Client::onConnection, this, _1));
     client_.setMessageCallback(std::bind(&Client::onMessage, this, _1, _2, _3));
     client_.connect();
@@ -76,86 +118,202 @@ class Client : noncopyable
                  Buffer* buffer,
                  Timestamp receiveTime)
   {
-    if (op_ == kSet)
+    while (buffer->readableBytes() > 0)
     {
-      while (buffer->readableBytes() > 0)
+      const bool acked = binary_ ? retrieveBinaryReply(buffer) : retrieveReply(buffer);
+      if (acked)
       {
-        const char* crlf = buffer->findCRLF();
-        if (crlf)
-        {
-          buffer->retrieveUntil(crlf+2);
-          ++acked_;
-          if (sent_ < requests_)
-          {
-            send();
-          }
-        }
-        else
+        ++acked_;
+        if (sent_ < requests_)
         {
-          break;
+          send();
         }
       }
+      else
+      {
+        break;
+      }
+    }
+    if (acked_ == requests_)
+    {
+      conn_->shutdown();
+    }
+  }
+
+  // returns true if retrieved the whole reply of a request
+  bool retrieveReply(Buffer* buffer)
+  {
+    if (op_ == kSet)
+    {
+      const char* crlf = buffer->findCRLF();
+      if (crlf)
+      {
+        buffer->retrieveUntil(crlf+2);
+        return true;
+      }
     }
     else
     {
-      while (buffer->readableBytes() > 0)
+      const char* end = static_cast<const char*>(memmem(buffer->peek(),
+                                                        buffer->readableBytes(),
+                                                        "END\r\n", 5));
+      if (end)
       {
-        const char* end = static_cast<const char*>(memmem(buffer->peek(),
-                                                          buffer->readableBytes(),
-                                                          "END\r\n", 5));
-        if (end)
-        {
-          buffer->retrieveUntil(end+5);
-          ++acked_;
-          if (sent_ < requests_)
-          {
-            send();
-          }
-        }
-        else
-        {
-          break;
-        }
+        buffer->retrieveUntil(end+5);
+        return true;
       }
     }
-    if (acked_ == requests_)
+    return false;
+  }
+
+  // a multiget is done with the reply to its noop
+  bool retrieveBinaryReply(Buffer* buffer)
+  {
+    while (buffer->readableBytes() >= binary::kHeaderLength)
     {
-      conn_->shutdown();
+      uint32_t bodylen = 0;
+      memcpy(&bodylen, buffer->peek() + 8, sizeof bodylen);
+      const size_t length = binary::kHeaderLength + sockets::networkToHost32(bodylen);
+      if (buffer->readableBytes() < length)
+      {
+        break;
+      }
+      const uint8_t opcode = static_cast<uint8_t>(buffer->peek()[1]);
+      buffer->retrieve(length);
+      if (multiget_ == 0 || op_ == kSet || opcode == binary::kCmdNoop)
+      {
+        return true;
+      }
     }
+    return false;
   }
 
   void fill(Buffer* buf)
   {
     char req[256];
+    // spreads sets evenly, 61 is coprime to 100
+    op_ = (sent_ % 100) * 61 % 100 < setPercent_ ? kSet : kGet;
     if (op_ == kSet)
     {
-      snprintf(req, sizeof req, "set %s%d 42 0 %d\r\n", name_.c_str(), sent_ % keys_, valuelen_);
-      ++sent_;
-      buf->append(req);
-      buf->append(value_);
+      snprintf(req, sizeof req, "%s%d", name_.c_str(), sent_ % keys_);
+      if (binary_)
+      {
+        // flags 42, never expires
+        const uint32_t extras[2] = { sockets::hostToNetwork32(42), 0 };
+        binary::appendRequest(buf, binary::kCmdSet,
+                              StringPiece(reinterpret_cast<const char*>(extras), sizeof extras),
+                              req, value_);
+      }
+      else
+      {
+        buf->append("set ");
+        buf->append(req);
+        snprintf(req, sizeof req, " 42 0 %d\r\n", valuelen_);
+        buf->append(req);
+        buf->append(value_);
+      }
+    }
+    else if (binary_)
+    {
+      if (multiget_ == 0)
+      {
+        snprintf(req, sizeof req, "%s%d", name_.c_str(), sent_ % keys_);
+        binary::appendRequest(buf, binary::kCmdGet, StringPiece(), req, StringPiece());
+      }
+      else
+      {
+        // quiet gets, only hits are replied
+        for (int i = 0; i < multiget_; ++i)
+        {
+          snprintf(req, sizeof req, "%s%d", name_.c_str(), (sent_ * multiget_ + i) % keys_);
+          binary::appendRequest(buf, binary::kCmdGetKQ, StringPiece(), req, StringPiece());
+        }
+        binary::appendRequest(buf, binary::kCmdNoop, StringPiece(), StringPiece(), StringPiece());
+      }
     }
     else
     {
-      snprintf(req, sizeof req, "get %s%d\r\n", name_.c_str(), sent_ % keys_);
-      ++sent_;
-      buf->append(req);
+      buf->append("get");
+      for (int i = 0; i < std::max(multiget_, 1); ++i)
+      {
+        snprintf(req, sizeof req, " %s%d", name_.c_str(), (sent_ * std::max(multiget_, 1) + i) % keys_);
+        buf->append(req);
+      }
+      buf->append("\r\n");
     }
+    ++sent_;
   }
 
   string name_;
   TcpClient client_;
   TcpConnectionPtr conn_;
-  const Operation op_;
+  const int setPercent_;
+  Operation op_;  // of the request in flight
   int sent_;
   int acked_;
   const int requests_;
   const int keys_;
   const int valuelen_;
   string value_;
+  const bool binary_;
+  const int multiget_;  // keys per get, 0 for get of one key
   CountDownLatch* const connected_;
   CountDownLatch* const finished_;
 };
 
+struct Workload
+{
+  int clients;
+  int requests;
+  int keys;
+  int valuelen;
+  int setPercent;
+  bool binary;
+  int multiget;
+};
+
+// returns requests per second
+double run(const InetAddress& serverAddr, int threads, const Workload& w)
+{
+  EventLoop loop;
+  EventLoopThreadPool pool(&loop, "bench-memcache");
+  pool.setThreadNum(threads);
+  pool.start();
+
+  char buf[32];
+  CountDownLatch connected(w.clients);
+  CountDownLatch finished(w.clients);
+  std::vector<std::unique_ptr<Client>> holder;
+  for (int i = 0; i < w.clients; ++i)
+  {
+    snprintf(buf, sizeof buf, "%d-", i+1);
+    holder.emplace_back(new Client(buf,
+                                pool.getNextLoop(),
+                                serverAddr,
+                                w.setPercent,
+                                w.requests,
+                                w.keys,
+                                w.valuelen,
+                                w.binary,
+                                w.multiget,
+                                &connected,
+                                &finished));
+  }
+  connected.wait();
+  LOG_WARN << w.clients << " clients all connected";
+  Timestamp start = Timestamp::now();
+  for (int i = 0; i < w.clients; ++i)
+  {
+    holder[i]->send();
+  }
+  finished.wait();
+  Timestamp end = Timestamp::now();
+  LOG_WARN << "All finished";
+  double seconds = timeDifference(end, start);
+  LOG_WARN << seconds << " sec";
+  return 1.0 * w.clients * w.requests / seconds;
+}
+
 int main(int argc, char* argv[])
 {
   Logger::setLogLevel(Logger::WARN);
@@ -163,10 +321,7 @@ int main(int argc, char* argv[])
   uint16_t tcpport = 11211;
   string hostIp = "127.0.0.1";
   int threads = 4;
-  int clients = 100;
-  int requests = 100000;
-  int keys = 10000;
-  bool set = false;
+  Workload w = { 100, 100000, 10000, 100, 0, false, 0 };
 
   po::options_description desc("Allowed options");
   desc.add_options()
@@ -174,10 +329,14 @@ int main(int argc, char* argv[])
       ("port,p", po::value<uint16_t>(&tcpport), "TCP port")
       ("ip,i", po::value<string>(&hostIp), "Host IP")
       ("threads,t", po::value<int>(&threads), "Number of worker threads")
-      ("clients,c", po::value<int>(&clients), "Number of concurrent clients")
-      ("requests,r", po::value<int>(&requests), "Number of requests per clients")
-      ("keys,k", po::value<int>(&keys), "Number of keys per clients")
+      ("clients,c", po::value<int>(&w.clients), "Number of concurrent clients")
+      ("requests,r", po::value<int>(&w.requests), "Number of requests per clients")
+      ("keys,k", po::value<int>(&w.keys), "Number of keys per clients")
       ("set,s", "Get or Set")
+      ("mix,x", po::value<int>(&w.setPercent), "Percent of sets among gets")
+      ("binary,b", "Binary protocol")
+      ("multiget,m", po::value<int>(&w.multiget), "Keys per get, as one request")
+      ("sweep", "Runs with 1, 2, 4 ... up to threads worker threads")
       ;
 
   po::variables_map vm;
@@ -189,51 +348,45 @@ int main(int argc, char* argv[])
     std::cout << desc << "\n";
     return 0;
   }
-  set = vm.count("set");
+  if (vm.count("set"))
+  {
+    w.setPercent = 100;
+  }
+  w.binary = vm.count("binary");
 
   InetAddress serverAddr(hostIp, tcpport);
   LOG_WARN << "Connecting " << serverAddr.toIpPort();
 
-  EventLoop loop;
-  EventLoopThreadPool pool(&loop, "bench-memcache");
-
-  int valuelen = 100;
-  Client::Operation op = set ? Client::kSet : Client::kGet;
-
-  double memoryMiB = 1.0 * clients * keys * (32+80+valuelen+8) / 1024 / 1024;
+  double memoryMiB = 1.0 * w.clients * w.keys * (32+80+w.valuelen+8) / 1024 / 1024;
   LOG_WARN << "estimated memcached-debug memory usage " << int(memoryMiB) << " MiB";
 
-  pool.setThreadNum(threads);
-  pool.start();
+  std::vector<int> threadNums;
+  if (vm.count("sweep"))
+  {
+    for (int n = 1; n < threads; n *= 2)
+    {
+      threadNums.push_back(n);
+    }
+  }
+  threadNums.push_back(threads);
 
-  char buf[32];
-  CountDownLatch connected(clients);
-  CountDownLatch finished(clients);
-  std::vector<std::unique_ptr<Client>> holder;
-  for (int i = 0; i < clients; ++i)
+  std::vector<double> qps;
+  for (int n : threadNums)
   {
-    snprintf(buf, sizeof buf, "%d-", i+1);
-    holder.emplace_back(new Client(buf,
-                                pool.getNextLoop(),
-                                serverAddr,
-                                op,
-                                requests,
-                                keys,
-                                valuelen,
-                                &connected,
-                                &finished));
+    qps.push_back(run(serverAddr, n, w));
+    LOG_WARN << qps.back() << " QPS";
+    if (w.setPercent < 100 && w.multiget > 0)
+    {
+      LOG_WARN << qps.back() * w.multiget << " keys per second";
+    }
   }
-  connected.wait();
-  LOG_WARN << clients << " clients all connected";
-  Timestamp start = Timestamp::now();
-  for (int i = 0; i < clients; ++i)
+
+  if (threadNums.size() > 1)
   {
-    holder[i]->send();
+    printf("%d%% sets, %d clients\nthreads  ops/sec\n", w.setPercent, w.clients);
+    for (size_t i = 0; i < threadNums.size(); ++i)
+    {
+      printf("%7d  %.0f\n", threadNums[i], qps[i]);
+    }
   }
-  finished.wait();
-  Timestamp end = Timestamp::now();
-  LOG_WARN << "All finished";
-  double seconds = timeDifference(end, start);
-  LOG_WARN << seconds << " sec";
-  LOG_WARN << 1.0 * clients * requests / seconds << " QPS";
 }
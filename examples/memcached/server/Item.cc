@@ -1,7 +1,8 @@
 #include "examples/memcached/server/Item.h"
+#include "examples/memcached/server/SlabAllocator.h"
 
 #include "muduo/base/LogStream.h"
-#include "muduo/net/Buffer.h"
+#include "muduo/net/OutputQueue.h"
 
 #include <boost/functional/hash/hash.hpp>
 
@@ -11,20 +12,49 @@
 using namespace muduo;
 using namespace muduo::net;
 
+namespace
+{
+
+// values below are cheaper to copy than to refer to
+const size_t kCopyThreshold = 1024;
+
+struct Unref
+{
+  void operator()(const Item* item) const
+  {
+    item->unref();
+  }
+};
+
+}  // namespace
+
+uint32_t Item::hashKey(StringPiece key)
+{
+  return static_cast<uint32_t>(boost::hash_range(key.begin(), key.end()));
+}
+
 Item::Item(StringPiece keyArg,
            uint32_t flagsArg,
            int exptimeArg,
            int valuelen,
-           uint64_t casArg)
-  : keylen_(keyArg.size()),
+           uint64_t casArg,
+           int slabClass)
+  : hashNext_(NULL),
+    prev_(NULL),
+    next_(NULL),
+    cas_(casArg),
+    hash_(hashKey(keyArg)),
     flags_(flagsArg),
     rel_exptime_(exptimeArg),
     valuelen_(valuelen),
     receivedBytes_(0),
-    cas_(casArg),
-    hash_(boost::hash_range(keyArg.begin(), keyArg.end())),
-    data_(static_cast<char*>(::malloc(totalLen())))
+    refCount_(1),
+    keylen_(static_cast<uint8_t>(keyArg.size())),
+    slabClass_(static_cast<uint8_t>(slabClass)),
+    lru_(kUnlinked),
+    active_(false)
 {
+  assert(keyArg.size() <= 250);
   assert(valuelen_ >= 2);
   assert(receivedBytes_ < totalLen());
   append(keyArg.data(), keylen_);
@@ -33,31 +63,44 @@ Item::Item(StringPiece keyArg,
 void Item::append(const char* data, size_t len)
 {
   assert(len <= neededBytes());
-  memcpy(data_ + receivedBytes_, data, len);
+  memcpy(this->data() + receivedBytes_, data, len);
   receivedBytes_ += static_cast<int>(len);
   assert(receivedBytes_ <= totalLen());
 }
 
-void Item::output(Buffer* out, bool needCas) const
+void Item::output(OutputQueue* out, bool needCas) const
 {
-  out->append("VALUE ");
-  out->append(data_, keylen_);
   LogStream buf;
-  buf << ' ' << flags_ << ' ' << valuelen_-2;
+  buf << "VALUE " << key() << ' ' << flags_ << ' ' << valuelen_-2;
   if (needCas)
   {
     buf << ' ' << cas_;
   }
   buf << "\r\n";
   out->append(buf.buffer().data(), buf.buffer().length());
-  out->append(value(), valuelen_);
+  outputValue(out, valuelen_);
 }
 
-void Item::resetKey(StringPiece k)
+void Item::outputValue(OutputQueue* out, size_t len) const
 {
-  assert(k.size() <= 250);
-  keylen_ = k.size();
-  receivedBytes_ = 0;
-  append(k.data(), k.size());
-  hash_ = boost::hash_range(k.begin(), k.end());
+  assert(len <= valueLength());
+  if (len < kCopyThreshold)
+  {
+    out->append(value(), len);
+  }
+  else
+  {
+    // the chunk is not reused before the last reference is gone
+    ref();
+    out->append(std::shared_ptr<const Item>(this, Unref()), value(), len);
+  }
+}
+
+void Item::unref() const
+{
+  if (refCount_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+  {
+    assert(lru_ == kUnlinked);
+    SlabAllocator::free(const_cast<Item*>(this));
+  }
 }
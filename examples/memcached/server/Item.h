@@ -1,25 +1,117 @@
 #ifndef MUDUO_EXAMPLES_MEMCACHED_SERVER_ITEM_H
 #define MUDUO_EXAMPLES_MEMCACHED_SERVER_ITEM_H
 
-#include "muduo/base/Atomic.h"
+#include "muduo/base/noncopyable.h"
 #include "muduo/base/StringPiece.h"
 #include "muduo/base/Types.h"
 
-#include <memory>
+#include <atomic>
+#include <utility>
 
 namespace muduo
 {
 namespace net
 {
-class Buffer;
+class OutputQueue;
 }
 }
 
+class SlabAllocator;
+
+// Intrusive reference to an Item, which goes back to its slab with the
+// last reference.
+template<typename T>
+class ItemRef
+{
+ public:
+  ItemRef()
+    : item_(NULL)
+  {
+  }
+
+  // takes over a reference
+  explicit ItemRef(T* item)
+    : item_(item)
+  {
+  }
+
+  ItemRef(const ItemRef& rhs)
+    : item_(rhs.item_)
+  {
+    if (item_)
+    {
+      item_->ref();
+    }
+  }
+
+  // ItemPtr to ConstItemPtr
+  template<typename U>
+  ItemRef(const ItemRef<U>& rhs)
+    : item_(rhs.get())
+  {
+    if (item_)
+    {
+      item_->ref();
+    }
+  }
+
+  ItemRef(ItemRef&& rhs) noexcept
+    : item_(rhs.item_)
+  {
+    rhs.item_ = NULL;
+  }
+
+  ~ItemRef()
+  {
+    if (item_)
+    {
+      item_->unref();
+    }
+  }
+
+  ItemRef& operator=(ItemRef rhs)
+  {
+    std::swap(item_, rhs.item_);
+    return *this;
+  }
+
+  void reset()
+  {
+    ItemRef().swap(*this);
+  }
+
+  void swap(ItemRef& rhs)
+  {
+    std::swap(item_, rhs.item_);
+  }
+
+  // gives up the reference without dropping it
+  T* release()
+  {
+    T* item = item_;
+    item_ = NULL;
+    return item;
+  }
+
+  T* get() const { return item_; }
+  T* operator->() const { return item_; }
+  T& operator*() const { return *item_; }
+  explicit operator bool() const { return item_ != NULL; }
+
+  bool unique() const { return item_ && item_->refCount() == 1; }
+
+ private:
+  T* item_;
+};
+
 class Item;
-typedef std::shared_ptr<Item> ItemPtr;  // TODO: use unique_ptr
-typedef std::shared_ptr<const Item> ConstItemPtr;  // TODO: use unique_ptr
+typedef ItemRef<Item> ItemPtr;
+typedef ItemRef<const Item> ConstItemPtr;
 
 // Item is immutable once added into hash table
+//
+// It lives in a chunk of SlabAllocator, the key and the value follow it,
+// the links of the hash table and the LRU of its slab class in front.
 class Item : muduo::noncopyable
 {
  public:
@@ -34,30 +126,33 @@ class Item : muduo::noncopyable
     kCas,
   };
 
-  static ItemPtr makeItem(muduo::StringPiece keyArg,
-                          uint32_t flagsArg,
-                          int exptimeArg,
-                          int valuelen,
-                          uint64_t casArg)
+  // the segments of the LRU of a slab class
+  enum LruSegment
+  {
+    kUnlinked,
+    kHot,
+    kWarm,
+    kCold,
+  };
+
+  static uint32_t hashKey(muduo::StringPiece key);
+
+  // chunk bytes for an item
+  static size_t totalBytes(size_t keylen, size_t valuelen)
   {
-    return std::make_shared<Item>(keyArg, flagsArg, exptimeArg, valuelen, casArg);
-    //return ItemPtr(new Item(keyArg, flagsArg, exptimeArg, valuelen, casArg));
+    return sizeof(Item) + keylen + valuelen;
   }
 
   Item(muduo::StringPiece keyArg,
        uint32_t flagsArg,
        int exptimeArg,
        int valuelen,
-       uint64_t casArg);
-
-  ~Item()
-  {
-    ::free(data_);
-  }
+       uint64_t casArg,
+       int slabClass);
 
   muduo::StringPiece key() const
   {
-    return muduo::StringPiece(data_, keylen_);
+    return muduo::StringPiece(data(), keylen_);
   }
 
   uint32_t flags() const
@@ -70,9 +165,15 @@ class Item : muduo::noncopyable
     return rel_exptime_;
   }
 
+  // now is relative to the start of the server, as rel_exptime
+  bool expired(int now) const
+  {
+    return rel_exptime_ != 0 && rel_exptime_ <= now;
+  }
+
   const char* value() const
   {
-    return data_+keylen_;
+    return data()+keylen_;
   }
 
   size_t valueLength() const
@@ -85,7 +186,7 @@ class Item : muduo::noncopyable
     return cas_;
   }
 
-  size_t hash() const
+  uint32_t hash() const
   {
     return hash_;
   }
@@ -105,25 +206,75 @@ class Item : muduo::noncopyable
   bool endsWithCRLF() const
   {
     return receivedBytes_ == totalLen()
-        && data_[totalLen()-2] == '\r'
-        && data_[totalLen()-1] == '\n';
+        && data()[totalLen()-2] == '\r'
+        && data()[totalLen()-1] == '\n';
   }
 
-  void output(muduo::net::Buffer* out, bool needCas = false) const;
+  // "VALUE key flags bytes [cas]\r\n" and the value
+  void output(muduo::net::OutputQueue* out, bool needCas = false) const;
 
-  void resetKey(muduo::StringPiece k);
+  // The first len bytes of the value. Large values are not copied, out
+  // refers to this Item until they are written.
+  void outputValue(muduo::net::OutputQueue* out, size_t len) const;
+
+  void ref() const
+  {
+    refCount_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Unless the last reference is gone. For readers of the hash table
+  // without its lock, the chunk may have been freed or even reused, which
+  // they find out afterwards.
+  bool tryRef() const
+  {
+    int count = refCount_.load(std::memory_order_relaxed);
+    while (count > 0
+           && !refCount_.compare_exchange_weak(count, count + 1,
+                                               std::memory_order_acquire,
+                                               std::memory_order_relaxed))
+    {
+    }
+    return count > 0;
+  }
+
+  void unref() const;
+
+  int refCount() const
+  {
+    return refCount_.load(std::memory_order_acquire);
+  }
+
+  // read since the last move in its LRU
+  void touch() const
+  {
+    if (!active_.load(std::memory_order_relaxed))
+    {
+      active_.store(true, std::memory_order_relaxed);
+    }
+  }
 
  private:
+  friend class SlabAllocator;
+  friend class MemcacheServer;
+
   int totalLen() const { return keylen_ + valuelen_; }
+  char* data() { return reinterpret_cast<char*>(this + 1); }
+  const char* data() const { return reinterpret_cast<const char*>(this + 1); }
 
-  int            keylen_;
+  std::atomic<Item*> hashNext_;   // by MemcacheServer
+  Item*          prev_;           // by SlabAllocator
+  Item*          next_;           // by SlabAllocator
+  uint64_t       cas_;
+  const uint32_t hash_;
   const uint32_t flags_;
   const int      rel_exptime_;
   const int      valuelen_;
   int            receivedBytes_;  // FIXME: remove this member
-  uint64_t       cas_;
-  size_t         hash_;
-  char*          data_;
+  mutable std::atomic<int> refCount_;
+  const uint8_t  keylen_;
+  const uint8_t  slabClass_;
+  uint8_t        lru_;            // LruSegment
+  mutable std::atomic<bool> active_;
 };
 
 #endif  // MUDUO_EXAMPLES_MEMCACHED_SERVER_ITEM_H
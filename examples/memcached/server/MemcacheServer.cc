@@ -4,6 +4,8 @@
 #include "muduo/base/Logging.h"
 #include "muduo/net/EventLoop.h"
 
+#include <algorithm>
+
 using namespace muduo;
 using namespace muduo::net;
 
@@ -18,21 +20,84 @@ struct MemcacheServer::Stats
 {
 };
 
+const size_t kInitialBuckets = 8;
+// lookups without the lock before taking it
+const int kOptimisticTries = 4;
+
+MemcacheServer::Table::Table(size_t size)
+  : mask(size - 1),
+    buckets(new Link[size])
+{
+  assert((size & mask) == 0);
+  for (size_t i = 0; i < size; ++i)
+  {
+    buckets[i].store(NULL, std::memory_order_relaxed);
+  }
+}
+
+MemcacheServer::Shard::Shard()
+  : version(0),
+    table(NULL),
+    count(0)
+{
+  tables.emplace_back(new Table(kInitialBuckets));
+  table.store(tables.back().get(), std::memory_order_relaxed);
+}
+
+void MemcacheServer::Shard::beginWrite()
+{
+  mutex.assertLocked();
+  version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+void MemcacheServer::Shard::endWrite()
+{
+  mutex.assertLocked();
+  version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
 MemcacheServer::MemcacheServer(muduo::net::EventLoop* loop, const Options& options)
   : loop_(loop),
     options_(options),
     startTime_(::time(NULL)-1),
+    allocator_(static_cast<size_t>(options.memoryLimit)),
+    crawlerCond_(crawlerMutex_),
+    crawling_(false),
     server_(loop, InetAddress(options.tcpport), "muduo-memcached"),
     stats_(new Stats)
 {
   server_.setConnectionCallback(
       std::bind(&MemcacheServer::onConnection, this, _1));
+  allocator_.setEvictCallback(
+      std::bind(&MemcacheServer::evict, this, _1));
 }
 
-MemcacheServer::~MemcacheServer() = default;
+MemcacheServer::~MemcacheServer()
+{
+  if (crawler_)
+  {
+    {
+      MutexLockGuard lock(crawlerMutex_);
+      crawling_ = false;
+      crawlerCond_.notify();
+    }
+    crawler_->join();
+  }
+}
 
 void MemcacheServer::start()
 {
+  if (options_.crawlInterval > 0)
+  {
+    {
+      MutexLockGuard lock(crawlerMutex_);
+      crawling_ = true;
+    }
+    crawler_.reset(new Thread(std::bind(&MemcacheServer::crawlerThread, this),
+                              "crawler"));
+    crawler_->start();
+  }
   server_.start();
 }
 
@@ -41,22 +106,39 @@ void MemcacheServer::stop()
   loop_->runAfter(3.0, std::bind(&EventLoop::quit, loop_));
 }
 
+// 0 never expires, up to 30 days is relative, otherwise absolute
+int MemcacheServer::relativeTime(time_t exptime) const
+{
+  if (exptime > 60*60*24*30)
+  {
+    return std::max(static_cast<int>(exptime - startTime_), 1);
+  }
+  else if (exptime > 0)
+  {
+    return static_cast<int>(exptime) + currentTime();
+  }
+  return 0;
+}
+
 bool MemcacheServer::storeItem(const ItemPtr& item, const Item::UpdatePolicy policy, bool* exists)
 {
   assert(item->neededBytes() == 0);
-  MutexLock& mutex = shards_[item->hash() % kShards].mutex;
-  ItemMap& items = shards_[item->hash() % kShards].items;
-  MutexLockGuard lock(mutex);
-  ItemMap::const_iterator it = items.find(item);
-  *exists = it != items.end();
+  Shard& shard = shardFor(item->hash());
+  MutexLockGuard lock(shard.mutex);
+  Link* it = findLocked(shard, item->key(), item->hash());
+  const Item* oldItem = it->load(std::memory_order_relaxed);
+  *exists = oldItem != NULL;
   if (policy == Item::kSet)
   {
     item->setCas(g_cas.incrementAndGet());
     if (*exists)
     {
-      items.erase(it);
+      replaceLocked(shard, it, item.get());
+    }
+    else
+    {
+      linkLocked(shard, item.get());
     }
-    items.insert(item);
   }
   else
   {
@@ -69,7 +151,7 @@ bool MemcacheServer::storeItem(const ItemPtr& item, const Item::UpdatePolicy pol
       else
       {
         item->setCas(g_cas.incrementAndGet());
-        items.insert(item);
+        linkLocked(shard, item.get());
       }
     }
     else if (policy == Item::kReplace)
@@ -77,8 +159,7 @@ bool MemcacheServer::storeItem(const ItemPtr& item, const Item::UpdatePolicy pol
       if (*exists)
       {
         item->setCas(g_cas.incrementAndGet());
-        items.erase(it);
-        items.insert(item);
+        replaceLocked(shard, it, item.get());
       }
       else
       {
@@ -89,13 +170,16 @@ bool MemcacheServer::storeItem(const ItemPtr& item, const Item::UpdatePolicy pol
     {
       if (*exists)
       {
-        const ConstItemPtr& oldItem = *it;
         int newLen = static_cast<int>(item->valueLength() + oldItem->valueLength() - 2);
-        ItemPtr newItem(Item::makeItem(item->key(),
-                                       oldItem->flags(),
-                                       oldItem->rel_exptime(),
-                                       newLen,
-                                       g_cas.incrementAndGet()));
+        ItemPtr newItem(allocator_.newItem(item->key(),
+                                           oldItem->flags(),
+                                           oldItem->rel_exptime(),
+                                           newLen,
+                                           g_cas.incrementAndGet()));
+        if (!newItem)
+        {
+          return false;
+        }
         if (policy == Item::kAppend)
         {
           newItem->append(oldItem->value(), oldItem->valueLength() - 2);
@@ -108,8 +192,7 @@ bool MemcacheServer::storeItem(const ItemPtr& item, const Item::UpdatePolicy pol
         }
         assert(newItem->neededBytes() == 0);
         assert(newItem->endsWithCRLF());
-        items.erase(it);
-        items.insert(newItem);
+        replaceLocked(shard, it, newItem.get());
       }
       else
       {
@@ -118,11 +201,10 @@ bool MemcacheServer::storeItem(const ItemPtr& item, const Item::UpdatePolicy pol
     }
     else if (policy == Item::kCas)
     {
-      if (*exists && (*it)->cas() == item->cas())
+      if (*exists && oldItem->cas() == item->cas())
       {
         item->setCas(g_cas.incrementAndGet());
-        items.erase(it);
-        items.insert(item);
+        replaceLocked(shard, it, item.get());
       }
       else
       {
@@ -137,21 +219,281 @@ bool MemcacheServer::storeItem(const ItemPtr& item, const Item::UpdatePolicy pol
   return true;
 }
 
-ConstItemPtr MemcacheServer::getItem(const ConstItemPtr& key) const
+ConstItemPtr MemcacheServer::getItem(StringPiece key)
+{
+  const uint32_t hash = Item::hashKey(key);
+  Shard& shard = shardFor(hash);
+  Item* item = NULL;
+  if (tryFind(shard, key, hash, &item))
+  {
+    if (!item || !item->expired(currentTime()))
+    {
+      if (item)
+      {
+        item->touch();
+      }
+      return ConstItemPtr(item);
+    }
+    // to be taken off with the lock
+    item->unref();
+  }
+
+  MutexLockGuard lock(shard.mutex);
+  item = findLocked(shard, key, hash)->load(std::memory_order_relaxed);
+  if (item)
+  {
+    item->touch();
+    item->ref();
+  }
+  return ConstItemPtr(item);
+}
+
+bool MemcacheServer::deleteItem(StringPiece key)
+{
+  const uint32_t hash = Item::hashKey(key);
+  Shard& shard = shardFor(hash);
+  MutexLockGuard lock(shard.mutex);
+  Link* it = findLocked(shard, key, hash);
+  if (it->load(std::memory_order_relaxed))
+  {
+    unlinkLocked(shard, it);
+    return true;
+  }
+  return false;
+}
+
+size_t MemcacheServer::crawlExpired()
+{
+  const int now = currentTime();
+  size_t expired = 0;
+  for (Shard& shard : shards_)
+  {
+    MutexLockGuard lock(shard.mutex);
+    const Table& table = *shard.table.load(std::memory_order_relaxed);
+    for (size_t i = 0; i <= table.mask; ++i)
+    {
+      Link* it = &table.buckets[i];
+      while (Item* item = it->load(std::memory_order_relaxed))
+      {
+        if (item->expired(now))
+        {
+          unlinkLocked(shard, it);
+          ++expired;
+        }
+        else
+        {
+          it = &item->hashNext_;
+        }
+      }
+    }
+  }
+  expiredItems_.add(static_cast<int64_t>(expired));
+  return expired;
+}
+
+size_t MemcacheServer::itemCount() const
 {
-  MutexLock& mutex = shards_[key->hash() % kShards].mutex;
-  const ItemMap& items = shards_[key->hash() % kShards].items;
-  MutexLockGuard lock(mutex);
-  ItemMap::const_iterator it = items.find(key);
-  return it != items.end() ? *it : ConstItemPtr();
+  size_t count = 0;
+  for (const Shard& shard : shards_)
+  {
+    MutexLockGuard lock(shard.mutex);
+    count += shard.count;
+  }
+  return count;
+}
+
+MemcacheServer::Link& MemcacheServer::bucketFor(const Table& table, uint32_t hash)
+{
+  // the low bits chose the shard
+  return table.buckets[(hash / kShards) & table.mask];
 }
 
-bool MemcacheServer::deleteItem(const ConstItemPtr& key)
+// Without the lock, returns false if shard kept changing. The Item found
+// is referred to.
+bool MemcacheServer::tryFind(Shard& shard, StringPiece key, uint32_t hash, Item** result)
 {
-  MutexLock& mutex = shards_[key->hash() % kShards].mutex;
-  ItemMap& items = shards_[key->hash() % kShards].items;
-  MutexLockGuard lock(mutex);
-  return items.erase(key) == 1;
+  for (int tries = 0; tries < kOptimisticTries; ++tries)
+  {
+    const uint32_t version = shard.version.load(std::memory_order_acquire);
+    if (version % 2 != 0)
+    {
+      continue;
+    }
+    const Table& table = *shard.table.load(std::memory_order_acquire);
+    Item* item = bucketFor(table, hash).load(std::memory_order_acquire);
+    bool stale = false;
+    for (int steps = 1; item && (item->hash() != hash || item->key() != key); ++steps)
+    {
+      item = item->hashNext_.load(std::memory_order_acquire);
+      // links being changed may lead anywhere, even in circles
+      if (steps % 16 == 0 && shard.version.load(std::memory_order_relaxed) != version)
+      {
+        stale = true;
+        break;
+      }
+    }
+    if (stale || (item && !item->tryRef()))
+    {
+      continue;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (shard.version.load(std::memory_order_relaxed) == version)
+    {
+      *result = item;
+      return true;
+    }
+    if (item)
+    {
+      item->unref();
+    }
+  }
+  return false;
+}
+
+// the link to the item of key, or to NULL at the end of its bucket,
+// takes it off if expired
+MemcacheServer::Link* MemcacheServer::findLocked(Shard& shard, StringPiece key, uint32_t hash)
+{
+  shard.mutex.assertLocked();
+  Link* it = &bucketFor(*shard.table.load(std::memory_order_relaxed), hash);
+  Item* item = it->load(std::memory_order_relaxed);
+  while (item && (item->hash() != hash || item->key() != key))
+  {
+    it = &item->hashNext_;
+    item = it->load(std::memory_order_relaxed);
+  }
+  if (item && item->expired(currentTime()))
+  {
+    unlinkLocked(shard, it);
+    expiredItems_.increment();
+    // the rest of the bucket doesn't have key
+    while ((item = it->load(std::memory_order_relaxed)) != NULL)
+    {
+      assert(item->key() != key);
+      it = &item->hashNext_;
+    }
+  }
+  return it;
+}
+
+void MemcacheServer::linkLocked(Shard& shard, Item* item)
+{
+  item->ref();
+  shard.beginWrite();
+  insertLocked(shard, item);
+  shard.endWrite();
+  allocator_.link(item);
+}
+
+void MemcacheServer::unlinkLocked(Shard& shard, Link* slot)
+{
+  shard.beginWrite();
+  Item* item = removeLocked(shard, slot);
+  shard.endWrite();
+  allocator_.unlink(item);
+  item->unref();
+}
+
+// in one go, so that readers find either item
+void MemcacheServer::replaceLocked(Shard& shard, Link* slot, Item* item)
+{
+  item->ref();
+  shard.beginWrite();
+  Item* oldItem = removeLocked(shard, slot);
+  insertLocked(shard, item);
+  shard.endWrite();
+  allocator_.unlink(oldItem);
+  oldItem->unref();
+  allocator_.link(item);
+}
+
+void MemcacheServer::insertLocked(Shard& shard, Item* item)
+{
+  shard.mutex.assertLocked();
+  Table* table = shard.table.load(std::memory_order_relaxed);
+  if (shard.count > table->mask)
+  {
+    // rehashed in place, the old table is kept for readers still on it
+    shard.tables.emplace_back(new Table((table->mask + 1) * 2));
+    Table* grown = shard.tables.back().get();
+    for (size_t i = 0; i <= table->mask; ++i)
+    {
+      Item* head = table->buckets[i].load(std::memory_order_relaxed);
+      while (head)
+      {
+        Item* next = head->hashNext_.load(std::memory_order_relaxed);
+        Link& bucket = bucketFor(*grown, head->hash());
+        head->hashNext_.store(bucket.load(std::memory_order_relaxed), std::memory_order_release);
+        bucket.store(head, std::memory_order_release);
+        head = next;
+      }
+    }
+    shard.table.store(grown, std::memory_order_release);
+    table = grown;
+  }
+  Link& bucket = bucketFor(*table, item->hash());
+  item->hashNext_.store(bucket.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  bucket.store(item, std::memory_order_release);
+  ++shard.count;
+}
+
+// returns the reference of the hash table
+Item* MemcacheServer::removeLocked(Shard& shard, Link* slot)
+{
+  shard.mutex.assertLocked();
+  Item* item = slot->load(std::memory_order_relaxed);
+  slot->store(item->hashNext_.load(std::memory_order_relaxed), std::memory_order_release);
+  item->hashNext_.store(NULL, std::memory_order_relaxed);
+  --shard.count;
+  return item;
+}
+
+// by SlabAllocator with the class of item locked
+bool MemcacheServer::evict(Item* item)
+{
+  Shard& shard = shardFor(item->hash());
+  if (!shard.mutex.tryLock())
+  {
+    return false;
+  }
+  bool evicted = false;
+  // takes the reference of the hash table unless somebody else refers to
+  // item, tryRef() fails after that
+  int tableOnly = 1;
+  if (item->refCount_.compare_exchange_strong(tableOnly, 0, std::memory_order_acquire))
+  {
+    Link* it = &bucketFor(*shard.table.load(std::memory_order_relaxed), item->hash());
+    while (it->load(std::memory_order_relaxed) != item)
+    {
+      it = &it->load(std::memory_order_relaxed)->hashNext_;
+    }
+    shard.beginWrite();
+    removeLocked(shard, it);
+    shard.endWrite();
+    evicted = true;
+  }
+  shard.mutex.unlock();
+  return evicted;
+}
+
+void MemcacheServer::crawlerThread()
+{
+  while (true)
+  {
+    {
+      MutexLockGuard lock(crawlerMutex_);
+      if (crawling_)
+      {
+        crawlerCond_.waitForSeconds(options_.crawlInterval);
+      }
+      if (!crawling_)
+      {
+        break;
+      }
+    }
+    size_t expired = crawlExpired();
+    LOG_DEBUG << "crawler took off " << expired << " expired items";
+  }
 }
 
 void MemcacheServer::onConnection(const TcpConnectionPtr& conn)
@@ -3,14 +3,20 @@
 
 #include "examples/memcached/server/Item.h"
 #include "examples/memcached/server/Session.h"
+#include "examples/memcached/server/SlabAllocator.h"
 
+#include "muduo/base/Atomic.h"
+#include "muduo/base/Condition.h"
 #include "muduo/base/Mutex.h"
+#include "muduo/base/Thread.h"
 #include "muduo/net/TcpServer.h"
 #include "examples/wordcount/hash.h"
 
 #include <array>
+#include <atomic>
+#include <memory>
 #include <unordered_map>
-#include <unordered_set>
+#include <vector>
 
 class MemcacheServer : muduo::noncopyable
 {
@@ -22,6 +28,8 @@ class MemcacheServer : muduo::noncopyable
     uint16_t udpport;
     uint16_t gperfport;
     int threads;
+    int64_t memoryLimit;   // bytes of items, 0 for no limit
+    double crawlInterval;  // seconds between crawls for expired items, 0 for none
   };
 
   MemcacheServer(muduo::net::EventLoop* loop, const Options&);
@@ -32,51 +40,103 @@ class MemcacheServer : muduo::noncopyable
   void stop();
 
   time_t startTime() const { return startTime_; }
+  // seconds since startTime(), the clock of Item::rel_exptime()
+  int currentTime() const { return static_cast<int>(::time(NULL) - startTime_); }
+  // exptime of a request to Item::rel_exptime()
+  int relativeTime(time_t exptime) const;
+
+  // NULL if out of memory
+  ItemPtr newItem(muduo::StringPiece key,
+                  uint32_t flags,
+                  int rel_exptime,
+                  int valuelen,
+                  uint64_t cas)
+  {
+    return allocator_.newItem(key, flags, rel_exptime, valuelen, cas);
+  }
 
   bool storeItem(const ItemPtr& item, Item::UpdatePolicy policy, bool* exists);
-  ConstItemPtr getItem(const ConstItemPtr& key) const;
-  bool deleteItem(const ConstItemPtr& key);
+  ConstItemPtr getItem(muduo::StringPiece key);
+  bool deleteItem(muduo::StringPiece key);
+
+  // takes expired items off, returns how many
+  size_t crawlExpired();
+
+  const SlabAllocator& allocator() const { return allocator_; }
+  size_t itemCount() const;
+  int64_t expiredItems() const { return expiredItems_.get(); }
 
  private:
+  struct Shard;
+
   void onConnection(const muduo::net::TcpConnectionPtr& conn);
 
+  typedef std::atomic<Item*> Link;
+  struct Table;
+
+  Shard& shardFor(uint32_t hash) { return shards_[hash % kShards]; }
+  static Link& bucketFor(const Table& table, uint32_t hash);
+  bool tryFind(Shard& shard, muduo::StringPiece key, uint32_t hash, Item** result);
+  Link* findLocked(Shard& shard, muduo::StringPiece key, uint32_t hash);
+  void linkLocked(Shard& shard, Item* item);
+  void unlinkLocked(Shard& shard, Link* slot);
+  void replaceLocked(Shard& shard, Link* slot, Item* item);
+  static void insertLocked(Shard& shard, Item* item);
+  static Item* removeLocked(Shard& shard, Link* slot);
+  bool evict(Item* item);
+  void crawlerThread();
+
   struct Stats;
 
   muduo::net::EventLoop* loop_;  // not own
   Options options_;
   const time_t startTime_;
+  // destructs after everything holding an Item
+  SlabAllocator allocator_;
 
   mutable muduo::MutexLock mutex_;
   std::unordered_map<string, SessionPtr> sessions_ GUARDED_BY(mutex_);
 
-  // a complicated solution to save memory
-  struct Hash
+  // the buckets of a shard, tables replaced on growth are kept until the
+  // end, as lock-free readers may still walk them
+  struct Table
   {
-    size_t operator()(const ConstItemPtr& x) const
-    {
-      return x->hash();
-    }
+    explicit Table(size_t size);
+
+    const size_t mask;  // size is a power of 2
+    std::unique_ptr<Link[]> buckets;
   };
 
-  struct Equal
+  // The items of a shard in a hash table chained through Item, which
+  // holds one reference of each.
+  //
+  // Writers take mutex, and make version odd while changing the links, so
+  // getItem() looks up without the lock and retries if version changed
+  // meanwhile, like a seqlock. Items it runs into are in the chunks of
+  // SlabAllocator, which are never returned to the system.
+  struct Shard
   {
-    bool operator()(const ConstItemPtr& x, const ConstItemPtr& y) const
-    {
-      return x->key() == y->key();
-    }
-  };
+    Shard();
 
-  typedef std::unordered_set<ConstItemPtr, Hash, Equal> ItemMap;
+    void beginWrite();
+    void endWrite();
 
-  struct MapWithLock
-  {
-    ItemMap items;
     mutable muduo::MutexLock mutex;
+    std::atomic<uint32_t> version;
+    std::atomic<Table*> table;
+    std::vector<std::unique_ptr<Table>> tables GUARDED_BY(mutex);
+    size_t count GUARDED_BY(mutex);
   };
 
   const static int kShards = 4096;
 
-  std::array<MapWithLock, kShards> shards_;
+  std::array<Shard, kShards> shards_;
+  mutable muduo::AtomicInt64 expiredItems_;
+
+  muduo::MutexLock crawlerMutex_;
+  muduo::Condition crawlerCond_ GUARDED_BY(crawlerMutex_);
+  bool crawling_ GUARDED_BY(crawlerMutex_);
+  std::unique_ptr<muduo::Thread> crawler_;
 
   // NOT guarded by mutex_, but here because server_ has to destructs before
   // sessions_
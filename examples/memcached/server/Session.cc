@@ -1,6 +1,8 @@
 #include "examples/memcached/server/Session.h"
 #include "examples/memcached/server/MemcacheServer.h"
 
+#include "muduo/net/Endian.h"
+
 #ifdef HAVE_TCMALLOC
 #include <gperftools/malloc_extension.h>
 #endif
@@ -14,7 +16,134 @@ static bool isBinaryProtocol(uint8_t firstByte)
 }
 
 const int kLongestKeySize = 250;
-string Session::kLongestKey(kLongestKeySize, 'x');
+const int kLargestValueSize = 1024 * 1024;
+
+namespace
+{
+
+// memcached binary protocol, integers are in network byte order
+const uint8_t kRequestMagic = 0x80;
+const uint8_t kResponseMagic = 0x81;
+const size_t kHeaderLength = 24;
+// requests other than updates are buffered as a whole
+const uint32_t kLongestBody = 1024;
+
+enum Command
+{
+  kCmdGet = 0x00,
+  kCmdSet = 0x01,
+  kCmdAdd = 0x02,
+  kCmdReplace = 0x03,
+  kCmdDelete = 0x04,
+  kCmdQuit = 0x07,
+  kCmdGetQ = 0x09,
+  kCmdNoop = 0x0a,
+  kCmdVersion = 0x0b,
+  kCmdGetK = 0x0c,
+  kCmdGetKQ = 0x0d,
+  kCmdAppend = 0x0e,
+  kCmdPrepend = 0x0f,
+  kCmdSetQ = 0x11,
+  kCmdAddQ = 0x12,
+  kCmdReplaceQ = 0x13,
+  kCmdDeleteQ = 0x14,
+  kCmdQuitQ = 0x17,
+  kCmdAppendQ = 0x19,
+  kCmdPrependQ = 0x1a,
+};
+
+enum Status
+{
+  kStatusSuccess = 0x00,
+  kStatusKeyNotFound = 0x01,
+  kStatusKeyExists = 0x02,
+  kStatusValueTooLarge = 0x03,
+  kStatusInvalidArguments = 0x04,
+  kStatusNotStored = 0x05,
+  kStatusUnknownCommand = 0x81,
+  kStatusOutOfMemory = 0x82,
+};
+
+// the quiet variant of a command replies only on failure,
+// of a get only on hit
+uint8_t loudCommand(uint8_t opcode)
+{
+  switch (opcode)
+  {
+    case kCmdGetQ: return kCmdGet;
+    case kCmdGetKQ: return kCmdGetK;
+    case kCmdSetQ: return kCmdSet;
+    case kCmdAddQ: return kCmdAdd;
+    case kCmdReplaceQ: return kCmdReplace;
+    case kCmdDeleteQ: return kCmdDelete;
+    case kCmdQuitQ: return kCmdQuit;
+    case kCmdAppendQ: return kCmdAppend;
+    case kCmdPrependQ: return kCmdPrepend;
+    default: return opcode;
+  }
+}
+
+bool isUpdate(uint8_t command)
+{
+  return command == kCmdSet || command == kCmdAdd || command == kCmdReplace
+      || command == kCmdAppend || command == kCmdPrepend;
+}
+
+const char* statusMessage(uint16_t status)
+{
+  switch (status)
+  {
+    case kStatusKeyNotFound: return "Not found";
+    case kStatusKeyExists: return "Data exists for key";
+    case kStatusValueTooLarge: return "Too large";
+    case kStatusInvalidArguments: return "Invalid arguments";
+    case kStatusNotStored: return "Not stored";
+    case kStatusUnknownCommand: return "Unknown command";
+    case kStatusOutOfMemory: return "Out of memory";
+    default: return "";
+  }
+}
+
+uint16_t readUint16(const char* p)
+{
+  uint16_t be16 = 0;
+  memcpy(&be16, p, sizeof be16);
+  return sockets::networkToHost16(be16);
+}
+
+uint32_t readUint32(const char* p)
+{
+  uint32_t be32 = 0;
+  memcpy(&be32, p, sizeof be32);
+  return sockets::networkToHost32(be32);
+}
+
+uint64_t readUint64(const char* p)
+{
+  uint64_t be64 = 0;
+  memcpy(&be64, p, sizeof be64);
+  return sockets::networkToHost64(be64);
+}
+
+void writeUint16(char* p, uint16_t x)
+{
+  uint16_t be16 = sockets::hostToNetwork16(x);
+  memcpy(p, &be16, sizeof be16);
+}
+
+void writeUint32(char* p, uint32_t x)
+{
+  uint32_t be32 = sockets::hostToNetwork32(x);
+  memcpy(p, &be32, sizeof be32);
+}
+
+void writeUint64(char* p, uint64_t x)
+{
+  uint64_t be64 = sockets::hostToNetwork64(x);
+  memcpy(p, &be64, sizeof be64);
+}
+
+}  // namespace
 
 template <typename InputIterator, typename Token>
 bool Session::SpaceSeparator::operator()(InputIterator& next, InputIterator end, Token& tok)
@@ -90,7 +219,10 @@ void Session::onMessage(const muduo::net::TcpConnectionPtr& conn,
       assert(protocol_ == kAscii || protocol_ == kBinary);
       if (protocol_ == kBinary)
       {
-        // FIXME
+        if (!processBinaryRequest(buf))
+        {
+          break;
+        }
       }
       else  // ASCII protocol
       {
@@ -110,6 +242,7 @@ void Session::onMessage(const muduo::net::TcpConnectionPtr& conn,
           if (buf->readableBytes() > 1024)
           {
             // FIXME: check for 'get' and 'gets'
+            flush();
             conn_->shutdown();
             // buf->retrieveAll() ???
           }
@@ -131,52 +264,86 @@ void Session::onMessage(const muduo::net::TcpConnectionPtr& conn,
     }
   }
   bytesRead_ += initialReadable - buf->readableBytes();
+  flush();
 }
 
 void Session::receiveValue(muduo::net::Buffer* buf)
 {
   assert(currItem_.get());
   assert(state_ == kReceiveValue);
-  // if (protocol_ == kBinary)
+  // binary values come without "\r\n", which is added to keep Items the same
+  const size_t crlf = protocol_ == kBinary ? 2 : 0;
 
-  const size_t avail = std::min(buf->readableBytes(), currItem_->neededBytes());
-  assert(currItem_.unique());
+  const size_t avail = std::min(buf->readableBytes(), currItem_->neededBytes() - crlf);
+  // may not be unique(), a reader of the hash table briefly refers to
+  // chunks it found without the lock
   currItem_->append(buf->peek(), avail);
   buf->retrieve(avail);
-  if (currItem_->neededBytes() == 0)
+  if (currItem_->neededBytes() == crlf)
   {
-    if (currItem_->endsWithCRLF())
+    if (crlf)
     {
-      bool exists = false;
-      if (owner_->storeItem(currItem_, policy_, &exists))
-      {
-        reply("STORED\r\n");
-      }
-      else
+      currItem_->append("\r\n", 2);
+    }
+    finishUpdate();
+    resetRequest();
+    state_ = kNewCommand;
+  }
+}
+
+void Session::finishUpdate()
+{
+  assert(currItem_->neededBytes() == 0);
+  if (!currItem_->endsWithCRLF())
+  {
+    reply("CLIENT_ERROR bad data chunk\r\n");
+    return;
+  }
+
+  bool exists = false;
+  if (owner_->storeItem(currItem_, policy_, &exists))
+  {
+    if (protocol_ == kBinary)
+    {
+      if (!noreply_)
       {
-        if (policy_ == Item::kCas)
-        {
-          if (exists)
-          {
-            reply("EXISTS\r\n");
-          }
-          else
-          {
-            reply("NOT_FOUND\r\n");
-          }
-        }
-        else
-        {
-          reply("NOT_STORED\r\n");
-        }
+        replyBinary(kStatusSuccess, StringPiece(), currItem_->cas());
       }
     }
     else
     {
-      reply("CLIENT_ERROR bad data chunk\r\n");
+      reply("STORED\r\n");
+    }
+  }
+  else if (protocol_ == kBinary)
+  {
+    if (policy_ == Item::kAdd || (policy_ == Item::kCas && exists))
+    {
+      replyBinary(kStatusKeyExists);
+    }
+    else if (policy_ == Item::kReplace || policy_ == Item::kCas)
+    {
+      replyBinary(kStatusKeyNotFound);
+    }
+    else
+    {
+      replyBinary(kStatusNotStored);
+    }
+  }
+  else if (policy_ == Item::kCas)
+  {
+    if (exists)
+    {
+      reply("EXISTS\r\n");
+    }
+    else
+    {
+      reply("NOT_FOUND\r\n");
     }
-    resetRequest();
-    state_ = kNewCommand;
+  }
+  else
+  {
+    reply("NOT_STORED\r\n");
   }
 }
 
@@ -238,7 +405,7 @@ bool Session::processRequest(StringPiece request)
   {
     bool cas = command_ == "gets";
 
-    // FIXME: send multiple chunks with write complete callback.
+    // hits are gathered and sent with the other replies by flush()
     while (beg != tok.end())
     {
       StringPiece key = *beg;
@@ -249,23 +416,14 @@ bool Session::processRequest(StringPiece request)
         return true;
       }
 
-      needle_->resetKey(key);
-      ConstItemPtr item = owner_->getItem(needle_);
+      ConstItemPtr item = owner_->getItem(key);
       ++beg;
       if (item)
       {
-        item->output(&outputBuf_, cas);
+        item->output(&gather_, cas);
       }
     }
-    outputBuf_.append("END\r\n");
-
-    if (conn_->outputBuffer()->writableBytes() > 65536 + outputBuf_.readableBytes())
-    {
-      LOG_DEBUG << "shrink output buffer from " << conn_->outputBuffer()->internalCapacity();
-      conn_->outputBuffer()->shrink(65536 + outputBuf_.readableBytes());
-    }
-
-    conn_->send(&outputBuf_);
+    gather_.append("END\r\n", 5);
   }
   else if (command_ == "delete")
   {
@@ -289,11 +447,13 @@ bool Session::processRequest(StringPiece request)
 #endif
   else if (command_ == "quit")
   {
+    flush();
     conn_->shutdown();
   }
   else if (command_ == "shutdown")
   {
     // "ERROR: shutdown not enabled"
+    flush();
     conn_->shutdown();
     owner_->stop();
   }
@@ -318,8 +478,53 @@ void Session::reply(muduo::StringPiece msg)
 {
   if (!noreply_)
   {
-    conn_->send(msg.data(), msg.size());
+    gather_.append(msg);
+  }
+}
+
+void Session::replyBinary(uint16_t status, StringPiece value, uint64_t cas)
+{
+  if (status != kStatusSuccess && value.empty())
+  {
+    value = statusMessage(status);
   }
+  appendBinaryHeader(status, 0, 0, static_cast<uint32_t>(value.size()), cas);
+  gather_.append(value);
+}
+
+void Session::appendBinaryHeader(uint16_t status,
+                                 uint8_t extlen,
+                                 uint16_t keylen,
+                                 uint32_t bodylen,
+                                 uint64_t cas)
+{
+  char header[kHeaderLength];
+  header[0] = static_cast<char>(kResponseMagic);
+  header[1] = static_cast<char>(opcode_);
+  writeUint16(header + 2, keylen);
+  header[4] = static_cast<char>(extlen);
+  header[5] = 0;  // data type
+  writeUint16(header + 6, status);
+  writeUint32(header + 8, bodylen);
+  memcpy(header + 12, &opaque_, sizeof opaque_);
+  writeUint64(header + 16, cas);
+  gather_.append(header, sizeof header);
+}
+
+void Session::flush()
+{
+  if (gather_.empty())
+  {
+    return;
+  }
+  if (conn_->outputQueue()->internalCapacity() > 65536 + conn_->outputQueue()->readableBytes())
+  {
+    LOG_DEBUG << "shrink output queue from " << conn_->outputQueue()->internalCapacity();
+    conn_->outputQueue()->shrink();
+  }
+  conn_->send(&gather_);
+  // left over if disconnected
+  gather_.retrieveAll();
 }
 
 bool Session::doUpdate(Session::Tokenizer::iterator& beg, Session::Tokenizer::iterator end)
@@ -352,19 +557,7 @@ bool Session::doUpdate(Session::Tokenizer::iterator& beg, Session::Tokenizer::it
   Reader r(beg, end);
   good = good && r.read(&flags) && r.read(&exptime) && r.read(&bytes);
 
-  int rel_exptime = static_cast<int>(exptime);
-  if (exptime > 60*60*24*30)
-  {
-    rel_exptime = static_cast<int>(exptime - owner_->startTime());
-    if (rel_exptime < 1)
-    {
-      rel_exptime = 1;
-    }
-  }
-  else
-  {
-    // rel_exptime = exptime + currentTime;
-  }
+  int rel_exptime = owner_->relativeTime(exptime);
 
   if (good && policy_ == Item::kCas)
   {
@@ -376,18 +569,26 @@ bool Session::doUpdate(Session::Tokenizer::iterator& beg, Session::Tokenizer::it
     reply("CLIENT_ERROR bad command line format\r\n");
     return true;
   }
-  if (bytes > 1024*1024)
+  if (bytes > kLargestValueSize)
   {
     reply("SERVER_ERROR object too large for cache\r\n");
-    needle_->resetKey(key);
-    owner_->deleteItem(needle_);
+    owner_->deleteItem(key);
     bytesToDiscard_ = bytes + 2;
     state_ = kDiscardValue;
     return false;
   }
   else
   {
-    currItem_ = Item::makeItem(key, flags, rel_exptime, bytes + 2, cas);
+    currItem_ = owner_->newItem(key, flags, rel_exptime, bytes + 2, cas);
+    if (!currItem_)
+    {
+      // no stale value either, as memcached
+      reply("SERVER_ERROR out of memory storing object\r\n");
+      owner_->deleteItem(key);
+      bytesToDiscard_ = bytes + 2;
+      state_ = kDiscardValue;
+      return false;
+    }
     state_ = kReceiveValue;
     return false;
   }
@@ -410,8 +611,7 @@ void Session::doDelete(Session::Tokenizer::iterator& beg, Session::Tokenizer::it
   }
   else
   {
-    needle_->resetKey(key);
-    if (owner_->deleteItem(needle_))
+    if (owner_->deleteItem(key))
     {
       reply("DELETED\r\n");
     }
@@ -421,3 +621,201 @@ void Session::doDelete(Session::Tokenizer::iterator& beg, Session::Tokenizer::it
     }
   }
 }
+
+bool Session::processBinaryRequest(muduo::net::Buffer* buf)
+{
+  assert(!noreply_);
+  assert(policy_ == Item::kInvalid);
+  assert(!currItem_);
+  if (buf->readableBytes() < kHeaderLength)
+  {
+    return false;
+  }
+
+  const char* header = buf->peek();
+  const uint8_t magic = static_cast<uint8_t>(header[0]);
+  const uint8_t opcode = static_cast<uint8_t>(header[1]);
+  const uint16_t keylen = readUint16(header + 2);
+  const uint8_t extlen = static_cast<uint8_t>(header[4]);
+  const uint32_t bodylen = readUint32(header + 8);
+  const uint64_t cas = readUint64(header + 16);
+  const uint8_t command = loudCommand(opcode);
+  const bool update = isUpdate(command);
+  if (magic != kRequestMagic
+      || extlen + keylen > bodylen
+      || (!update && bodylen > kLongestBody))
+  {
+    LOG_INFO << "Bad binary request from " << conn_->peerAddress().toIpPort();
+    flush();
+    conn_->shutdown();
+    buf->retrieveAll();
+    return false;
+  }
+
+  // the value of an update is received as it comes
+  const size_t length = kHeaderLength + (update ? extlen + keylen : bodylen);
+  if (buf->readableBytes() < length)
+  {
+    return false;
+  }
+
+  ++requestsProcessed_;
+  opcode_ = opcode;
+  // echoed back as is
+  memcpy(&opaque_, header + 12, sizeof opaque_);
+  noreply_ = command != opcode;
+  StringPiece extras(header + kHeaderLength, extlen);
+  StringPiece key(extras.end(), keylen);
+
+  bool finished = true;
+  switch (command)
+  {
+    case kCmdGet:
+    case kCmdGetK:
+      doBinaryGet(key);
+      break;
+    case kCmdSet:
+    case kCmdAdd:
+    case kCmdReplace:
+    case kCmdAppend:
+    case kCmdPrepend:
+      finished = doBinaryUpdate(extras, key, bodylen - extlen - keylen, cas);
+      break;
+    case kCmdDelete:
+      if (key.empty() || key.size() > kLongestKeySize || !extras.empty())
+      {
+        replyBinary(kStatusInvalidArguments);
+      }
+      else if (owner_->deleteItem(key))
+      {
+        if (!noreply_)
+        {
+          replyBinary(kStatusSuccess);
+        }
+      }
+      else
+      {
+        replyBinary(kStatusKeyNotFound);
+      }
+      break;
+    case kCmdNoop:
+      replyBinary(kStatusSuccess);
+      break;
+    case kCmdVersion:
+      replyBinary(kStatusSuccess, "0.01 muduo");
+      break;
+    case kCmdQuit:
+      if (!noreply_)
+      {
+        replyBinary(kStatusSuccess);
+      }
+      flush();
+      conn_->shutdown();
+      break;
+    default:
+      replyBinary(kStatusUnknownCommand);
+      LOG_INFO << "Unknown binary command: " << opcode;
+  }
+
+  buf->retrieve(length);
+  if (finished)
+  {
+    resetRequest();
+  }
+  return true;
+}
+
+bool Session::doBinaryUpdate(StringPiece extras, StringPiece key,
+                             uint32_t valuelen, uint64_t cas)
+{
+  const uint8_t command = loudCommand(opcode_);
+  if (command == kCmdSet)
+    policy_ = cas != 0 ? Item::kCas : Item::kSet;
+  else if (command == kCmdAdd)
+    policy_ = Item::kAdd;
+  else if (command == kCmdReplace)
+    policy_ = cas != 0 ? Item::kCas : Item::kReplace;
+  else if (command == kCmdAppend)
+    policy_ = Item::kAppend;
+  else if (command == kCmdPrepend)
+    policy_ = Item::kPrepend;
+  else
+    assert(false);
+
+  // flags and exptime, none for append and prepend
+  const int extlen = policy_ == Item::kAppend || policy_ == Item::kPrepend ? 0 : 8;
+  uint16_t status = kStatusSuccess;
+  if (key.empty() || key.size() > kLongestKeySize || extras.size() != extlen)
+  {
+    status = kStatusInvalidArguments;
+  }
+  else if (valuelen > static_cast<uint32_t>(kLargestValueSize))
+  {
+    status = kStatusValueTooLarge;
+  }
+  else
+  {
+    uint32_t flags = extlen ? readUint32(extras.data()) : 0;
+    time_t exptime = extlen ? readUint32(extras.data() + 4) : 0;
+    currItem_ = owner_->newItem(key, flags, owner_->relativeTime(exptime),
+                                static_cast<int>(valuelen) + 2, cas);
+    if (!currItem_)
+    {
+      status = kStatusOutOfMemory;
+    }
+  }
+
+  if (status != kStatusSuccess)
+  {
+    replyBinary(status);
+    if (status != kStatusInvalidArguments)
+    {
+      // no stale value either, as memcached
+      owner_->deleteItem(key);
+    }
+    bytesToDiscard_ = valuelen;
+    if (valuelen > 0)
+    {
+      state_ = kDiscardValue;
+      return false;
+    }
+    return true;
+  }
+
+  if (valuelen == 0)
+  {
+    currItem_->append("\r\n", 2);
+    finishUpdate();
+    return true;
+  }
+  state_ = kReceiveValue;
+  return false;
+}
+
+void Session::doBinaryGet(StringPiece key)
+{
+  if (key.empty() || key.size() > kLongestKeySize)
+  {
+    replyBinary(kStatusInvalidArguments);
+    return;
+  }
+
+  ConstItemPtr item = owner_->getItem(key);
+  if (item)
+  {
+    // flags, the key of getk, and the value without "\r\n"
+    const uint16_t keylen = loudCommand(opcode_) == kCmdGetK ? static_cast<uint16_t>(key.size()) : 0;
+    const size_t valuelen = item->valueLength() - 2;
+    const uint32_t flags = sockets::hostToNetwork32(item->flags());
+    appendBinaryHeader(kStatusSuccess, sizeof flags, keylen,
+                       static_cast<uint32_t>(sizeof flags + keylen + valuelen),
+                       item->cas());
+    gather_.append(&flags, sizeof flags);
+    gather_.append(key.data(), keylen);
+    item->outputValue(&gather_, valuelen);
+  }
+  else if (!noreply_)
+  {
+    replyBinary(kStatusKeyNotFound);
+  }
+}
@@ -21,11 +21,12 @@ class Session : public std::enable_shared_from_this<Session>,
     : owner_(owner),
       conn_(conn),
       state_(kNewCommand),
-      protocol_(kAscii), // FIXME
+      protocol_(kAuto),
       noreply_(false),
+      opcode_(0),
+      opaque_(0),
       policy_(Item::kInvalid),
       bytesToDiscard_(0),
-      needle_(Item::makeItem(kLongestKey, 0, 0, 2, 0)),
       bytesRead_(0),
       requestsProcessed_(0)
   {
@@ -41,7 +42,7 @@ class Session : public std::enable_shared_from_this<Session>,
   {
     LOG_INFO << "requests processed: " << requestsProcessed_
              << " input buffer size: " << conn_->inputBuffer()->internalCapacity()
-             << " output buffer size: " << conn_->outputBuffer()->internalCapacity();
+             << " output queue size: " << conn_->outputQueue()->internalCapacity();
   }
 
  private:
@@ -70,8 +71,20 @@ class Session : public std::enable_shared_from_this<Session>,
 
   // returns true if finished a request
   bool processRequest(muduo::StringPiece request);
+  // returns false if buf doesn't hold enough of a request
+  bool processBinaryRequest(muduo::net::Buffer* buf);
   void resetRequest();
   void reply(muduo::StringPiece msg);
+  void replyBinary(uint16_t status,
+                   muduo::StringPiece value = muduo::StringPiece(),
+                   uint64_t cas = 0);
+  void appendBinaryHeader(uint16_t status,
+                          uint8_t extlen,
+                          uint16_t keylen,
+                          uint32_t bodylen,
+                          uint64_t cas);
+  // sends the replies to all requests of one onMessage() in one go
+  void flush();
 
   struct SpaceSeparator
   {
@@ -86,6 +99,10 @@ class Session : public std::enable_shared_from_this<Session>,
   struct Reader;
   bool doUpdate(Tokenizer::iterator& beg, Tokenizer::iterator end);
   void doDelete(Tokenizer::iterator& beg, Tokenizer::iterator end);
+  bool doBinaryUpdate(muduo::StringPiece extras, muduo::StringPiece key,
+                      uint32_t valuelen, uint64_t cas);
+  void doBinaryGet(muduo::StringPiece key);
+  void finishUpdate();
 
   MemcacheServer* owner_;
   muduo::net::TcpConnectionPtr conn_;
@@ -94,19 +111,18 @@ class Session : public std::enable_shared_from_this<Session>,
 
   // current request
   string command_;
-  bool noreply_;
+  bool noreply_;  // quiet command of binary protocol
+  uint8_t opcode_;   // binary protocol
+  uint32_t opaque_;  // binary protocol
   Item::UpdatePolicy policy_;
   ItemPtr currItem_;
   size_t bytesToDiscard_;
-  // cached
-  ItemPtr needle_;
-  muduo::net::Buffer outputBuf_;
+  // replies, values of large Items are referred to instead of copied
+  muduo::net::OutputQueue gather_;
 
   // per session stats
   size_t bytesRead_;
   size_t requestsProcessed_;
-
-  static string kLongestKey;
 };
 
 typedef std::shared_ptr<Session> SessionPtr;
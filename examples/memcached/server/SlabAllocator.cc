@@ -0,0 +1,344 @@
+#include "examples/memcached/server/SlabAllocator.h"
+
+#include "muduo/base/Logging.h"
+
+#include <algorithm>
+#include <new>
+
+#include <stdlib.h>
+
+using namespace muduo;
+
+namespace
+{
+
+const size_t kPageHeader = 64;
+const size_t kMinChunkSize = sizeof(Item) + 32;
+// the largest item Session takes
+const size_t kMaxItemSize = Item::totalBytes(250, 1024 * 1024 + 2);
+
+// percent of the items of a class
+const size_t kHotPercent = 20;
+const size_t kWarmPercent = 40;
+// per link() or eviction, bounds the time under the lock of a class
+const int kMaxMoves = 4;
+const int kEvictTries = 8;
+
+size_t roundUp(size_t n, size_t align)
+{
+  return (n + align - 1) / align * align;
+}
+
+}  // namespace
+
+// at the beginning of every page, so that free() finds it by address
+struct SlabAllocator::Page
+{
+  SlabAllocator* owner;
+  int slabClass;
+};
+
+struct SlabAllocator::FreeChunk
+{
+  FreeChunk* next;
+};
+
+struct SlabAllocator::SlabClass
+{
+  SlabClass()
+    : chunkSize(0),
+      pageSize(0),
+      freeList(NULL),
+      freeChunks(0),
+      evictions(0)
+  {
+    std::fill(heads, heads + 4, static_cast<Item*>(NULL));
+    std::fill(tails, tails + 4, static_cast<Item*>(NULL));
+    std::fill(sizes, sizes + 4, 0);
+  }
+
+  size_t chunkSize;
+  size_t pageSize;
+  mutable MutexLock mutex;
+  std::vector<void*> pages GUARDED_BY(mutex);
+  FreeChunk* freeList GUARDED_BY(mutex);
+  size_t freeChunks GUARDED_BY(mutex);
+  int64_t evictions GUARDED_BY(mutex);
+  // by Item::LruSegment
+  Item* heads[4] GUARDED_BY(mutex);
+  Item* tails[4] GUARDED_BY(mutex);
+  size_t sizes[4] GUARDED_BY(mutex);
+};
+
+SlabAllocator::SlabAllocator(size_t memoryLimit, double factor)
+  : memoryLimit_(memoryLimit),
+    allocated_(0)
+{
+  assert(factor > 1.0);
+  const size_t maxChunk = (kPageSize - kPageHeader) / 2;
+  size_t size = roundUp(kMinChunkSize, 8);
+  while (size <= maxChunk)
+  {
+    chunkSizes_.push_back(size);
+    size = roundUp(std::max(static_cast<size_t>(static_cast<double>(size) * factor), size + 8), 8);
+  }
+  // the rest in one class, one chunk per page
+  chunkSizes_.push_back(roundUp(kMaxItemSize, 8));
+
+  classes_.reset(new SlabClass[chunkSizes_.size()]);
+  for (size_t i = 0; i < chunkSizes_.size(); ++i)
+  {
+    classes_[i].chunkSize = chunkSizes_[i];
+    classes_[i].pageSize = i + 1 < chunkSizes_.size()
+        ? kPageSize : roundUp(kPageHeader + chunkSizes_[i], kPageSize);
+  }
+  LOG_INFO << "SlabAllocator " << chunkSizes_.size() << " classes from "
+           << chunkSizes_.front() << " to " << chunkSizes_.back()
+           << " bytes, memory limit " << memoryLimit_;
+}
+
+SlabAllocator::~SlabAllocator()
+{
+  for (int i = 0; i < numClasses(); ++i)
+  {
+    MutexLockGuard lock(classes_[i].mutex);
+    for (void* page : classes_[i].pages)
+    {
+      ::free(page);
+    }
+  }
+}
+
+ItemPtr SlabAllocator::newItem(StringPiece key,
+                               uint32_t flags,
+                               int exptime,
+                               int valuelen,
+                               uint64_t cas)
+{
+  int slabClass = classFor(Item::totalBytes(key.size(), valuelen));
+  void* chunk = slabClass >= 0 ? allocate(slabClass) : NULL;
+  if (!chunk)
+  {
+    return ItemPtr();
+  }
+  return ItemPtr(new (chunk) Item(key, flags, exptime, valuelen, cas, slabClass));
+}
+
+void SlabAllocator::link(Item* item)
+{
+  SlabClass& c = classes_[item->slabClass_];
+  MutexLockGuard lock(c.mutex);
+  assert(item->lru_ == Item::kUnlinked);
+  item->active_.store(false, std::memory_order_relaxed);
+  pushHead(c, item, Item::kHot);
+  balance(c);
+}
+
+void SlabAllocator::unlink(Item* item)
+{
+  SlabClass& c = classes_[item->slabClass_];
+  MutexLockGuard lock(c.mutex);
+  remove(c, item);
+}
+
+void SlabAllocator::free(Item* item)
+{
+  uintptr_t address = reinterpret_cast<uintptr_t>(item);
+  Page* page = reinterpret_cast<Page*>(address & ~(kPageSize - 1));
+  assert(page->slabClass == item->slabClass_);
+  page->owner->deallocate(item);
+}
+
+SlabAllocator::ClassStats SlabAllocator::classStats(int slabClass) const
+{
+  const SlabClass& c = classes_[slabClass];
+  MutexLockGuard lock(c.mutex);
+  ClassStats stats;
+  stats.chunkSize = c.chunkSize;
+  stats.pages = c.pages.size();
+  stats.freeChunks = c.freeChunks;
+  stats.hot = c.sizes[Item::kHot];
+  stats.warm = c.sizes[Item::kWarm];
+  stats.cold = c.sizes[Item::kCold];
+  stats.evictions = c.evictions;
+  return stats;
+}
+
+int64_t SlabAllocator::evictions() const
+{
+  int64_t total = 0;
+  for (int i = 0; i < numClasses(); ++i)
+  {
+    total += classStats(i).evictions;
+  }
+  return total;
+}
+
+int SlabAllocator::classFor(size_t bytes) const
+{
+  std::vector<size_t>::const_iterator it =
+      std::lower_bound(chunkSizes_.begin(), chunkSizes_.end(), bytes);
+  return it != chunkSizes_.end() ? static_cast<int>(it - chunkSizes_.begin()) : -1;
+}
+
+void* SlabAllocator::allocate(int slabClass)
+{
+  SlabClass& c = classes_[slabClass];
+  MutexLockGuard lock(c.mutex);
+  if (!c.freeList && !newPage(c) && !evict(c))
+  {
+    return NULL;
+  }
+  assert(c.freeList);
+  FreeChunk* chunk = c.freeList;
+  c.freeList = chunk->next;
+  --c.freeChunks;
+  return chunk;
+}
+
+bool SlabAllocator::newPage(SlabClass& c)
+{
+  c.mutex.assertLocked();
+  size_t allocated = allocated_.load(std::memory_order_relaxed);
+  do
+  {
+    if (memoryLimit_ > 0 && allocated + c.pageSize > memoryLimit_ && !c.pages.empty())
+    {
+      return false;
+    }
+  } while (!allocated_.compare_exchange_weak(allocated, allocated + c.pageSize));
+
+  void* memory = NULL;
+  if (::posix_memalign(&memory, kPageSize, c.pageSize) != 0)
+  {
+    allocated_.fetch_sub(c.pageSize);
+    LOG_ERROR << "SlabAllocator out of memory for a page of " << c.pageSize;
+    return false;
+  }
+  c.pages.push_back(memory);
+  Page* page = static_cast<Page*>(memory);
+  page->owner = this;
+  page->slabClass = static_cast<int>(&c - classes_.get());
+
+  // handed out in address order
+  char* begin = static_cast<char*>(memory) + kPageHeader;
+  for (size_t i = (c.pageSize - kPageHeader) / c.chunkSize; i > 0; --i)
+  {
+    FreeChunk* free = reinterpret_cast<FreeChunk*>(begin + (i - 1) * c.chunkSize);
+    free->next = c.freeList;
+    c.freeList = free;
+    ++c.freeChunks;
+  }
+  return true;
+}
+
+// from the tail of cold, then warm, then hot, skipping Items in use
+bool SlabAllocator::evict(SlabClass& c)
+{
+  c.mutex.assertLocked();
+  const Item::LruSegment order[] = { Item::kCold, Item::kWarm, Item::kHot };
+  for (Item::LruSegment lru : order)
+  {
+    Item* item = c.tails[lru];
+    for (int tries = 0; item && tries < kEvictTries; ++tries)
+    {
+      Item* prev = item->prev_;
+      if (lru == Item::kCold && item->active_.exchange(false, std::memory_order_relaxed))
+      {
+        remove(c, item);
+        pushHead(c, item, Item::kWarm);
+      }
+      else if (evictCallback_ && evictCallback_(item))
+      {
+        // with the reference of the hash table, refCount() is 0
+        assert(item->refCount() == 0);
+        remove(c, item);
+        FreeChunk* free = reinterpret_cast<FreeChunk*>(item);
+        free->next = c.freeList;
+        c.freeList = free;
+        ++c.freeChunks;
+        ++c.evictions;
+        return true;
+      }
+      item = prev;
+    }
+  }
+  return false;
+}
+
+void SlabAllocator::deallocate(Item* item)
+{
+  SlabClass& c = classes_[item->slabClass_];
+  MutexLockGuard lock(c.mutex);
+  assert(item->lru_ == Item::kUnlinked);
+  FreeChunk* free = reinterpret_cast<FreeChunk*>(item);
+  free->next = c.freeList;
+  c.freeList = free;
+  ++c.freeChunks;
+}
+
+void SlabAllocator::pushHead(SlabClass& c, Item* item, Item::LruSegment lru)
+{
+  c.mutex.assertLocked();
+  assert(item->lru_ == Item::kUnlinked);
+  item->lru_ = static_cast<uint8_t>(lru);
+  item->prev_ = NULL;
+  item->next_ = c.heads[lru];
+  if (item->next_)
+  {
+    item->next_->prev_ = item;
+  }
+  else
+  {
+    c.tails[lru] = item;
+  }
+  c.heads[lru] = item;
+  ++c.sizes[lru];
+}
+
+void SlabAllocator::remove(SlabClass& c, Item* item)
+{
+  c.mutex.assertLocked();
+  int lru = item->lru_;
+  assert(lru != Item::kUnlinked);
+  if (item->prev_)
+  {
+    item->prev_->next_ = item->next_;
+  }
+  else
+  {
+    c.heads[lru] = item->next_;
+  }
+  if (item->next_)
+  {
+    item->next_->prev_ = item->prev_;
+  }
+  else
+  {
+    c.tails[lru] = item->prev_;
+  }
+  item->prev_ = item->next_ = NULL;
+  item->lru_ = Item::kUnlinked;
+  --c.sizes[lru];
+}
+
+// moves a few Items out of hot and warm when they are over their share
+void SlabAllocator::balance(SlabClass& c)
+{
+  c.mutex.assertLocked();
+  const size_t total = c.sizes[Item::kHot] + c.sizes[Item::kWarm] + c.sizes[Item::kCold];
+  for (int i = 0; i < kMaxMoves && c.sizes[Item::kHot] * 100 > total * kHotPercent; ++i)
+  {
+    Item* item = c.tails[Item::kHot];
+    remove(c, item);
+    bool active = item->active_.exchange(false, std::memory_order_relaxed);
+    pushHead(c, item, active ? Item::kWarm : Item::kCold);
+  }
+  for (int i = 0; i < kMaxMoves && c.sizes[Item::kWarm] * 100 > total * kWarmPercent; ++i)
+  {
+    Item* item = c.tails[Item::kWarm];
+    remove(c, item);
+    bool active = item->active_.exchange(false, std::memory_order_relaxed);
+    pushHead(c, item, active ? Item::kWarm : Item::kCold);
+  }
+}
@@ -0,0 +1,94 @@
+#ifndef MUDUO_EXAMPLES_MEMCACHED_SERVER_SLABALLOCATOR_H
+#define MUDUO_EXAMPLES_MEMCACHED_SERVER_SLABALLOCATOR_H
+
+#include "examples/memcached/server/Item.h"
+
+#include "muduo/base/Mutex.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Memory for Items, as memcached does it.
+//
+// Items are carved from 1 MiB pages into chunks of one of the slab
+// classes, whose sizes grow by factor. Pages are taken until the memory
+// limit, after that a class gets a chunk by evicting the least recently
+// used Item of its own.
+//
+// Each class keeps its linked Items in a segmented LRU: new Items go to
+// the head of hot, which overflows into warm if read meanwhile, otherwise
+// into cold, where Items are evicted from the tail. An Item read in cold
+// goes back to warm. Reads only mark an Item, it is moved on the next
+// link() or eviction in its class, so a hit takes no lock here.
+class SlabAllocator : muduo::noncopyable
+{
+ public:
+  static const size_t kPageSize = 1024 * 1024;
+
+  // Called with the class of item locked, it takes item off the hash
+  // table along with the reference of the table, if nobody else refers
+  // to it, and returns true. Must not block.
+  typedef std::function<bool (Item* item)> EvictCallback;
+
+  struct ClassStats
+  {
+    size_t chunkSize;
+    size_t pages;
+    size_t freeChunks;
+    size_t hot;
+    size_t warm;
+    size_t cold;
+    int64_t evictions;
+  };
+
+  // memoryLimit 0 means no limit, each class gets one page anyway
+  explicit SlabAllocator(size_t memoryLimit, double factor = 1.25);
+  ~SlabAllocator();
+
+  void setEvictCallback(const EvictCallback& cb)
+  { evictCallback_ = cb; }
+
+  // NULL if the Item is too large or its class is out of memory
+  ItemPtr newItem(muduo::StringPiece key,
+                  uint32_t flags,
+                  int exptime,
+                  int valuelen,
+                  uint64_t cas);
+
+  // into or out of the LRU of its class, along with the hash table
+  void link(Item* item);
+  void unlink(Item* item);
+
+  // by the last Item::unref()
+  static void free(Item* item);
+
+  size_t memoryLimit() const { return memoryLimit_; }
+  size_t memoryAllocated() const { return allocated_.load(std::memory_order_relaxed); }
+  int numClasses() const { return static_cast<int>(chunkSizes_.size()); }
+  ClassStats classStats(int slabClass) const;
+  int64_t evictions() const;
+
+ private:
+  struct Page;
+  struct FreeChunk;
+  struct SlabClass;
+
+  int classFor(size_t bytes) const;
+  void* allocate(int slabClass);
+  bool newPage(SlabClass& c);
+  bool evict(SlabClass& c);
+  void deallocate(Item* item);
+
+  static void pushHead(SlabClass& c, Item* item, Item::LruSegment lru);
+  static void remove(SlabClass& c, Item* item);
+  static void balance(SlabClass& c);
+
+  const size_t memoryLimit_;
+  std::atomic<size_t> allocated_;
+  std::vector<size_t> chunkSizes_;
+  std::unique_ptr<SlabClass[]> classes_;
+  EvictCallback evictCallback_;
+};
+
+#endif  // MUDUO_EXAMPLES_MEMCACHED_SERVER_SLABALLOCATOR_H
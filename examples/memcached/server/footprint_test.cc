@@ -1,8 +1,11 @@
 #include "examples/memcached/server/MemcacheServer.h"
+#include "muduo/base/ProcessInfo.h"
 #include "muduo/net/EventLoop.h"
 #include "muduo/net/inspect/ProcessInspector.h"
 
+#include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
 #ifdef HAVE_TCMALLOC
 #include <gperftools/heap-profiler.h>
 #include <gperftools/malloc_extension.h>
@@ -10,6 +13,14 @@
 
 using namespace muduo::net;
 
+// VmRSS in /proc/self/status
+int64_t residentBytes()
+{
+  muduo::string status = muduo::ProcessInfo::procStatus();
+  size_t pos = status.find("VmRSS:");
+  return pos != muduo::string::npos ? atoll(status.c_str() + pos + 6) * 1024 : 0;
+}
+
 int main(int argc, char* argv[])
 {
 #ifdef HAVE_TCMALLOC
@@ -18,19 +29,23 @@ int main(int argc, char* argv[])
   int items = argc > 1 ? atoi(argv[1]) : 10000;
   int keylen = argc > 2 ? atoi(argv[2]) : 10;
   int valuelen = argc > 3 ? atoi(argv[3]) : 100;
+  int memoryMB = argc > 4 ? atoi(argv[4]) : 0;
   EventLoop loop;
   MemcacheServer::Options options;
+  options.memoryLimit = static_cast<int64_t>(memoryMB) * 1024 * 1024;
   MemcacheServer server(&loop, options);
 
-  printf("sizeof(Item) = %zd\npid = %d\nitems = %d\nkeylen = %d\nvaluelen = %d\n",
-         sizeof(Item), getpid(), items, keylen, valuelen);
+  printf("sizeof(Item) = %zd\npid = %d\nitems = %d\nkeylen = %d\nvaluelen = %d\nmemory limit = %d MiB\n",
+         sizeof(Item), getpid(), items, keylen, valuelen, memoryMB);
+  const int64_t residentBefore = residentBytes();
   char key[256] = { 0 };
   string value;
   for (int i = 0; i < items; ++i)
   {
     snprintf(key, sizeof key, "%0*d", keylen, i);
     value.assign(valuelen, "0123456789"[i % 10]);
-    ItemPtr item(Item::makeItem(key, 0, 0, valuelen+2, 1));
+    ItemPtr item(server.newItem(key, 0, 0, valuelen+2, 1));
+    assert(item);
     item->append(value.data(), value.size());
     item->append("\r\n", 2);
     assert(item->endsWithCRLF());
@@ -39,10 +54,36 @@ int main(int argc, char* argv[])
     assert(stored); (void) stored;
     assert(!exists);
   }
+  const int64_t resident = residentBytes() - residentBefore;
   Inspector::ArgList arg;
   printf("==========\n%s\n",
          ProcessInspector::overview(HttpRequest::kGet, arg).c_str());
-  // TODO: print bytes per item, overhead percent
+
+  // all items may not be there with a memory limit
+  const size_t stored = server.itemCount();
+  const size_t payload = static_cast<size_t>(keylen + valuelen + 2);
+  const SlabAllocator& slabs = server.allocator();
+  printf("==========\nitems stored = %zd\nevictions = %" PRId64 "\n",
+         stored, slabs.evictions());
+  if (stored > 0)
+  {
+    double bytesPerItem = static_cast<double>(resident) / static_cast<double>(stored);
+    double slabPerItem = static_cast<double>(slabs.memoryAllocated()) / static_cast<double>(stored);
+    printf("resident bytes per item = %.1f, overhead %.1f%% of %zd bytes of key and value\n",
+           bytesPerItem, (bytesPerItem / static_cast<double>(payload) - 1) * 100, payload);
+    printf("slab bytes per item = %.1f, in %zd bytes of pages\n",
+           slabPerItem, slabs.memoryAllocated());
+  }
+  for (int i = 0; i < slabs.numClasses(); ++i)
+  {
+    SlabAllocator::ClassStats stats = slabs.classStats(i);
+    if (stats.pages > 0)
+    {
+      printf("class %2d chunk %7zd pages %5zd free %8zd hot %8zd warm %8zd cold %8zd evicted %" PRId64 "\n",
+             i, stats.chunkSize, stats.pages, stats.freeChunks,
+             stats.hot, stats.warm, stats.cold, stats.evictions);
+    }
+  }
   fflush(stdout);
 #ifdef HAVE_TCMALLOC
   char buf[8192];
@@ -14,6 +14,8 @@ bool parseCommandLine(int argc, char* argv[], MemcacheServer::Options* options)
   options->tcpport = 11211;
   options->gperfport = 11212;
   options->threads = 4;
+  int memoryMB = 64;
+  options->crawlInterval = 60;
 
   po::options_description desc("Allowed options");
   desc.add_options()
@@ -22,11 +24,15 @@ bool parseCommandLine(int argc, char* argv[], MemcacheServer::Options* options)
       ("udpport,U", po::value<uint16_t>(&options->udpport), "UDP port")
       ("gperf,g", po::value<uint16_t>(&options->gperfport), "port for gperftools")
       ("threads,t", po::value<int>(&options->threads), "Number of worker threads")
+      ("memory-limit,m", po::value<int>(&memoryMB), "Item memory in megabytes, 0 for no limit")
+      ("crawl-interval", po::value<double>(&options->crawlInterval),
+       "Seconds between crawls for expired items, 0 for none")
       ;
 
   po::variables_map vm;
   po::store(po::parse_command_line(argc, argv, desc), vm);
   po::notify(vm);
+  options->memoryLimit = static_cast<int64_t>(memoryMB) * 1024 * 1024;
 
   if (vm.count("help"))
   {
@@ -4,8 +4,12 @@ import static org.jboss.netty.buffer.ChannelBuffers.wrappedBuffer;
 
 import java.net.InetSocketAddress;
 import java.nio.charset.Charset;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.ConcurrentMap;
 import java.util.concurrent.CountDownLatch;
 import java.util.concurrent.Executor;
+import java.util.regex.Matcher;
+import java.util.regex.Pattern;
 
 import org.jboss.netty.bootstrap.ServerBootstrap;
 import org.jboss.netty.buffer.ChannelBuffer;
@@ -33,8 +37,6 @@ public class MockBackendServer {
         public void channelConnected(ChannelHandlerContext ctx, ChannelStateEvent e)
                 throws Exception {
             logger.debug("channelConnected {},, {}", ctx, e);
-            assert connection == null;
-            connection = e.getChannel();
             latch.countDown();
         }
 
@@ -42,20 +44,25 @@ public class MockBackendServer {
         public void channelDisconnected(ChannelHandlerContext ctx, ChannelStateEvent e)
                 throws Exception {
             logger.debug("channelDisconnected {},, {}", ctx, e);
-            assert connection == e.getChannel();
-            connection = null;
+            clients.values().remove(e.getChannel());
         }
 
         @Override
         public void messageReceived(ChannelHandlerContext ctx, MessageEvent e)
                 throws Exception {
             logger.debug("messageReceived {},, {}", ctx, e);
-            assert connection == e.getChannel();
             ChannelBuffer input = (ChannelBuffer) e.getMessage();
             int len = input.readUnsignedByte();
             int whichClient = input.readUnsignedShort();
             assert len == input.readableBytes();
-            logger.debug("From {}, '{}'", whichClient, input.toString(Charset.defaultCharset()));
+            String str = input.toString(Charset.defaultCharset());
+            logger.debug("From {}, '{}'", whichClient, str);
+            if (whichClient == 0) {
+                // a client talks to the backend connection it comes up on
+                Matcher m = commandChannel.matcher(str);
+                if (m.matches() && m.group(2).equals("UP"))
+                    clients.put(Integer.parseInt(m.group(1)), e.getChannel());
+            }
             queue.put(new DataEvent(EventSource.kBackend, whichClient, input));
         }
 
@@ -71,8 +78,10 @@ public class MockBackendServer {
     private final Executor boss;
     private final Executor worker;
     private final CountDownLatch latch;
+    private static final Pattern commandChannel = Pattern.compile("CONN (\\d+) FROM [0-9.:]+ IS ([A-Z]+)\r\n");
     private Channel listener;
-    private volatile Channel connection;
+    // the multiplexer may have several connections, by client id
+    private final ConcurrentMap<Integer, Channel> clients = new ConcurrentHashMap<Integer, Channel>();
 
     public MockBackendServer(EventQueue queue, int listeningPort, Executor boss, Executor worker,
             CountDownLatch latch) {
@@ -93,7 +102,7 @@ public class MockBackendServer {
         ChannelBuffer output = data.factory().getBuffer(3);
         output.writeByte(data.readableBytes());
         output.writeShort(whichClient);
-        connection.write(wrappedBuffer(output, data));
+        clients.get(whichClient).write(wrappedBuffer(output, data));
     }
 
     public ChannelBuffer sendToClient(int whichClient, String str) {
@@ -16,6 +16,7 @@ import com.chenshuo.muduo.example.multiplexer.testcase.TestOneClientBothSend;
 import com.chenshuo.muduo.example.multiplexer.testcase.TestOneClientNoData;
 import com.chenshuo.muduo.example.multiplexer.testcase.TestOneClientSend;
 import com.chenshuo.muduo.example.multiplexer.testcase.TestOneClientBackendSend;
+import com.chenshuo.muduo.example.multiplexer.testcase.TestThroughput;
 import com.chenshuo.muduo.example.multiplexer.testcase.TestTwoClients;
 
 public class MultiplexerTest {
@@ -54,6 +55,7 @@ public class MultiplexerTest {
             test.addTestCase(new TestOneClientBackendSend());
             test.addTestCase(new TestOneClientBothSend());
             test.addTestCase(new TestTwoClients());
+            test.addTestCase(new TestThroughput());
             test.run();
         } else {
             System.out.println("Usage: ./run.sh path_to_test_data multiplexer_host");
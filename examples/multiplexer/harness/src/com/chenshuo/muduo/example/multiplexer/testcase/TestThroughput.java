@@ -0,0 +1,97 @@
+package com.chenshuo.muduo.example.multiplexer.testcase;
+
+import java.util.ArrayList;
+import java.util.regex.Matcher;
+
+import org.jboss.netty.buffer.ChannelBuffer;
+
+import com.chenshuo.muduo.example.multiplexer.DataEvent;
+import com.chenshuo.muduo.example.multiplexer.EventSource;
+import com.chenshuo.muduo.example.multiplexer.MockClient;
+import com.chenshuo.muduo.example.multiplexer.TestCase;
+
+public class TestThroughput extends TestCase {
+    private static final int kClients = 8;
+    private static final int kMessages = 2000;
+    private static final int kMessageLen = 200;
+
+    @Override
+    public void run() {
+        if (!queue.isEmpty())
+            fail("EventQueue is not empty");
+
+        ArrayList<MockClient> clients = new ArrayList<MockClient>();
+        ArrayList<Integer> ids = new ArrayList<Integer>();
+        for (int i = 0; i < kClients; ++i) {
+            MockClient client = god.newClient();
+            DataEvent de = (DataEvent) queue.take();
+            assertEquals(EventSource.kBackend, de.source);
+            Matcher m = god.commandChannel.matcher(de.getString());
+            if (!m.matches())
+                fail("command channel message doesn't match.");
+            assertEquals("UP", m.group(2));
+            int connId = Integer.parseInt(m.group(1));
+            client.setId(connId);
+            clients.add(client);
+            ids.add(connId);
+        }
+
+        byte[] message = new byte[kMessageLen];
+        for (int i = 0; i < kMessageLen; ++i)
+            message[i] = (byte) ('A' + i % 26);
+        final long total = (long) kClients * kMessages * kMessageLen;
+
+        // clients to backend
+        long start = System.nanoTime();
+        for (int i = 0; i < kMessages; ++i) {
+            for (MockClient client : clients) {
+                ChannelBuffer buf = bufferFactory.getBuffer(message, 0, message.length);
+                client.send(buf);
+            }
+        }
+        receive(EventSource.kBackend, total);
+        report("client -> backend", total, System.nanoTime() - start);
+
+        // backend to clients
+        start = System.nanoTime();
+        for (int i = 0; i < kMessages; ++i) {
+            for (int connId : ids) {
+                ChannelBuffer buf = bufferFactory.getBuffer(message, 0, message.length);
+                backend.sendToClient(connId, buf);
+            }
+        }
+        receive(EventSource.kClient, total);
+        report("backend -> client", total, System.nanoTime() - start);
+
+        for (MockClient client : clients) {
+            client.disconnect();
+        }
+        for (int i = 0; i < kClients; ++i) {
+            DataEvent de = (DataEvent) queue.take();
+            assertEquals(EventSource.kBackend, de.source);
+            Matcher m = god.commandChannel.matcher(de.getString());
+            if (!m.matches())
+                fail("command channel message doesn't match.");
+            assertEquals("DOWN", m.group(2));
+        }
+    }
+
+    private void receive(EventSource source, long total) {
+        long received = 0;
+        while (received < total) {
+            DataEvent de = (DataEvent) queue.take();
+            if (de == null)
+                fail("timeout after " + received + " bytes");
+            assertEquals(source, de.source);
+            received += de.data.readableBytes();
+        }
+        assertEquals(total, received);
+    }
+
+    private void report(String direction, long bytes, long nanos) {
+        double seconds = nanos / 1e9;
+        System.out.printf("%s: %.3f MiB/s, %.3f Ki packets/s\n", direction,
+                bytes / seconds / 1024 / 1024,
+                bytes / kMessageLen / seconds / 1024);
+    }
+}
@@ -1,14 +1,18 @@
 #include "muduo/base/Atomic.h"
+#include "muduo/base/BoundedMpmcQueue.h"
 #include "muduo/base/Logging.h"
 #include "muduo/base/Mutex.h"
 #include "muduo/base/Thread.h"
 #include "muduo/net/EventLoop.h"
+#include "muduo/net/EventLoopThreadPool.h"
 #include "muduo/net/InetAddress.h"
 #include "muduo/net/TcpClient.h"
 #include "muduo/net/TcpServer.h"
 
-#include <queue>
+#include <algorithm>
+#include <memory>
 #include <utility>
+#include <vector>
 
 #include <stdio.h>
 #include <unistd.h>
@@ -16,26 +20,36 @@
 using namespace muduo;
 using namespace muduo::net;
 
-const int kMaxConns = 10;  // 65535
+const int kMaxConns = 65535;  // ids are 16-bit, 0 is the command channel
 const size_t kMaxPacketLen = 255;
 const size_t kHeaderLen = 3;
+const int kStripes = 64;
 
 const uint16_t kClientPort = 3333;
 const char* backendIp = "127.0.0.1";
 const uint16_t kBackendPort = 9999;
 
-class MultiplexServer
+// Clients are spread over the io threads of server_, with a backend
+// connection in each io thread, so a client's packets usually go to a
+// backend in its own loop, without crossing threads.
+// Ids are taken from and returned to a lock-free queue, the client of an
+// id is looked up in a flat array, guarded by one of kStripes mutexes.
+class MultiplexServer : noncopyable
 {
  public:
   MultiplexServer(EventLoop* loop,
                   const InetAddress& listenAddr,
                   const InetAddress& backendAddr,
-                  int numThreads)
+                  int numThreads,
+                  int numBackends)
     : server_(loop, listenAddr, "MultiplexServer"),
-      backend_(loop, backendAddr, "MultiplexBackend"),
+      backendAddr_(backendAddr),
       numThreads_(numThreads),
+      numBackends_(numBackends),
       oldCounter_(0),
-      startTime_(Timestamp::now())
+      startTime_(Timestamp::now()),
+      availIds_(kMaxConns),
+      clients_(kMaxConns + 1)
   {
     server_.setConnectionCallback(
         std::bind(&MultiplexServer::onClientConnection, this, _1));
@@ -43,11 +57,11 @@ class MultiplexServer
         std::bind(&MultiplexServer::onClientMessage, this, _1, _2, _3));
     server_.setThreadNum(numThreads);
 
-    backend_.setConnectionCallback(
-        std::bind(&MultiplexServer::onBackendConnection, this, _1));
-    backend_.setMessageCallback(
-        std::bind(&MultiplexServer::onBackendMessage, this, _1, _2, _3));
-    backend_.enableRetry();
+    // ids are reused in FIFO order, as late as possible
+    for (int id = 1; id <= kMaxConns; ++id)
+    {
+      availIds_.tryPut(id);
+    }
 
     // loop->runEvery(10.0, std::bind(&MultiplexServer::printStatistics, this));
 
@@ -55,13 +69,57 @@ class MultiplexServer
 
   void start()
   {
-    LOG_INFO << "starting " << numThreads_ << " threads.";
-    backend_.connect();
+    LOG_INFO << "starting " << numThreads_ << " threads, "
+             << numBackends_ << " backends.";
     server_.start();
+
+    // new clients are dispatched once loop_ runs, after backends_ is filled
+    std::vector<EventLoop*> loops = server_.threadPool()->getAllLoops();
+    for (int i = 0; i < numBackends_; ++i)
+    {
+      char name[32];
+      snprintf(name, sizeof name, "MultiplexBackend%d", i);
+      EventLoop* ioLoop = loops[static_cast<size_t>(i) % loops.size()];
+      std::unique_ptr<TcpClient> backend(new TcpClient(ioLoop, backendAddr_, name));
+      backend->setConnectionCallback(
+          std::bind(&MultiplexServer::onBackendConnection, this, i, _1));
+      backend->setMessageCallback(
+          std::bind(&MultiplexServer::onBackendMessage, this, _1, _2, _3));
+      backend->enableRetry();
+      backends_.push_back(std::move(backend));
+    }
+    for (const auto& backend : backends_)
+    {
+      backend->connect();
+    }
   }
 
  private:
-  void sendBackendPacket(int id, Buffer* buf)
+  struct ClientContext
+  {
+    ClientContext(int i, const TcpConnectionPtr& conn)
+      : id(i), backendConn(conn)
+    {
+    }
+
+    int id;
+    TcpConnectionPtr backendConn;
+  };
+
+  struct Client
+  {
+    Client() : backend(-1) {}
+
+    TcpConnectionPtr conn;
+    int backend;  // index in backends_
+  };
+
+  MutexLock& stripe(int id)
+  {
+    return stripes_[id % kStripes];
+  }
+
+  static void prependHeader(int id, Buffer* buf)
   {
     size_t len = buf->readableBytes();
     assert(len <= kMaxPacketLen);
@@ -71,38 +129,46 @@ class MultiplexServer
       static_cast<uint8_t>((id & 0xFF00) >> 8)
     };
     buf->prepend(header, kHeaderLen);
-    TcpConnectionPtr backendConn;
-    {
-      MutexLockGuard lock(mutex_);
-      backendConn = backendConn_;
-    }
-    if (backendConn)
-    {
-      backendConn->send(buf);
-    }
   }
 
-  void sendBackendString(int id, const string& msg)
+  void sendBackendString(const TcpConnectionPtr& backendConn, int id, const string& msg)
   {
     assert(msg.size() <= kMaxPacketLen);
     Buffer buf;
     buf.append(msg);
-    sendBackendPacket(id, &buf);
+    prependHeader(id, &buf);
+    backendConn->send(&buf);
   }
 
-  void sendBackendBuffer(int id, Buffer* buf)
+  // frames buf in place if it fits in one packet, otherwise copies it once
+  // into packets, either way sent as a whole
+  void sendBackendBuffer(const TcpConnectionPtr& backendConn, int id, Buffer* buf)
   {
-    while (buf->readableBytes() > kMaxPacketLen)
+    size_t len = buf->readableBytes();
+    if (len <= kMaxPacketLen)
     {
-      Buffer packet;
-      packet.append(buf->peek(), kMaxPacketLen);
-      buf->retrieve(kMaxPacketLen);
-      sendBackendPacket(id, &packet);
+      prependHeader(id, buf);
+      backendConn->send(buf);
     }
-    if (buf->readableBytes() > 0)
+    else
     {
-      sendBackendPacket(id, buf);
+      Buffer packets(len + (len / kMaxPacketLen + 1) * kHeaderLen);
+      while (buf->readableBytes() > 0)
+      {
+        size_t n = std::min(buf->readableBytes(), kMaxPacketLen);
+        uint8_t header[kHeaderLen] = {
+          static_cast<uint8_t>(n),
+          static_cast<uint8_t>(id & 0xFF),
+          static_cast<uint8_t>((id & 0xFF00) >> 8)
+        };
+        packets.append(header, kHeaderLen);
+        packets.append(buf->peek(), n);
+        buf->retrieve(n);
+      }
+      backendConn->send(&packets);
     }
+    // not sent if the backend is down
+    buf->retrieveAll();
   }
 
   void sendToClient(Buffer* buf)
@@ -121,12 +187,8 @@ class MultiplexServer
 
         TcpConnectionPtr clientConn;
         {
-          MutexLockGuard lock(mutex_);
-          std::map<int, TcpConnectionPtr>::iterator it = clientConns_.find(id);
-          if (it != clientConns_.end())
-          {
-            clientConn = it->second;
-          }
+          MutexLockGuard lock(stripe(id));
+          clientConn = clients_[id].conn;
         }
         if (clientConn)
         {
@@ -137,6 +199,34 @@ class MultiplexServer
     }
   }
 
+  // the backend up in ioLoop if any, otherwise the next one up,
+  // returns its index, or -1 if all are down
+  int pickBackend(EventLoop* ioLoop, TcpConnectionPtr* backendConn)
+  {
+    const size_t n = backends_.size();
+    const size_t first = static_cast<uint32_t>(nextBackend_.getAndAdd(1)) % n;
+    int picked = -1;
+    for (size_t i = 0; i < n; ++i)
+    {
+      size_t index = (first + i) % n;
+      TcpConnectionPtr conn = backends_[index]->connection();
+      if (conn && conn->connected())
+      {
+        if (conn->getLoop() == ioLoop)
+        {
+          *backendConn = conn;
+          return static_cast<int>(index);
+        }
+        if (picked < 0)
+        {
+          *backendConn = conn;
+          picked = static_cast<int>(index);
+        }
+      }
+    }
+    return picked;
+  }
+
   void onClientConnection(const TcpConnectionPtr& conn)
   {
     LOG_TRACE << "Client " << conn->peerAddress().toIpPort() << " -> "
@@ -145,51 +235,49 @@ class MultiplexServer
     if (conn->connected())
     {
       int id = -1;
+      TcpConnectionPtr backendConn;
+      int backend = pickBackend(conn->getLoop(), &backendConn);
+      if (backend < 0 || !availIds_.tryTake(&id))
       {
-        MutexLockGuard lock(mutex_);
-        if (!availIds_.empty())
-        {
-          id = availIds_.front();
-          availIds_.pop();
-          clientConns_[id] = conn;
-        }
+        conn->shutdown();
+        return;
       }
 
-      if (id <= 0)
       {
-        conn->shutdown();
+        MutexLockGuard lock(stripe(id));
+        clients_[id].conn = conn;
+        clients_[id].backend = backend;
       }
-      else
+      conn->setContext(ClientContext(id, backendConn));
+      char buf[256];
+      snprintf(buf, sizeof(buf), "CONN %d FROM %s IS UP\r\n", id,
+               conn->peerAddress().toIpPort().c_str());
+      sendBackendString(backendConn, 0, buf);
+      // missed by onBackendConnection() if it went down meanwhile
+      if (!backendConn->connected())
       {
-        conn->setContext(id);
-        char buf[256];
-        snprintf(buf, sizeof(buf), "CONN %d FROM %s IS UP\r\n", id,
-                 conn->peerAddress().toIpPort().c_str());
-        sendBackendString(0, buf);
+        conn->shutdown();
       }
     }
     else
     {
-      if (!conn->getContext().empty())
+      ClientContext* context = boost::any_cast<ClientContext>(conn->getMutableContext());
+      if (context)
       {
-        int id = boost::any_cast<int>(conn->getContext());
+        int id = context->id;
         assert(id > 0 && id <= kMaxConns);
         char buf[256];
         snprintf(buf, sizeof(buf), "CONN %d FROM %s IS DOWN\r\n",
                  id, conn->peerAddress().toIpPort().c_str());
-        sendBackendString(0, buf);
+        sendBackendString(context->backendConn, 0, buf);
+        conn->setContext(boost::any());
 
-        MutexLockGuard lock(mutex_);
-        if (backendConn_)
-        {
-          availIds_.push(id);
-          clientConns_.erase(id);
-        }
-        else
         {
-          assert(availIds_.empty());
-          assert(clientConns_.empty());
+          MutexLockGuard lock(stripe(id));
+          clients_[id].conn.reset();
+          clients_[id].backend = -1;
         }
+        availIds_.put(id);
       }
     }
   }
@@ -199,11 +287,10 @@ class MultiplexServer
     size_t len = buf->readableBytes();
     transferred_.addAndGet(len);
     receivedMessages_.incrementAndGet();
-    if (!conn->getContext().empty())
+    const ClientContext* context = boost::any_cast<ClientContext>(conn->getMutableContext());
+    if (context)
     {
-      int id = boost::any_cast<int>(conn->getContext());
-      sendBackendBuffer(id, buf);
-      // assert(buf->readableBytes() == 0);
+      sendBackendBuffer(context->backendConn, context->id, buf);
     }
     else
     {
@@ -212,37 +299,27 @@ class MultiplexServer
     }
   }
 
-  void onBackendConnection(const TcpConnectionPtr& conn)
+  void onBackendConnection(int backend, const TcpConnectionPtr& conn)
   {
     LOG_TRACE << "Backend " << conn->localAddress().toIpPort() << " -> "
               << conn->peerAddress().toIpPort() << " is "
               << (conn->connected() ? "UP" : "DOWN");
-    std::vector<TcpConnectionPtr> connsToDestroy;
     if (conn->connected())
     {
-      MutexLockGuard lock(mutex_);
-      backendConn_ = conn;
-      assert(availIds_.empty());
-      for (int i = 1; i <= kMaxConns; ++i)
-      {
-        availIds_.push(i);
-      }
+      return;
     }
-    else
+
+    // its clients give back their ids when they are down
+    std::vector<TcpConnectionPtr> connsToDestroy;
+    for (int s = 0; s < kStripes; ++s)
     {
-      MutexLockGuard lock(mutex_);
-      backendConn_.reset();
-      connsToDestroy.reserve(clientConns_.size());
-      for (std::map<int, TcpConnectionPtr>::iterator it = clientConns_.begin();
-          it != clientConns_.end();
-          ++it)
-      {
-        connsToDestroy.push_back(it->second);
-      }
-      clientConns_.clear();
-      while (!availIds_.empty())
+      MutexLockGuard lock(stripes_[s]);
+      for (int id = s; id <= kMaxConns; id += kStripes)
       {
-        availIds_.pop();
+        if (clients_[id].conn && clients_[id].backend == backend)
+        {
+          connsToDestroy.push_back(clients_[id].conn);
+        }
       }
     }
 
@@ -279,16 +356,18 @@ class MultiplexServer
   }
 
   TcpServer server_;
-  TcpClient backend_;
+  InetAddress backendAddr_;
   int numThreads_;
+  int numBackends_;
   AtomicInt64 transferred_;
   AtomicInt64 receivedMessages_;
   int64_t oldCounter_;
   Timestamp startTime_;
-  MutexLock mutex_;
-  TcpConnectionPtr backendConn_ GUARDED_BY(mutex_);
-  std::map<int, TcpConnectionPtr> clientConns_ GUARDED_BY(mutex_);
-  std::queue<int> availIds_ GUARDED_BY(mutex_);
+  std::vector<std::unique_ptr<TcpClient>> backends_;  // filled in start()
+  AtomicInt32 nextBackend_;
+  BoundedMpmcQueue<int> availIds_;
+  MutexLock stripes_[kStripes];
+  std::vector<Client> clients_;  // by id, guarded by stripe(id)
 };
 
 int main(int argc, char* argv[])
@@ -303,10 +382,15 @@ int main(int argc, char* argv[])
   {
     numThreads = atoi(argv[2]);
   }
+  int numBackends = std::max(numThreads, 1);
+  if (argc > 3)
+  {
+    numBackends = atoi(argv[3]);
+  }
   EventLoop loop;
   InetAddress listenAddr(kClientPort);
   InetAddress backendAddr(backendIp, kBackendPort);
-  MultiplexServer server(&loop, listenAddr, backendAddr, numThreads);
+  MultiplexServer server(&loop, listenAddr, backendAddr, numThreads, numBackends);
 
   server.start();
 
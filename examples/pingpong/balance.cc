@@ -0,0 +1,166 @@
+// Tail latency of light sessions next to a few heavy ones,
+// with each EventLoopThreadPool::SelectionPolicy of the server.
+//
+// Every (threads)th connection is heavy, echoing large blocks, the rest
+// are light pingpong sessions measuring round trip times. Round-robin
+// stacks all heavy sessions on one loop, load-aware policies spread them.
+
+#include "muduo/base/Logging.h"
+#include "muduo/net/EventLoop.h"
+#include "muduo/net/EventLoopThread.h"
+#include "muduo/net/EventLoopThreadPool.h"
+#include "muduo/net/InetAddress.h"
+#include "muduo/net/TcpClient.h"
+#include "muduo/net/TcpServer.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+const int kLightMessage = 64;
+
+class Session : noncopyable
+{
+ public:
+  Session(EventLoop* loop, const InetAddress& serverAddr,
+          const string& name, int blockSize)
+    : client_(loop, serverAddr, name),
+      message_(blockSize, 'H'),
+      light_(blockSize == kLightMessage)
+  {
+    client_.setConnectionCallback(
+        std::bind(&Session::onConnection, this, _1));
+    client_.setMessageCallback(
+        std::bind(&Session::onMessage, this, _1, _2, _3));
+  }
+
+  void start() { client_.connect(); }
+  void stop() { client_.disconnect(); }
+
+  // round trip times in microseconds, stopped sessions only
+  const std::vector<int64_t>& latencies() const { return latencies_; }
+
+ private:
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      conn->setTcpNoDelay(true);
+      sendTime_ = Timestamp::now();
+      conn->send(message_);
+    }
+  }
+
+  void onMessage(const TcpConnectionPtr& conn, Buffer* buf, Timestamp receiveTime)
+  {
+    if (buf->readableBytes() < message_.size())
+    {
+      return;
+    }
+    buf->retrieve(message_.size());
+    if (light_)
+    {
+      latencies_.push_back(receiveTime.microSecondsSinceEpoch()
+                           - sendTime_.microSecondsSinceEpoch());
+    }
+    sendTime_ = Timestamp::now();
+    conn->send(message_);
+  }
+
+  TcpClient client_;
+  const string message_;
+  const bool light_;
+  Timestamp sendTime_;
+  std::vector<int64_t> latencies_;
+};
+
+void onServerMessage(const TcpConnectionPtr& conn, Buffer* buf, Timestamp)
+{
+  conn->send(buf);
+}
+
+const uint16_t kPort = 2011;
+
+void run(EventLoopThreadPool::SelectionPolicy policy, const char* name,
+         int threads, int sessions, int heavyBlock, double seconds)
+{
+  EventLoop loop;
+  InetAddress listenAddr(kPort, true);
+  TcpServer server(&loop, listenAddr, "Balance");
+  server.setMessageCallback(onServerMessage);
+  server.setThreadNum(threads);
+  server.threadPool()->setSelectionPolicy(policy);
+  server.start();
+  InetAddress serverAddr("127.0.0.1", kPort);
+
+  EventLoopThread clientThread;
+  EventLoop* clientLoop = clientThread.startLoop();
+  std::vector<std::unique_ptr<Session>> clients;
+  for (int i = 0; i < sessions; ++i)
+  {
+    char buf[32];
+    snprintf(buf, sizeof buf, "C%05d", i);
+    bool heavy = i % threads == 0;
+    clients.emplace_back(new Session(clientLoop, serverAddr, buf,
+                                     heavy ? heavyBlock : kLightMessage));
+  }
+  // connect one by one, so that load of the earlier ones is visible
+  for (size_t i = 0; i < clients.size(); ++i)
+  {
+    loop.runAfter(0.01 * static_cast<double>(i),
+                  std::bind(&Session::start, get_pointer(clients[i])));
+  }
+  double start = 0.01 * sessions + 0.5;
+  loop.runAfter(start + seconds, [&]
+    {
+      for (const auto& stats : server.threadPool()->getLoopStats())
+      {
+        printf("%18s loop %p connections %3d pending %8" PRId64 " bytes\n",
+               name, stats.loop, stats.connections, stats.pendingOutputBytes);
+      }
+      for (auto& client : clients)
+      {
+        clientLoop->runInLoop(std::bind(&Session::stop, get_pointer(client)));
+      }
+      loop.runAfter(0.5, std::bind(&EventLoop::quit, &loop));
+    });
+  loop.loop();
+
+  std::vector<int64_t> all;
+  for (auto& client : clients)
+  {
+    const std::vector<int64_t>& lat = client->latencies();
+    all.insert(all.end(), lat.begin(), lat.end());
+  }
+  std::sort(all.begin(), all.end());
+  if (all.empty())
+  {
+    printf("%18s no samples\n", name);
+    return;
+  }
+  printf("%18s %9zu rtts  p50 %6" PRId64 " us  p99 %6" PRId64 " us  p99.9 %6" PRId64 " us\n",
+         name, all.size(), all[all.size() / 2], all[all.size() * 99 / 100],
+         all[all.size() * 999 / 1000]);
+}
+
+int main(int argc, char* argv[])
+{
+  Logger::setLogLevel(Logger::ERROR);
+  int threads = argc > 1 ? atoi(argv[1]) : 4;
+  int sessions = argc > 2 ? atoi(argv[2]) : 64;
+  int heavyBlock = argc > 3 ? atoi(argv[3]) : 1024 * 1024;
+  double seconds = argc > 4 ? atof(argv[4]) : 5;
+  printf("%d IO threads, %d sessions, one in %d echoes %d bytes\n",
+         threads, sessions, threads, heavyBlock);
+
+  run(EventLoopThreadPool::kRoundRobin, "round-robin", threads, sessions, heavyBlock, seconds);
+  run(EventLoopThreadPool::kLeastConnections, "least-connections", threads, sessions, heavyBlock, seconds);
+  run(EventLoopThreadPool::kLeastPendingBytes, "least-pending", threads, sessions, heavyBlock, seconds);
+  run(EventLoopThreadPool::kPowerOfTwoChoices, "power-of-two", threads, sessions, heavyBlock, seconds);
+}
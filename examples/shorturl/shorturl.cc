@@ -22,12 +22,9 @@ void onRequest(const HttpRequest& req, HttpResponse* resp)
   LOG_INFO << "Headers " << req.methodString() << " " << req.path();
   if (!benchmark)
   {
-    const std::map<string, string>& headers = req.headers();
-    for (std::map<string, string>::const_iterator it = headers.begin();
-        it != headers.end();
-        ++it)
+    for (const HttpRequest::Header& header : req.headerList())
     {
-      LOG_DEBUG << it->first << ": " << it->second;
+      LOG_DEBUG << header.first << ": " << header.second;
     }
   }
 
@@ -10,6 +10,7 @@ std::vector<InetAddress> g_backends;
 ThreadLocal<std::map<string, TunnelPtr> > t_tunnels;
 MutexLock g_mutex;
 size_t g_current = 0;
+bool g_splice = false;
 
 void onServerConnection(const TcpConnectionPtr& conn)
 {
@@ -28,6 +29,7 @@ void onServerConnection(const TcpConnectionPtr& conn)
 
     InetAddress backend = g_backends[current];
     TunnelPtr tunnel(new Tunnel(conn->getLoop(), backend, conn));
+    tunnel->setSplice(g_splice);
     tunnel->setup();
     tunnel->connect();
 
@@ -55,13 +57,18 @@ int main(int argc, char* argv[])
 {
   if (argc < 3)
   {
-    fprintf(stderr, "Usage: %s listen_port backend_ip:port [backend_ip:port]\n", argv[0]);
+    fprintf(stderr, "Usage: %s listen_port backend_ip:port [backend_ip:port] [splice]\n", argv[0]);
   }
   else
   {
     for (int i = 2; i < argc; ++i)
     {
       string hostport = argv[i];
+      if (hostport == "splice")
+      {
+        g_splice = true;
+        continue;
+      }
       size_t colon = hostport.find(':');
       if (colon != string::npos)
       {
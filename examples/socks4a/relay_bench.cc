@@ -0,0 +1,160 @@
+#include "examples/socks4a/tunnel.h"
+
+#include "muduo/base/CountDownLatch.h"
+#include "muduo/net/EventLoopThread.h"
+
+#include <atomic>
+#include <map>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// CPU of the relay thread per Gbit relayed, from a blocking writer through
+// a Tunnel to a sink which discards, copying through Buffers or splice(2).
+
+std::atomic<int64_t> g_received(0);
+std::map<string, TunnelPtr> g_tunnels;  // in the relay loop
+InetAddress* g_sinkAddr;
+bool g_splice = false;
+
+void onSinkMessage(const TcpConnectionPtr&, Buffer* buf, Timestamp)
+{
+  g_received += static_cast<int64_t>(buf->readableBytes());
+  buf->retrieveAll();
+}
+
+void onRelayConnection(const TcpConnectionPtr& conn)
+{
+  if (conn->connected())
+  {
+    conn->setTcpNoDelay(true);
+    conn->stopRead();
+    TunnelPtr tunnel(new Tunnel(conn->getLoop(), *g_sinkAddr, conn));
+    tunnel->setSplice(g_splice);
+    tunnel->setup();
+    tunnel->connect();
+    g_tunnels[conn->name()] = tunnel;
+  }
+  else
+  {
+    g_tunnels[conn->name()]->disconnect();
+    g_tunnels.erase(conn->name());
+  }
+}
+
+void onRelayMessage(const TcpConnectionPtr& conn, Buffer* buf, Timestamp)
+{
+  if (!conn->getContext().empty())
+  {
+    const TcpConnectionPtr& clientConn
+      = boost::any_cast<const TcpConnectionPtr&>(conn->getContext());
+    clientConn->send(buf);
+  }
+}
+
+// runs f in loop and waits for it
+void runSync(EventLoop* loop, const std::function<void()>& f)
+{
+  CountDownLatch latch(1);
+  loop->runInLoop([&f, &latch]
+      {
+        f();
+        latch.countDown();
+      });
+  latch.wait();
+}
+
+double threadCpuSeconds(EventLoop* loop)
+{
+  double seconds = 0;
+  runSync(loop, [&seconds]
+      {
+        struct timespec ts;
+        ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        seconds = static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+      });
+  return seconds;
+}
+
+void bench(bool splice, uint16_t port, double seconds)
+{
+  g_splice = splice;
+  g_received = 0;
+  EventLoopThread sinkThread(EventLoopThread::ThreadInitCallback(), "sink");
+  EventLoopThread relayThread(EventLoopThread::ThreadInitCallback(), "relay");
+  EventLoop* sinkLoop = sinkThread.startLoop();
+  EventLoop* relayLoop = relayThread.startLoop();
+
+  InetAddress sinkAddr("127.0.0.1", port);
+  InetAddress relayAddr("127.0.0.1", static_cast<uint16_t>(port + 1));
+  g_sinkAddr = &sinkAddr;
+  std::unique_ptr<TcpServer> sink;
+  std::unique_ptr<TcpServer> relay;
+  runSync(sinkLoop, [&]
+      {
+        sink.reset(new TcpServer(sinkLoop, sinkAddr, "sink"));
+        sink->setMessageCallback(onSinkMessage);
+        sink->start();
+      });
+  runSync(relayLoop, [&]
+      {
+        relay.reset(new TcpServer(relayLoop, relayAddr, "relay"));
+        relay->setConnectionCallback(onRelayConnection);
+        relay->setMessageCallback(onRelayMessage);
+        relay->start();
+      });
+
+  int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP);
+  if (::connect(sockfd, relayAddr.getSockAddr(), sizeof(struct sockaddr_in)) < 0)
+  {
+    LOG_SYSFATAL << "connect";
+  }
+  string data(64*1024, 'x');
+  int64_t sent = 0;
+  double cpuStart = threadCpuSeconds(relayLoop);
+  Timestamp start(Timestamp::now());
+  while (timeDifference(Timestamp::now(), start) < seconds)
+  {
+    ssize_t n = ::write(sockfd, data.data(), data.size());
+    if (n <= 0)
+    {
+      LOG_SYSFATAL << "write";
+    }
+    sent += n;
+  }
+  while (g_received < sent)
+  {
+    ::usleep(1000);
+  }
+  double elapsed = timeDifference(Timestamp::now(), start);
+  double cpu = threadCpuSeconds(relayLoop) - cpuStart;
+  ::close(sockfd);
+
+  double gbits = static_cast<double>(sent) * 8 / 1e9;
+  printf("%-6s %7.2f Gbit/s, relay CPU %5.1f%%, %6.1f ms CPU per Gbit\n",
+         splice ? "splice" : "copy", gbits / elapsed, cpu / elapsed * 100, cpu / gbits * 1000);
+  fflush(stdout);
+
+  // the tunnel and the servers go in their loops
+  ::usleep(100*1000);
+  runSync(relayLoop, [&relay]
+      {
+        g_tunnels.clear();
+        relay.reset();
+      });
+  runSync(sinkLoop, [&sink] { sink.reset(); });
+}
+
+int main(int argc, char* argv[])
+{
+  Logger::setLogLevel(Logger::WARN);
+  double seconds = argc > 1 ? atof(argv[1]) : 5;
+  bench(false, 23001, seconds);
+  bench(true, 23011, seconds);
+}
@@ -7,6 +7,12 @@
 #include "muduo/net/TcpClient.h"
 #include "muduo/net/TcpServer.h"
 
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
 class Tunnel : public std::enable_shared_from_this<Tunnel>,
                muduo::noncopyable
 {
@@ -15,7 +21,8 @@ class Tunnel : public std::enable_shared_from_this<Tunnel>,
          const muduo::net::InetAddress& serverAddr,
          const muduo::net::TcpConnectionPtr& serverConn)
     : client_(loop, serverAddr, serverConn->name()),
-      serverConn_(serverConn)
+      serverConn_(serverConn),
+      splice_(false)
   {
     LOG_INFO << "Tunnel " << serverConn->peerAddress().toIpPort()
              << " <-> " << serverAddr.toIpPort();
@@ -26,6 +33,13 @@ class Tunnel : public std::enable_shared_from_this<Tunnel>,
     LOG_INFO << "~Tunnel";
   }
 
+  // Relays socket -> pipe -> socket with splice(2), without copying
+  // to user space. Must be called before setup().
+  void setSplice(bool on)
+  {
+    splice_ = on;
+  }
+
   void setup()
   {
     using std::placeholders::_1;
@@ -60,6 +74,7 @@ class Tunnel : public std::enable_shared_from_this<Tunnel>,
     client_.setMessageCallback(muduo::net::defaultMessageCallback);
     if (serverConn_)
     {
+      serverConn_->setRawReadCallback(muduo::net::RawReadCallback());
       serverConn_->setContext(boost::any());
       serverConn_->shutdown();
     }
@@ -80,8 +95,12 @@ class Tunnel : public std::enable_shared_from_this<Tunnel>,
                     std::weak_ptr<Tunnel>(shared_from_this()), kClient, _1, _2),
           1024*1024);
       serverConn_->setContext(conn);
-      serverConn_->startRead();
       clientConn_ = conn;
+      if (splice_)
+      {
+        setupSplice();
+      }
+      serverConn_->startRead();
       if (serverConn_->inputBuffer()->readableBytes() > 0)
       {
         conn->send(serverConn_->inputBuffer());
@@ -114,6 +133,105 @@ class Tunnel : public std::enable_shared_from_this<Tunnel>,
     kServer, kClient
   };
 
+  // holds what was spliced from one side, until sent to the other
+  struct Pipe : muduo::noncopyable
+  {
+    Pipe()
+      : capacity(0)
+    {
+      if (::pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0)
+      {
+        LOG_SYSFATAL << "Tunnel::Pipe";
+      }
+      int size = ::fcntl(fds[1], F_SETPIPE_SZ, kPipeSize);
+      if (size < 0)
+      {
+        size = ::fcntl(fds[1], F_GETPIPE_SZ);
+      }
+      capacity = static_cast<size_t>(size);
+    }
+
+    ~Pipe()
+    {
+      ::close(fds[0]);
+      ::close(fds[1]);
+    }
+
+    int fds[2];
+    size_t capacity;
+  };
+  typedef std::shared_ptr<Pipe> PipePtr;
+
+  static const int kPipeSize = 1024*1024;
+
+  // Data read from a side waits in its pipe, queued as a file segment on
+  // the other side, so the high water mark of the other side is at most
+  // the capacity of the pipe, and stops reading before the pipe is full.
+  void setupSplice()
+  {
+    using std::placeholders::_1;
+    using std::placeholders::_2;
+
+    std::weak_ptr<Tunnel> weak(shared_from_this());
+    for (ServerClient which : { kServer, kClient })
+    {
+      pipes_[which].reset(new Pipe);
+      const muduo::net::TcpConnectionPtr& conn = which == kServer ? serverConn_ : clientConn_;
+      const muduo::net::TcpConnectionPtr& peer = which == kServer ? clientConn_ : serverConn_;
+      conn->setRawReadCallback(std::bind(&Tunnel::onSpliceWeak, weak, which, _1, _2));
+      peer->setHighWaterMarkCallback(
+          std::bind(&Tunnel::onHighWaterMarkWeak, weak, which == kServer ? kClient : kServer, _1, _2),
+          std::min<size_t>(pipes_[which]->capacity, 1024*1024));
+    }
+  }
+
+  ssize_t onSplice(ServerClient which, int sockfd)
+  {
+    const muduo::net::TcpConnectionPtr& peer = which == kServer ? clientConn_ : serverConn_;
+    if (!peer)
+    {
+      return 0;
+    }
+    const PipePtr& pipe = pipes_[which];
+    size_t queued = peer->outputQueue()->readableBytes();
+    if (queued >= pipe->capacity)
+    {
+      onHighWaterMark(which == kServer ? kClient : kServer, peer, queued);
+      errno = EAGAIN;
+      return -1;
+    }
+    ssize_t n = ::splice(sockfd, NULL, pipe->fds[1], NULL,
+                         std::min<size_t>(pipe->capacity - queued, 256*1024),
+                         SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n > 0)
+    {
+      peer->sendFile(pipe, pipe->fds[0], 0, n);
+    }
+    else if (n < 0 && errno == EAGAIN && queued > 0)
+    {
+      // A pipe fills by pages, one per segment spliced in, so small
+      // segments fill it long before capacity bytes. If the socket still
+      // has data, it would stay readable and spin the loop, so stop
+      // reading until peer drains the pipe.
+      int readable = 0;
+      if (::ioctl(sockfd, FIONREAD, &readable) == 0 && readable > 0)
+      {
+        onHighWaterMark(which == kServer ? kClient : kServer, peer, queued);
+      }
+      errno = EAGAIN;
+    }
+    return n;
+  }
+
+  static ssize_t onSpliceWeak(const std::weak_ptr<Tunnel>& wkTunnel,
+                              ServerClient which,
+                              const muduo::net::TcpConnectionPtr&,
+                              int sockfd)
+  {
+    std::shared_ptr<Tunnel> tunnel = wkTunnel.lock();
+    return tunnel ? tunnel->onSplice(which, sockfd) : 0;
+  }
+
   void onHighWaterMark(ServerClient which,
                        const muduo::net::TcpConnectionPtr& conn,
                        size_t bytesToSent)
@@ -126,7 +244,7 @@ class Tunnel : public std::enable_shared_from_this<Tunnel>,
 
     if (which == kServer)
     {
-      if (serverConn_->outputBuffer()->readableBytes() > 0)
+      if (serverConn_->outputQueue()->readableBytes() > 0)
       {
         clientConn_->stopRead();
         serverConn_->setWriteCompleteCallback(
@@ -136,7 +254,7 @@ class Tunnel : public std::enable_shared_from_this<Tunnel>,
     }
     else
     {
-      if (clientConn_->outputBuffer()->readableBytes() > 0)
+      if (clientConn_->outputQueue()->readableBytes() > 0)
       {
         serverConn_->stopRead();
         clientConn_->setWriteCompleteCallback(
@@ -189,6 +307,8 @@ class Tunnel : public std::enable_shared_from_this<Tunnel>,
   muduo::net::TcpClient client_;
   muduo::net::TcpConnectionPtr serverConn_;
   muduo::net::TcpConnectionPtr clientConn_;
+  bool splice_;
+  PipePtr pipes_[2];  // by the side read from
 };
 typedef std::shared_ptr<Tunnel> TunnelPtr;
 
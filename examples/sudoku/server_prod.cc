@@ -12,6 +12,8 @@
 
 #include <boost/circular_buffer.hpp>
 
+#include <utility>
+
 //#include <stdio.h>
 //#include <unistd.h>
 
@@ -170,7 +172,7 @@ class SudokuServer : noncopyable
       bool throttle = boost::any_cast<bool>(conn->getContext());
       if (threadPool_.queueSize() < 1000 * 1000 && !throttle)
       {
-        threadPool_.run(std::bind(&SudokuServer::solve, this, conn, req));
+        threadPool_.run(std::bind(&SudokuServer::solve, this, conn, std::move(req)));
       }
       else
       {
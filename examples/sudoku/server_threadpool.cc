@@ -96,7 +96,7 @@ class SudokuServer
 
     if (puzzle.size() == implicit_cast<size_t>(kCells))
     {
-      threadPool_.run(std::bind(&solve, conn, puzzle, id));
+      threadPool_.run(std::bind(&solve, conn, std::move(puzzle), std::move(id)));
     }
     else
     {
@@ -4,13 +4,133 @@
 // Author: Shuo Chen (chenshuo at chenshuo dot com)
 
 #include "muduo/base/AsyncLogging.h"
+#include "muduo/base/LogDecoder.h"
 #include "muduo/base/LogFile.h"
+#include "muduo/base/Logging.h"
 #include "muduo/base/Timestamp.h"
 
+#include <algorithm>
+
 #include <stdio.h>
 
 using namespace muduo;
 
+namespace
+{
+
+std::atomic<uint64_t> g_nextId(1);
+
+// every record in a thread buffer is
+// int64_t microSecondsSinceEpoch, int32_t length, then the line
+const int kRecordHeader = static_cast<int>(sizeof(int64_t) + sizeof(int32_t));
+
+}  // namespace
+
+///
+/// Single-producer single-consumer ring of buffers of one thread.
+///
+/// The owning thread appends to slot head, the background thread writes
+/// out slots from tail up to head, including what is in slot head so far,
+/// and hands slots before head back by advancing tail.
+///
+class AsyncLogging::ThreadBuffer : noncopyable
+{
+ public:
+  static const int kNumSlots = 8;
+
+  enum Result { kAppended, kRotated, kFull };
+
+  ThreadBuffer()
+    : head_(0),
+      tail_(0),
+      retired_(false),
+      consumed_(0),
+      harvestHead_(0),
+      harvestLength_(0)
+  {
+    for (Slot& slot : slots_)
+    {
+      slot.length.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // in the owning thread
+  Result append(int64_t micros, const char* logline, int len)
+  {
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    Slot* slot = &slots_[head % kNumSlots];
+    Result result = kAppended;
+    if (slot->buffer.avail() <= kRecordHeader + len)
+    {
+      if (kRecordHeader + len >= detail::kThreadBuffer ||
+          head + 1 - tail_.load(std::memory_order_acquire) >= kNumSlots)
+      {
+        return kFull;
+      }
+      head_.store(++head, std::memory_order_release);
+      slot = &slots_[head % kNumSlots];
+      result = kRotated;
+    }
+    int32_t length = len;
+    slot->buffer.append(reinterpret_cast<const char*>(&micros), sizeof micros);
+    slot->buffer.append(reinterpret_cast<const char*>(&length), sizeof length);
+    slot->buffer.append(logline, len);
+    slot->length.store(slot->buffer.length(), std::memory_order_release);
+    return result;
+  }
+
+  // when the owning thread exits
+  void retire() { retired_.store(true, std::memory_order_release); }
+  bool retired() const { return retired_.load(std::memory_order_acquire); }
+
+  // in the background thread, records appended since the last release()
+  void collect(std::vector<StringPiece>* pieces)
+  {
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    harvestHead_ = head_.load(std::memory_order_acquire);
+    for (uint64_t i = tail; i <= harvestHead_; ++i)
+    {
+      const Slot& slot = slots_[i % kNumSlots];
+      int length = slot.length.load(std::memory_order_acquire);
+      int begin = i == tail ? consumed_ : 0;
+      if (length > begin)
+      {
+        pieces->push_back(StringPiece(slot.buffer.data() + begin, length - begin));
+      }
+      harvestLength_ = length;
+    }
+  }
+
+  // in the background thread, after the collected records are written
+  void release()
+  {
+    for (uint64_t i = tail_.load(std::memory_order_relaxed); i < harvestHead_; ++i)
+    {
+      Slot& slot = slots_[i % kNumSlots];
+      slot.buffer.reset();
+      slot.length.store(0, std::memory_order_relaxed);
+    }
+    consumed_ = harvestLength_;
+    tail_.store(harvestHead_, std::memory_order_release);
+  }
+
+ private:
+  struct Slot
+  {
+    detail::FixedBuffer<detail::kThreadBuffer> buffer;
+    std::atomic<int> length;
+  };
+
+  Slot slots_[kNumSlots];
+  std::atomic<uint64_t> head_;
+  std::atomic<uint64_t> tail_;
+  std::atomic<bool> retired_;
+  // in the background thread
+  int consumed_;  // of slot tail
+  uint64_t harvestHead_;
+  int harvestLength_;
+};
+
 AsyncLogging::AsyncLogging(const string& basename,
                            off_t rollSize,
                            int flushInterval)
@@ -24,14 +144,65 @@ AsyncLogging::AsyncLogging(const string& basename,
     cond_(mutex_),
     currentBuffer_(new Buffer),
     nextBuffer_(new Buffer),
-    buffers_()
+    buffers_(),
+    directIo_(false),
+    perThreadBuffers_(false),
+    id_(g_nextId.fetch_add(1)),
+    harvestRequested_(false),
+    overflowLines_(0)
 {
   currentBuffer_->bzero();
   nextBuffer_->bzero();
   buffers_.reserve(16);
 }
 
+AsyncLogging::~AsyncLogging()
+{
+  if (running_)
+  {
+    stop();
+  }
+}
+
+void AsyncLogging::setDecoding(bool on)
+{
+  decoder_.reset(on ? new LogDecoder : NULL);
+}
+
+void AsyncLogging::setUp(LogFile* output)
+{
+  if (directIo_)
+  {
+    output->setDirectIo(true);
+  }
+  output->setRollCallback(rollCallback_);
+}
+
+void AsyncLogging::write(LogFile* output, const char* data, int len)
+{
+  if (decoder_)
+  {
+    decoder_->decode(data, len, [output](const char* line, int n) { output->append(line, n); });
+  }
+  else
+  {
+    output->append(data, len);
+  }
+}
+
 void AsyncLogging::append(const char* logline, int len)
+{
+  if (perThreadBuffers_)
+  {
+    appendPerThread(logline, len);
+  }
+  else
+  {
+    appendShared(logline, len);
+  }
+}
+
+void AsyncLogging::appendShared(const char* logline, int len)
 {
   muduo::MutexLockGuard lock(mutex_);
   if (currentBuffer_->avail() > len)
@@ -57,9 +228,16 @@ void AsyncLogging::append(const char* logline, int len)
 
 void AsyncLogging::threadFunc()
 {
+  if (perThreadBuffers_)
+  {
+    threadFuncPerThread();
+    return;
+  }
+
   assert(running_ == true);
   latch_.countDown();
   LogFile output(basename_, rollSize_, false);
+  setUp(&output);
   BufferPtr newBuffer1(new Buffer);
   BufferPtr newBuffer2(new Buffer);
   newBuffer1->bzero();
@@ -96,14 +274,18 @@ void AsyncLogging::threadFunc()
                Timestamp::now().toFormattedString().c_str(),
                buffersToWrite.size()-2);
       fputs(buf, stderr);
-      output.append(buf, static_cast<int>(strlen(buf)));
+      // not amid binary records
+      if (decoder_ || Logger::format() == Logger::kText)
+      {
+        output.append(buf, static_cast<int>(strlen(buf)));
+      }
       buffersToWrite.erase(buffersToWrite.begin()+2, buffersToWrite.end());
     }
 
     for (const auto& buffer : buffersToWrite)
     {
       // FIXME: use unbuffered stdio FILE ? or use ::writev ?
-      output.append(buffer->data(), buffer->length());
+      write(&output, buffer->data(), buffer->length());
     }
 
     if (buffersToWrite.size() > 2)
@@ -131,6 +313,208 @@ void AsyncLogging::threadFunc()
     buffersToWrite.clear();
     output.flush();
   }
+
+  // appended while the last buffers were written
+  {
+    muduo::MutexLockGuard lock(mutex_);
+    buffers_.push_back(std::move(currentBuffer_));
+    buffersToWrite.swap(buffers_);
+  }
+  for (const auto& buffer : buffersToWrite)
+  {
+    write(&output, buffer->data(), buffer->length());
+  }
+  output.flush();
+}
+
+
+void AsyncLogging::appendPerThread(const char* logline, int len)
+{
+  ThreadBuffer::Result result =
+    threadBuffer()->append(Timestamp::now().microSecondsSinceEpoch(), logline, len);
+  if (result == ThreadBuffer::kFull)
+  {
+    overflowLines_.fetch_add(1, std::memory_order_relaxed);
+    appendShared(logline, len);
+  }
+  else if (result == ThreadBuffer::kRotated)
+  {
+    wakeUp();
+  }
+}
+
+AsyncLogging::ThreadBuffer* AsyncLogging::threadBuffer()
+{
+  struct Registration
+  {
+    Registration()
+      : owner(0)
+    {
+    }
+
+    ~Registration()
+    {
+      if (buffer)
+      {
+        buffer->retire();
+      }
+    }
+
+    uint64_t owner;
+    ThreadBufferPtr buffer;
+  };
+  static thread_local Registration t_registration;
+
+  if (t_registration.owner != id_)
+  {
+    if (t_registration.buffer)
+    {
+      t_registration.buffer->retire();
+    }
+    ThreadBufferPtr buffer(new ThreadBuffer);
+    {
+      muduo::MutexLockGuard lock(mutex_);
+      threadBuffers_.push_back(buffer);
+    }
+    t_registration.owner = id_;
+    t_registration.buffer = buffer;
+  }
+  return t_registration.buffer.get();
+}
+
+void AsyncLogging::wakeUp()
+{
+  // once per harvest, the flag is checked under the lock
+  if (!harvestRequested_.exchange(true))
+  {
+    muduo::MutexLockGuard lock(mutex_);
+    cond_.notify();
+  }
+}
+
+void AsyncLogging::threadFuncPerThread()
+{
+  assert(running_ == true);
+  latch_.countDown();
+  LogFile output(basename_, rollSize_, false);
+  setUp(&output);
+  while (running_)
+  {
+    {
+      muduo::MutexLockGuard lock(mutex_);
+      if (!harvestRequested_ && buffers_.empty())
+      {
+        cond_.waitForSeconds(flushInterval_);
+      }
+    }
+    harvestRequested_ = false;
+    harvest(&output);
+    output.flush();
+  }
+  harvest(&output);
   output.flush();
 }
 
+void AsyncLogging::harvest(LogFile* output)
+{
+  std::vector<ThreadBufferPtr> buffers;
+  BufferVector overflow;
+  {
+    muduo::MutexLockGuard lock(mutex_);
+    buffers = threadBuffers_;
+    if (currentBuffer_->length() > 0)
+    {
+      buffers_.push_back(std::move(currentBuffer_));
+      currentBuffer_.reset(new Buffer);
+    }
+    overflow.swap(buffers_);
+    if (!nextBuffer_)
+    {
+      nextBuffer_.reset(new Buffer);
+    }
+  }
+
+  // records of one thread are in time order, merge the threads
+  struct Cursor
+  {
+    int64_t micros;
+    std::vector<StringPiece> pieces;
+    size_t piece;
+    const char* record;
+
+    bool operator>(const Cursor& rhs) const { return micros > rhs.micros; }
+
+    const char* end() const { return pieces[piece].end(); }
+
+    // false if exhausted
+    bool load()
+    {
+      if (record == end())
+      {
+        if (++piece == pieces.size())
+        {
+          return false;
+        }
+        record = pieces[piece].data();
+      }
+      memcpy(&micros, record, sizeof micros);
+      return true;
+    }
+  };
+  std::vector<Cursor> cursors(buffers.size());
+  std::vector<bool> retired(buffers.size());
+  std::vector<Cursor*> heap;
+  for (size_t i = 0; i < buffers.size(); ++i)
+  {
+    retired[i] = buffers[i]->retired();
+    Cursor& cursor = cursors[i];
+    buffers[i]->collect(&cursor.pieces);
+    if (!cursor.pieces.empty())
+    {
+      cursor.piece = 0;
+      cursor.record = cursor.pieces[0].data();
+      cursor.load();
+      heap.push_back(&cursor);
+    }
+  }
+
+  auto later = [](const Cursor* lhs, const Cursor* rhs) { return *lhs > *rhs; };
+  std::make_heap(heap.begin(), heap.end(), later);
+  while (!heap.empty())
+  {
+    std::pop_heap(heap.begin(), heap.end(), later);
+    Cursor* cursor = heap.back();
+    int32_t length = 0;
+    memcpy(&length, cursor->record + sizeof(int64_t), sizeof length);
+    write(output, cursor->record + kRecordHeader, length);
+    cursor->record += kRecordHeader + length;
+    if (cursor->load())
+    {
+      std::push_heap(heap.begin(), heap.end(), later);
+    }
+    else
+    {
+      heap.pop_back();
+    }
+  }
+
+  for (const auto& buffer : buffers)
+  {
+    buffer->release();
+  }
+
+  for (const auto& buffer : overflow)
+  {
+    write(output, buffer->data(), buffer->length());
+  }
+
+  // whatever a retired thread appended has been written
+  muduo::MutexLockGuard lock(mutex_);
+  for (size_t i = 0; i < buffers.size(); ++i)
+  {
+    if (retired[i])
+    {
+      threadBuffers_.erase(std::find(threadBuffers_.begin(), threadBuffers_.end(), buffers[i]));
+    }
+  }
+}
@@ -14,11 +14,16 @@
 #include "muduo/base/LogStream.h"
 
 #include <atomic>
+#include <functional>
+#include <memory>
 #include <vector>
 
 namespace muduo
 {
 
+class LogDecoder;
+class LogFile;
+
 class AsyncLogging : noncopyable
 {
 public:
@@ -26,16 +31,32 @@ public:
                  off_t rollSize,
                  int flushInterval = 3);
 
-    ~AsyncLogging()
-    {
-        if (running_)
-        {
-            stop();
-        }
-    }
+    ~AsyncLogging();
 
     void append(const char *logline, int len);
 
+    /// Each thread appends to its own ring of buffers without locking, the
+    /// background thread harvests them and merges the lines by time.
+    /// While the ring of a thread is full, its lines go to the shared
+    /// buffer, and may be out of order.
+    /// Must be called before start().
+    void setPerThreadBuffers(bool on) { perThreadBuffers_ = on; }
+
+    /// Formats the records of Logger::kBinary in the background thread,
+    /// instead of writing them as they are for LogDecoder later.
+    /// Must be called before start().
+    void setDecoding(bool on);
+
+    /// See LogFile::setDirectIo() and LogFile::setRollCallback(), the
+    /// callback runs in the background thread.
+    /// Must be called before start().
+    void setDirectIo(bool on) { directIo_ = on; }
+    void setRollCallback(const std::function<void (const string &)> &cb)
+    { rollCallback_ = cb; }
+
+    /// Lines which went to the shared buffer with per-thread buffers.
+    int64_t overflowLines() const { return overflowLines_.load(std::memory_order_relaxed); }
+
     void start()
     {
         running_ = true;
@@ -51,7 +72,18 @@ public:
     }
 
 private:
+    class ThreadBuffer;
+    typedef std::shared_ptr<ThreadBuffer> ThreadBufferPtr;
+
     void threadFunc();
+    void threadFuncPerThread();
+    void appendShared(const char *logline, int len);
+    void appendPerThread(const char *logline, int len);
+    ThreadBuffer *threadBuffer();
+    void wakeUp();
+    void harvest(LogFile *output);
+    void write(LogFile *output, const char *data, int len);
+    void setUp(LogFile *output);
 
     typedef muduo::detail::FixedBuffer<muduo::detail::kLargeBuffer> Buffer;
     typedef std::vector<std::unique_ptr<Buffer>> BufferVector;
@@ -68,6 +100,17 @@ private:
     BufferPtr currentBuffer_ GUARDED_BY(mutex_); // 当前缓冲区
     BufferPtr nextBuffer_ GUARDED_BY(mutex_);    // 备用缓冲区
     BufferVector buffers_ GUARDED_BY(mutex_);    // 待写入文件的以填满的缓冲
+
+    std::unique_ptr<LogDecoder> decoder_;  // in the background thread
+    bool directIo_;
+    std::function<void (const string &)> rollCallback_;
+
+    // per-thread buffers
+    bool perThreadBuffers_;
+    const uint64_t id_;
+    std::vector<ThreadBufferPtr> threadBuffers_ GUARDED_BY(mutex_);
+    std::atomic<bool> harvestRequested_;
+    std::atomic<int64_t> overflowLines_;
 };
 
 } // namespace muduo
@@ -0,0 +1,292 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#ifndef MUDUO_BASE_BOUNDEDMPMCQUEUE_H
+#define MUDUO_BASE_BOUNDEDMPMCQUEUE_H
+
+#include "muduo/base/noncopyable.h"
+
+#include <atomic>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <assert.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace muduo
+{
+
+///
+/// Lock-free bounded multi-producer multi-consumer queue, after Dmitry
+/// Vyukov's, with the interface of BoundedBlockingQueue.
+///
+/// Every cell has a sequence number telling whether it is ready for the
+/// producer or the consumer of this round, so producers and consumers
+/// contend only on their own position, each on its own cache line.
+/// tryPut() and tryTake() don't block, put() and take() spin for a while,
+/// yield a few times, then sleep on a futex, woken only if somebody is
+/// sleeping.
+///
+/// The capacity is rounded up to a power of 2. T must be default
+/// constructible, and movable.
+///
+template<typename T>
+class BoundedMpmcQueue : noncopyable
+{
+ public:
+  explicit BoundedMpmcQueue(int maxSize)
+    : mask_(roundUp(maxSize) - 1),
+      cells_(new Cell[mask_ + 1]),
+      enqueuePos_(0),
+      dequeuePos_(0),
+      notEmptyWaiters_(0),
+      notEmptySeq_(0),
+      notFullWaiters_(0),
+      notFullSeq_(0)
+  {
+    for (size_t i = 0; i <= mask_; ++i)
+    {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  ~BoundedMpmcQueue()
+  {
+    T x;
+    while (tryTake(&x))
+    {
+    }
+    delete[] cells_;
+  }
+
+  void put(const T& x)
+  {
+    T copy(x);
+    put(std::move(copy));
+  }
+
+  void put(T&& x)
+  {
+    for (int spin = 0; !tryPut(std::move(x)); ++spin)
+    {
+      if (spin < kSpins + kYields)
+      {
+        backoff(spin);
+      }
+      else
+      {
+        wait(notFullWaiters_, notFullSeq_, [this, &x] { return tryPut(std::move(x)); });
+        break;
+      }
+    }
+    wake(notEmptyWaiters_, notEmptySeq_);
+  }
+
+  T take()
+  {
+    T x;
+    for (int spin = 0; !tryTake(&x); ++spin)
+    {
+      if (spin < kSpins + kYields)
+      {
+        backoff(spin);
+      }
+      else
+      {
+        wait(notEmptyWaiters_, notEmptySeq_, [this, &x] { return tryTake(&x); });
+        break;
+      }
+    }
+    wake(notFullWaiters_, notFullSeq_);
+    return x;
+  }
+
+  /// Returns false if full, x is not moved from then.
+  bool tryPut(T&& x)
+  {
+    size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+    Cell* cell = NULL;
+    while (true)
+    {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0)
+      {
+        if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          break;
+        }
+      }
+      else if (diff < 0)
+      {
+        return false;
+      }
+      else
+      {
+        pos = enqueuePos_.load(std::memory_order_relaxed);
+      }
+    }
+    new (&cell->storage) T(std::move(x));
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool tryPut(const T& x)
+  {
+    T copy(x);
+    return tryPut(std::move(copy));
+  }
+
+  /// Returns false if empty.
+  bool tryTake(T* x)
+  {
+    size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+    Cell* cell = NULL;
+    while (true)
+    {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0)
+      {
+        if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          break;
+        }
+      }
+      else if (diff < 0)
+      {
+        return false;
+      }
+      else
+      {
+        pos = dequeuePos_.load(std::memory_order_relaxed);
+      }
+    }
+    T* value = reinterpret_cast<T*>(&cell->storage);
+    *x = std::move(*value);
+    value->~T();
+    cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool empty() const
+  {
+    return size() == 0;
+  }
+
+  bool full() const
+  {
+    return size() >= capacity();
+  }
+
+  // approximate while others put or take
+  size_t size() const
+  {
+    size_t dequeue = dequeuePos_.load(std::memory_order_acquire);
+    size_t enqueue = enqueuePos_.load(std::memory_order_acquire);
+    return enqueue > dequeue ? enqueue - dequeue : 0;
+  }
+
+  size_t capacity() const
+  {
+    return mask_ + 1;
+  }
+
+ private:
+  static const size_t kCacheLine = 64;
+  static const int kSpins = 128;
+  static const int kYields = 16;
+
+  struct Cell
+  {
+    std::atomic<size_t> sequence;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+  };
+
+  static size_t roundUp(int maxSize)
+  {
+    assert(maxSize > 0);
+    size_t size = 1;
+    while (size < static_cast<size_t>(maxSize))
+    {
+      size <<= 1;
+    }
+    return size;
+  }
+
+  // spins, then lets the other side run if it shares the CPU
+  static void backoff(int spin)
+  {
+    if (spin < kSpins)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#endif
+    }
+    else
+    {
+      ::sched_yield();
+    }
+  }
+
+  // sleeps on seq until ready() returns true, an eventcount
+  template<typename Ready>
+  static void wait(std::atomic<int>& waiters, std::atomic<uint32_t>& seq, Ready ready)
+  {
+    while (true)
+    {
+      uint32_t key = seq.load(std::memory_order_acquire);
+      waiters.fetch_add(1);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (ready())
+      {
+        waiters.fetch_sub(1);
+        return;
+      }
+      ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&seq), FUTEX_WAIT_PRIVATE,
+                key, NULL, NULL, 0);
+      waiters.fetch_sub(1);
+    }
+  }
+
+  // after a put or take which ready() of the waiters would see
+  static void wake(std::atomic<int>& waiters, std::atomic<uint32_t>& seq)
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters.load(std::memory_order_relaxed) > 0)
+    {
+      seq.fetch_add(1, std::memory_order_release);
+      ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&seq), FUTEX_WAKE_PRIVATE,
+                1, NULL, NULL, 0);
+    }
+  }
+
+  // each position and each pair of waiters and seq on its own cache line
+  const size_t mask_;
+  Cell* const cells_;
+  char pad0_[kCacheLine - sizeof(size_t) - sizeof(Cell*)];
+  std::atomic<size_t> enqueuePos_;
+  char pad1_[kCacheLine - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> dequeuePos_;
+  char pad2_[kCacheLine - sizeof(std::atomic<size_t>)];
+  std::atomic<int> notEmptyWaiters_;
+  std::atomic<uint32_t> notEmptySeq_;
+  char pad3_[kCacheLine - sizeof(std::atomic<int>) - sizeof(std::atomic<uint32_t>)];
+  std::atomic<int> notFullWaiters_;
+  std::atomic<uint32_t> notFullSeq_;
+  char pad4_[kCacheLine - sizeof(std::atomic<int>) - sizeof(std::atomic<uint32_t>)];
+};
+
+}  // namespace muduo
+
+#endif  // MUDUO_BASE_BOUNDEDMPMCQUEUE_H
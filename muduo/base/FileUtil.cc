@@ -4,21 +4,257 @@
 // Author: Shuo Chen (chenshuo at chenshuo dot com)
 
 #include "muduo/base/FileUtil.h"
+#include "muduo/base/Condition.h"
 #include "muduo/base/Logging.h"
+#include "muduo/base/Mutex.h"
+#include "muduo/base/Thread.h"
+
+#include <algorithm>
+#include <deque>
+#include <vector>
 
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
 using namespace muduo;
 
-FileUtil::AppendFile::AppendFile(StringArg filename)
-  : fp_(::fopen(filename.c_str(), "ae")),  // 'e' for O_CLOEXEC
+// Chunks of kBufferSize go round between the appending thread and the
+// writer thread. A chunk begins at an aligned offset of the file, its
+// aligned part is written with O_DIRECT, the rest through the page cache,
+// and copied to the beginning of the next chunk, to be written again with
+// the bytes following it.
+class FileUtil::AppendFile::DirectWriter : noncopyable
+{
+ public:
+  static const size_t kAlignment = 4096;
+  static const size_t kBufferSize = 1024 * 1024;
+  static const int kNumBuffers = 4;
+
+  explicit DirectWriter(StringArg filename)
+    : fd_(::open(filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666)),
+      directFd_(::open(filename.c_str(), O_WRONLY | O_DIRECT | O_CLOEXEC)),
+      offset_(0),
+      carried_(0),
+      current_(NULL),
+      thread_(std::bind(&DirectWriter::threadFunc, this), "DirectWriter"),
+      notEmpty_(mutex_),
+      notFull_(mutex_)
+  {
+    assert(fd_ >= 0);
+    for (int i = 0; i < kNumBuffers; ++i)
+    {
+      void* data = NULL;
+      if (::posix_memalign(&data, kAlignment, kBufferSize) != 0)
+      {
+        abort();
+      }
+      chunks_.push_back(Chunk(static_cast<char*>(data)));
+    }
+    for (Chunk& chunk : chunks_)
+    {
+      free_.push_back(&chunk);
+    }
+    current_ = free_.back();
+    free_.pop_back();
+
+    // appends to an existing file from its last aligned offset
+    struct stat statbuf;
+    if (::fstat(fd_, &statbuf) == 0)
+    {
+      offset_ = statbuf.st_size & ~static_cast<off_t>(kAlignment - 1);
+      size_t tail = static_cast<size_t>(statbuf.st_size - offset_);
+      if (::pread(fd_, current_->data, tail, offset_) == static_cast<ssize_t>(tail))
+      {
+        current_->length = carried_ = tail;
+      }
+      else
+      {
+        offset_ = statbuf.st_size;
+        ::close(directFd_);
+        directFd_ = -1;
+      }
+    }
+    thread_.start();
+  }
+
+  ~DirectWriter()
+  {
+    flush();
+    {
+      MutexLockGuard lock(mutex_);
+      queue_.push_back(NULL);
+    }
+    notEmpty_.notify();
+    thread_.join();
+    for (Chunk& chunk : chunks_)
+    {
+      ::free(chunk.data);
+    }
+    if (directFd_ >= 0)
+    {
+      ::close(directFd_);
+    }
+    ::close(fd_);
+  }
+
+  void append(const char* data, size_t len)
+  {
+    while (len > 0)
+    {
+      size_t n = std::min(len, kBufferSize - current_->length);
+      ::memcpy(current_->data + current_->length, data, n);
+      current_->length += n;
+      data += n;
+      len -= n;
+      if (current_->length == kBufferSize)
+      {
+        submit();
+      }
+    }
+  }
+
+  void flush()
+  {
+    if (current_->length > carried_)
+    {
+      submit();
+    }
+  }
+
+ private:
+  struct Chunk
+  {
+    explicit Chunk(char* d)
+      : data(d), length(0), offset(0)
+    {
+    }
+
+    char* data;  // kBufferSize, aligned
+    size_t length;
+    off_t offset;  // in the file, aligned
+  };
+
+  void submit()
+  {
+    Chunk* chunk = current_;
+    chunk->offset = offset_;
+    {
+      MutexLockGuard lock(mutex_);
+      while (free_.empty())
+      {
+        notFull_.wait();
+      }
+      current_ = free_.back();
+      free_.pop_back();
+    }
+    size_t aligned = chunk->length & ~(kAlignment - 1);
+    carried_ = chunk->length - aligned;
+    ::memcpy(current_->data, chunk->data + aligned, carried_);
+    current_->length = carried_;
+    offset_ += static_cast<off_t>(aligned);
+    {
+      MutexLockGuard lock(mutex_);
+      queue_.push_back(chunk);
+    }
+    notEmpty_.notify();
+  }
+
+  void threadFunc()
+  {
+    while (true)
+    {
+      Chunk* chunk = NULL;
+      {
+        MutexLockGuard lock(mutex_);
+        while (queue_.empty())
+        {
+          notEmpty_.wait();
+        }
+        chunk = queue_.front();
+        queue_.pop_front();
+      }
+      if (chunk == NULL)
+      {
+        break;
+      }
+      write(*chunk);
+      chunk->length = 0;
+      {
+        MutexLockGuard lock(mutex_);
+        free_.push_back(chunk);
+      }
+      notFull_.notify();
+    }
+  }
+
+  void write(const Chunk& chunk)
+  {
+    size_t direct = directFd_ >= 0 ? chunk.length & ~(kAlignment - 1) : 0;
+    if (direct > 0 && !writeAll(directFd_, chunk.data, direct, chunk.offset))
+    {
+      // e.g. EINVAL if the file system wants a larger alignment
+      ::close(directFd_);
+      directFd_ = -1;
+      direct = 0;
+    }
+    if (!writeAll(fd_, chunk.data + direct, chunk.length - direct,
+                  chunk.offset + static_cast<off_t>(direct)))
+    {
+      fprintf(stderr, "AppendFile::append() failed %s\n", strerror_tl(errno));
+    }
+  }
+
+  static bool writeAll(int fd, const char* data, size_t len, off_t offset)
+  {
+    while (len > 0)
+    {
+      ssize_t n = ::pwrite(fd, data, len, offset);
+      if (n < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (n <= 0)
+      {
+        return false;
+      }
+      data += n;
+      len -= static_cast<size_t>(n);
+      offset += n;
+    }
+    return true;
+  }
+
+  const int fd_;
+  int directFd_;  // -1 if O_DIRECT is not supported, in the writer thread
+  // in the appending thread
+  off_t offset_;  // of current_
+  size_t carried_;  // from the previous chunk, written already
+  Chunk* current_;
+
+  std::vector<Chunk> chunks_;
+  Thread thread_;
+  MutexLock mutex_;
+  Condition notEmpty_ GUARDED_BY(mutex_);
+  Condition notFull_ GUARDED_BY(mutex_);
+  std::deque<Chunk*> queue_ GUARDED_BY(mutex_);  // NULL to stop
+  std::vector<Chunk*> free_ GUARDED_BY(mutex_);
+};
+
+FileUtil::AppendFile::AppendFile(StringArg filename, bool directIo)
+  : fp_(directIo ? NULL : ::fopen(filename.c_str(), "ae")),  // 'e' for O_CLOEXEC
     writtenBytes_(0)
 {
+  if (directIo)
+  {
+    writer_.reset(new DirectWriter(filename));
+    return;
+  }
   assert(fp_);
   ::setbuffer(fp_, buffer_, sizeof buffer_);
   // posix_fadvise POSIX_FADV_DONTNEED ?
@@ -26,11 +262,20 @@ FileUtil::AppendFile::AppendFile(StringArg filename)
 
 FileUtil::AppendFile::~AppendFile()
 {
-  ::fclose(fp_);
+  if (fp_)
+  {
+    ::fclose(fp_);
+  }
 }
 
 void FileUtil::AppendFile::append(const char* logline, const size_t len)
 {
+  if (writer_)
+  {
+    writer_->append(logline, len);
+    writtenBytes_ += len;
+    return;
+  }
   size_t n = write(logline, len);
   size_t remain = len - n;
   while (remain > 0)
@@ -54,6 +299,11 @@ void FileUtil::AppendFile::append(const char* logline, const size_t len)
 
 void FileUtil::AppendFile::flush()
 {
+  if (writer_)
+  {
+    writer_->flush();
+    return;
+  }
   ::fflush(fp_);
 }
 
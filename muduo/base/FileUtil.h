@@ -10,6 +10,9 @@
 
 #include "muduo/base/noncopyable.h"
 #include "muduo/base/StringPiece.h"
+
+#include <memory>
+
 #include <sys/types.h>  // for off_t
 
 namespace muduo
@@ -63,7 +66,11 @@ int readFile(StringArg filename,
 class AppendFile : noncopyable
 {
  public:
-  explicit AppendFile(StringArg filename);
+  /// With directIo, append() and flush() hand the data to a writer thread,
+  /// which writes it in 1MiB aligned blocks, with O_DIRECT if the file
+  /// system supports it. They wait for the disk only when the writer is
+  /// behind by all of its buffers.
+  explicit AppendFile(StringArg filename, bool directIo = false);
 
   ~AppendFile();
 
@@ -74,12 +81,14 @@ class AppendFile : noncopyable
   off_t writtenBytes() const { return writtenBytes_; }
 
  private:
+  class DirectWriter;
 
   size_t write(const char* logline, size_t len);
 
   FILE* fp_;
   char buffer_[64*1024];
   off_t writtenBytes_;
+  std::unique_ptr<DirectWriter> writer_;  // directIo
 };
 
 }  // namespace FileUtil
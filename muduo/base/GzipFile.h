@@ -57,6 +57,14 @@ class GzipFile : noncopyable
 
   // int flush(int f) { return ::gzflush(file_, f); }
 
+  // return Z_OK if all was written
+  int close()
+  {
+    int err = ::gzclose(file_);
+    file_ = NULL;
+    return err;
+  }
+
   static GzipFile openForRead(StringArg filename)
   {
     return GzipFile(::gzopen(filename.c_str(), "rbe"));
@@ -0,0 +1,116 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include "muduo/base/LogCompressor.h"
+
+#include "muduo/base/GzipFile.h"
+#include "muduo/base/Logging.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+using namespace muduo;
+
+LogCompressor::LogCompressor()
+  : thread_(std::bind(&LogCompressor::threadFunc, this), "LogCompressor"),
+    compressedFiles_(0),
+    failedFiles_(0)
+{
+  thread_.start();
+}
+
+LogCompressor::~LogCompressor()
+{
+  queue_.put(string());
+  thread_.join();
+}
+
+void LogCompressor::compress(const string& filename)
+{
+  if (!filename.empty())
+  {
+    queue_.put(filename);
+  }
+}
+
+bool LogCompressor::compressFile(const string& filename)
+{
+  int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    fprintf(stderr, "LogCompressor: open %s failed %s\n", filename.c_str(), strerror_tl(errno));
+    return false;
+  }
+  const string gzname = filename + ".gz";
+  GzipFile gz = GzipFile::openForWriteExclusive(gzname);
+  if (!gz.valid())
+  {
+    fprintf(stderr, "LogCompressor: open %s failed %s\n", gzname.c_str(), strerror_tl(errno));
+    ::close(fd);
+    return false;
+  }
+#if ZLIB_VERNUM >= 0x1240
+  gz.setBuffer(64 * 1024);
+#endif
+
+  bool ok = true;
+  char buf[64 * 1024];
+  ssize_t n = 0;
+  while ((n = ::read(fd, buf, sizeof buf)) != 0)
+  {
+    if (n < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      ok = false;
+      break;
+    }
+    if (gz.write(StringPiece(buf, static_cast<int>(n))) != n)
+    {
+      ok = false;
+      break;
+    }
+  }
+  ::close(fd);
+  if (gz.close() != Z_OK)
+  {
+    ok = false;
+  }
+
+  if (ok)
+  {
+    ::unlink(filename.c_str());
+  }
+  else
+  {
+    fprintf(stderr, "LogCompressor: compressing %s failed\n", filename.c_str());
+    ::unlink(gzname.c_str());
+  }
+  return ok;
+}
+
+void LogCompressor::threadFunc()
+{
+  while (true)
+  {
+    string filename = queue_.take();
+    if (filename.empty())
+    {
+      break;
+    }
+    if (compressFile(filename))
+    {
+      compressedFiles_.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+      failedFiles_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+}
@@ -0,0 +1,55 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#ifndef MUDUO_BASE_LOGCOMPRESSOR_H
+#define MUDUO_BASE_LOGCOMPRESSOR_H
+
+#include "muduo/base/BlockingQueue.h"
+#include "muduo/base/Thread.h"
+#include "muduo/base/Types.h"
+
+#include <atomic>
+
+namespace muduo
+{
+
+///
+/// Compresses rolled log files to filename.gz with GzipFile in a
+/// background thread, then removes them, so the logging thread waits
+/// neither for zlib nor for the disk. Built if zlib is found.
+///
+/// @code
+/// LogCompressor compressor;
+/// log.setRollCallback([&compressor](const string& f) { compressor.compress(f); });
+/// @endcode
+///
+/// Thread safe.
+class LogCompressor : noncopyable
+{
+ public:
+  LogCompressor();
+  /// Compresses the files queued, then stops.
+  ~LogCompressor();
+
+  void compress(const string& filename);
+
+  /// In the calling thread. Leaves filename as it is on failure.
+  static bool compressFile(const string& filename);
+
+  int64_t compressedFiles() const { return compressedFiles_.load(std::memory_order_relaxed); }
+  int64_t failedFiles() const { return failedFiles_.load(std::memory_order_relaxed); }
+
+ private:
+  void threadFunc();
+
+  BlockingQueue<string> queue_;  // empty to stop
+  Thread thread_;
+  std::atomic<int64_t> compressedFiles_;
+  std::atomic<int64_t> failedFiles_;
+};
+
+}  // namespace muduo
+
+#endif  // MUDUO_BASE_LOGCOMPRESSOR_H
@@ -0,0 +1,214 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include "muduo/base/LogDecoder.h"
+
+#include "muduo/base/Logging.h"
+#include "muduo/base/Timestamp.h"
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace muduo;
+
+namespace
+{
+
+template <typename T>
+bool read(const char** p, const char* end, T* value)
+{
+  if (end - *p < static_cast<ptrdiff_t>(sizeof(T)))
+  {
+    return false;
+  }
+  memcpy(value, *p, sizeof(T));
+  *p += sizeof(T);
+  return true;
+}
+
+bool readString(const char** p, const char* end, string* value)
+{
+  uint16_t len = 0;
+  if (!read(p, end, &len) || end - *p < len)
+  {
+    return false;
+  }
+  value->assign(*p, len);
+  *p += len;
+  return true;
+}
+
+}  // namespace
+
+LogDecoder::LogDecoder()
+  : errors_(0)
+{
+}
+
+size_t LogDecoder::decode(const char* data, size_t len, const OutputCallback& output)
+{
+  const char* p = data;
+  const char* end = data + len;
+  uint32_t size = 0;
+  uint32_t site = 0;
+  while (end - p >= static_cast<ptrdiff_t>(sizeof size + sizeof site))
+  {
+    memcpy(&size, p, sizeof size);
+    memcpy(&site, p + sizeof size, sizeof site);
+    if (size < sizeof size + sizeof site)
+    {
+      // can't find the next record
+      ++errors_;
+      return len;
+    }
+    if (size > static_cast<size_t>(end - p))
+    {
+      break;
+    }
+    const char* body = p + sizeof size + sizeof site;
+    p += size;
+    if (site & kDefinition)
+    {
+      if (!decodeDefinition(site & ~kDefinition, body, p))
+      {
+        ++errors_;
+      }
+    }
+    else if (site < sites_.size() && sites_[site].level >= 0)
+    {
+      stream_.resetBuffer();
+      if (decodeLine(body, p, sites_[site]))
+      {
+        output(stream_.buffer().data(), stream_.buffer().length());
+      }
+      else
+      {
+        ++errors_;
+      }
+    }
+    else
+    {
+      ++errors_;
+    }
+  }
+  return static_cast<size_t>(p - data);
+}
+
+bool LogDecoder::decodeDefinition(uint32_t id, const char* p, const char* end)
+{
+  Site site;
+  int32_t level = 0;
+  int32_t line = 0;
+  if (!read(&p, end, &level) || !read(&p, end, &line) ||
+      !readString(&p, end, &site.file) || !readString(&p, end, &site.func) ||
+      level < 0 || level >= Logger::NUM_LOG_LEVELS)
+  {
+    return false;
+  }
+  site.level = level;
+  site.line = line;
+  if (id >= sites_.size())
+  {
+    sites_.resize(id + 1);
+  }
+  sites_[id] = site;
+  return true;
+}
+
+// as Logger::Impl formats a kText line
+bool LogDecoder::decodeLine(const char* p, const char* end, const Site& site)
+{
+  int64_t microSecondsSinceEpoch = 0;
+  int32_t tid = 0;
+  int32_t savedErrno = 0;
+  if (!read(&p, end, &microSecondsSinceEpoch) || !read(&p, end, &tid) ||
+      !read(&p, end, &savedErrno))
+  {
+    return false;
+  }
+  Logger::formatTime(stream_, Timestamp(microSecondsSinceEpoch));
+  char buf[32];
+  int n = snprintf(buf, sizeof buf, "%5d ", tid);
+  stream_.append(buf, n);
+  stream_.append(Logger::levelName(static_cast<Logger::LogLevel>(site.level)), 6);
+  if (savedErrno != 0)
+  {
+    stream_ << strerror_tl(savedErrno) << " (errno=" << savedErrno << ") ";
+  }
+  if (!site.func.empty())
+  {
+    stream_ << site.func << ' ';
+  }
+
+  while (p < end)
+  {
+    char tag = *p++;
+    bool ok = false;
+    switch (tag)
+    {
+      case LogStream::kBool:
+      {
+        bool v = false;
+        ok = read(&p, end, &v);
+        stream_ << v;
+        break;
+      }
+      case LogStream::kChar:
+      {
+        char v = 0;
+        ok = read(&p, end, &v);
+        stream_ << v;
+        break;
+      }
+      case LogStream::kInt64:
+      {
+        int64_t v = 0;
+        ok = read(&p, end, &v);
+        stream_ << v;
+        break;
+      }
+      case LogStream::kUInt64:
+      {
+        uint64_t v = 0;
+        ok = read(&p, end, &v);
+        stream_ << v;
+        break;
+      }
+      case LogStream::kDouble:
+      {
+        double v = 0;
+        ok = read(&p, end, &v);
+        stream_ << v;
+        break;
+      }
+      case LogStream::kPointer:
+      {
+        uint64_t v = 0;
+        ok = read(&p, end, &v);
+        stream_ << reinterpret_cast<const void*>(static_cast<uintptr_t>(v));
+        break;
+      }
+      case LogStream::kString:
+      {
+        uint32_t len = 0;
+        ok = read(&p, end, &len) && static_cast<size_t>(end - p) >= len;
+        if (ok)
+        {
+          stream_.append(p, static_cast<int>(len));
+          p += len;
+        }
+        break;
+      }
+      default:
+        break;
+    }
+    if (!ok)
+    {
+      return false;
+    }
+  }
+  stream_ << " - " << site.file << ':' << site.line << '\n';
+  return true;
+}
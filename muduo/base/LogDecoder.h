@@ -0,0 +1,70 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#ifndef MUDUO_BASE_LOGDECODER_H
+#define MUDUO_BASE_LOGDECODER_H
+
+#include "muduo/base/LogStream.h"
+#include "muduo/base/Types.h"
+
+#include <functional>
+#include <vector>
+
+#include <stdint.h>
+
+namespace muduo
+{
+
+///
+/// Formats the records of Logger::kBinary into the lines of Logger::kText.
+///
+/// Every record begins with uint32_t size, of the whole record, and
+/// uint32_t site, then, in host byte order:
+///  - a line: int64_t microSecondsSinceEpoch, int32_t tid, int32_t errno,
+///    then the arguments, see LogStream::BinaryTag.
+///  - if site has kDefinition set, a call site: int32_t level, int32_t line,
+///    uint16_t length and the source file, uint16_t length and the function.
+///
+/// A thread defines a site before its first line from there, so a log is
+/// decoded from the beginning, or all of its files in order.
+///
+class LogDecoder : noncopyable
+{
+ public:
+  static const uint32_t kDefinition = 0x80000000;
+
+  typedef std::function<void (const char* line, int len)> OutputCallback;
+
+  LogDecoder();
+
+  /// Formats the whole records at the beginning of [data, data+len),
+  /// one call of output per line. Returns the bytes consumed.
+  size_t decode(const char* data, size_t len, const OutputCallback& output);
+
+  /// Records which could not be decoded, they are skipped.
+  int64_t errors() const { return errors_; }
+
+ private:
+  struct Site
+  {
+    Site() : level(-1), line(0) {}
+
+    int level;
+    int line;
+    string file;
+    string func;
+  };
+
+  bool decodeLine(const char* p, const char* end, const Site& site);
+  bool decodeDefinition(uint32_t id, const char* p, const char* end);
+
+  std::vector<Site> sites_;  // by id
+  LogStream stream_;
+  int64_t errors_;
+};
+
+}  // namespace muduo
+
+#endif  // MUDUO_BASE_LOGDECODER_H
@@ -27,7 +27,8 @@ LogFile::LogFile(const string& basename,
     mutex_(threadSafe ? new MutexLock : NULL),
     startOfPeriod_(0),
     lastRoll_(0),
-    lastFlush_(0)
+    lastFlush_(0),
+    directIo_(false)
 {
   assert(basename.find('/') == string::npos);
   rollFile();
@@ -35,6 +36,12 @@ LogFile::LogFile(const string& basename,
 
 LogFile::~LogFile() = default;
 
+void LogFile::setDirectIo(bool on)
+{
+  directIo_ = on;
+  file_.reset(new FileUtil::AppendFile(filename_, directIo_));
+}
+
 void LogFile::append(const char* logline, int len)
 {
   if (mutex_)
@@ -101,7 +108,12 @@ bool LogFile::rollFile()
     lastRoll_ = now;
     lastFlush_ = now;
     startOfPeriod_ = start;
-    file_.reset(new FileUtil::AppendFile(filename));
+    file_.reset(new FileUtil::AppendFile(filename, directIo_));
+    filename_.swap(filename);
+    if (rollCallback_ && !filename.empty())
+    {
+      rollCallback_(filename);
+    }
     return true;
   }
   return false;
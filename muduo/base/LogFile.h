@@ -9,6 +9,7 @@
 #include "muduo/base/Mutex.h"
 #include "muduo/base/Types.h"
 
+#include <functional>
 #include <memory>
 
 namespace muduo
@@ -22,6 +23,8 @@ class AppendFile;
 class LogFile : noncopyable
 {
  public:
+  typedef std::function<void (const string& filename)> RollCallback;
+
   LogFile(const string& basename,
           off_t rollSize,
           bool threadSafe = true,
@@ -33,6 +36,13 @@ class LogFile : noncopyable
   void flush();
   bool rollFile();
 
+  /// Appends with the writer thread of FileUtil::AppendFile, in large
+  /// aligned writes. Must be called before the first append().
+  void setDirectIo(bool on);
+  /// Called with the name of the previous file after it is rolled and
+  /// closed, in the appending thread, e.g. to LogCompressor::compress() it.
+  void setRollCallback(const RollCallback& cb) { rollCallback_ = cb; }
+
  private:
   void append_unlocked(const char* logline, int len);
 
@@ -49,6 +59,9 @@ class LogFile : noncopyable
   time_t startOfPeriod_;
   time_t lastRoll_;
   time_t lastFlush_;
+  bool directIo_;
+  RollCallback rollCallback_;
+  string filename_;
   std::unique_ptr<FileUtil::AppendFile> file_;
 
   const static int kRollPerSeconds_ = 60*60*24;
@@ -86,6 +86,7 @@ size_t convertHex(char buf[], uintptr_t value)
 
 template class FixedBuffer<kSmallBuffer>;
 template class FixedBuffer<kLargeBuffer>;
+template class FixedBuffer<kThreadBuffer>;
 
 }  // namespace detail
 
@@ -236,6 +237,20 @@ void LogStream::staticCheck()
 template<typename T>
 void LogStream::formatInteger(T v)
 {
+  if (binary_)
+  {
+    if (std::is_signed<T>::value)
+    {
+      int64_t i = static_cast<int64_t>(v);
+      appendBinary(kInt64, &i, sizeof i);
+    }
+    else
+    {
+      uint64_t u = static_cast<uint64_t>(v);
+      appendBinary(kUInt64, &u, sizeof u);
+    }
+    return;
+  }
   if (buffer_.avail() >= kMaxNumericSize)
   {
     size_t len = convert(buffer_.current(), v);
@@ -291,9 +306,31 @@ LogStream& LogStream::operator<<(unsigned long long v)
   return *this;
 }
 
+void LogStream::appendBinaryString(const char* data, int len)
+{
+  // truncated to what fits
+  const int kHeader = 1 + static_cast<int>(sizeof(uint32_t));
+  int n = std::min(len, buffer_.avail() - kHeader - 1);
+  if (n >= 0)
+  {
+    char header[kHeader];
+    header[0] = static_cast<char>(kString);
+    uint32_t length = static_cast<uint32_t>(n);
+    memcpy(header + 1, &length, sizeof length);
+    buffer_.append(header, kHeader);
+    buffer_.append(data, n);
+  }
+}
+
 LogStream& LogStream::operator<<(const void* p)
 {
   uintptr_t v = reinterpret_cast<uintptr_t>(p);
+  if (binary_)
+  {
+    uint64_t u = v;
+    appendBinary(kPointer, &u, sizeof u);
+    return *this;
+  }
   if (buffer_.avail() >= kMaxNumericSize)
   {
     char* buf = buffer_.current();
@@ -308,6 +345,11 @@ LogStream& LogStream::operator<<(const void* p)
 // FIXME: replace this with Grisu3 by Florian Loitsch.
 LogStream& LogStream::operator<<(double v)
 {
+  if (binary_)
+  {
+    appendBinary(kDouble, &v, sizeof v);
+    return *this;
+  }
   if (buffer_.avail() >= kMaxNumericSize)
   {
     int len = snprintf(buffer_.current(), kMaxNumericSize, "%.12g", v);
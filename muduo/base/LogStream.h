@@ -20,6 +20,7 @@ namespace detail
 
 const int kSmallBuffer = 4000;
 const int kLargeBuffer = 4000 * 1000;
+const int kThreadBuffer = 64 * 1024;
 
 template <int SIZE>
 class FixedBuffer : noncopyable
@@ -47,6 +48,7 @@ public:
     }
 
     const char *data() const { return data_; }
+    char *data() { return data_; }
     int length() const { return static_cast<int>(cur_ - data_); }
 
     // write to data_ directly
@@ -84,8 +86,36 @@ class LogStream : noncopyable
 public:
     typedef detail::FixedBuffer<detail::kSmallBuffer> Buffer;
 
+    // tags of the arguments in binary mode, followed by the value in host
+    // byte order, strings by a uint32_t length then the bytes.
+    enum BinaryTag
+    {
+        kBool = 1,
+        kChar,
+        kInt64,
+        kUInt64,
+        kDouble,
+        kPointer,
+        kString,
+    };
+
+    LogStream()
+        : binary_(false)
+    {
+    }
+
+    /// Records every argument as a tag and its raw bytes instead of text,
+    /// see Logger::kBinary and LogDecoder.
+    void setBinary(bool on) { binary_ = on; }
+    bool binary() const { return binary_; }
+
     self &operator<<(bool v)
     {
+        if (binary_)
+        {
+            appendBinary(kBool, &v, sizeof v);
+            return *this;
+        }
         buffer_.append(v ? "1" : "0", 1);
         return *this;
     }
@@ -111,6 +141,11 @@ public:
 
     self &operator<<(char v)
     {
+        if (binary_)
+        {
+            appendBinary(kChar, &v, 1);
+            return *this;
+        }
         buffer_.append(&v, 1);
         return *this;
     }
@@ -122,11 +157,11 @@ public:
     {
         if (str)
         {
-            buffer_.append(str, strlen(str));
+            append(str, static_cast<int>(strlen(str)));
         }
         else
         {
-            buffer_.append("(null)", 6);
+            append("(null)", 6);
         }
         return *this;
     }
@@ -138,13 +173,13 @@ public:
 
     self &operator<<(const string &v)
     {
-        buffer_.append(v.c_str(), v.size());
+        append(v.c_str(), static_cast<int>(v.size()));
         return *this;
     }
 
     self &operator<<(const StringPiece &v)
     {
-        buffer_.append(v.data(), v.size());
+        append(v.data(), v.size());
         return *this;
     }
 
@@ -154,7 +189,25 @@ public:
         return *this;
     }
 
-    void append(const char *data, int len) { buffer_.append(data, len); }
+    // a string argument in binary mode
+    void append(const char *data, int len)
+    {
+        if (binary_)
+        {
+            appendBinaryString(data, len);
+            return;
+        }
+        buffer_.append(data, len);
+    }
+
+    // the same in both modes, for Logger
+    void appendRaw(const void *data, int len) { buffer_.append(static_cast<const char *>(data), len); }
+    void rewriteRaw(int offset, const void *data, int len)
+    {
+        assert(offset + len <= buffer_.length());
+        memcpy(buffer_.data() + offset, data, len);
+    }
+
     const Buffer &buffer() const { return buffer_; }
     void resetBuffer() { buffer_.reset(); }
 
@@ -164,7 +217,18 @@ private:
     template <typename T>
     void formatInteger(T);
 
+    // an argument is recorded whole or not at all
+    void appendBinary(BinaryTag tag, const void *data, int len)
+    {
+        char buf[16];
+        buf[0] = static_cast<char>(tag);
+        memcpy(buf + 1, data, len);
+        buffer_.append(buf, len + 1);
+    }
+    void appendBinaryString(const char *data, int len);
+
     Buffer buffer_;
+    bool binary_;
 
     static const int kMaxNumericSize = 32;
 };
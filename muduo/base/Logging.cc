@@ -6,6 +6,8 @@
 #include "muduo/base/Logging.h"
 
 #include "muduo/base/CurrentThread.h"
+#include "muduo/base/LogDecoder.h"
+#include "muduo/base/Mutex.h"
 #include "muduo/base/Timestamp.h"
 #include "muduo/base/TimeZone.h"
 
@@ -13,7 +15,10 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <atomic>
+#include <map>
 #include <sstream>
+#include <tuple>
 
 namespace muduo
 {
@@ -55,6 +60,8 @@ Logger::LogLevel initLogLevel()
 }
 
 Logger::LogLevel g_logLevel = initLogLevel();
+Logger::Format g_logFormat = Logger::kText;
+bool g_logCoarseClock = false;
 
 const char* LogLevelName[Logger::NUM_LOG_LEVELS] =
 {
@@ -109,17 +116,128 @@ Logger::OutputFunc g_output = defaultOutput;
 Logger::FlushFunc g_flush = defaultFlush;
 TimeZone g_logTimeZone;
 
+// "00" to "99"
+const char kDigitPairs[] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+inline void formatTwoDigits(char* buf, int value)
+{
+  memcpy(buf, kDigitPairs + value * 2, 2);
+}
+
+// "%4d%02d%02d %02d:%02d:%02d", 17 chars
+void formatSecond(const struct tm& tm_time, char* buf)
+{
+  int year = tm_time.tm_year + 1900;
+  formatTwoDigits(buf, year / 100);
+  formatTwoDigits(buf + 2, year % 100);
+  formatTwoDigits(buf + 4, tm_time.tm_mon + 1);
+  formatTwoDigits(buf + 6, tm_time.tm_mday);
+  buf[8] = ' ';
+  formatTwoDigits(buf + 9, tm_time.tm_hour);
+  buf[11] = ':';
+  formatTwoDigits(buf + 12, tm_time.tm_min);
+  buf[14] = ':';
+  formatTwoDigits(buf + 15, tm_time.tm_sec);
+}
+
+// The second formatted last by any thread, so that each thread doesn't
+// format it again. A seqlock: sequence is odd while it is written, and 0
+// until the first second.
+struct TimeCache
+{
+  std::atomic<uint32_t> sequence;
+  std::atomic<int64_t> second;
+  std::atomic<uint64_t> text[3];  // of formatSecond()
+};
+TimeCache g_timeCache;
+
+bool readTimeCache(time_t seconds, char* buf)
+{
+  uint32_t sequence = g_timeCache.sequence.load(std::memory_order_acquire);
+  if (sequence == 0 || (sequence & 1) ||
+      g_timeCache.second.load(std::memory_order_relaxed) != seconds)
+  {
+    return false;
+  }
+  uint64_t text[3];
+  for (int i = 0; i < 3; ++i)
+  {
+    text[i] = g_timeCache.text[i].load(std::memory_order_relaxed);
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (g_timeCache.sequence.load(std::memory_order_relaxed) != sequence)
+  {
+    return false;
+  }
+  memcpy(buf, text, 17);
+  return true;
+}
+
+void writeTimeCache(time_t seconds, const char* buf)
+{
+  uint32_t sequence = g_timeCache.sequence.load(std::memory_order_relaxed);
+  // one writer at a time, the others go on without
+  if ((sequence & 1) ||
+      seconds <= g_timeCache.second.load(std::memory_order_relaxed) ||
+      !g_timeCache.sequence.compare_exchange_strong(sequence, sequence + 1,
+                                                    std::memory_order_relaxed))
+  {
+    return;
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+  uint64_t text[3] = { 0 };
+  memcpy(text, buf, 17);
+  g_timeCache.second.store(seconds, std::memory_order_relaxed);
+  for (int i = 0; i < 3; ++i)
+  {
+    g_timeCache.text[i].store(text[i], std::memory_order_relaxed);
+  }
+  g_timeCache.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+// ids of call sites for kBinary
+struct SiteCacheEntry
+{
+  const char* file;
+  int line;
+  int level;
+  uint32_t id;
+};
+const int kSiteCacheSize = 256;
+__thread SiteCacheEntry t_siteCache[kSiteCacheSize];
+
+typedef std::tuple<const char*, int, int> SiteKey;
+MutexLock g_sitesMutex;
+std::map<SiteKey, uint32_t> g_sites GUARDED_BY(g_sitesMutex);
+
 }  // namespace muduo
 
 using namespace muduo;
 
-Logger::Impl::Impl(LogLevel level, int savedErrno, const SourceFile& file, int line)
-  : time_(Timestamp::now()),
+Logger::Impl::Impl(LogLevel level, int savedErrno, const SourceFile& file, int line,
+                   const char* func)
+  : time_(g_logCoarseClock ? Timestamp::nowCoarse() : Timestamp::now()),
     stream_(),
     level_(level),
     line_(line),
-    basename_(file)
+    basename_(file),
+    recordStart_(0)
 {
+  if (g_logFormat == kBinary)
+  {
+    beginRecord(savedErrno, func);
+    return;
+  }
   formatTime();
   CurrentThread::tid();
   stream_ << T(CurrentThread::tidString(), CurrentThread::tidStringLength());
@@ -128,48 +246,127 @@ Logger::Impl::Impl(LogLevel level, int savedErrno, const SourceFile& file, int l
   {
     stream_ << strerror_tl(savedErrno) << " (errno=" << savedErrno << ") ";
   }
+  if (func)
+  {
+    stream_ << func << ' ';
+  }
 }
 
 void Logger::Impl::formatTime()
 {
+  Logger::formatTime(stream_, time_);
+}
+
+// See LogDecoder.h for the records.
+void Logger::Impl::beginRecord(int savedErrno, const char* func)
+{
+  stream_.setBinary(true);
+  uintptr_t hash = (reinterpret_cast<uintptr_t>(basename_.data_) >> 3) * 31 +
+    static_cast<uintptr_t>(line_) * 8 + level_;
+  SiteCacheEntry& entry = t_siteCache[hash % kSiteCacheSize];
+  if (entry.file != basename_.data_ || entry.line != line_ || entry.level != level_)
+  {
+    uint32_t id;
+    {
+      MutexLockGuard lock(g_sitesMutex);
+      SiteKey key(basename_.data_, line_, level_);
+      id = g_sites.insert(std::make_pair(key, static_cast<uint32_t>(g_sites.size()))).first->second;
+    }
+    entry.file = basename_.data_;
+    entry.line = line_;
+    entry.level = level_;
+    entry.id = id;
+
+    // every thread defines a site before its first line from there,
+    // and again after the site is evicted from the cache
+    int start = stream_.buffer().length();
+    uint32_t size = 0;
+    uint32_t site = id | LogDecoder::kDefinition;
+    int32_t level = level_;
+    int32_t line = line_;
+    uint16_t fileLength = static_cast<uint16_t>(basename_.size_);
+    uint16_t funcLength = static_cast<uint16_t>(func ? strlen(func) : 0);
+    stream_.appendRaw(&size, sizeof size);
+    stream_.appendRaw(&site, sizeof site);
+    stream_.appendRaw(&level, sizeof level);
+    stream_.appendRaw(&line, sizeof line);
+    stream_.appendRaw(&fileLength, sizeof fileLength);
+    stream_.appendRaw(basename_.data_, fileLength);
+    stream_.appendRaw(&funcLength, sizeof funcLength);
+    stream_.appendRaw(func, funcLength);
+    size = static_cast<uint32_t>(stream_.buffer().length() - start);
+    stream_.rewriteRaw(start, &size, sizeof size);
+  }
+
+  recordStart_ = stream_.buffer().length();
+  uint32_t size = 0;
   int64_t microSecondsSinceEpoch = time_.microSecondsSinceEpoch();
+  int32_t tid = CurrentThread::tid();
+  int32_t error = savedErrno;
+  stream_.appendRaw(&size, sizeof size);
+  stream_.appendRaw(&entry.id, sizeof entry.id);
+  stream_.appendRaw(&microSecondsSinceEpoch, sizeof microSecondsSinceEpoch);
+  stream_.appendRaw(&tid, sizeof tid);
+  stream_.appendRaw(&error, sizeof error);
+}
+
+void Logger::formatTime(LogStream& stream, Timestamp time)
+{
+  int64_t microSecondsSinceEpoch = time.microSecondsSinceEpoch();
   time_t seconds = static_cast<time_t>(microSecondsSinceEpoch / Timestamp::kMicroSecondsPerSecond);
   int microseconds = static_cast<int>(microSecondsSinceEpoch % Timestamp::kMicroSecondsPerSecond);
   if (seconds != t_lastSecond)
   {
     t_lastSecond = seconds;
-    struct tm tm_time;
-    if (g_logTimeZone.valid())
+    if (!readTimeCache(seconds, t_time))
     {
-      tm_time = g_logTimeZone.toLocalTime(seconds);
+      struct tm tm_time;
+      if (g_logTimeZone.valid())
+      {
+        tm_time = g_logTimeZone.toLocalTime(seconds);
+      }
+      else
+      {
+        ::gmtime_r(&seconds, &tm_time); // FIXME TimeZone::fromUtcTime
+      }
+      formatSecond(tm_time, t_time);
+      writeTimeCache(seconds, t_time);
     }
-    else
-    {
-      ::gmtime_r(&seconds, &tm_time); // FIXME TimeZone::fromUtcTime
-    }
-
-    int len = snprintf(t_time, sizeof(t_time), "%4d%02d%02d %02d:%02d:%02d",
-        tm_time.tm_year + 1900, tm_time.tm_mon + 1, tm_time.tm_mday,
-        tm_time.tm_hour, tm_time.tm_min, tm_time.tm_sec);
-    assert(len == 17); (void)len;
   }
 
+  // ".%06d " or ".%06dZ "
+  char us[9];
+  us[0] = '.';
+  formatTwoDigits(us + 1, microseconds / 10000);
+  formatTwoDigits(us + 3, microseconds / 100 % 100);
+  formatTwoDigits(us + 5, microseconds % 100);
+  us[7] = 'Z';
+  us[8] = ' ';
+  stream.append(t_time, 17);
   if (g_logTimeZone.valid())
   {
-    Fmt us(".%06d ", microseconds);
-    assert(us.length() == 8);
-    stream_ << T(t_time, 17) << T(us.data(), 8);
+    us[7] = ' ';
+    stream.append(us, 8);
   }
   else
   {
-    Fmt us(".%06dZ ", microseconds);
-    assert(us.length() == 9);
-    stream_ << T(t_time, 17) << T(us.data(), 9);
+    stream.append(us, 9);
   }
 }
 
+const char* Logger::levelName(LogLevel level)
+{
+  return LogLevelName[level];
+}
+
 void Logger::Impl::finish()
 {
+  if (stream_.binary())
+  {
+    uint32_t size = static_cast<uint32_t>(stream_.buffer().length() - recordStart_);
+    stream_.rewriteRaw(recordStart_, &size, sizeof size);
+    return;
+  }
   stream_ << " - " << basename_ << ':' << line_ << '\n';
 }
 
@@ -179,9 +376,8 @@ Logger::Logger(SourceFile file, int line)
 }
 
 Logger::Logger(SourceFile file, int line, LogLevel level, const char* func)
-  : impl_(level, 0, file, line)
+  : impl_(level, 0, file, line, func)
 {
-  impl_.stream_ << func << ' ';
 }
 
 Logger::Logger(SourceFile file, int line, LogLevel level)
@@ -224,4 +420,17 @@ void Logger::setFlush(FlushFunc flush)
 void Logger::setTimeZone(const TimeZone& tz)
 {
   g_logTimeZone = tz;
+  g_timeCache.second.store(-1, std::memory_order_relaxed);
+  g_timeCache.sequence.store(0, std::memory_order_release);
+  t_lastSecond = 0;
+}
+
+void Logger::setCoarseClock(bool on)
+{
+  g_logCoarseClock = on;
+}
+
+void Logger::setFormat(Format format)
+{
+  g_logFormat = format;
 }
@@ -29,6 +29,14 @@ public:
         NUM_LOG_LEVELS,
     };
 
+    enum Format
+    {
+        kText,
+        // every line is a record of its call site and the raw arguments,
+        // formatted later by LogDecoder, e.g. in AsyncLogging.
+        kBinary,
+    };
+
     // compile time calculation of basename of source file
     class SourceFile
     {
@@ -77,14 +85,26 @@ public:
     static void setOutput(OutputFunc);
     static void setFlush(FlushFunc);
     static void setTimeZone(const TimeZone &tz);
+    /// Timestamps lines with Timestamp::nowCoarse(), for high rates of
+    /// logging which can do with milliseconds.
+    /// Not thread safe, call it before logging.
+    static void setCoarseClock(bool on);
+
+    static Format format();
+    /// Not thread safe, call it before logging.
+    static void setFormat(Format format);
 
 private:
+    friend class LogDecoder;
+
     class Impl
     {
     public:
         typedef Logger::LogLevel LogLevel;
-        Impl(LogLevel level, int old_errno, const SourceFile &file, int line);
+        Impl(LogLevel level, int old_errno, const SourceFile &file, int line,
+             const char *func = NULL);
         void formatTime();
+        void beginRecord(int savedErrno, const char *func);
         void finish();
 
         Timestamp time_;
@@ -92,18 +112,29 @@ private:
         LogLevel level_;
         int line_;
         SourceFile basename_;
+        int recordStart_;  // kBinary
     };
 
+    // as at the beginning of a kText line
+    static void formatTime(LogStream &stream, Timestamp time);
+    static const char *levelName(LogLevel level);
+
     Impl impl_;
 };
 
 extern Logger::LogLevel g_logLevel;
+extern Logger::Format g_logFormat;
 
 inline Logger::LogLevel Logger::logLevel()
 {
     return g_logLevel;
 }
 
+inline Logger::Format Logger::format()
+{
+    return g_logFormat;
+}
+
 //
 // CAUTION: do not write:
 //
@@ -0,0 +1,105 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#ifndef MUDUO_BASE_MPSCQUEUE_H
+#define MUDUO_BASE_MPSCQUEUE_H
+
+#include "muduo/base/noncopyable.h"
+
+#include <atomic>
+
+#include <assert.h>
+#include <stddef.h>
+
+namespace muduo
+{
+
+///
+/// Intrusive lock-free multi-producer single-consumer queue.
+///
+/// push() is wait-free and safe to call from any thread,
+/// pop() must only be called from one consumer thread.
+/// The queue never allocates, nodes are embedded in user objects.
+/// Algorithm by Dmitry Vyukov:
+/// http://www.1024cores.net/home/lock-free-algorithms/queues/intrusive-mpsc-node-based-queue
+// 侵入式无锁多生产者单消费者队列，节点由使用者提供
+class MpscQueue : noncopyable
+{
+ public:
+  struct Node
+  {
+    Node() : next(NULL) {}
+    std::atomic<Node*> next;
+  };
+
+  MpscQueue()
+    : head_(&stub_),
+      tail_(&stub_)
+  {
+  }
+
+  void push(Node* node)
+  {
+    node->next.store(NULL, std::memory_order_relaxed);
+    // 生产者之间只在这一个 exchange 上竞争
+    Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+    // 在这一步之前，消费者看不到 node，pop() 会暂时返回 NULL
+    prev->next.store(node, std::memory_order_release);
+  }
+
+  /// Returns NULL if the queue is empty,
+  /// or a producer is in the middle of push().
+  Node* pop()
+  {
+    Node* tail = tail_;
+    Node* next = tail->next.load(std::memory_order_acquire);
+    if (tail == &stub_)
+    {
+      if (next == NULL)
+      {
+        return NULL;
+      }
+      tail_ = next;
+      tail = next;
+      next = next->next.load(std::memory_order_acquire);
+    }
+    if (next)
+    {
+      tail_ = next;
+      return tail;
+    }
+    if (tail != head_.load(std::memory_order_acquire))
+    {
+      return NULL;
+    }
+    // tail 是最后一个节点，放回 stub 以便把它取出
+    push(&stub_);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next)
+    {
+      tail_ = next;
+      return tail;
+    }
+    return NULL;
+  }
+
+  /// Last node pushed, for the consumer to bound one round of pop().
+  /// Returns NULL if the queue is empty.
+  Node* back() const
+  {
+    Node* head = head_.load(std::memory_order_acquire);
+    return head == &stub_ ? NULL : head;
+  }
+
+ private:
+  std::atomic<Node*> head_;  // producers push here
+  char pad_[64 - sizeof(std::atomic<Node*>)];  // keep head_ and tail_ off the same cache line
+  Node* tail_;  // consumer pops here
+  Node stub_;
+};
+
+}  // namespace muduo
+
+#endif  // MUDUO_BASE_MPSCQUEUE_H
@@ -151,6 +151,17 @@ public:
     assignHolder();
   }
 
+  // returns false at once if somebody else holds it
+  bool tryLock() TRY_ACQUIRE(true)
+  {
+    if (pthread_mutex_trylock(&mutex_) == 0)
+    {
+      assignHolder();
+      return true;
+    }
+    return false;
+  }
+
   void unlock() RELEASE()
   {
     unassignHolder();
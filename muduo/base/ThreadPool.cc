@@ -7,18 +7,46 @@
 
 #include "muduo/base/Exception.h"
 
+#include <algorithm>
+#include <deque>
+
 #include <assert.h>
+#include <sched.h>
 #include <stdio.h>
 
 using namespace muduo;
 
+namespace
+{
+
+// 当前线程所属的线程池及其序号
+__thread ThreadPool* t_pool = NULL;
+__thread int t_index = -1;
+
+}  // namespace
+
+struct ThreadPool::Worker : noncopyable
+{
+    Worker() : depth(0) {}
+
+    MutexLock mutex;
+    std::deque<Task> queue GUARDED_BY(mutex);
+    std::atomic<size_t> depth; // queue.size()，不加锁读取
+    std::unique_ptr<muduo::Thread> thread;
+};
+
 ThreadPool::ThreadPool(const string &nameArg)
     : mutex_(),
       notEmpty_(mutex_),
       notFull_(mutex_),
       name_(nameArg),
       maxQueueSize_(0),
-      running_(false)
+      running_(false),
+      pending_(0),
+      sleepingWorkers_(0),
+      fullWaiters_(0),
+      nextWorker_(0),
+      stolenTasks_(0)
 {
 }
 
@@ -30,20 +58,24 @@ ThreadPool::~ThreadPool()
     }
 }
 
-// 启动线程池，线程个数是固定个数 numThreads
+// 启动线程池，线程个数是固定个数 numThreads，每个线程一个任务队列
 void ThreadPool::start(int numThreads)
 {
-    assert(threads_.empty());
+    assert(workers_.empty());
     running_ = true; // 正在运行标记
-    threads_.reserve(numThreads);
+    workers_.reserve(numThreads);
+    for (int i = 0; i < numThreads; ++i)
+    {
+        workers_.emplace_back(new Worker);
+    }
     // 创建线程 Thread
     for (int i = 0; i < numThreads; ++i)
     {
         char id[32];
         snprintf(id, sizeof id, "%d", i + 1);
-        threads_.emplace_back(new muduo::Thread(
-            std::bind(&ThreadPool::runInThread, this), name_ + id));
-        threads_[i]->start();
+        workers_[i]->thread.reset(new muduo::Thread(
+            std::bind(&ThreadPool::runInThread, this, i), name_ + id));
+        workers_[i]->thread->start();
     }
     if (numThreads == 0 && threadInitCallback_)
     {
@@ -51,24 +83,29 @@ void ThreadPool::start(int numThreads)
     }
 }
 
-// 停止所有线程
+// 停止所有线程，队列中剩下的任务不再执行
 void ThreadPool::stop()
 {
     {
         MutexLockGuard lock(mutex_);
         running_ = false;
         notEmpty_.notifyAll();
+        notFull_.notifyAll();
     }
-    for (auto &thr : threads_)
+    for (auto &worker : workers_)
     {
-        thr->join();
+        worker->thread->join();
     }
 }
 
-size_t ThreadPool::queueSize() const
+std::vector<size_t> ThreadPool::workerQueueSizes() const
 {
-    MutexLockGuard lock(mutex_);
-    return queue_.size();
+    std::vector<size_t> sizes;
+    for (const auto &worker : workers_)
+    {
+        sizes.push_back(worker->depth.load(std::memory_order_relaxed));
+    }
+    return sizes;
 }
 
 // 执行任务
@@ -76,58 +113,212 @@ void ThreadPool::run(Task task)
 {
     // 如果线程池没有线程，那么直接执行任务
     // 也就是说假设没有消费者，那么生产者直接消费产品，而不把任务加入任务队列
-    if (threads_.empty())
+    if (workers_.empty())
     {
         task();
+        return;
+    }
+    if (reserve(1) == 0)
+    {
+        return; // stopped
+    }
+    // 线程池里的线程加入自己的队列，其他线程轮流加入各个队列
+    int index = t_pool == this
+        ? t_index
+        : static_cast<int>(nextWorker_.fetch_add(1, std::memory_order_relaxed) % workers_.size());
+    Worker &worker = *workers_[index];
+    {
+        MutexLockGuard lock(worker.mutex);
+        worker.queue.push_back(std::move(task));
+        worker.depth.store(worker.queue.size(), std::memory_order_relaxed);
     }
-    // 如果线程池有线程，则将任务添加到任务队列
-    else
+    notifyWorkers(1);
+}
+
+void ThreadPool::runAll(std::vector<Task> tasks)
+{
+    if (workers_.empty())
     {
+        for (Task &task : tasks)
+        {
+            task();
+        }
+        return;
+    }
+    size_t next = 0;
+    while (next < tasks.size())
+    {
+        size_t n = reserve(tasks.size() - next);
+        if (n == 0)
+        {
+            return; // stopped
+        }
+        // 每个队列分到连续的一段，每个锁只取一次
+        size_t numWorkers = workers_.size();
+        size_t per = (n + numWorkers - 1) / numWorkers;
+        unsigned first = nextWorker_.fetch_add(1, std::memory_order_relaxed);
+        size_t end = next + n;
+        for (size_t i = 0; i < numWorkers && next < end; ++i)
+        {
+            Worker &worker = *workers_[(first + i) % numWorkers];
+            size_t last = std::min(end, next + per);
+            MutexLockGuard lock(worker.mutex);
+            for (; next < last; ++next)
+            {
+                worker.queue.push_back(std::move(tasks[next]));
+            }
+            worker.depth.store(worker.queue.size(), std::memory_order_relaxed);
+        }
+        notifyWorkers(n);
+    }
+}
+
+// 占用至多 n 个队列位置，队列满时等待，返回占用的个数，停止后返回 0
+size_t ThreadPool::reserve(size_t n)
+{
+    size_t pending = pending_.load();
+    while (true)
+    {
+        size_t available = n;
+        if (maxQueueSize_ > 0)
+        {
+            available = pending < maxQueueSize_ ? std::min(n, maxQueueSize_ - pending) : 0;
+        }
+        if (available > 0)
+        {
+            if (pending_.compare_exchange_weak(pending, pending + available))
+            {
+                return available;
+            }
+            continue;
+        }
         MutexLockGuard lock(mutex_);
-        while (isFull())
+        ++fullWaiters_;
+        while (pending_ >= maxQueueSize_ && running_)
         {
             notFull_.wait();
         }
-        assert(!isFull());
-
-        queue_.push_back(std::move(task));
-        notEmpty_.notify();
+        --fullWaiters_;
+        if (!running_)
+        {
+            return 0;
+        }
+        pending = pending_.load();
     }
 }
 
-// 任务分配函数(获取任务)
-// 线程池函数或者线程池里面的函数都可以到这里取出一个任务
-// 然后在自己的线程中执行任务，返回一个任务指针 
-ThreadPool::Task ThreadPool::take()
+// 唤醒睡眠的线程，与 take() 中先增加 sleepingWorkers_ 再检查 pending_ 配对
+void ThreadPool::notifyWorkers(size_t n)
 {
-    MutexLockGuard lock(mutex_);
-    // always use a while-loop, due to spurious wakeup
-    // 任务队列为空且线程池处于运行状态，需要等待任务的到来
-    while (queue_.empty() && running_)
+    if (sleepingWorkers_ > 0)
     {
-        notEmpty_.wait();
+        MutexLockGuard lock(mutex_);
+        if (n > 1)
+        {
+            notEmpty_.notifyAll();
+        }
+        else
+        {
+            notEmpty_.notify();
+        }
     }
+}
+
+// 任务分配函数(获取任务)
+// 先取自己队列的第一个任务，没有的话去其他队列偷取，都没有则睡眠等待
+// 停止后返回空任务
+ThreadPool::Task ThreadPool::take(int index)
+{
+    Worker &self = *workers_[index];
     Task task;
-    if (!queue_.empty())
+    while (running_)
     {
-        task = queue_.front();
-        queue_.pop_front();
-        if (maxQueueSize_ > 0)
         {
-            notFull_.notify();
+            MutexLockGuard lock(self.mutex);
+            if (!self.queue.empty())
+            {
+                task = std::move(self.queue.front());
+                self.queue.pop_front();
+                self.depth.store(self.queue.size(), std::memory_order_relaxed);
+            }
+        }
+        if (task || steal(index, &task))
+        {
+            pending_.fetch_sub(1);
+            if (maxQueueSize_ > 0 && fullWaiters_ > 0)
+            {
+                MutexLockGuard lock(mutex_);
+                notFull_.notify();
+            }
+            return task;
+        }
+        if (pending_ > 0)
+        {
+            // 任务正在加入某个队列
+            sched_yield();
+            continue;
+        }
+        MutexLockGuard lock(mutex_);
+        ++sleepingWorkers_;
+        // always use a while-loop, due to spurious wakeup
+        while (pending_ == 0 && running_)
+        {
+            notEmpty_.wait();
         }
+        --sleepingWorkers_;
     }
     return task;
 }
 
-bool ThreadPool::isFull() const
+// 从其他队列的尾部偷取一半任务，第一个交给调用者，其余放入自己的队列
+bool ThreadPool::steal(int index, Task *task)
 {
-    mutex_.assertLocked();
-    return maxQueueSize_ > 0 && queue_.size() >= maxQueueSize_;
+    size_t numWorkers = workers_.size();
+    for (size_t i = 1; i < numWorkers; ++i)
+    {
+        Worker &victim = *workers_[(index + i) % numWorkers];
+        if (victim.depth.load(std::memory_order_relaxed) == 0)
+        {
+            continue;
+        }
+        std::vector<Task> stolen;
+        {
+            MutexLockGuard lock(victim.mutex);
+            size_t n = (victim.queue.size() + 1) / 2;
+            for (size_t j = 0; j < n; ++j)
+            {
+                stolen.push_back(std::move(victim.queue.back()));
+                victim.queue.pop_back();
+            }
+            victim.depth.store(victim.queue.size(), std::memory_order_relaxed);
+        }
+        if (stolen.empty())
+        {
+            continue;
+        }
+        stolenTasks_.fetch_add(static_cast<int64_t>(stolen.size()), std::memory_order_relaxed);
+        *task = std::move(stolen.back());
+        stolen.pop_back();
+        if (!stolen.empty())
+        {
+            Worker &self = *workers_[index];
+            MutexLockGuard lock(self.mutex);
+            // 保持原来的先后顺序
+            for (auto it = stolen.rbegin(); it != stolen.rend(); ++it)
+            {
+                self.queue.push_back(std::move(*it));
+            }
+            self.depth.store(self.queue.size(), std::memory_order_relaxed);
+        }
+        return true;
+    }
+    return false;
 }
 
-void ThreadPool::runInThread()
+void ThreadPool::runInThread(int index)
 {
+    t_pool = this;
+    t_index = index;
     try
     {
         if (threadInitCallback_)
@@ -136,7 +327,7 @@ void ThreadPool::runInThread()
         }
         while (running_)
         {
-            Task task(take());
+            Task task(take(index));
             if (task)
             {
                 task();
@@ -11,24 +11,155 @@
 #include "muduo/base/Thread.h"
 #include "muduo/base/Types.h"
 
-#include <deque>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#include <stddef.h>
+
 // 最新版 muduo 已经使用 EventThreadPool 来代替 threadPool
 namespace muduo
 {
 
+///
+/// Fixed number of threads, each with its own queue of tasks. Tasks run()
+/// from outside go round the queues, tasks run() from a thread of the pool
+/// go to its own queue, and an idle thread steals half of the tasks of
+/// another queue.
+///
 class ThreadPool : noncopyable
 {
  public:
-  typedef std::function<void ()> Task;
+  /// A move-only std::function<void ()>, callables up to kInlineSize bytes
+  /// are kept inside, larger ones on the heap.
+  class Task
+  {
+   public:
+    static const size_t kInlineSize = 48;
+
+    Task() noexcept
+      : invoke_(NULL), manage_(NULL)
+    {
+    }
+
+    template <typename F,
+              typename = typename std::enable_if<
+                !std::is_same<typename std::decay<F>::type, Task>::value>::type>
+    Task(F&& f)
+      : invoke_(NULL), manage_(NULL)
+    {
+      typedef typename std::decay<F>::type Func;
+      init<Func>(std::forward<F>(f), std::integral_constant<bool, isInline<Func>()>());
+    }
+
+    Task(Task&& rhs) noexcept
+      : invoke_(NULL), manage_(NULL)
+    {
+      moveFrom(rhs);
+    }
+
+    Task& operator=(Task&& rhs) noexcept
+    {
+      if (this != &rhs)
+      {
+        reset();
+        moveFrom(rhs);
+      }
+      return *this;
+    }
+
+    ~Task() { reset(); }
+
+    void operator()() { invoke_(&storage_); }
+    explicit operator bool() const { return invoke_ != NULL; }
+
+   private:
+    enum Operation { kMove, kDestroy };
+    typedef void (*Invoke)(void* storage);
+    // kMove moves src to dst and destroys src
+    typedef void (*Manage)(Operation op, void* dst, void* src);
+    typedef std::aligned_storage<kInlineSize, alignof(max_align_t)>::type Storage;
+
+    template <typename Func>
+    static constexpr bool isInline()
+    {
+      return sizeof(Func) <= kInlineSize && alignof(Func) <= alignof(Storage) &&
+        std::is_nothrow_move_constructible<Func>::value;
+    }
+
+    template <typename Func, typename F>
+    void init(F&& f, std::true_type)
+    {
+      new (&storage_) Func(std::forward<F>(f));
+      invoke_ = [](void* storage) { (*static_cast<Func*>(storage))(); };
+      manage_ = [](Operation op, void* dst, void* src)
+        {
+          Func* func = static_cast<Func*>(src);
+          if (op == kMove)
+          {
+            new (dst) Func(std::move(*func));
+          }
+          func->~Func();
+        };
+    }
+
+    template <typename Func, typename F>
+    void init(F&& f, std::false_type)
+    {
+      *reinterpret_cast<Func**>(&storage_) = new Func(std::forward<F>(f));
+      invoke_ = [](void* storage) { (**static_cast<Func**>(storage))(); };
+      manage_ = [](Operation op, void* dst, void* src)
+        {
+          Func** func = static_cast<Func**>(src);
+          if (op == kMove)
+          {
+            *static_cast<Func**>(dst) = *func;
+          }
+          else
+          {
+            delete *func;
+          }
+        };
+    }
+
+    void moveFrom(Task& rhs) noexcept
+    {
+      if (rhs.manage_)
+      {
+        rhs.manage_(kMove, &storage_, &rhs.storage_);
+      }
+      invoke_ = rhs.invoke_;
+      manage_ = rhs.manage_;
+      rhs.invoke_ = NULL;
+      rhs.manage_ = NULL;
+    }
+
+    void reset() noexcept
+    {
+      if (manage_)
+      {
+        manage_(kDestroy, NULL, &storage_);
+      }
+      invoke_ = NULL;
+      manage_ = NULL;
+    }
+
+    Storage storage_;
+    Invoke invoke_;
+    Manage manage_;
+  };
+
+  typedef std::function<void ()> ThreadInitCallback;
 
   explicit ThreadPool(const string& nameArg = string("ThreadPool"));
   ~ThreadPool();
 
   // Must be called before start().
   void setMaxQueueSize(int maxSize) { maxQueueSize_ = maxSize; }
-  void setThreadInitCallback(const Task& cb)
+  void setThreadInitCallback(const ThreadInitCallback& cb)
   { threadInitCallback_ = cb; }
 
   void start(int numThreads);
@@ -37,31 +168,42 @@ class ThreadPool : noncopyable
   const string& name() const
   { return name_; }
 
-  size_t queueSize() const;
+  /// Tasks waiting in all queues.
+  size_t queueSize() const { return pending_.load(std::memory_order_relaxed); }
+  /// Tasks waiting in the queue of each thread.
+  std::vector<size_t> workerQueueSizes() const;
+  /// Tasks taken by a thread from the queue of another.
+  int64_t stolenTasks() const { return stolenTasks_.load(std::memory_order_relaxed); }
 
   // Could block if maxQueueSize > 0
-  // There is no move-only version of std::function in C++ as of C++14.
-  // So we don't need to overload a const& and an && versions
-  // as we do in (Bounded)BlockingQueue.
-  // https://stackoverflow.com/a/25408989
   void run(Task f);
+  // Spreads tasks over the queues, taking each lock once.
+  // Could block if maxQueueSize > 0, until all are queued.
+  void runAll(std::vector<Task> tasks);
 
  private:
-  bool isFull() const REQUIRES(mutex_);
-  void runInThread();
-  Task take();
+  struct Worker;
+
+  size_t reserve(size_t n);
+  void notifyWorkers(size_t n);
+  void runInThread(int index);
+  Task take(int index);
+  bool steal(int index, Task* task);
 
   mutable MutexLock mutex_;
   Condition notEmpty_ GUARDED_BY(mutex_);
   Condition notFull_ GUARDED_BY(mutex_);
   string name_;
-  Task threadInitCallback_;
-  // 所有线程
-  std::vector<std::unique_ptr<muduo::Thread>> threads_;
-  // 任务队列
-  std::deque<Task> queue_ GUARDED_BY(mutex_);
+  ThreadInitCallback threadInitCallback_;
+  // 所有线程，以及各自的任务队列
+  std::vector<std::unique_ptr<Worker>> workers_;
   size_t maxQueueSize_;
-  bool running_;
+  std::atomic<bool> running_;
+  std::atomic<size_t> pending_;  // tasks queued or about to be
+  std::atomic<int> sleepingWorkers_;
+  std::atomic<int> fullWaiters_;
+  std::atomic<unsigned> nextWorker_;
+  std::atomic<int64_t> stolenTasks_;
 };
 
 }  // namespace muduo
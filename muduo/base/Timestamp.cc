@@ -7,6 +7,7 @@
 
 #include <sys/time.h>
 #include <stdio.h>
+#include <time.h>
 
 #ifndef __STDC_FORMAT_MACROS
 #define __STDC_FORMAT_MACROS
@@ -60,3 +61,11 @@ Timestamp Timestamp::now()
   int64_t seconds = tv.tv_sec;
   return Timestamp(seconds * kMicroSecondsPerSecond + tv.tv_usec);
 }
+
+Timestamp Timestamp::nowCoarse()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+  int64_t seconds = ts.tv_sec;
+  return Timestamp(seconds * kMicroSecondsPerSecond + ts.tv_nsec / 1000);
+}
@@ -67,6 +67,11 @@ public:
   /// Get time of now.
   ///
   static Timestamp now();
+  ///
+  /// Get time of now from CLOCK_REALTIME_COARSE, cheaper than now(),
+  /// but only as fine as the kernel tick, a few milliseconds.
+  ///
+  static Timestamp nowCoarse();
   // 返回一个无效的时间戳
   static Timestamp invalid()
   {
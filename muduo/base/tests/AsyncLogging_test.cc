@@ -1,8 +1,15 @@
 #include "muduo/base/AsyncLogging.h"
+#include "muduo/base/CountDownLatch.h"
 #include "muduo/base/Logging.h"
+#include "muduo/base/Thread.h"
 #include "muduo/base/Timestamp.h"
 
+#include <memory>
+#include <vector>
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/resource.h>
 #include <unistd.h>
 
@@ -42,6 +49,59 @@ void bench(bool longLog)
   }
 }
 
+// Lines per second of numThreads threads logging together,
+// with the shared buffer or per-thread buffers.
+void scale(const char* basename, int totalLines)
+{
+  muduo::Logger::setOutput(asyncOutput);
+  printf("%8s %14s %14s %10s\n", "threads", "shared/s", "per-thread/s", "overflow");
+  for (int numThreads = 1; numThreads <= 64; numThreads *= 2)
+  {
+    double rates[2] = { 0, 0 };
+    int64_t overflow = 0;
+    for (int perThread = 0; perThread < 2; ++perThread)
+    {
+      muduo::AsyncLogging log(basename, kRollSize);
+      log.setPerThreadBuffers(perThread != 0);
+      log.start();
+      g_asyncLog = &log;
+
+      const int lines = totalLines / numThreads;
+      muduo::CountDownLatch ready(numThreads);
+      muduo::CountDownLatch go(1);
+      std::vector<std::unique_ptr<muduo::Thread>> threads;
+      for (int i = 0; i < numThreads; ++i)
+      {
+        threads.emplace_back(new muduo::Thread([&]
+            {
+              ready.countDown();
+              go.wait();
+              for (int n = 0; n < lines; ++n)
+              {
+                LOG_INFO << "Hello 0123456789" << " abcdefghijklmnopqrstuvwxyz " << n;
+              }
+            }));
+        threads.back()->start();
+      }
+      ready.wait();
+      muduo::Timestamp start = muduo::Timestamp::now();
+      go.countDown();
+      for (auto& thr : threads)
+      {
+        thr->join();
+      }
+      double seconds = timeDifference(muduo::Timestamp::now(), start);
+      rates[perThread] = lines * numThreads / seconds;
+      log.stop();
+      overflow = log.overflowLines();
+    }
+    printf("%8d %14.0f %14.0f %10lld\n", numThreads, rates[0], rates[1],
+           static_cast<long long>(overflow));
+  }
+}
+
+// Usage: asynclogging_test [long]
+//        asynclogging_test scale [lines]
 int main(int argc, char* argv[])
 {
   {
@@ -55,6 +115,12 @@ int main(int argc, char* argv[])
 
   char name[256] = { 0 };
   strncpy(name, argv[0], sizeof name - 1);
+  if (argc > 1 && strcmp(argv[1], "scale") == 0)
+  {
+    scale(::basename(name), argc > 2 ? atoi(argv[2]) : 1000 * 1000);
+    return 0;
+  }
+
   muduo::AsyncLogging log(::basename(name), kRollSize);
   log.start();
   g_asyncLog = &log;
@@ -1,19 +1,46 @@
 #include "muduo/base/BlockingQueue.h"
+#include "muduo/base/BoundedBlockingQueue.h"
+#include "muduo/base/BoundedMpmcQueue.h"
 #include "muduo/base/CountDownLatch.h"
 #include "muduo/base/Thread.h"
 #include "muduo/base/Timestamp.h"
 
+#include <atomic>
 #include <map>
 #include <string>
 #include <vector>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
+const int kCapacity = 1024;
+
+template<typename Queue>
+Queue* newQueue()
+{
+  return new Queue(kCapacity);
+}
+
+template<>
+muduo::BlockingQueue<muduo::Timestamp>* newQueue()
+{
+  return new muduo::BlockingQueue<muduo::Timestamp>;
+}
+
+template<>
+muduo::BlockingQueue<int64_t>* newQueue()
+{
+  return new muduo::BlockingQueue<int64_t>;
+}
+
+// latency from one thread to numThreads
+template<typename Queue>
 class Bench
 {
  public:
   Bench(int numThreads)
-    : latch_(numThreads)
+    : queue_(newQueue<Queue>()),
+      latch_(numThreads)
   {
     threads_.reserve(numThreads);
     for (int i = 0; i < numThreads; ++i)
@@ -37,7 +64,7 @@ class Bench
     for (int i = 0; i < times; ++i)
     {
       muduo::Timestamp now(muduo::Timestamp::now());
-      queue_.put(now);
+      queue_->put(now);
       usleep(1000);
     }
   }
@@ -46,7 +73,7 @@ class Bench
   {
     for (size_t i = 0; i < threads_.size(); ++i)
     {
-      queue_.put(muduo::Timestamp::invalid());
+      queue_->put(muduo::Timestamp::invalid());
     }
 
     for (auto& thr : threads_)
@@ -68,7 +95,7 @@ class Bench
     bool running = true;
     while (running)
     {
-      muduo::Timestamp t(queue_.take());
+      muduo::Timestamp t(queue_->take());
       muduo::Timestamp now(muduo::Timestamp::now());
       if (t.valid())
       {
@@ -91,16 +118,109 @@ class Bench
     }
   }
 
-  muduo::BlockingQueue<muduo::Timestamp> queue_;
+  std::unique_ptr<Queue> queue_;
   muduo::CountDownLatch latch_;
   std::vector<std::unique_ptr<muduo::Thread>> threads_;
 };
 
+// throughput of producers to consumers, each item taken once
+template<typename Queue>
+void benchThroughput(const char* name, int producers, int consumers, int64_t items)
+{
+  std::unique_ptr<Queue> queue(newQueue<Queue>());
+  std::atomic<int64_t> sum(0);
+  muduo::CountDownLatch ready(producers + consumers);
+  muduo::CountDownLatch go(1);
+  std::vector<std::unique_ptr<muduo::Thread>> threads;
+  for (int i = 0; i < producers; ++i)
+  {
+    int64_t begin = items * i / producers;
+    int64_t end = items * (i + 1) / producers;
+    threads.emplace_back(new muduo::Thread([&queue, &ready, &go, begin, end]
+        {
+          ready.countDown();
+          go.wait();
+          for (int64_t x = begin; x < end; ++x)
+          {
+            queue->put(x);
+          }
+        }, "producer"));
+  }
+  for (int i = 0; i < consumers; ++i)
+  {
+    int64_t count = items * (i + 1) / consumers - items * i / consumers;
+    threads.emplace_back(new muduo::Thread([&queue, &ready, &go, &sum, count]
+        {
+          ready.countDown();
+          go.wait();
+          int64_t local = 0;
+          for (int64_t n = 0; n < count; ++n)
+          {
+            local += queue->take();
+          }
+          sum += local;
+        }, "consumer"));
+  }
+  for (auto& thr : threads)
+  {
+    thr->start();
+  }
+  ready.wait();
+  muduo::Timestamp start(muduo::Timestamp::now());
+  go.countDown();
+  for (auto& thr : threads)
+  {
+    thr->join();
+  }
+  double seconds = timeDifference(muduo::Timestamp::now(), start);
+  bool ok = sum == items * (items - 1) / 2;
+  printf("%-20s %2d to %-2d %8.1f ns/item %7.2f Mitems/s%s\n", name, producers, consumers,
+         seconds * 1e9 / static_cast<double>(items), static_cast<double>(items) / seconds / 1e6,
+         ok ? "" : " WRONG SUM");
+}
+
+void benchTopologies(int64_t items)
+{
+  const int kTopologies[][2] = { { 1, 1 }, { 1, 4 }, { 1, 8 }, { 2, 2 }, { 4, 4 }, { 8, 8 } };
+  for (const auto& topology : kTopologies)
+  {
+    benchThroughput<muduo::BlockingQueue<int64_t>>(
+        "BlockingQueue", topology[0], topology[1], items);
+    benchThroughput<muduo::BoundedBlockingQueue<int64_t>>(
+        "BoundedBlockingQueue", topology[0], topology[1], items);
+    benchThroughput<muduo::BoundedMpmcQueue<int64_t>>(
+        "BoundedMpmcQueue", topology[0], topology[1], items);
+  }
+}
+
+// blockingqueue_bench [threads [blocking|bounded|mpmc]]
+// blockingqueue_bench topology [items]
 int main(int argc, char* argv[])
 {
-  int threads = argc > 1 ? atoi(argv[1]) : 1;
+  if (argc > 1 && strcmp(argv[1], "topology") == 0)
+  {
+    benchTopologies(argc > 2 ? atoll(argv[2]) : 1000 * 1000);
+    return 0;
+  }
 
-  Bench t(threads);
-  t.run(10000);
-  t.joinAll();
+  int threads = argc > 1 ? atoi(argv[1]) : 1;
+  const char* queue = argc > 2 ? argv[2] : "blocking";
+  if (strcmp(queue, "bounded") == 0)
+  {
+    Bench<muduo::BoundedBlockingQueue<muduo::Timestamp>> t(threads);
+    t.run(10000);
+    t.joinAll();
+  }
+  else if (strcmp(queue, "mpmc") == 0)
+  {
+    Bench<muduo::BoundedMpmcQueue<muduo::Timestamp>> t(threads);
+    t.run(10000);
+    t.joinAll();
+  }
+  else
+  {
+    Bench<muduo::BlockingQueue<muduo::Timestamp>> t(threads);
+    t.run(10000);
+    t.joinAll();
+  }
 }
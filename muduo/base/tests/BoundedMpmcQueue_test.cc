@@ -0,0 +1,83 @@
+#include "muduo/base/BoundedMpmcQueue.h"
+#include "muduo/base/CurrentThread.h"
+#include "muduo/base/Thread.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+
+void testTry()
+{
+  muduo::BoundedMpmcQueue<int> queue(3);
+  assert(queue.capacity() == 4);
+  assert(queue.empty());
+  for (int i = 0; i < 4; ++i)
+  {
+    bool ok = queue.tryPut(i);
+    assert(ok); (void)ok;
+  }
+  assert(queue.full());
+  assert(!queue.tryPut(4));
+  int x = -1;
+  for (int i = 0; i < 4; ++i)
+  {
+    bool ok = queue.tryTake(&x);
+    assert(ok && x == i); (void)ok;
+  }
+  assert(!queue.tryTake(&x));
+  assert(queue.empty());
+}
+
+// producers and consumers of move-only items through a small queue
+bool testThreads(int producers, int consumers)
+{
+  const int kItems = 200 * 1000;
+  muduo::BoundedMpmcQueue<std::unique_ptr<int>> queue(16);
+  std::atomic<int64_t> sum(0);
+  std::vector<std::unique_ptr<muduo::Thread>> threads;
+  for (int i = 0; i < producers; ++i)
+  {
+    threads.emplace_back(new muduo::Thread([&queue, i, producers]
+        {
+          for (int x = i; x < kItems; x += producers)
+          {
+            queue.put(std::unique_ptr<int>(new int(x)));
+          }
+        }, "producer"));
+  }
+  for (int i = 0; i < consumers; ++i)
+  {
+    int count = kItems * (i + 1) / consumers - kItems * i / consumers;
+    threads.emplace_back(new muduo::Thread([&queue, &sum, count]
+        {
+          for (int n = 0; n < count; ++n)
+          {
+            std::unique_ptr<int> x(queue.take());
+            sum += *x;
+          }
+        }, "consumer"));
+  }
+  for (auto& thr : threads)
+  {
+    thr->start();
+  }
+  for (auto& thr : threads)
+  {
+    thr->join();
+  }
+  bool ok = sum == static_cast<int64_t>(kItems) * (kItems - 1) / 2 && queue.empty();
+  printf("%d to %d %s\n", producers, consumers, ok ? "ok" : "WRONG");
+  return ok;
+}
+
+int main()
+{
+  testTry();
+  bool ok = testThreads(1, 1) && testThreads(1, 4) && testThreads(4, 1) && testThreads(4, 4);
+  printf("pid = %d, tid = %d\n", ::getpid(), muduo::CurrentThread::tid());
+  return ok ? 0 : 1;
+}
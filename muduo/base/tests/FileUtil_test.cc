@@ -1,11 +1,41 @@
 #include "muduo/base/FileUtil.h"
 
 #include <stdio.h>
+#include <unistd.h>
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 
 using namespace muduo;
 
+// appends lines of all sizes with directIo, twice to the same file
+int testDirectIo()
+{
+  const char* filename = "/tmp/fileutil_test.log";
+  ::unlink(filename);
+  string expected;
+  for (int pass = 0; pass < 2; ++pass)
+  {
+    FileUtil::AppendFile file(filename, true);
+    for (int i = 0; i < 3000; ++i)
+    {
+      string line(static_cast<size_t>(i * 7 % 1500), static_cast<char>('a' + i % 26));
+      line += '\n';
+      file.append(line.data(), line.size());
+      expected += line;
+      if (i % 100 == 0)
+      {
+        file.flush();
+      }
+    }
+  }
+
+  string result;
+  int err = FileUtil::readFile(filename, 64*1024*1024, &result);
+  printf("directIo %d %zd %zd\n", err, result.size(), expected.size());
+  ::unlink(filename);
+  return result == expected ? 0 : 1;
+}
+
 int main()
 {
   string result;
@@ -26,5 +56,5 @@ int main()
   printf("%d %zd %" PRIu64 "\n", err, result.size(), size);
   err = FileUtil::readFile("/dev/zero", 102400, &result, NULL);
   printf("%d %zd %" PRIu64 "\n", err, result.size(), size);
+  return testDirectIo();
 }
-
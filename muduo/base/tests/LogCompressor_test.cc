@@ -0,0 +1,77 @@
+#include "muduo/base/LogCompressor.h"
+#include "muduo/base/GzipFile.h"
+#include "muduo/base/LogFile.h"
+
+#include <vector>
+
+#include <glob.h>
+#include <stdio.h>
+#include <unistd.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+
+using namespace muduo;
+
+// rolls a LogFile many times, compressing the rolled files
+int main()
+{
+  if (::chdir("/tmp") != 0)
+  {
+    return 1;
+  }
+
+  const string line = "1234567890 abcdefghijklmnopqrstuvwxyz ABCDEFGHIJKLMNOPQRSTUVWXYZ\n";
+  std::vector<string> rolled;
+  LogCompressor compressor;
+  {
+    LogFile file("logcompressor_test", 1000*1000, false);
+    file.setRollCallback([&](const string& filename)
+        {
+          rolled.push_back(filename);
+          compressor.compress(filename);
+        });
+    for (int i = 0; i < 3; ++i)
+    {
+      for (int j = 0; j < 20000; ++j)
+      {
+        file.append(line.data(), static_cast<int>(line.size()));
+      }
+      // rolls at most once a second
+      ::sleep(1);
+    }
+  }
+
+  bool ok = !rolled.empty();
+  while (compressor.compressedFiles() + compressor.failedFiles() < static_cast<int64_t>(rolled.size()))
+  {
+    ::usleep(10*1000);
+  }
+  for (const string& filename : rolled)
+  {
+    GzipFile gz = GzipFile::openForRead(filename + ".gz");
+    string content;
+    char buf[64*1024];
+    int n = 0;
+    while (gz.valid() && (n = gz.read(buf, sizeof buf)) > 0)
+    {
+      content.append(buf, n);
+    }
+    printf("%s.gz %zd\n", filename.c_str(), content.size());
+    ok = ok && ::access(filename.c_str(), F_OK) != 0 && content.size() > 1000*1000 &&
+      content.size() % line.size() == 0 && content.compare(0, line.size(), line) == 0;
+    ::unlink((filename + ".gz").c_str());
+  }
+  // the last one
+  glob_t files;
+  if (::glob("logcompressor_test.*.log", 0, NULL, &files) == 0)
+  {
+    for (size_t i = 0; i < files.gl_pathc; ++i)
+    {
+      ::unlink(files.gl_pathv[i]);
+    }
+    ::globfree(&files);
+  }
+  printf("rolled %zd compressed %" PRId64 " failed %" PRId64 "\n",
+         rolled.size(), compressor.compressedFiles(), compressor.failedFiles());
+  return ok ? 0 : 1;
+}
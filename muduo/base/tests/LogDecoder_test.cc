@@ -0,0 +1,53 @@
+// Formats logs written with Logger::kBinary, e.g. by AsyncLogging without
+// setDecoding(), to stdout.
+//
+// Usage: logdecoder_test file...
+// Give all files of a log in order, call sites are defined once.
+
+#include "muduo/base/LogDecoder.h"
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdio.h>
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    fprintf(stderr, "Usage: %s file...\n", argv[0]);
+    return 1;
+  }
+
+  muduo::LogDecoder decoder;
+  auto output = [](const char* line, int len)
+  {
+    fwrite(line, 1, len, stdout);
+  };
+  std::vector<char> data;
+  char buf[64 * 1024];
+  for (int i = 1; i < argc; ++i)
+  {
+    FILE* fp = ::fopen(argv[i], "rb");
+    if (!fp)
+    {
+      perror(argv[i]);
+      return 1;
+    }
+    size_t n = 0;
+    while ((n = ::fread(buf, 1, sizeof buf, fp)) > 0)
+    {
+      // records span reads
+      data.insert(data.end(), buf, buf + n);
+      size_t decoded = decoder.decode(data.data(), data.size(), output);
+      data.erase(data.begin(), data.begin() + static_cast<ptrdiff_t>(decoded));
+    }
+    ::fclose(fp);
+  }
+  if (!data.empty() || decoder.errors() > 0)
+  {
+    fprintf(stderr, "%zd bytes left, %lld bad records\n",
+            data.size(), static_cast<long long>(decoder.errors()));
+    return 1;
+  }
+}
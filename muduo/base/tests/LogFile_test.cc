@@ -20,6 +20,10 @@ int main(int argc, char* argv[])
   char name[256] = { 0 };
   strncpy(name, argv[0], sizeof name - 1);
   g_logFile.reset(new muduo::LogFile(::basename(name), 200*1000));
+  if (argc > 1 && strcmp(argv[1], "direct") == 0)
+  {
+    g_logFile->setDirectIo(true);
+  }
   muduo::Logger::setOutput(outputFunc);
   muduo::Logger::setFlush(flushFunc);
 
@@ -1,4 +1,6 @@
+#include "muduo/base/LogDecoder.h"
 #include "muduo/base/LogStream.h"
+#include "muduo/base/Logging.h"
 #include "muduo/base/Timestamp.h"
 
 #include <sstream>
@@ -55,6 +57,48 @@ void benchLogStream()
   printf("benchLogStream %f\n", timeDifference(end, start));
 }
 
+string g_output;
+
+void bufferOutput(const char* msg, int len)
+{
+  g_output.append(msg, len);
+}
+
+// Whole LOG_INFO lines, formatted now or recorded for LogDecoder.
+void benchLogger(Logger::Format format, const char* name, bool coarseClock = false)
+{
+  // pages touched in advance
+  g_output.assign(N * 128, '\0');
+  g_output.clear();
+  Logger::setOutput(bufferOutput);
+  Logger::setFormat(format);
+  Logger::setCoarseClock(coarseClock);
+  Timestamp start(Timestamp::now());
+  for (size_t i = 0; i < N; ++i)
+  {
+    LOG_INFO << "Hello " << i << " abcdefghijklmnopqrstuvwxyz " << 3.14 * static_cast<double>(i)
+             << ' ' << static_cast<const void*>(&g_output);
+  }
+  Timestamp end(Timestamp::now());
+  Logger::setFormat(Logger::kText);
+  Logger::setCoarseClock(false);
+  printf("benchLogger %-6s %6.1f ns/line %6.1f bytes/line\n", name,
+         timeDifference(end, start) * 1e9 / N,
+         static_cast<double>(g_output.size()) / N);
+
+  if (format == Logger::kBinary)
+  {
+    LogDecoder decoder;
+    size_t bytes = 0;
+    start = Timestamp::now();
+    decoder.decode(g_output.data(), g_output.size(),
+                   [&bytes](const char*, int len) { bytes += len; });
+    end = Timestamp::now();
+    printf("benchLogger decode %6.1f ns/line %6.1f bytes/line\n",
+           timeDifference(end, start) * 1e9 / N, static_cast<double>(bytes) / N);
+  }
+}
+
 int main()
 {
   benchPrintf<int>("%d");
@@ -79,4 +123,8 @@ int main()
   benchStringStream<void*>();
   benchLogStream<void*>();
 
+  puts("Logger");
+  benchLogger(Logger::kText, "text");
+  benchLogger(Logger::kText, "coarse", true);
+  benchLogger(Logger::kBinary, "binary");
 }
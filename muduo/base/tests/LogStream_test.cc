@@ -1,7 +1,10 @@
 #include "muduo/base/LogStream.h"
+#include "muduo/base/LogDecoder.h"
+#include "muduo/base/Logging.h"
 
 #include <limits>
 #include <stdint.h>
+#include <errno.h>
 
 //#define BOOST_TEST_MODULE LogStreamTest
 #define BOOST_TEST_MAIN
@@ -284,3 +287,85 @@ BOOST_AUTO_TEST_CASE(testFormatIEC)
   BOOST_CHECK_EQUAL(muduo::formatIEC(10480518), string("10.0Mi"));
   BOOST_CHECK_EQUAL(muduo::formatIEC(INT64_MAX), string("8.00Ei"));
 }
+
+namespace
+{
+
+string g_logged;
+
+void captureOutput(const char* msg, int len)
+{
+  g_logged.append(msg, len);
+}
+
+// the same call sites in both formats
+void logLines()
+{
+  LOG_WARN << "int " << -42 << " uint " << 42u << " int64 " << std::numeric_limits<int64_t>::min()
+           << " double " << 3.25 << " bool " << true << " char " << 'c'
+           << " ptr " << reinterpret_cast<const void*>(0x1234)
+           << " str " << string("hello") << " null " << static_cast<const char*>(NULL);
+  errno = ENOENT;
+  LOG_SYSERR << "syserr";
+  LOG_ERROR << muduo::Fmt("%4.1f", 1.5);
+}
+
+// without the time
+string stripTime(const string& lines)
+{
+  string result;
+  size_t begin = 0;
+  while (begin < lines.size())
+  {
+    size_t end = lines.find('\n', begin);
+    size_t space = lines.find(' ', lines.find(' ', begin) + 1);
+    result += lines.substr(space, end + 1 - space);
+    begin = end + 1;
+  }
+  return result;
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(testLogStreamBinary)
+{
+  muduo::Logger::setOutput(captureOutput);
+  g_logged.clear();
+  logLines();
+  string text = g_logged;
+
+  muduo::Logger::setFormat(muduo::Logger::kBinary);
+  g_logged.clear();
+  logLines();
+  logLines();  // no more site definitions
+  string binary = g_logged;
+  muduo::Logger::setFormat(muduo::Logger::kText);
+
+  muduo::LogDecoder decoder;
+  string decoded;
+  size_t n = decoder.decode(binary.data(), binary.size(),
+                            [&decoded](const char* line, int len) { decoded.append(line, len); });
+  BOOST_CHECK_EQUAL(n, binary.size());
+  BOOST_CHECK_EQUAL(decoder.errors(), 0);
+  BOOST_CHECK_EQUAL(stripTime(decoded), stripTime(text + text));
+  BOOST_CHECK(binary.size() < 2 * text.size());
+
+  // a truncated record is left for later
+  muduo::LogDecoder again;
+  n = again.decode(binary.data(), binary.size() - 1,
+                   [](const char*, int) {});
+  BOOST_CHECK(n < binary.size() - 1);
+  BOOST_CHECK_EQUAL(again.errors(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(testLogStreamBinaryTruncated)
+{
+  muduo::LogStream os;
+  os.setBinary(true);
+  string big(5000, 'x');
+  os << 1 << big << 2;
+  const muduo::LogStream::Buffer& buf = os.buffer();
+  // the string is cut to fit, the number after it doesn't
+  BOOST_CHECK_EQUAL(buf.avail(), 1);
+  BOOST_CHECK_EQUAL(buf.data()[9], static_cast<char>(muduo::LogStream::kString));
+}
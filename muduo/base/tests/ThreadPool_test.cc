@@ -2,6 +2,9 @@
 #include "muduo/base/CountDownLatch.h"
 #include "muduo/base/CurrentThread.h"
 #include "muduo/base/Logging.h"
+#include "muduo/base/Timestamp.h"
+
+#include <atomic>
 
 #include <stdio.h>
 #include <unistd.h>  // usleep
@@ -41,18 +44,57 @@ void test(int maxSize)
   pool.stop();
 }
 
-/*
- * Wish we could do this in the future.
 void testMove()
 {
   muduo::ThreadPool pool;
   pool.start(2);
 
   std::unique_ptr<int> x(new int(42));
-  pool.run([y = std::move(x)]{ printf("%d: %d\n", muduo::CurrentThread::tid(), *y); });
+  muduo::CountDownLatch latch(1);
+  pool.run(std::bind([&latch](std::unique_ptr<int>& y)
+      {
+        printf("%d: %d\n", muduo::CurrentThread::tid(), *y);
+        latch.countDown();
+      }, std::move(x)));
+  latch.wait();
+  pool.stop();
+}
+
+// tasks run from a thread of the pool stay in its queue, until stolen
+void testRunAll(int maxSize)
+{
+  const int kTasks = 1000 * 1000;
+  muduo::ThreadPool pool("RunAllPool");
+  pool.setMaxQueueSize(maxSize);
+  pool.start(4);
+
+  std::atomic<int> done(0);
+  muduo::CountDownLatch latch(1);
+  muduo::Timestamp start(muduo::Timestamp::now());
+  pool.run([&]
+      {
+        std::vector<muduo::ThreadPool::Task> tasks;
+        tasks.reserve(kTasks);
+        for (int i = 0; i < kTasks; ++i)
+        {
+          tasks.push_back([&]
+              {
+                if (done.fetch_add(1) + 1 == kTasks)
+                {
+                  latch.countDown();
+                }
+              });
+        }
+        pool.runAll(std::move(tasks));
+      });
+  latch.wait();
+  double seconds = timeDifference(muduo::Timestamp::now(), start);
+  std::vector<size_t> sizes = pool.workerQueueSizes();
+  LOG_WARN << "runAll max queue size = " << maxSize << ": " << kTasks / seconds
+           << " tasks/s, stolen " << pool.stolenTasks()
+           << ", queue sizes " << sizes[0] << ' ' << sizes[1] << ' ' << sizes[2] << ' ' << sizes[3];
   pool.stop();
 }
-*/
 
 int main()
 {
@@ -61,4 +103,7 @@ int main()
   test(5);
   test(10);
   test(50);
+  testMove();
+  testRunAll(0);
+  testRunAll(1000);
 }
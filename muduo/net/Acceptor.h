@@ -44,6 +44,11 @@ public:
     bool listenning() const { return listenning_; }
     // 开始监听，对 listen 的封装
     void listen();
+    // 在 SO_REUSEPORT 组上按 CPU 分配新连接，见 Socket::setReusePortCpuSteering
+    void setReusePortCpuSteering(int groupSize)
+    {
+        acceptSocket_.setReusePortCpuSteering(groupSize);
+    }
 
 private:
     // 处理套接字可读，在 accept 中，就是新连接
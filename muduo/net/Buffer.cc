@@ -26,6 +26,11 @@ ssize_t Buffer::readFd(int fd, int* savedErrno)
 {
   // saved an ioctl()/FIONREAD call to tell how much to read
   char extrabuf[65536];
+  if (buffer_.empty())
+  {
+    // pooled storage is taken when there is something to read
+    ensureWritableBytes(kInitialSize);
+  }
   struct iovec vec[2];
   const size_t writable = writableBytes();
   vec[0].iov_base = begin()+writerIndex_;
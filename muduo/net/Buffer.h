@@ -15,6 +15,7 @@
 #include "muduo/base/StringPiece.h"
 #include "muduo/base/Types.h"
 
+#include "muduo/net/BufferPool.h"
 #include "muduo/net/Endian.h"
 
 #include <algorithm>
@@ -39,6 +40,9 @@ namespace net
 /// |                   |                  |                  |
 /// 0      <=      readerIndex   <=   writerIndex    <=     size
 /// @endcode
+///
+/// A Buffer drawing from a BufferPool has no storage until written, grows
+/// by size classes and gives its storage back with release().
 class Buffer : public muduo::copyable
 {
  public:
@@ -55,7 +59,16 @@ class Buffer : public muduo::copyable
     assert(prependableBytes() == kCheapPrepend);
   }
 
+  /// Pooled, allocates on the first write.
+  explicit Buffer(const std::shared_ptr<BufferPool>& pool)
+    : buffer_(BufferAllocator(pool)),
+      readerIndex_(kCheapPrepend),
+      writerIndex_(kCheapPrepend)
+  {
+  }
+
   // implicit copy-ctor, move-ctor, dtor and assignment are fine
+  // copies are not pooled, see BufferAllocator
   // NOTE: implicit move-ctor is added in g++ 4.6
 
   void swap(Buffer& rhs)
@@ -69,7 +82,7 @@ class Buffer : public muduo::copyable
   { return writerIndex_ - readerIndex_; }
 
   size_t writableBytes() const
-  { return buffer_.size() - writerIndex_; }
+  { return buffer_.size() > writerIndex_ ? buffer_.size() - writerIndex_ : 0; }
 
   size_t prependableBytes() const
   { return readerIndex_; }
@@ -353,6 +366,10 @@ class Buffer : public muduo::copyable
 
   void prepend(const void* /*restrict*/ data, size_t len)
   {
+    if (buffer_.empty())
+    {
+      makeSpace(0);
+    }
     assert(len <= prependableBytes());
     readerIndex_ -= len;
     const char* d = static_cast<const char*>(data);
@@ -362,7 +379,7 @@ class Buffer : public muduo::copyable
   void shrink(size_t reserve)
   {
     // FIXME: use vector::shrink_to_fit() in C++ 11 if possible.
-    Buffer other;
+    Buffer other = pooled() ? Buffer(pool()) : Buffer();
     other.ensureWritableBytes(readableBytes()+reserve);
     other.append(toStringPiece());
     swap(other);
@@ -373,6 +390,36 @@ class Buffer : public muduo::copyable
     return buffer_.capacity();
   }
 
+  bool pooled() const
+  { return static_cast<bool>(buffer_.get_allocator().pool()); }
+
+  std::shared_ptr<BufferPool> pool() const
+  { return buffer_.get_allocator().pool(); }
+
+  /// Gives the storage back to the pool if nothing is readable.
+  /// No-op if not pooled.
+  void release()
+  {
+    if (readableBytes() == 0 && !buffer_.empty() && pooled())
+    {
+      Storage(buffer_.get_allocator()).swap(buffer_);
+      retrieveAll();
+    }
+  }
+
+  /// Moves the storage to @c pool, or to the heap if @c pool is null,
+  /// keeping the content.
+  void setPool(const std::shared_ptr<BufferPool>& pool)
+  {
+    if (this->pool() == pool)
+    {
+      return;
+    }
+    Buffer other = pool ? Buffer(pool) : Buffer();
+    other.append(peek(), readableBytes());
+    swap(other);
+  }
+
   /// Read data directly into buffer.
   ///
   /// It may implement with readv(2)
@@ -382,17 +429,18 @@ class Buffer : public muduo::copyable
  private:
 
   char* begin()
-  { return &*buffer_.begin(); }
+  { return buffer_.data(); }
 
   const char* begin() const
-  { return &*buffer_.begin(); }
+  { return buffer_.data(); }
 
   void makeSpace(size_t len)
   {
     if (writableBytes() + prependableBytes() < len + kCheapPrepend)
     {
       // FIXME: move readable data
-      buffer_.resize(writerIndex_+len);
+      // pooled storage takes the whole block of its class
+      buffer_.resize(pooled() ? BufferPool::roundUp(writerIndex_+len) : writerIndex_+len);
     }
     else
     {
@@ -409,7 +457,9 @@ class Buffer : public muduo::copyable
   }
 
  private:
-  std::vector<char> buffer_;
+  typedef std::vector<char, BufferAllocator> Storage;
+
+  Storage buffer_;
   size_t readerIndex_;
   size_t writerIndex_;
 
@@ -0,0 +1,106 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+#include "muduo/net/BufferPool.h"
+
+#include "muduo/base/CurrentThread.h"
+
+using namespace muduo;
+using namespace muduo::net;
+
+const size_t BufferPool::kMinClassSize;
+const int BufferPool::kNumClasses;
+const size_t BufferPool::kMaxClassSize;
+
+BufferPool::BufferPool()
+  : threadId_(CurrentThread::tid()),
+    detached_(false),
+    maxPooledBytes_(16 * 1024 * 1024),
+    liveBytes_(0),
+    pooledBytes_(0),
+    hits_(0),
+    allocations_(0)
+{
+}
+
+BufferPool::~BufferPool()
+{
+  for (std::vector<char*>& freeList : freeLists_)
+  {
+    for (char* p : freeList)
+    {
+      ::operator delete(p);
+    }
+  }
+}
+
+int BufferPool::classOf(size_t n)
+{
+  int index = 0;
+  size_t size = kMinClassSize;
+  while (size < n)
+  {
+    size <<= 1;
+    ++index;
+  }
+  return index;
+}
+
+size_t BufferPool::roundUp(size_t n)
+{
+  return n > kMaxClassSize ? n : kMinClassSize << classOf(n);
+}
+
+bool BufferPool::recycling() const
+{
+  return threadId_ == CurrentThread::tid()
+      && !detached_.load(std::memory_order_relaxed);
+}
+
+char* BufferPool::allocate(size_t n)
+{
+  const size_t size = roundUp(n);
+  allocations_.fetch_add(1, std::memory_order_relaxed);
+  liveBytes_.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed);
+  if (size <= kMaxClassSize && recycling())
+  {
+    std::vector<char*>& freeList = freeLists_[classOf(size)];
+    if (!freeList.empty())
+    {
+      char* p = freeList.back();
+      freeList.pop_back();
+      hits_.fetch_add(1, std::memory_order_relaxed);
+      pooledBytes_.fetch_sub(static_cast<int64_t>(size), std::memory_order_relaxed);
+      return p;
+    }
+  }
+  return static_cast<char*>(::operator new(size));
+}
+
+void BufferPool::deallocate(char* p, size_t n)
+{
+  const size_t size = roundUp(n);
+  liveBytes_.fetch_sub(static_cast<int64_t>(size), std::memory_order_relaxed);
+  if (size <= kMaxClassSize && recycling()
+      && static_cast<size_t>(pooledBytes()) + size <= maxPooledBytes_)
+  {
+    freeLists_[classOf(size)].push_back(p);
+    pooledBytes_.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed);
+    return;
+  }
+  ::operator delete(p);
+}
+
+void BufferPool::detach()
+{
+  detached_.store(true, std::memory_order_relaxed);
+  for (std::vector<char*>& freeList : freeLists_)
+  {
+    for (char* p : freeList)
+    {
+      ::operator delete(p);
+    }
+    std::vector<char*>().swap(freeList);
+  }
+  pooledBytes_.store(0, std::memory_order_relaxed);
+}
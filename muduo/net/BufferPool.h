@@ -0,0 +1,151 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_BUFFERPOOL_H
+#define MUDUO_NET_BUFFERPOOL_H
+
+#include "muduo/base/noncopyable.h"
+
+#include <atomic>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace muduo
+{
+namespace net
+{
+
+///
+/// Storage of the Buffers of one EventLoop, in power-of-two size classes
+/// from 1KiB to 256KiB, each with a free list.
+///
+/// Blocks are recycled only in the thread that created the pool, blocks
+/// freed elsewhere, or after detach(), go back to the heap, so a Buffer
+/// may outlive the loop or leave it.
+///
+class BufferPool : noncopyable
+{
+ public:
+  static const size_t kMinClassSize = 1024;
+  static const int kNumClasses = 9;
+  static const size_t kMaxClassSize = kMinClassSize << (kNumClasses - 1);
+
+  BufferPool();
+  ~BufferPool();
+
+  /// Returns the size of the class serving @c n bytes,
+  /// or @c n if it's larger than kMaxClassSize.
+  static size_t roundUp(size_t n);
+
+  char* allocate(size_t n);
+  void deallocate(char* p, size_t n);
+
+  /// Idle blocks beyond this go back to the heap. In the pool's thread.
+  void setMaxPooledBytes(size_t bytes) { maxPooledBytes_ = bytes; }
+
+  /// Frees idle blocks and stops recycling, for the owner going away.
+  /// Not thread safe, call it after the owner stopped using the pool.
+  void detach();
+
+  /// Bytes handed out to Buffers. Thread safe.
+  int64_t liveBytes() const { return liveBytes_.load(std::memory_order_relaxed); }
+  /// Bytes idle in free lists. Thread safe.
+  int64_t pooledBytes() const { return pooledBytes_.load(std::memory_order_relaxed); }
+  /// Allocations served from free lists, and all allocations. Thread safe.
+  int64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+  int64_t allocations() const { return allocations_.load(std::memory_order_relaxed); }
+
+ private:
+  static int classOf(size_t n);
+  bool recycling() const;
+
+  const pid_t threadId_;
+  std::atomic<bool> detached_;
+  size_t maxPooledBytes_;
+  std::vector<char*> freeLists_[kNumClasses];
+  std::atomic<int64_t> liveBytes_;
+  std::atomic<int64_t> pooledBytes_;
+  std::atomic<int64_t> hits_;
+  std::atomic<int64_t> allocations_;
+};
+
+///
+/// Allocator of Buffer, from a BufferPool if any, otherwise from the heap.
+///
+/// Copies of a Buffer don't inherit the pool, the storage and its pool
+/// travel together when Buffers are swapped or moved.
+///
+class BufferAllocator
+{
+ public:
+  typedef char value_type;
+  typedef std::true_type propagate_on_container_move_assignment;
+  typedef std::true_type propagate_on_container_swap;
+
+  template <typename U>
+  struct rebind
+  {
+    typedef BufferAllocator other;
+  };
+
+  BufferAllocator()
+  {
+  }
+
+  explicit BufferAllocator(const std::shared_ptr<BufferPool>& pool)
+    : pool_(pool)
+  {
+  }
+
+  char* allocate(size_t n)
+  {
+    return pool_ ? pool_->allocate(n) : static_cast<char*>(::operator new(n));
+  }
+
+  void deallocate(char* p, size_t n)
+  {
+    if (pool_)
+    {
+      pool_->deallocate(p, n);
+    }
+    else
+    {
+      ::operator delete(p);
+    }
+  }
+
+  BufferAllocator select_on_container_copy_construction() const
+  {
+    return BufferAllocator();
+  }
+
+  const std::shared_ptr<BufferPool>& pool() const
+  {
+    return pool_;
+  }
+
+  bool operator==(const BufferAllocator& rhs) const
+  {
+    return pool_ == rhs.pool_;
+  }
+
+  bool operator!=(const BufferAllocator& rhs) const
+  {
+    return pool_ != rhs.pool_;
+  }
+
+ private:
+  std::shared_ptr<BufferPool> pool_;
+};
+
+}  // namespace net
+}  // namespace muduo
+
+#endif  // MUDUO_NET_BUFFERPOOL_H
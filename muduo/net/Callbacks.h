@@ -16,6 +16,8 @@
 #include <functional>
 #include <memory>
 
+#include <sys/types.h>  // ssize_t
+
 namespace muduo
 {
 
@@ -71,6 +73,9 @@ typedef std::function<void (const TcpConnectionPtr&,
                             Buffer*,
                             Timestamp)> MessageCallback;
 
+// reads the socket some other way, returns as read(2) does
+typedef std::function<ssize_t (const TcpConnectionPtr&, int sockfd)> RawReadCallback;
+
 void defaultConnectionCallback(const TcpConnectionPtr& conn);
 void defaultMessageCallback(const TcpConnectionPtr& conn,
                             Buffer* buffer,
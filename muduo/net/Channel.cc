@@ -28,6 +28,10 @@ Channel::Channel(EventLoop *loop, int fd__)
       revents_(0),
       index_(-1),
       logHup_(true),
+      edgeTriggered_(false),
+      sendQueued_(false),
+      receiveBuffer_(NULL),
+      sendQueue_(NULL),
       tied_(false),  // 默认不进行关联，accept 的 channel 不关联，TcpConnection 的 channel 进行关联
       eventHandling_(false),
       addedToLoop_(false)
@@ -71,6 +75,15 @@ void Channel::remove()
     loop_->removeChannel(this);
 }
 
+bool Channel::queueSend()
+{
+    if (!sendQueued_ && sendQueue_ && loop_->queueSend(this))
+    {
+        sendQueued_ = true;
+    }
+    return sendQueued_;
+}
+
 // 事件回调处理（这个函数不用注册，直接在 EventLoop 中调用）
 void Channel::handleEvent(Timestamp receiveTime)
 {
@@ -132,6 +145,9 @@ void Channel::handleEventWithGuard(Timestamp receiveTime)
             // 可写事件
             writeCallback_();
     }
+    // 回调没有取走的结果不能留到下一轮
+    received_.valid = false;
+    sent_.valid = false;
     // 事件处理完毕
     eventHandling_ = false;
 }
@@ -17,12 +17,16 @@
 #include <functional>
 #include <memory>
 
+#include <sys/types.h>  // ssize_t
+
 namespace muduo
 {
 namespace net
 {
 
+class Buffer;
 class EventLoop;
+class OutputQueue;
 
 ///
 /// A selectable I/O channel.
@@ -98,15 +102,18 @@ public:
         events_ &= ~kWriteEvent;
         update();
     }
-    // 删除所有事件到 poll
+    // 删除所有事件到 poll，排队的批量发送也取消
     void disableAll()
     {
         events_ = kNoneEvent;
+        sendQueued_ = false;
         update();
     }
     // 判断这个套接字所关心的事件
     bool isWriting() const { return events_ & kWriteEvent; }
     bool isReading() const { return events_ & kReadEvent; }
+    // 是否已经注册到 loop 的 poller 中
+    bool addedToLoop() const { return addedToLoop_; }
 
     // for Poller poll 使用的接口
     int index() { return index_; }
@@ -117,11 +124,75 @@ public:
     string eventsToString() const;
 
     void doNotLogHup() { logHup_ = false; }
+
+    /// The read callback drains the fd every time (eventfd, timerfd),
+    /// so the poller may report edges only, eg. io_uring multishot poll.
+    // 读回调每次都会读空 fd，poller 可以只报告边沿
+    void setEdgeTriggered(bool on) { edgeTriggered_ = on; }
+    bool edgeTriggered() const { return edgeTriggered_; }
+
+    /// For a poller that batches socket I/O, eg. IoUringPoller. It receives
+    /// into @c receiveBuffer for all readable channels, and sends from
+    /// @c sendQueue for all channels in queueSend(), one system call each
+    /// per round, then the read and write callbacks run with the results,
+    /// see takeReceived() and takeSent(). NULL to read or write as usual.
+    // 批量收发：poller 一次系统调用替所有 channel 收发，回调中取结果
+    void setBatchedIo(Buffer *receiveBuffer, OutputQueue *sendQueue)
+    {
+        receiveBuffer_ = receiveBuffer;
+        sendQueue_ = sendQueue;
+    }
+    Buffer *receiveBuffer() const { return receiveBuffer_; }
+    OutputQueue *sendQueue() const { return sendQueue_; }
+    /// Sends the send queue before the next poll, the write callback runs
+    /// then. Returns false if the poller doesn't batch, the caller writes.
+    bool queueSend();
+    bool sendQueued() const { return sendQueued_; }
+    /// In the read or write callback, true if the poller did the I/O,
+    /// @c n is as returned by read(2) or write(2).
+    bool takeReceived(ssize_t *n, int *savedErrno) { return received_.take(n, savedErrno); }
+    bool takeSent(ssize_t *n, int *savedErrno) { return sent_.take(n, savedErrno); }
+    // used by pollers
+    void setReceived(ssize_t n, int savedErrno) { received_.set(n, savedErrno); }
+    void setSent(ssize_t n, int savedErrno)
+    {
+        sendQueued_ = false;
+        sent_.set(n, savedErrno);
+    }
     // 返回这个线程的 Loop
     EventLoop *ownerLoop() { return loop_; }
     void remove();
 
 private:
+    // 批量收发的结果，只在本轮的回调中有效
+    struct IoResult
+    {
+        IoResult() : n(0), savedErrno(0), valid(false) {}
+
+        void set(ssize_t bytes, int err)
+        {
+            n = bytes;
+            savedErrno = err;
+            valid = true;
+        }
+
+        bool take(ssize_t *bytes, int *err)
+        {
+            if (!valid)
+            {
+                return false;
+            }
+            *bytes = n;
+            *err = savedErrno;
+            valid = false;
+            return true;
+        }
+
+        ssize_t n;
+        int savedErrno;
+        bool valid;
+    };
+
     static string eventsToString(int fd, int ev);
     // 把 channel 添加/修改 至 poll
     void update();
@@ -137,6 +208,12 @@ private:
     int revents_;     // it's the received event types of epoll or poll，目前活动的事件类型，由 Poll 修改返回
     int index_;       // used by Poller. 在 Poll 中进行使用
     bool logHup_;
+    bool edgeTriggered_;
+    bool sendQueued_;
+    Buffer *receiveBuffer_;
+    OutputQueue *sendQueue_;
+    IoResult received_;
+    IoResult sent_;
     // 这个 tie 用来保存 TcpConnection 对象指针，没来锁定
     std::weak_ptr<void> tie_;
     // 标识是否关联了 TcpConnection
@@ -0,0 +1,95 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+#include "muduo/net/ConnectionTable.h"
+
+#include <assert.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+ConnectionTable::ConnectionTable()
+{
+}
+
+ConnectionTable::~ConnectionTable()
+{
+}
+
+uint32_t ConnectionTable::allocateSlot(Shard &shard)
+{
+  if (!shard.freeSlots.empty())
+  {
+    uint32_t slot = shard.freeSlots.back();
+    shard.freeSlots.pop_back();
+    return slot;
+  }
+  assert(shard.slots.size() < (1u << kSlotBits));
+  shard.slots.emplace_back();
+  return static_cast<uint32_t>(shard.slots.size() - 1);
+}
+
+bool ConnectionTable::remove(ConnectionId id)
+{
+  Shard& shard = shards_[shardOf(id)];
+  uint32_t slot = slotOf(id);
+  TcpConnectionPtr conn;  // destroyed after unlocking
+  MutexLockGuard lock(shard.mutex);
+  if (slot >= shard.slots.size() || shard.slots[slot].generation != generationOf(id)
+      || !shard.slots[slot].conn)
+  {
+    return false;
+  }
+  Slot& s = shard.slots[slot];
+  conn.swap(s.conn);
+  ++s.generation;
+  shard.freeSlots.push_back(slot);
+  --shard.size;
+  return true;
+}
+
+TcpConnectionPtr ConnectionTable::get(ConnectionId id) const
+{
+  const Shard& shard = shards_[shardOf(id)];
+  uint32_t slot = slotOf(id);
+  MutexLockGuard lock(shard.mutex);
+  if (slot >= shard.slots.size() || shard.slots[slot].generation != generationOf(id))
+  {
+    return TcpConnectionPtr();
+  }
+  return shard.slots[slot].conn;
+}
+
+size_t ConnectionTable::size() const
+{
+  size_t n = 0;
+  for (const Shard& shard : shards_)
+  {
+    MutexLockGuard lock(shard.mutex);
+    n += shard.size;
+  }
+  return n;
+}
+
+void ConnectionTable::takeAll(std::vector<TcpConnectionPtr>* conns)
+{
+  for (Shard& shard : shards_)
+  {
+    MutexLockGuard lock(shard.mutex);
+    for (Slot& s : shard.slots)
+    {
+      if (s.conn)
+      {
+        conns->push_back(TcpConnectionPtr());
+        conns->back().swap(s.conn);
+        ++s.generation;
+      }
+    }
+    shard.freeSlots.clear();
+    for (uint32_t i = 0; i < shard.slots.size(); ++i)
+    {
+      shard.freeSlots.push_back(i);
+    }
+    shard.size = 0;
+  }
+}
@@ -0,0 +1,152 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// This is an internal header file, you should not include this.
+
+#ifndef MUDUO_NET_CONNECTIONTABLE_H
+#define MUDUO_NET_CONNECTIONTABLE_H
+
+#include "muduo/base/Mutex.h"
+#include "muduo/net/TcpConnection.h"
+
+#include <vector>
+
+namespace muduo
+{
+namespace net
+{
+
+///
+/// Connections of a TcpServer, indexed by integer ids.
+///
+/// An id packs (generation, slot, shard), a freed slot is reused with the
+/// next generation, so a stale id never finds the new occupant. Shards
+/// have their own locks, adding in the accepting loop and removing in
+/// the IO loops seldom contend. No allocation once slots are warm.
+///
+class ConnectionTable : noncopyable
+{
+ public:
+  typedef uint64_t ConnectionId;
+
+  ConnectionTable();
+  ~ConnectionTable();
+
+  /// Constructs the connection with @c make(id) and stores it, in the
+  /// shard chosen by @c hint, the sockfd. Thread safe.
+  template <typename Factory>
+  TcpConnectionPtr add(int hint, Factory make);
+
+  /// Returns false if @c id is not (or no longer) in the table.
+  /// Thread safe.
+  bool remove(ConnectionId id);
+
+  /// Returns null if @c id is not in the table. Thread safe.
+  TcpConnectionPtr get(ConnectionId id) const;
+
+  /// Thread safe.
+  size_t size() const;
+
+  /// Calls @c f on every connection, holding the lock of one shard
+  /// at a time. Thread safe, @c f mustn't add or remove.
+  template <typename Func>
+  void forEach(Func f) const;
+
+  /// Like forEach(), also passes a counter kept in the slot for the
+  /// caller, zero for a new connection, as @c f(conn, &mark).
+  /// Thread safe, @c f mustn't add or remove.
+  template <typename Func>
+  void forEachMarked(Func f);
+
+  /// Empties the table into @c conns. Thread safe.
+  void takeAll(std::vector<TcpConnectionPtr>* conns);
+
+ private:
+  static const int kShardBits = 4;
+  static const int kNumShards = 1 << kShardBits;
+  static const int kSlotBits = 28;
+
+  struct Slot
+  {
+    Slot() : mark(0), generation(0) {}
+
+    TcpConnectionPtr conn;
+    int64_t mark;
+    uint32_t generation;
+  };
+
+  struct Shard
+  {
+    Shard() : size(0) {}
+
+    mutable MutexLock mutex;
+    std::vector<Slot> slots GUARDED_BY(mutex);
+    std::vector<uint32_t> freeSlots GUARDED_BY(mutex);
+    size_t size GUARDED_BY(mutex);
+  };
+
+  static ConnectionId makeId(uint32_t generation, uint32_t slot, int shard)
+  {
+    return static_cast<ConnectionId>(generation) << 32 |
+        slot << kShardBits | static_cast<uint32_t>(shard);
+  }
+
+  static uint32_t generationOf(ConnectionId id) { return static_cast<uint32_t>(id >> 32); }
+  static uint32_t slotOf(ConnectionId id) { return static_cast<uint32_t>(id) >> kShardBits; }
+  static int shardOf(ConnectionId id) { return static_cast<int>(id & (kNumShards - 1)); }
+
+  static uint32_t allocateSlot(Shard& shard) REQUIRES(shard.mutex);
+
+  Shard shards_[kNumShards];
+};
+
+template <typename Factory>
+TcpConnectionPtr ConnectionTable::add(int hint, Factory make)
+{
+  int index = hint & (kNumShards - 1);
+  Shard& shard = shards_[index];
+  MutexLockGuard lock(shard.mutex);
+  uint32_t slot = allocateSlot(shard);
+  Slot& s = shard.slots[slot];
+  s.conn = make(makeId(s.generation, slot, index));
+  s.mark = 0;
+  ++shard.size;
+  return s.conn;
+}
+
+template <typename Func>
+void ConnectionTable::forEach(Func f) const
+{
+  for (const Shard& shard : shards_)
+  {
+    MutexLockGuard lock(shard.mutex);
+    for (const Slot& s : shard.slots)
+    {
+      if (s.conn)
+      {
+        f(s.conn);
+      }
+    }
+  }
+}
+
+template <typename Func>
+void ConnectionTable::forEachMarked(Func f)
+{
+  for (Shard& shard : shards_)
+  {
+    MutexLockGuard lock(shard.mutex);
+    for (Slot& s : shard.slots)
+    {
+      if (s.conn)
+      {
+        f(s.conn, &s.mark);
+      }
+    }
+  }
+}
+
+}  // namespace net
+}  // namespace muduo
+
+#endif  // MUDUO_NET_CONNECTIONTABLE_H
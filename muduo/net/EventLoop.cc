@@ -10,6 +10,7 @@
 
 #include "muduo/base/Logging.h"
 #include "muduo/base/Mutex.h"
+#include "muduo/net/BufferPool.h"
 #include "muduo/net/Channel.h"
 #include "muduo/net/Poller.h"
 #include "muduo/net/SocketsOps.h"
@@ -55,6 +56,81 @@ public:
 #pragma GCC diagnostic error "-Wold-style-cast"
 
 IgnoreSigPipe initObj;
+
+// pendingFunctors_ 的节点，用完后回收复用，稳定运行时 queueInLoop 不再分配内存
+struct FunctorNode : public MpscQueue::Node
+{
+    EventLoop::Functor functor;
+    FunctorNode *nextFree;
+};
+
+// 所有 loop 共享的空闲节点栈，消费者归还节点，生产者一次取走全部，没有 ABA 问题
+std::atomic<FunctorNode *> g_freeNodes(NULL);
+
+// 每个线程自己缓存的空闲节点
+struct FunctorNodeCache
+{
+    static const int kMaxCached = 256;
+
+    FunctorNodeCache() : head(NULL), size(0) {}
+
+    ~FunctorNodeCache()
+    {
+        while (head)
+        {
+            FunctorNode *node = head;
+            head = node->nextFree;
+            delete node;
+        }
+    }
+
+    FunctorNode *head;
+    int size;
+};
+
+thread_local FunctorNodeCache t_nodeCache;
+
+FunctorNode *allocNode()
+{
+    FunctorNodeCache &cache = t_nodeCache;
+    if (cache.head == NULL)
+    {
+        cache.head = g_freeNodes.exchange(NULL, std::memory_order_acquire);
+        cache.size = 0;
+        for (FunctorNode *node = cache.head; node; node = node->nextFree)
+        {
+            ++cache.size;
+        }
+    }
+    if (cache.head)
+    {
+        FunctorNode *node = cache.head;
+        cache.head = node->nextFree;
+        --cache.size;
+        return node;
+    }
+    return new FunctorNode;
+}
+
+void freeNode(FunctorNode *node)
+{
+    FunctorNodeCache &cache = t_nodeCache;
+    if (cache.size < FunctorNodeCache::kMaxCached)
+    {
+        node->nextFree = cache.head;
+        cache.head = node;
+        ++cache.size;
+    }
+    else
+    {
+        node->nextFree = g_freeNodes.load(std::memory_order_relaxed);
+        while (!g_freeNodes.compare_exchange_weak(node->nextFree, node,
+                                                  std::memory_order_release,
+                                                  std::memory_order_relaxed))
+        {
+        }
+    }
+}
 } // namespace
 
 // 获取线程中的 EventLoop，基本用来做断言判断了
@@ -74,7 +150,13 @@ EventLoop::EventLoop()
       timerQueue_(new TimerQueue(this)),            // 时间处理队列
       wakeupFd_(createEventfd()),                   // 监控 fd，用于事件通知
       wakeupChannel_(new Channel(this, wakeupFd_)), // 这个 fd 对应的 channel
-      currentActiveChannel_(NULL)
+      currentActiveChannel_(NULL),
+      numPendingFunctors_(0),
+      wakeupPending_(false),
+      numConnections_(0),
+      pendingOutputBytes_(0),
+      busyMicroSeconds_(0),
+      bufferPool_(std::make_shared<BufferPool>())
 {
     LOG_DEBUG << "EventLoop created " << this << " in thread " << threadId_;
     if (t_loopInThisThread)
@@ -92,6 +174,7 @@ EventLoop::EventLoop()
         std::bind(&EventLoop::handleRead, this));
     // we are always reading the wakeupfd
     // 我们一直对 wakeupfd 进行可读监听
+    wakeupChannel_->setEdgeTriggered(true);
     wakeupChannel_->enableReading();
 }
 
@@ -103,6 +186,15 @@ EventLoop::~EventLoop()
     wakeupChannel_->disableAll();
     wakeupChannel_->remove();
     ::close(wakeupFd_);
+    // 丢弃没来得及执行的函数
+    while (MpscQueue::Node *node = pendingFunctors_.pop())
+    {
+        FunctorNode *fn = static_cast<FunctorNode *>(node);
+        fn->functor = Functor(); // 绑定的对象现在释放，不留在节点缓存里
+        freeNode(fn);
+    }
+    // 之后归还的内存直接释放
+    bufferPool_->detach();
     t_loopInThisThread = NULL;
 }
 
@@ -139,6 +231,10 @@ void EventLoop::loop()
         eventHandling_ = false; // 事件处理完毕
         // TODO，暂时不懂
         doPendingFunctors();
+        // 本轮处理事件和函数队列花费的时间
+        busyMicroSeconds_.fetch_add(Timestamp::now().microSecondsSinceEpoch()
+                                        - pollReturnTime_.microSecondsSinceEpoch(),
+                                    std::memory_order_relaxed);
     }
 
     LOG_TRACE << "EventLoop " << this << " stop looping";
@@ -171,23 +267,30 @@ void EventLoop::runInLoop(Functor cb)
 // 添加到队列中等待执行
 void EventLoop::queueInLoop(Functor cb)
 {
-    {
-        MutexLockGuard lock(mutex_);
-        // 添加到 pendingFunctors_ 中
-        pendingFunctors_.push_back(std::move(cb));
-    }
+    FunctorNode *node = allocNode();
+    node->functor = std::move(cb);
+    // 只用于 queueSize()，近似值即可
+    numPendingFunctors_.fetch_add(1, std::memory_order_relaxed);
+    pendingFunctors_.push(node);
     // 不是同一个线程但是正在执行函数，唤醒它
+    // 已经有人唤醒过且 loop 还没处理时，省掉这次 write，
+    // 先读一次标志，避免每次都在共享的缓存行上做原子交换
     if (!isInLoopThread() || callingPendingFunctors_)
     {
-        wakeup();
+        // 和 doPendingFunctors 中的 fence 配对：要么看到标志已清除，要么 loop 看到本节点
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!wakeupPending_.load(std::memory_order_relaxed) &&
+            !wakeupPending_.exchange(true, std::memory_order_relaxed))
+        {
+            wakeup();
+        }
     }
 }
 
 // 等待函数队列长度
 size_t EventLoop::queueSize() const
 {
-    MutexLockGuard lock(mutex_);
-    return pendingFunctors_.size();
+    return numPendingFunctors_.load(std::memory_order_relaxed);
 }
 
 // 在 time 时间执行
@@ -215,6 +318,13 @@ void EventLoop::cancel(TimerId timerId)
     return timerQueue_->cancel(timerId);
 }
 
+// 定时器改用时间轮
+void EventLoop::useTimingWheel(double tickSeconds)
+{
+    assertInLoopThread();
+    timerQueue_->useTimingWheel(tickSeconds);
+}
+
 // 更新 Poll
 void EventLoop::updateChannel(Channel *channel)
 {
@@ -244,6 +354,13 @@ bool EventLoop::hasChannel(Channel *channel)
     return poller_->hasChannel(channel);
 }
 
+bool EventLoop::queueSend(Channel *channel)
+{
+    assert(channel->ownerLoop() == this);
+    assertInLoopThread();
+    return poller_->queueSend(channel);
+}
+
 void EventLoop::abortNotInLoopThread()
 {
     LOG_FATAL << "EventLoop::abortNotInLoopThread - EventLoop " << this
@@ -276,19 +393,30 @@ void EventLoop::handleRead()
 // 队列中等待运行的函数
 void EventLoop::doPendingFunctors()
 {
-    std::vector<Functor> functors;
     callingPendingFunctors_ = true;
+    // 先清除标志再取队列，之后入队的生产者会重新唤醒我们
+    wakeupPending_.store(false, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
 
+    // 只执行本轮开始前已入队的函数，和以前 swap 的语义一致
+    MpscQueue::Node *last = pendingFunctors_.back();
+    while (last)
     {
-        MutexLockGuard lock(mutex_);
-        // 把函数移到 functors 中
-        functors.swap(pendingFunctors_);
-    }
-
-    for (const Functor &functor : functors)
-    {
+        MpscQueue::Node *node = pendingFunctors_.pop();
+        if (node == NULL)
+        {
+            break; // a producer is in the middle of push(), it will wake us up
+        }
+        FunctorNode *fn = static_cast<FunctorNode *>(node);
+        numPendingFunctors_.fetch_sub(1, std::memory_order_relaxed);
         // 执行
-        functor();
+        fn->functor();
+        fn->functor = Functor(); // release bound objects in loop thread
+        freeNode(fn);
+        if (node == last)
+        {
+            break;
+        }
     }
     callingPendingFunctors_ = false;
 }
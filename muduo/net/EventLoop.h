@@ -13,12 +13,14 @@
 
 #include <atomic>
 #include <functional>
+#include <memory>
 #include <vector>
 
 #include <boost/any.hpp>
 
 #include "muduo/base/Mutex.h"
 #include "muduo/base/CurrentThread.h"
+#include "muduo/base/MpscQueue.h"
 #include "muduo/base/Timestamp.h"
 #include "muduo/net/Callbacks.h"
 #include "muduo/net/TimerId.h"
@@ -28,6 +30,7 @@ namespace muduo
 namespace net
 {
 
+class BufferPool;
 class Channel;
 class Poller;
 class TimerQueue;
@@ -103,11 +106,57 @@ public:
     ///
     void cancel(TimerId timerId);
 
+    ///
+    /// Uses a hierarchical timing wheel for timers of this loop,
+    /// O(1) add and cancel with @c tickSeconds precision,
+    /// instead of the default O(log n) std::set.
+    /// Must be called in loop thread, eg. from ThreadInitCallback.
+    /// Can also be turned on for all loops by MUDUO_USE_TIMING_WHEEL env var.
+    ///
+    void useTimingWheel(double tickSeconds = 0.001);
+
+    ///
+    /// Load of this loop, updated by its TcpConnections in the loop thread,
+    /// read by EventLoopThreadPool to place new connections. A connection
+    /// TcpServer has placed here is counted before it is established.
+    /// Safe to call from other threads.
+    ///
+    // 负载统计：连接数和输出队列中尚未写出的字节数
+    int numConnections() const
+    {
+        return numConnections_.load(std::memory_order_relaxed);
+    }
+    int64_t pendingOutputBytes() const
+    {
+        return pendingOutputBytes_.load(std::memory_order_relaxed);
+    }
+    /// Time spent handling events and functors since the loop started,
+    /// sample it twice for the busy ratio of an interval.
+    int64_t busyMicroSeconds() const
+    {
+        return busyMicroSeconds_.load(std::memory_order_relaxed);
+    }
+
+    /// Storage of the Buffers of the TcpConnections in this loop,
+    /// for its stats.
+    // 本 loop 中各连接 Buffer 的内存池
+    const std::shared_ptr<BufferPool> &bufferPool() const { return bufferPool_; }
+
     // internal usage
+    void addConnections(int delta)
+    {
+        numConnections_.fetch_add(delta, std::memory_order_relaxed);
+    }
+    void addPendingOutputBytes(int64_t delta)
+    {
+        pendingOutputBytes_.fetch_add(delta, std::memory_order_relaxed);
+    }
     void wakeup();
     void updateChannel(Channel *channel);
     void removeChannel(Channel *channel);
     bool hasChannel(Channel *channel);
+    // 由 poller 在下次等待前批量发送，见 Channel::queueSend()
+    bool queueSend(Channel *channel);
 
     // pid_t threadId() const { return threadId_; }
     // 判断是否处当前线程
@@ -170,10 +219,17 @@ private:
     // scratch variables
     ChannelList activeChannels_;    // 当前 Eventloop 持有的 channel
     Channel *currentActiveChannel_; // 当前活动 channels
-    // loop 需要全局锁
-    mutable MutexLock mutex_;
-    // 等待在本线程上执行的函数
-    std::vector<Functor> pendingFunctors_ GUARDED_BY(mutex_);
+    // 等待在本线程上执行的函数，无锁多生产者单消费者队列
+    MpscQueue pendingFunctors_;
+    std::atomic<size_t> numPendingFunctors_;
+    // 已经写过 wakeupFd_ 且 loop 尚未处理，其他生产者不必再写
+    std::atomic<bool> wakeupPending_;
+    // 负载统计，只由本线程修改
+    std::atomic<int> numConnections_;
+    std::atomic<int64_t> pendingOutputBytes_;
+    std::atomic<int64_t> busyMicroSeconds_;
+    // Buffer 可能比 loop 活得久，所以用 shared_ptr
+    std::shared_ptr<BufferPool> bufferPool_;
 };
 
 } // namespace net
@@ -8,8 +8,10 @@
 
 #include "muduo/net/EventLoopThreadPool.h"
 
+#include "muduo/net/BufferPool.h"
 #include "muduo/net/EventLoop.h"
 #include "muduo/net/EventLoopThread.h"
+#include "muduo/net/InetAddress.h"
 
 #include <stdio.h>
 
@@ -22,7 +24,8 @@ EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseLoop, const string &name
       name_(nameArg),
       started_(false),
       numThreads_(0),
-      next_(0)
+      next_(0),
+      policy_(kRoundRobin)
 {
 }
 
@@ -50,6 +53,7 @@ void EventLoopThreadPool::start(const ThreadInitCallback &cb)
         threads_.push_back(std::unique_ptr<EventLoopThread>(t));
         loops_.push_back(t->startLoop());
     }
+    assigned_.resize(loops_.empty() ? 1 : loops_.size());
     if (numThreads_ == 0 && cb)
     {
         cb(baseLoop_);
@@ -90,6 +94,112 @@ EventLoop *EventLoopThreadPool::getLoopForHash(size_t hashCode)
     return loop;
 }
 
+namespace
+{
+int64_t connectionsOf(const EventLoop *loop)
+{
+    return loop->numConnections();
+}
+
+int64_t pendingBytesOf(const EventLoop *loop)
+{
+    return loop->pendingOutputBytes();
+}
+}
+
+int64_t EventLoopThreadPool::loadOf(const EventLoop *loop)
+{
+    return loop->pendingOutputBytes() + loop->numConnections() * kBytesPerConnection;
+}
+
+// 负载最小的 loop，相同时取连接数少的，再相同取序号小的
+size_t EventLoopThreadPool::leastLoaded(int64_t (*load)(const EventLoop *)) const
+{
+    size_t best = 0;
+    int64_t bestLoad = load(loops_[0]);
+    int bestConnections = loops_[0]->numConnections();
+    for (size_t i = 1; i < loops_.size(); ++i)
+    {
+        int64_t l = load(loops_[i]);
+        int connections = loops_[i]->numConnections();
+        if (l < bestLoad || (l == bestLoad && connections < bestConnections))
+        {
+            best = i;
+            bestLoad = l;
+            bestConnections = connections;
+        }
+    }
+    return best;
+}
+
+// 按策略为新连接选择 loop
+EventLoop *EventLoopThreadPool::getLoopForConnection(const InetAddress &peerAddr)
+{
+    baseLoop_->assertInLoopThread();
+    assert(started_);
+    if (loops_.empty())
+    {
+        ++assigned_[0];
+        return baseLoop_;
+    }
+    size_t index = 0;
+    switch (policy_)
+    {
+    case kRoundRobin:
+        index = next_;
+        getNextLoop();
+        break;
+    case kLeastConnections:
+        index = leastLoaded(connectionsOf);
+        break;
+    case kLeastPendingBytes:
+        index = leastLoaded(pendingBytesOf);
+        break;
+    case kPowerOfTwoChoices:
+    {
+        // 随机两个不同的 loop，取负载小的
+        index = random_() % loops_.size();
+        if (loops_.size() > 1)
+        {
+            size_t other = (index + 1 + random_() % (loops_.size() - 1)) % loops_.size();
+            if (loadOf(loops_[other]) < loadOf(loops_[index]))
+            {
+                index = other;
+            }
+        }
+        break;
+    }
+    case kHashByPeer:
+    {
+        // 只用 IP，同一客户端的多个连接落在同一个 loop
+        size_t hash = peerAddr.family() == AF_INET
+                          ? peerAddr.ipNetEndian() * 2654435761u
+                          : std::hash<string>()(peerAddr.toIp());
+        index = hash % loops_.size();
+        break;
+    }
+    }
+    ++assigned_[index];
+    return loops_[index];
+}
+
+std::vector<EventLoopThreadPool::LoopStats> EventLoopThreadPool::getLoopStats()
+{
+    baseLoop_->assertInLoopThread(); // assigned_ 只在 base loop 中读写
+    std::vector<EventLoop *> loops = getAllLoops();
+    std::vector<LoopStats> stats(loops.size());
+    for (size_t i = 0; i < loops.size(); ++i)
+    {
+        stats[i].loop = loops[i];
+        stats[i].connections = loops[i]->numConnections();
+        stats[i].pendingOutputBytes = loops[i]->pendingOutputBytes();
+        stats[i].assigned = assigned_[i];
+        stats[i].bufferLiveBytes = loops[i]->bufferPool()->liveBytes();
+        stats[i].bufferPooledBytes = loops[i]->bufferPool()->pooledBytes();
+    }
+    return stats;
+}
+
 // 返回所有的 EventLoop
 std::vector<EventLoop *> EventLoopThreadPool::getAllLoops()
 {
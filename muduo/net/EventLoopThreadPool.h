@@ -16,6 +16,7 @@
 
 #include <functional>
 #include <memory>
+#include <random>
 #include <vector>
 
 namespace muduo
@@ -26,6 +27,7 @@ namespace net
 
 class EventLoop;
 class EventLoopThread;
+class InetAddress;
 // 线程池
 class EventLoopThreadPool : noncopyable
 {
@@ -33,9 +35,32 @@ public:
     // 线程初始化回调函数
     typedef std::function<void(EventLoop *)> ThreadInitCallback;
 
+    /// How getLoopForConnection() places a new connection.
+    // 新连接选择 loop 的策略
+    enum SelectionPolicy
+    {
+        kRoundRobin,         // getNextLoop()
+        kLeastConnections,   // fewest EventLoop::numConnections()
+        kLeastPendingBytes,  // fewest EventLoop::pendingOutputBytes()
+        kPowerOfTwoChoices,  // the less loaded of two random loops
+        kHashByPeer,         // same peer IP, same loop
+    };
+
+    /// Snapshot of the load of one loop.
+    struct LoopStats
+    {
+        EventLoop *loop;
+        int connections;
+        int64_t pendingOutputBytes;
+        int64_t assigned; // connections placed by getLoopForConnection()
+        int64_t bufferLiveBytes;   // see EventLoop::bufferPool()
+        int64_t bufferPooledBytes;
+    };
+
     EventLoopThreadPool(EventLoop *baseLoop, const string &nameArg);
     ~EventLoopThreadPool();
     void setThreadNum(int numThreads) { numThreads_ = numThreads; }
+    void setSelectionPolicy(SelectionPolicy policy) { policy_ = policy; }
     void start(const ThreadInitCallback &cb = ThreadInitCallback());
 
     // valid after calling start()
@@ -46,8 +71,14 @@ public:
     // 根据 hash 随机获取一个 Loop
     EventLoop *getLoopForHash(size_t hashCode);
 
+    /// picks a loop for a new connection from peerAddr, by the policy
+    EventLoop *getLoopForConnection(const InetAddress &peerAddr);
+
     std::vector<EventLoop *> getAllLoops();
 
+    /// one per loop, in the order of getAllLoops(), in the base loop thread
+    std::vector<LoopStats> getLoopStats();
+
     bool started() const
     {
         return started_;
@@ -59,6 +90,12 @@ public:
     }
 
 private:
+    // 每个已建立的连接折算成的积压字节数，用于 kPowerOfTwoChoices
+    static const int64_t kBytesPerConnection = 16 * 1024;
+
+    static int64_t loadOf(const EventLoop *loop);
+    size_t leastLoaded(int64_t (*load)(const EventLoop *)) const;
+
     // 主循环的 EventLoop
     EventLoop *baseLoop_;
     string name_;    // name
@@ -69,6 +106,9 @@ private:
     std::vector<std::unique_ptr<EventLoopThread>> threads_;
     // 所有 ThreadLoopThread 对应的 EventLoop
     std::vector<EventLoop *> loops_;
+    SelectionPolicy policy_;
+    std::vector<int64_t> assigned_; // 与 loops_ 对应，只在 base loop 中访问
+    std::minstd_rand random_;
 };
 
 } // namespace net
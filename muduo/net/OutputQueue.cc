@@ -0,0 +1,334 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+#include "muduo/net/OutputQueue.h"
+
+#include "muduo/net/Buffer.h"
+#include "muduo/net/SocketsOps.h"
+
+#include <algorithm>
+
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+namespace
+{
+
+// 借用分片的 "析构器"，只负责通知用户
+struct ReleaseNotifier
+{
+  explicit ReleaseNotifier(const OutputQueue::ReleaseCallback& cb)
+    : release(cb)
+  {
+  }
+
+  void operator()(const void*) const
+  {
+    if (release)
+    {
+      release();
+    }
+  }
+
+  OutputQueue::ReleaseCallback release;
+};
+
+}  // namespace
+
+const size_t OutputQueue::kBlockSize;
+const size_t OutputQueue::kSwapThreshold;
+const int OutputQueue::kMaxIovecs;
+
+OutputQueue::OutputQueue()
+  : readableBytes_(0)
+{
+}
+
+OutputQueue::OutputQueue(const std::shared_ptr<BufferPool>& pool)
+  : pool_(pool),
+    readableBytes_(0)
+{
+}
+
+OutputQueue::~OutputQueue()
+{
+}
+
+const char* OutputQueue::peek(const Slice& slice)
+{
+  return slice.block ? slice.block->peek() : slice.data;
+}
+
+size_t OutputQueue::length(const Slice& slice)
+{
+  return slice.block ? slice.block->readableBytes() : slice.len;
+}
+
+void OutputQueue::appendBlock(std::unique_ptr<Buffer> block)
+{
+  Slice slice;
+  slice.block = std::move(block);
+  slice.data = NULL;
+  slice.len = 0;
+  slice.fd = -1;
+  slice.offset = 0;
+  slice.pipe = false;
+  slices_.push_back(std::move(slice));
+}
+
+std::unique_ptr<Buffer> OutputQueue::newBlock()
+{
+  return std::unique_ptr<Buffer>(pool_ ? new Buffer(pool_) : new Buffer);
+}
+
+void OutputQueue::setPool(const std::shared_ptr<BufferPool>& pool)
+{
+  pool_ = pool;
+  spare_.reset();
+}
+
+void OutputQueue::append(const void* data, size_t len)
+{
+  if (len == 0)
+  {
+    return;
+  }
+  // 尾部是自有块且未满时直接合并，否则新开一个块
+  if (slices_.empty()
+      || !slices_.back().block
+      || (slices_.back().block->readableBytes() > 0
+          && slices_.back().block->readableBytes() + len > kBlockSize))
+  {
+    appendBlock(spare_ ? std::move(spare_) : newBlock());
+  }
+  slices_.back().block->append(data, len);
+  readableBytes_ += len;
+}
+
+void OutputQueue::append(Buffer* buf)
+{
+  const size_t len = buf->readableBytes();
+  if (len < kSwapThreshold)
+  {
+    append(buf->peek(), len);
+    buf->retrieveAll();
+  }
+  else
+  {
+    std::unique_ptr<Buffer> block(newBlock());
+    block->swap(*buf);
+    appendBlock(std::move(block));
+    readableBytes_ += len;
+  }
+}
+
+void OutputQueue::append(const std::shared_ptr<const void>& block,
+                         const void* data, size_t len)
+{
+  if (len == 0)
+  {
+    return;
+  }
+  Slice slice;
+  slice.data = static_cast<const char*>(data);
+  slice.len = len;
+  slice.holder = block;
+  slice.fd = -1;
+  slice.offset = 0;
+  slice.pipe = false;
+  slices_.push_back(std::move(slice));
+  readableBytes_ += len;
+}
+
+void OutputQueue::append(OutputQueue* queue)
+{
+  assert(queue != this);
+  while (!queue->slices_.empty())
+  {
+    Slice& front = queue->slices_.front();
+    if (front.block && front.block->readableBytes() < kSwapThreshold)
+    {
+      append(front.block->peek(), front.block->readableBytes());
+      if (!queue->spare_)
+      {
+        // for the next batch of queue
+        front.block->retrieveAll();
+        queue->spare_ = std::move(front.block);
+      }
+    }
+    else
+    {
+      readableBytes_ += length(front);
+      slices_.push_back(std::move(front));
+    }
+    queue->slices_.pop_front();
+  }
+  queue->readableBytes_ = 0;
+}
+
+void OutputQueue::appendFile(const std::shared_ptr<const void>& holder,
+                             int fd, off_t offset, size_t len)
+{
+  if (len == 0)
+  {
+    return;
+  }
+  struct stat st;
+  Slice slice;
+  slice.data = NULL;
+  slice.len = len;
+  slice.holder = holder;
+  slice.fd = fd;
+  slice.offset = offset;
+  slice.pipe = ::fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+  slices_.push_back(std::move(slice));
+  readableBytes_ += len;
+}
+
+std::shared_ptr<const void> OutputQueue::borrow(const void* data,
+                                                const ReleaseCallback& release)
+{
+  return std::shared_ptr<const void>(data, ReleaseNotifier(release));
+}
+
+void OutputQueue::retrieve(size_t len)
+{
+  assert(len <= readableBytes_);
+  readableBytes_ -= len;
+  while (len > 0)
+  {
+    assert(!slices_.empty());
+    Slice& front = slices_.front();
+    const size_t n = length(front);
+    if (len < n)
+    {
+      if (front.block)
+      {
+        front.block->retrieve(len);
+      }
+      else
+      {
+        if (front.fd >= 0)
+        {
+          front.offset += static_cast<off_t>(len);
+        }
+        else
+        {
+          front.data += len;
+        }
+        front.len -= len;
+      }
+      break;
+    }
+    len -= n;
+    if (front.block && !spare_)
+    {
+      // keep one drained block, so a busy connection doesn't malloc() per write
+      // a pooled one keeps no storage, the pool recycles it
+      front.block->retrieveAll();
+      front.block->release();
+      spare_ = std::move(front.block);
+    }
+    slices_.pop_front();
+  }
+}
+
+void OutputQueue::retrieveAll()
+{
+  slices_.clear();
+  readableBytes_ = 0;
+}
+
+ssize_t OutputQueue::writeFd(int fd, int* savedErrno)
+{
+  if (!slices_.empty() && slices_.front().fd >= 0)
+  {
+    return writeFile(fd, savedErrno);
+  }
+  struct iovec vec[kMaxIovecs];
+  const int iovcnt = gather(vec, kMaxIovecs);
+  const ssize_t n = sockets::writev(fd, vec, iovcnt);
+  if (n < 0)
+  {
+    *savedErrno = errno;
+  }
+  else
+  {
+    retrieve(implicit_cast<size_t>(n));
+  }
+  return n;
+}
+
+int OutputQueue::gather(struct iovec* vec, int maxIovecs) const
+{
+  int iovcnt = 0;
+  for (std::deque<Slice>::const_iterator it = slices_.begin();
+       it != slices_.end() && it->fd < 0 && iovcnt < maxIovecs;
+       ++it)
+  {
+    const size_t len = length(*it);
+    if (len > 0)
+    {
+      vec[iovcnt].iov_base = const_cast<char*>(peek(*it));
+      vec[iovcnt].iov_len = len;
+      ++iovcnt;
+    }
+  }
+  return iovcnt;
+}
+
+// 文件分片不经过用户态，普通文件用 sendfile，管道用 splice
+ssize_t OutputQueue::writeFile(int fd, int* savedErrno)
+{
+  const Slice& front = slices_.front();
+  off_t offset = front.offset;
+  ssize_t n = front.pipe ? sockets::splice(fd, front.fd, front.len)
+                         : sockets::sendfile(fd, front.fd, &offset, front.len);
+  if (n < 0 && !front.pipe && (errno == EINVAL || errno == ENOSYS))
+  {
+    // the file doesn't support sendfile(2), copies it through user space
+    char buf[kBlockSize];
+    n = ::pread(front.fd, buf, std::min(front.len, sizeof buf), front.offset);
+    if (n > 0)
+    {
+      n = sockets::write(fd, buf, implicit_cast<size_t>(n));
+    }
+  }
+  if (n == 0)
+  {
+    // the file is shorter than queued, the peer would wait for the rest forever
+    errno = EIO;
+    n = -1;
+  }
+  if (n < 0)
+  {
+    *savedErrno = errno;
+  }
+  else
+  {
+    retrieve(implicit_cast<size_t>(n));
+  }
+  return n;
+}
+
+void OutputQueue::shrink()
+{
+  spare_.reset();
+}
+
+size_t OutputQueue::internalCapacity() const
+{
+  size_t capacity = spare_ ? spare_->internalCapacity() : 0;
+  for (std::deque<Slice>::const_iterator it = slices_.begin();
+       it != slices_.end();
+       ++it)
+  {
+    capacity += it->block ? it->block->internalCapacity() : it->fd < 0 ? it->len : 0;
+  }
+  return capacity;
+}
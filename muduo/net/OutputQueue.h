@@ -0,0 +1,153 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_OUTPUTQUEUE_H
+#define MUDUO_NET_OUTPUTQUEUE_H
+
+#include "muduo/base/noncopyable.h"
+#include "muduo/base/StringPiece.h"
+#include "muduo/base/Types.h"
+
+#include <deque>
+#include <functional>
+#include <memory>
+
+#include <sys/types.h>  // ssize_t
+
+struct iovec;
+
+namespace muduo
+{
+namespace net
+{
+
+class Buffer;
+class BufferPool;
+
+///
+/// Output queue of TcpConnection, a chain of slices.
+///
+/// Each slice is either
+///  - a block owned by the queue, small writes are copied and coalesced into it,
+///  - a slice of a refcounted block, shared with other connections (fan-out),
+///  - a borrowed, user owned slice, released by a callback when sent,
+///  - a segment of a file, sent with sendfile(2), or splice(2) from a pipe.
+/// Slices in memory are flushed with one writev(2), up to a file segment.
+/// A file segment shorter than queued fails writeFd() with EIO.
+// 输出队列，由多个分片组成，一次 writev 写出，避免拷贝和 vector 扩容
+class OutputQueue : noncopyable
+{
+ public:
+  typedef std::function<void()> ReleaseCallback;
+
+  // 拷贝写入时，单个块最多合并的字节数
+  static const size_t kBlockSize = 64 * 1024;
+  // 小于此值的 Buffer 直接拷贝合并，否则交换其内容
+  static const size_t kSwapThreshold = 4096;
+  // 一次 writev 最多的分片数
+  static const int kMaxIovecs = 64;
+
+  OutputQueue();
+  /// Blocks owned by the queue draw from @c pool and go back when drained.
+  explicit OutputQueue(const std::shared_ptr<BufferPool>& pool);
+  ~OutputQueue();
+
+  /// For blocks allocated from now on.
+  void setPool(const std::shared_ptr<BufferPool>& pool);
+
+  size_t readableBytes() const
+  { return readableBytes_; }
+
+  bool empty() const
+  { return readableBytes_ == 0; }
+
+  size_t numSlices() const
+  { return slices_.size(); }
+
+  /// Copies data into the tail block.
+  void append(const void* data, size_t len);
+
+  void append(const StringPiece& str)
+  { append(str.data(), str.size()); }
+
+  /// Takes over the content of buf, buf is left empty.
+  /// Large buffers are swapped in without copying.
+  void append(Buffer* buf);
+
+  /// Queues [data, data+len) which lives inside block,
+  /// block is kept alive until the slice has been written.
+  void append(const std::shared_ptr<const void>& block,
+              const void* data, size_t len);
+
+  void append(const std::shared_ptr<const string>& message)
+  { append(message, message->data(), message->size()); }
+
+  /// Takes over all slices of queue, queue is left empty.
+  /// Small blocks are copied into the tail block, the rest are moved.
+  void append(OutputQueue* queue);
+
+  /// Queues a user owned slice without copying,
+  /// release is called once it has been written or the queue is destroyed.
+  void appendBorrowed(const void* data, size_t len,
+                      const ReleaseCallback& release)
+  { append(borrow(data, release), data, len); }
+
+  /// Queues [offset, offset+len) of file fd without copying it to user space.
+  /// holder keeps fd open until the segment has been written.
+  /// A pipe is spliced from, offset is ignored, and it must already hold
+  /// len bytes, since the queue doesn't poll it.
+  void appendFile(const std::shared_ptr<const void>& holder,
+                  int fd, off_t offset, size_t len);
+
+  /// Wraps a user owned block, release is called when the last reference is gone.
+  static std::shared_ptr<const void> borrow(const void* data,
+                                            const ReleaseCallback& release);
+
+  void retrieve(size_t len);
+  void retrieveAll();
+
+  /// Gathers up to kMaxIovecs slices and writes them with writev(2),
+  /// or writes the file segment at the front.
+  /// @return result of writev(2) or sendfile(2), @c errno is saved
+  ssize_t writeFd(int fd, int* savedErrno);
+
+  /// Fills vec with up to maxIovecs slices in memory, which stay valid
+  /// until the queue is changed. Returns 0 if a file segment is in front,
+  /// retrieve() what has been written.
+  int gather(struct iovec* vec, int maxIovecs) const;
+
+  /// Releases the spare block, for idle connections.
+  void shrink();
+
+  size_t internalCapacity() const;
+
+ private:
+  struct Slice
+  {
+    std::unique_ptr<Buffer> block;  // non-null for blocks owned by this queue
+    const char* data;
+    size_t len;
+    std::shared_ptr<const void> holder;
+    int fd;        // of a file segment, or -1
+    off_t offset;  // file segment
+    bool pipe;     // file segment
+  };
+
+  static const char* peek(const Slice& slice);
+  static size_t length(const Slice& slice);
+  void appendBlock(std::unique_ptr<Buffer> block);
+  ssize_t writeFile(int fd, int* savedErrno);
+  std::unique_ptr<Buffer> newBlock();
+
+  std::deque<Slice> slices_;
+  std::shared_ptr<BufferPool> pool_;
+  std::unique_ptr<Buffer> spare_;  // one drained block kept for reuse
+  size_t readableBytes_;
+};
+
+}  // namespace net
+}  // namespace muduo
+
+#endif  // MUDUO_NET_OUTPUTQUEUE_H
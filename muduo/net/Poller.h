@@ -51,6 +51,16 @@ public:
 
     virtual bool hasChannel(Channel *channel) const;
 
+    /// Sends the send queue of the channel before the next wait, in a batch
+    /// with the others, see Channel::setBatchedIo().
+    /// Returns false if the poller doesn't batch socket I/O.
+    /// Must be called in the loop thread.
+    virtual bool queueSend(Channel *channel)
+    {
+        (void)channel;
+        return false;
+    }
+
     static Poller *newDefaultPoller(EventLoop *loop);
 
     void assertInLoopThread() const
@@ -12,6 +12,8 @@
 #include "muduo/net/InetAddress.h"
 #include "muduo/net/SocketsOps.h"
 
+#include <assert.h>
+#include <linux/filter.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <stdio.h> // snprintf
@@ -127,6 +129,34 @@ void Socket::setReusePort(bool on)
 #endif
 }
 
+// SO_ATTACH_REUSEPORT_CBPF，把连接分给当前 CPU 对应的套接字
+void Socket::setReusePortCpuSteering(int groupSize)
+{
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+    assert(groupSize > 0);
+    struct sock_filter code[] = {
+        // A = raw_smp_processor_id()
+        {BPF_LD | BPF_W | BPF_ABS, 0, 0, static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU)},
+        // A = A % groupSize
+        {BPF_ALU | BPF_MOD | BPF_K, 0, 0, static_cast<uint32_t>(groupSize)},
+        // return A
+        {BPF_RET | BPF_A, 0, 0, 0},
+    };
+    struct sock_fprog prog;
+    prog.len = static_cast<unsigned short>(sizeof code / sizeof code[0]);
+    prog.filter = code;
+    int ret = ::setsockopt(sockfd_, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+                           &prog, static_cast<socklen_t>(sizeof prog));
+    if (ret < 0)
+    {
+        LOG_SYSERR << "SO_ATTACH_REUSEPORT_CBPF failed.";
+    }
+#else
+    (void)groupSize;
+    LOG_ERROR << "SO_ATTACH_REUSEPORT_CBPF is not supported.";
+#endif
+}
+
 // SO_KEEPALIVE 套接字选项
 void Socket::setKeepAlive(bool on)
 {
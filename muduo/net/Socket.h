@@ -81,6 +81,13 @@ public:
     /// SO_REUSEPORT 描述符
     void setReusePort(bool on);
 
+    ///
+    /// Attach a classic BPF program to the SO_REUSEPORT group of this
+    /// listening socket, steering each new connection to the socket
+    /// of index (CPU of the softirq % groupSize), in order of listen().
+    /// 按处理中断的 CPU 选择 reuseport 组中的套接字
+    void setReusePortCpuSteering(int groupSize);
+
     ///
     /// Enable/disable SO_KEEPALIVE
     /// keepalive 算法 SO_KEEPALIVE
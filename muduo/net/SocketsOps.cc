@@ -15,8 +15,9 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>  // snprintf
+#include <sys/sendfile.h>
 #include <sys/socket.h>
-#include <sys/uio.h>  // readv
+#include <sys/uio.h>  // readv, writev
 #include <unistd.h>
 
 using namespace muduo;
@@ -176,6 +177,21 @@ ssize_t sockets::write(int sockfd, const void *buf, size_t count)
   return ::write(sockfd, buf, count);
 }
 
+ssize_t sockets::writev(int sockfd, const struct iovec *iov, int iovcnt)
+{
+  return ::writev(sockfd, iov, iovcnt);
+}
+
+ssize_t sockets::sendfile(int sockfd, int fileFd, off_t *offset, size_t count)
+{
+  return ::sendfile(sockfd, fileFd, offset, count);
+}
+
+ssize_t sockets::splice(int sockfd, int pipeFd, size_t count)
+{
+  return ::splice(pipeFd, NULL, sockfd, NULL, count, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+}
+
 void sockets::close(int sockfd)
 {
   if (::close(sockfd) < 0)
@@ -37,6 +37,10 @@ ssize_t read(int sockfd, void *buf, size_t count);
 ssize_t readv(int sockfd, const struct iovec *iov, int iovcnt);
 // write
 ssize_t write(int sockfd, const void *buf, size_t count);
+ssize_t writev(int sockfd, const struct iovec *iov, int iovcnt);
+// zero-copy write, from a file, or from a pipe
+ssize_t sendfile(int sockfd, int fileFd, off_t *offset, size_t count);
+ssize_t splice(int sockfd, int pipeFd, size_t count);
 // close
 void close(int sockfd);
 // shutdown
@@ -16,6 +16,9 @@
 #include "muduo/net/SocketsOps.h"
 
 #include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <unistd.h>
 
 using namespace muduo;
 using namespace muduo::net;
@@ -41,6 +44,10 @@ TcpConnection::TcpConnection(EventLoop *loop,
                              const InetAddress &localAddr,
                              const InetAddress &peerAddr)
     : loop_(CHECK_NOTNULL(loop)),
+      ownerLoop_(loop),
+      dispatchState_(0),
+      migrating_(false),
+      id_(0),
       name_(nameArg),
       state_(kConnecting),    // 初始化就设置为 kConnecting
       reading_(true),   // 初始化时设置为 reading
@@ -48,9 +55,68 @@ TcpConnection::TcpConnection(EventLoop *loop,
       channel_(new Channel(loop, sockfd)),
       localAddr_(localAddr),
       peerAddr_(peerAddr),
-      highWaterMark_(64 * 1024 * 1024)  // 64MB
+      highWaterMark_(64 * 1024 * 1024),  // 64MB
+      reportedPendingBytes_(0),
+      inputBuffer_(loop->bufferPool()),   // 从所属 loop 的内存池分配，读到数据时才分配
+      outputQueue_(loop->bufferPool()),
+      bytesReceived_(0)
+{
+    setupChannel();
+    LOG_DEBUG << "TcpConnection::ctor[" << name() << "] at " << this
+              << " fd=" << sockfd;
+    // 设置 KeepAlive
+    socket_->setKeepAlive(true);
+}
+
+TcpConnection::TcpConnection(EventLoop *loop,
+                             const std::shared_ptr<const string> &namePrefix,
+                             uint64_t id,
+                             int sockfd,
+                             const InetAddress &localAddr,
+                             const InetAddress &peerAddr)
+    : loop_(CHECK_NOTNULL(loop)),
+      ownerLoop_(loop),
+      dispatchState_(0),
+      migrating_(false),
+      namePrefix_(namePrefix),
+      id_(id),
+      state_(kConnecting),    // 初始化就设置为 kConnecting
+      reading_(true),   // 初始化时设置为 reading
+      socket_(new Socket(sockfd)),
+      channel_(new Channel(loop, sockfd)),
+      localAddr_(localAddr),
+      peerAddr_(peerAddr),
+      highWaterMark_(64 * 1024 * 1024),  // 64MB
+      reportedPendingBytes_(0),
+      inputBuffer_(loop->bufferPool()),   // 从所属 loop 的内存池分配，读到数据时才分配
+      outputQueue_(loop->bufferPool()),
+      bytesReceived_(0)
+{
+    setupChannel();
+    LOG_DEBUG << "TcpConnection::ctor[" << name() << "] at " << this
+              << " fd=" << sockfd;
+    // 设置 KeepAlive
+    socket_->setKeepAlive(true);
+}
+
+const string &TcpConnection::name() const
+{
+    // 拼接字符串只在日志或用户需要名字时发生，不在 accept 路径上
+    std::call_once(nameOnce_, [this]
+                   {
+                       if (namePrefix_)
+                       {
+                           char buf[32];
+                           snprintf(buf, sizeof buf, "#%" PRIu64, id_);
+                           name_ = *namePrefix_ + buf;
+                       }
+                   });
+    return name_;
+}
+
+// channel 获得 TcpConnection 的指针，通过回调注册进去的
+void TcpConnection::setupChannel()
 {
-    // channel 获得 TcpConnection 的指针，通过回调注册进去的
     channel_->setReadCallback(
         std::bind(&TcpConnection::handleRead, this, _1));
     channel_->setWriteCallback(
@@ -59,15 +125,19 @@ TcpConnection::TcpConnection(EventLoop *loop,
         std::bind(&TcpConnection::handleClose, this));
     channel_->setErrorCallback(
         std::bind(&TcpConnection::handleError, this));
-    LOG_DEBUG << "TcpConnection::ctor[" << name_ << "] at " << this
-              << " fd=" << sockfd;
-    // 设置 KeepAlive
-    socket_->setKeepAlive(true);
+    // poller 批量收发时直接读写这两个缓冲区，原始读回调自己读 socket
+    channel_->setBatchedIo(rawReadCallback_ ? NULL : &inputBuffer_, &outputQueue_);
+}
+
+void TcpConnection::setRawReadCallback(const RawReadCallback &cb)
+{
+    rawReadCallback_ = cb;
+    channel_->setBatchedIo(rawReadCallback_ ? NULL : &inputBuffer_, &outputQueue_);
 }
 
 TcpConnection::~TcpConnection()
 {
-    LOG_DEBUG << "TcpConnection::dtor[" << name_ << "] at " << this
+    LOG_DEBUG << "TcpConnection::dtor[" << name() << "] at " << this
               << " fd=" << channel_->fd()
               << " state=" << stateToString();
     assert(state_ == kDisconnected);
@@ -96,14 +166,14 @@ void TcpConnection::send(const StringPiece &message)
 {
     if (state_ == kConnected)
     {
-        if (loop_->isInLoopThread())
+        if (isInOwnerLoop())
         {
             sendInLoop(message);
         }
         else
         {
             void (TcpConnection::*fp)(const StringPiece &message) = &TcpConnection::sendInLoop;
-            loop_->runInLoop(
+            runInOwnerLoop(
                 std::bind(fp,
                           this, // FIXME
                           message.as_string()));
@@ -112,84 +182,334 @@ void TcpConnection::send(const StringPiece &message)
     }
 }
 
-// FIXME efficiency!!!
-void TcpConnection::send(Buffer *buf)
+void TcpConnection::send(string &&message)
 {
     if (state_ == kConnected)
     {
-        if (loop_->isInLoopThread())
+        if (message.size() >= OutputQueue::kSwapThreshold)
+        {
+            // 大消息移入引用计数块，IO 线程把它直接挂到输出队列上，全程不拷贝
+            send(std::make_shared<const string>(std::move(message)));
+        }
+        else if (isInOwnerLoop())
         {
-            sendInLoop(buf->peek(), buf->readableBytes());
-            buf->retrieveAll();
+            sendInLoop(message.data(), message.size());
         }
         else
         {
             void (TcpConnection::*fp)(const StringPiece &message) = &TcpConnection::sendInLoop;
-            loop_->runInLoop(
+            runInOwnerLoop(
+                std::bind(fp,
+                          this, // FIXME
+                          std::move(message)));
+        }
+    }
+}
+
+void TcpConnection::send(Buffer &&message)
+{
+    send(&message);
+}
+
+void TcpConnection::send(Buffer *buf)
+{
+    if (state_ == kConnected)
+    {
+        if (isInOwnerLoop())
+        {
+            void (TcpConnection::*fp)(Buffer *buf) = &TcpConnection::sendInLoop;
+            (this->*fp)(buf);
+        }
+        else if (buf->readableBytes() < OutputQueue::kSwapThreshold)
+        {
+            void (TcpConnection::*fp)(const StringPiece &message) = &TcpConnection::sendInLoop;
+            runInOwnerLoop(
                 std::bind(fp,
                           this, // FIXME
                           buf->retrieveAllAsString()));
-            //std::forward<string>(message)));
+        }
+        else
+        {
+            // 跨线程时交换出 buf 的内容，交给 IO 线程，不拷贝
+            std::shared_ptr<Buffer> block(std::make_shared<Buffer>());
+            block->swap(*buf);
+            send(block, block->peek(), block->readableBytes());
         }
     }
 }
 
-void TcpConnection::sendInLoop(const StringPiece &message)
+void TcpConnection::send(OutputQueue *queue)
 {
-    sendInLoop(message.data(), message.size());
+    if (state_ == kConnected)
+    {
+        if (isInOwnerLoop())
+        {
+            void (TcpConnection::*fp)(OutputQueue *queue) = &TcpConnection::sendInLoop;
+            (this->*fp)(queue);
+        }
+        else
+        {
+            // 跨线程时把分片移交给 IO 线程，不拷贝大块
+            std::shared_ptr<OutputQueue> moved(std::make_shared<OutputQueue>());
+            moved->append(queue);
+            runInOwnerLoop([this, moved] // FIXME this
+                           { sendInLoop(moved.get()); });
+        }
+    }
 }
 
-void TcpConnection::sendInLoop(const void *data, size_t len)
+void TcpConnection::send(const std::shared_ptr<const string> &message)
 {
-    loop_->assertInLoopThread();
-    ssize_t nwrote = 0;
-    size_t remaining = len;
-    bool faultError = false;
-    if (state_ == kDisconnected)
+    send(message, message->data(), message->size());
+}
+
+void TcpConnection::send(const std::shared_ptr<const void> &block, const void *data, size_t len)
+{
+    if (state_ == kConnected)
     {
-        LOG_WARN << "disconnected, give up writing";
-        return;
+        void (TcpConnection::*fp)(const std::shared_ptr<const void> &block,
+                                  const void *data, size_t len) = &TcpConnection::sendInLoop;
+        if (isInOwnerLoop())
+        {
+            (this->*fp)(block, data, len);
+        }
+        else
+        {
+            // 只拷贝引用计数，不拷贝数据
+            runInOwnerLoop(
+                std::bind(fp,
+                          this, // FIXME
+                          block, data, len));
+        }
+    }
+}
+
+void TcpConnection::sendBorrowed(const void *data, size_t len,
+                                 const OutputQueue::ReleaseCallback &release)
+{
+    // 未连接时 block 立即析构，release 随之被调用
+    send(OutputQueue::borrow(data, release), data, len);
+}
+
+void TcpConnection::sendFile(int fd, off_t offset, size_t len)
+{
+    if (state_ == kConnected)
+    {
+        int copy = ::dup(fd);
+        if (copy < 0)
+        {
+            LOG_SYSERR << "TcpConnection::sendFile";
+            return;
+        }
+        sendFile(OutputQueue::borrow(NULL, [copy] { ::close(copy); }), copy, offset, len);
+    }
+}
+
+void TcpConnection::sendFile(const std::shared_ptr<const void> &holder, int fd, off_t offset, size_t len)
+{
+    if (state_ == kConnected)
+    {
+        if (isInOwnerLoop())
+        {
+            sendFileInLoop(holder, fd, offset, len);
+        }
+        else
+        {
+            runInOwnerLoop(
+                std::bind(&TcpConnection::sendFileInLoop,
+                          this, // FIXME
+                          holder, fd, offset, len));
+        }
     }
-    // if no thing in output queue, try writing directly
-    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+}
+
+void TcpConnection::sendInLoop(const StringPiece &message)
+{
+    sendInLoop(message.data(), message.size());
+}
+
+// 输出队列为空时先尝试直接写，返回已写出的字节数
+// poller 批量发送时不写，数据全部进入输出队列，在下次等待前一起发出
+size_t TcpConnection::writeDirectly(const void *data, size_t len, bool *faultError)
+{
+    size_t nwrote = 0;
+    if (!channel_->isWriting() && outputQueue_.empty() && !channel_->queueSend())
     {
-        nwrote = sockets::write(channel_->fd(), data, len);
-        if (nwrote >= 0)
+        ssize_t n = sockets::write(channel_->fd(), data, len);
+        if (n >= 0)
         {
-            remaining = len - nwrote;
-            if (remaining == 0 && writeCompleteCallback_)
+            nwrote = implicit_cast<size_t>(n);
+            if (nwrote == len && writeCompleteCallback_)
             {
-                loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+                ownerLoop()->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
             }
         }
-        else // nwrote < 0
+        else // n < 0
         {
-            nwrote = 0;
             if (errno != EWOULDBLOCK)
             {
                 LOG_SYSERR << "TcpConnection::sendInLoop";
                 if (errno == EPIPE || errno == ECONNRESET) // FIXME: any others?
                 {
-                    faultError = true;
+                    *faultError = true;
                 }
             }
         }
     }
+    assert(nwrote <= len);
+    return nwrote;
+}
 
-    assert(remaining <= len);
+// 输出队列有数据要写：交给 poller 批量发送，或者等可写事件
+void TcpConnection::scheduleWrite()
+{
+    if (!channel_->isWriting() && !channel_->queueSend())
+    {
+        channel_->enableWriting();
+    }
+}
+
+// remaining 字节即将进入输出队列，跨过高水位时通知用户
+void TcpConnection::checkHighWaterMark(size_t remaining)
+{
+    size_t oldLen = outputQueue_.readableBytes();
+    checkHighWaterMark(oldLen, oldLen + remaining);
+}
+
+// 输出队列从 oldLen 变为 newLen，向上越过高水位时回调
+void TcpConnection::checkHighWaterMark(size_t oldLen, size_t newLen)
+{
+    if (newLen >= highWaterMark_ && oldLen < highWaterMark_ && highWaterMarkCallback_)
+    {
+        ownerLoop()->queueInLoop(std::bind(highWaterMarkCallback_, shared_from_this(), newLen));
+    }
+}
+
+void TcpConnection::sendInLoop(const void *data, size_t len)
+{
+    ownerLoop()->assertInLoopThread();
+    if (state_ == kDisconnected)
+    {
+        LOG_WARN << "disconnected, give up writing";
+        return;
+    }
+    bool faultError = false;
+    size_t nwrote = writeDirectly(data, len, &faultError);
+    size_t remaining = len - nwrote;
     if (!faultError && remaining > 0)
     {
-        size_t oldLen = outputBuffer_.readableBytes();
-        if (oldLen + remaining >= highWaterMark_ && oldLen < highWaterMark_ && highWaterMarkCallback_)
+        checkHighWaterMark(remaining);
+        outputQueue_.append(static_cast<const char *>(data) + nwrote, remaining);
+        reportPendingBytes();
+        scheduleWrite();
+    }
+}
+
+void TcpConnection::sendInLoop(Buffer *buf)
+{
+    ownerLoop()->assertInLoopThread();
+    if (state_ == kDisconnected)
+    {
+        LOG_WARN << "disconnected, give up writing";
+        buf->retrieveAll();
+        return;
+    }
+    bool faultError = false;
+    buf->retrieve(writeDirectly(buf->peek(), buf->readableBytes(), &faultError));
+    if (!faultError && buf->readableBytes() > 0)
+    {
+        checkHighWaterMark(buf->readableBytes());
+        // 大块数据直接交换进队列，不拷贝
+        outputQueue_.append(buf);
+        reportPendingBytes();
+        scheduleWrite();
+    }
+    buf->retrieveAll();
+}
+
+void TcpConnection::sendInLoop(const std::shared_ptr<const void> &block, const void *data, size_t len)
+{
+    ownerLoop()->assertInLoopThread();
+    if (state_ == kDisconnected)
+    {
+        LOG_WARN << "disconnected, give up writing";
+        return;
+    }
+    bool faultError = false;
+    size_t nwrote = writeDirectly(data, len, &faultError);
+    size_t remaining = len - nwrote;
+    if (!faultError && remaining > 0)
+    {
+        checkHighWaterMark(remaining);
+        outputQueue_.append(block, static_cast<const char *>(data) + nwrote, remaining);
+        reportPendingBytes();
+        scheduleWrite();
+    }
+}
+
+void TcpConnection::sendInLoop(OutputQueue *queue)
+{
+    ownerLoop()->assertInLoopThread();
+    if (state_ == kDisconnected)
+    {
+        LOG_WARN << "disconnected, give up writing";
+        queue->retrieveAll();
+        return;
+    }
+    bool idle = !channel_->isWriting() && outputQueue_.empty();
+    size_t oldLen = outputQueue_.readableBytes();
+    outputQueue_.append(queue);
+    if (idle && !channel_->queueSend())
+    {
+        // 整批一次 writev，出错留给 handleWrite 处理
+        int savedErrno = 0;
+        outputQueue_.writeFd(channel_->fd(), &savedErrno);
+        if (outputQueue_.empty())
         {
-            loop_->queueInLoop(std::bind(highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
+            if (writeCompleteCallback_)
+            {
+                ownerLoop()->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+            }
+            return;
         }
-        outputBuffer_.append(static_cast<const char *>(data) + nwrote, remaining);
-        if (!channel_->isWriting())
+    }
+    checkHighWaterMark(oldLen, outputQueue_.readableBytes());
+    reportPendingBytes();
+    scheduleWrite();
+}
+
+void TcpConnection::sendFileInLoop(const std::shared_ptr<const void> &holder, int fd, off_t offset, size_t len)
+{
+    ownerLoop()->assertInLoopThread();
+    if (state_ == kDisconnected)
+    {
+        LOG_WARN << "disconnected, give up writing";
+        return;
+    }
+    bool idle = !channel_->isWriting() && outputQueue_.empty();
+    size_t oldLen = outputQueue_.readableBytes();
+    outputQueue_.appendFile(holder, fd, offset, len);
+    if (idle)
+    {
+        // 和 writeDirectly 一样先写一次，省一轮 poll，出错留给 handleWrite 处理
+        int savedErrno = 0;
+        outputQueue_.writeFd(channel_->fd(), &savedErrno);
+        if (outputQueue_.empty())
         {
-            channel_->enableWriting();
+            if (writeCompleteCallback_)
+            {
+                ownerLoop()->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+            }
+            return;
         }
     }
+    // 按写过之后实际留在队列中的字节数判断高水位
+    checkHighWaterMark(oldLen, outputQueue_.readableBytes());
+    reportPendingBytes();
+    if (!channel_->isWriting())
+    {
+        channel_->enableWriting();
+    }
 }
 
 void TcpConnection::shutdown()
@@ -199,14 +519,14 @@ void TcpConnection::shutdown()
     {
         setState(kDisconnecting);
         // FIXME: shared_from_this()?
-        loop_->runInLoop(std::bind(&TcpConnection::shutdownInLoop, this));
+        runInOwnerLoop(std::bind(&TcpConnection::shutdownInLoop, this));
     }
 }
 
 void TcpConnection::shutdownInLoop()
 {
-    loop_->assertInLoopThread();
-    if (!channel_->isWriting())
+    ownerLoop()->assertInLoopThread();
+    if (!channel_->isWriting() && !channel_->sendQueued())
     {
         // we are not writing
         socket_->shutdownWrite();
@@ -243,7 +563,7 @@ void TcpConnection::forceClose()
     if (state_ == kConnected || state_ == kDisconnecting)
     {
         setState(kDisconnecting);
-        loop_->queueInLoop(std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+        queueInOwnerLoop(std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
     }
 }
 
@@ -252,7 +572,7 @@ void TcpConnection::forceCloseWithDelay(double seconds)
     if (state_ == kConnected || state_ == kDisconnecting)
     {
         setState(kDisconnecting);
-        loop_->runAfter(
+        getLoop()->runAfter(
             seconds,
             makeWeakCallback(shared_from_this(),
                              &TcpConnection::forceClose)); // not forceCloseInLoop to avoid race condition
@@ -261,7 +581,7 @@ void TcpConnection::forceCloseWithDelay(double seconds)
 
 void TcpConnection::forceCloseInLoop()
 {
-    loop_->assertInLoopThread();
+    ownerLoop()->assertInLoopThread();
     if (state_ == kConnected || state_ == kDisconnecting)
     {
         // as if we received 0 byte in handleRead();
@@ -294,12 +614,12 @@ void TcpConnection::setTcpNoDelay(bool on)
 
 void TcpConnection::startRead()
 {
-    loop_->runInLoop(std::bind(&TcpConnection::startReadInLoop, this));
+    runInOwnerLoop(std::bind(&TcpConnection::startReadInLoop, this));
 }
 
 void TcpConnection::startReadInLoop()
 {
-    loop_->assertInLoopThread();
+    ownerLoop()->assertInLoopThread();
     if (!reading_ || !channel_->isReading())
     {
         channel_->enableReading();
@@ -309,12 +629,12 @@ void TcpConnection::startReadInLoop()
 
 void TcpConnection::stopRead()
 {
-    loop_->runInLoop(std::bind(&TcpConnection::stopReadInLoop, this));
+    runInOwnerLoop(std::bind(&TcpConnection::stopReadInLoop, this));
 }
 
 void TcpConnection::stopReadInLoop()
 {
-    loop_->assertInLoopThread();
+    ownerLoop()->assertInLoopThread();
     if (reading_ || channel_->isReading())
     {
         channel_->disableReading();
@@ -324,12 +644,13 @@ void TcpConnection::stopReadInLoop()
 // 建立连接
 void TcpConnection::connectEstablished()
 {
-    loop_->assertInLoopThread();
+    ownerLoop()->assertInLoopThread();
     assert(state_ == kConnecting);
     setState(kConnected);
     // 绑定 channel 和 TcpConnection
     channel_->tie(shared_from_this());
     channel_->enableReading();
+    ownerLoop()->addConnections(1);
 
     connectionCallback_(shared_from_this());
 }
@@ -337,7 +658,12 @@ void TcpConnection::connectEstablished()
 // 链接删除时的操作，会在链接断开后，最后执行
 void TcpConnection::connectDestroyed()
 {
-    loop_->assertInLoopThread();
+    if (!isInOwnerLoop())
+    {
+        // 连接正在迁移，或者调用者拿到的是迁移前的 loop
+        runInOwnerLoop(std::bind(&TcpConnection::connectDestroyed, shared_from_this()));
+        return;
+    }
     if (state_ == kConnected)
     {
         setState(kDisconnected);
@@ -345,18 +671,76 @@ void TcpConnection::connectDestroyed()
 
         connectionCallback_(shared_from_this());
     }
-    channel_->remove();
+    if (channel_->addedToLoop())
+    {
+        channel_->remove();
+    }
+    ownerLoop()->addConnections(-1);
+    ownerLoop()->addPendingOutputBytes(-static_cast<int64_t>(reportedPendingBytes_));
+    reportedPendingBytes_ = 0;
+}
+
+// 输出队列长度变化后更新所属 loop 的负载统计
+void TcpConnection::reportPendingBytes()
+{
+    size_t pending = outputQueue_.readableBytes();
+    if (pending != reportedPendingBytes_)
+    {
+        ownerLoop()->addPendingOutputBytes(static_cast<int64_t>(pending) - static_cast<int64_t>(reportedPendingBytes_));
+        reportedPendingBytes_ = pending;
+    }
 }
 
 // 四种处理操作
 void TcpConnection::handleRead(Timestamp receiveTime)
 {
-    loop_->assertInLoopThread();
+    ownerLoop()->assertInLoopThread();
     int savedErrno = 0;
-    ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
+    ssize_t n = 0;
+    bool raw = false;
+    if (channel_->takeReceived(&n, &savedErrno))
+    {
+        // poller 已经批量收到 inputBuffer_ 中，收满了再读一次剩下的
+        if (n > 0 && inputBuffer_.writableBytes() == 0)
+        {
+            int moreErrno = 0;
+            ssize_t more = inputBuffer_.readFd(channel_->fd(), &moreErrno);
+            if (more > 0)
+            {
+                n += more;
+            }
+        }
+        else if (n < 0 && (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK))
+        {
+            inputBuffer_.release();
+            return;
+        }
+    }
+    else if (rawReadCallback_)
+    {
+        raw = true;
+        // 由用户自己读，数据不经过 inputBuffer_
+        n = rawReadCallback_(shared_from_this(), channel_->fd());
+        savedErrno = errno;
+        if (n < 0 && (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK))
+        {
+            return;
+        }
+    }
+    else
+    {
+        n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
+    }
     if (n > 0)
     {
-        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        bytesReceived_.store(bytesReceived_.load(std::memory_order_relaxed) + n,
+                             std::memory_order_relaxed);
+        if (!raw)
+        {
+            messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+            // 读空了就把内存还给 loop 的内存池，空闲连接不占缓冲区
+            inputBuffer_.release();
+        }
     }
     else if (n == 0)
     {
@@ -372,21 +756,27 @@ void TcpConnection::handleRead(Timestamp receiveTime)
 
 void TcpConnection::handleWrite()
 {
-    loop_->assertInLoopThread();
-    if (channel_->isWriting())
+    ownerLoop()->assertInLoopThread();
+    ssize_t sent = 0;
+    int sentErrno = 0;
+    if (channel_->takeSent(&sent, &sentErrno))
     {
-        ssize_t n = sockets::write(channel_->fd(),
-                                   outputBuffer_.peek(),
-                                   outputBuffer_.readableBytes());
+        handleSent(sent, sentErrno);
+    }
+    else if (channel_->isWriting())
+    {
+        // 所有分片一次 writev 写出，已写部分在 writeFd 中出队
+        int savedErrno = 0;
+        ssize_t n = outputQueue_.writeFd(channel_->fd(), &savedErrno);
         if (n > 0)
         {
-            outputBuffer_.retrieve(n);
-            if (outputBuffer_.readableBytes() == 0)
+            reportPendingBytes();
+            if (outputQueue_.empty())
             {
                 channel_->disableWriting();
                 if (writeCompleteCallback_)
                 {
-                    loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+                    ownerLoop()->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
                 }
                 if (state_ == kDisconnecting)
                 {
@@ -396,7 +786,13 @@ void TcpConnection::handleWrite()
         }
         else
         {
+            errno = savedErrno;
             LOG_SYSERR << "TcpConnection::handleWrite";
+            if (savedErrno == EIO)
+            {
+                // 文件比 sendFile 时声明的短，对端永远等不到剩下的数据
+                forceCloseInLoop();
+            }
             // if (state_ == kDisconnecting)
             // {
             //   shutdownInLoop();
@@ -410,9 +806,49 @@ void TcpConnection::handleWrite()
     }
 }
 
+// poller 批量发送之后，写不完的等可写事件
+void TcpConnection::handleSent(ssize_t n, int savedErrno)
+{
+    if (state_ == kDisconnected)
+    {
+        return;
+    }
+    if (n < 0 && savedErrno != EAGAIN && savedErrno != EWOULDBLOCK)
+    {
+        // 与 writeDirectly 相同，出错之后不再写，由读端发现连接断开
+        errno = savedErrno;
+        LOG_SYSERR << "TcpConnection::handleSent";
+        return;
+    }
+    if (n > 0)
+    {
+        reportPendingBytes();
+    }
+    if (!outputQueue_.empty())
+    {
+        if (!channel_->isWriting())
+        {
+            channel_->enableWriting();
+        }
+        return;
+    }
+    if (channel_->isWriting())
+    {
+        channel_->disableWriting();
+    }
+    if (writeCompleteCallback_)
+    {
+        ownerLoop()->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+    }
+    if (state_ == kDisconnecting)
+    {
+        shutdownInLoop();
+    }
+}
+
 void TcpConnection::handleClose()
 {
-    loop_->assertInLoopThread();
+    ownerLoop()->assertInLoopThread();
     LOG_TRACE << "fd = " << channel_->fd() << " state = " << stateToString();
     assert(state_ == kConnected || state_ == kDisconnecting);
     // we don't close fd, leave it to dtor, so we can find leaks easily.
@@ -428,6 +864,177 @@ void TcpConnection::handleClose()
 void TcpConnection::handleError()
 {
     int err = sockets::getSocketError(channel_->fd());
-    LOG_ERROR << "TcpConnection::handleError [" << name_
+    LOG_ERROR << "TcpConnection::handleError [" << name()
               << "] - SO_ERROR = " << err << " " << strerror_tl(err);
 }
+
+// 任何线程都可能调用：ownerLoop_ 在新 loop 的线程中修改，所以是原子变量
+bool TcpConnection::isInOwnerLoop() const
+{
+    EventLoop *loop = getLoop();
+    return loop->isInLoopThread() && ownerLoop() == loop;
+}
+
+void TcpConnection::runInOwnerLoop(Functor cb)
+{
+    dispatch(std::move(cb), false);
+}
+
+void TcpConnection::queueInOwnerLoop(Functor cb)
+{
+    dispatch(std::move(cb), true);
+}
+
+void TcpConnection::dispatch(Functor cb, bool queue)
+{
+    if (isInOwnerLoop())
+    {
+        // loop_ 只会被拥有者线程修改，不必加锁
+        if (queue)
+        {
+            ownerLoop()->queueInLoop(std::move(cb));
+        }
+        else
+        {
+            cb();
+        }
+        return;
+    }
+    // 没有迁移时直接投递：迁移会等这些线程投递完才安排交接，见 queueHandOverInLoop()
+    unsigned state = dispatchState_.fetch_add(2, std::memory_order_acquire);
+    if (!(state & 1))
+    {
+        EventLoop *loop = getLoop();
+        if (queue)
+        {
+            loop->queueInLoop(std::move(cb));
+        }
+        else
+        {
+            loop->runInLoop(std::move(cb));
+        }
+        dispatchState_.fetch_sub(2, std::memory_order_release);
+        return;
+    }
+    dispatchState_.fetch_sub(2, std::memory_order_relaxed);
+    // 与 queueHandOverInLoop() 修改 loop_ 互斥：读到旧 loop 的操作一定排在交接之前
+    Functor owned(std::bind(&TcpConnection::runOwned, this, std::move(cb)));
+    MutexLockGuard lock(migrateMutex_);
+    EventLoop *loop = getLoop();
+    if (queue)
+    {
+        loop->queueInLoop(std::move(owned));
+    }
+    else
+    {
+        loop->runInLoop(std::move(owned));
+    }
+}
+
+// 在投递到的 loop 中执行：要么是拥有者，要么是交接前就到达的迁移目标
+void TcpConnection::runOwned(const Functor &cb)
+{
+    if (ownerLoop()->isInLoopThread())
+    {
+        cb();
+    }
+    else
+    {
+        deferred_.push_back(cb);
+    }
+}
+
+void TcpConnection::migrateTo(EventLoop *loop, const ConnectionCallback &cb)
+{
+    // 不在事件处理中途移除 channel
+    queueInOwnerLoop(std::bind(&TcpConnection::migrateInLoop, shared_from_this(), loop, cb));
+}
+
+void TcpConnection::migrateInLoop(EventLoop *loop, const ConnectionCallback &cb)
+{
+    ownerLoop()->assertInLoopThread();
+    if (migrating_)
+    {
+        // 上一次迁移尚未交接，排到它后面
+        queueInOwnerLoop(std::bind(&TcpConnection::migrateInLoop, shared_from_this(), loop, cb));
+        return;
+    }
+    if (loop == ownerLoop() || state_ != kConnected)
+    {
+        return;
+    }
+    migrating_ = true;
+    dispatchState_.fetch_or(1, std::memory_order_acq_rel);
+    LOG_DEBUG << "TcpConnection::migrateInLoop [" << name() << "] from "
+              << ownerLoop() << " to " << loop;
+    queueHandOverInLoop(loop, cb);
+}
+
+// 等不加锁直接投递的线程都投递完才改 loop_：它们读到的一定是旧 loop，
+// 投递的操作都已在队列中，排在它们后面交接
+void TcpConnection::queueHandOverInLoop(EventLoop *loop, const ConnectionCallback &cb)
+{
+    ownerLoop()->assertInLoopThread();
+    if (dispatchState_.load(std::memory_order_acquire) >> 1)
+    {
+        ownerLoop()->queueInLoop(
+            std::bind(&TcpConnection::queueHandOverInLoop, shared_from_this(), loop, cb));
+        return;
+    }
+    {
+        MutexLockGuard lock(migrateMutex_);
+        loop_.store(loop, std::memory_order_release);
+    }
+    ownerLoop()->queueInLoop(
+        std::bind(&TcpConnection::handOverInLoop, shared_from_this(), loop, cb));
+}
+
+// 旧 loop 中最后一步：停止 IO，把 channel 换成新 loop 的
+void TcpConnection::handOverInLoop(EventLoop *loop, const ConnectionCallback &cb)
+{
+    ownerLoop()->assertInLoopThread();
+    channel_->disableAll();
+    channel_->remove();
+    ownerLoop()->addConnections(-1);
+    ownerLoop()->addPendingOutputBytes(-static_cast<int64_t>(reportedPendingBytes_));
+    reportedPendingBytes_ = 0;
+    channel_.reset(new Channel(loop, socket_->fd()));
+    setupChannel();
+    loop->runInLoop(std::bind(&TcpConnection::attachInLoop, shared_from_this(), cb));
+}
+
+void TcpConnection::attachInLoop(const ConnectionCallback &cb)
+{
+    EventLoop *loop = getLoop();
+    loop->assertInLoopThread();
+    ownerLoop_.store(loop, std::memory_order_release);
+    migrating_ = false;
+    dispatchState_.fetch_and(~1u, std::memory_order_release);
+    inputBuffer_.setPool(loop->bufferPool());
+    outputQueue_.setPool(loop->bufferPool());
+    loop->addConnections(1);
+    reportPendingBytes();
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        channel_->tie(shared_from_this());
+        if (reading_)
+        {
+            channel_->enableReading();
+        }
+        if (!outputQueue_.empty())
+        {
+            channel_->enableWriting();
+        }
+    }
+    // 迁移期间提前到达的操作，按到达顺序执行
+    std::vector<Functor> deferred;
+    deferred.swap(deferred_);
+    for (const Functor &functor : deferred)
+    {
+        functor();
+    }
+    if (cb)
+    {
+        cb(shared_from_this());
+    }
+}
@@ -11,14 +11,19 @@
 #ifndef MUDUO_NET_TCPCONNECTION_H
 #define MUDUO_NET_TCPCONNECTION_H
 
+#include "muduo/base/Mutex.h"
 #include "muduo/base/noncopyable.h"
 #include "muduo/base/StringPiece.h"
 #include "muduo/base/Types.h"
 #include "muduo/net/Callbacks.h"
 #include "muduo/net/Buffer.h"
 #include "muduo/net/InetAddress.h"
+#include "muduo/net/OutputQueue.h"
 
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #include <boost/any.hpp>
 
@@ -52,11 +57,23 @@ public:
                   int sockfd,
                   const InetAddress &localAddr,
                   const InetAddress &peerAddr);
+    /// Named @c *namePrefix + "#" + id on the first call of name(),
+    /// used by TcpServer, which keys connections by id.
+    TcpConnection(EventLoop *loop,
+                  const std::shared_ptr<const string> &namePrefix,
+                  uint64_t id,
+                  int sockfd,
+                  const InetAddress &localAddr,
+                  const InetAddress &peerAddr);
     ~TcpConnection();
 
     // 一系列基本操作
-    EventLoop *getLoop() const { return loop_; }
-    const string &name() const { return name_; }
+    /// The loop serving this connection, changes with migrateTo().
+    EventLoop *getLoop() const { return loop_.load(std::memory_order_acquire); }
+    /// Thread safe.
+    const string &name() const;
+    /// Key of this connection in TcpServer, meaningless for TcpClient.
+    uint64_t id() const { return id_; }
     const InetAddress &localAddress() const { return localAddr_; }
     const InetAddress &peerAddress() const { return peerAddr_; }
     bool connected() const { return state_ == kConnected; }
@@ -65,11 +82,31 @@ public:
     bool getTcpInfo(struct tcp_info *) const;
     string getTcpInfoString() const;
 
-    // void send(string&& message); // C++11
+    void send(string &&message); // C++11, large message is moved, not copied
     void send(const void *message, int len);
     void send(const StringPiece &message);
-    // void send(Buffer&& message); // C++11
+    void send(const char *message) { send(StringPiece(message)); } // disambiguate string&&
+    void send(Buffer &&message); // C++11, large message is swapped, not copied
     void send(Buffer *message); // this one will swap data
+    // 零拷贝发送：message 由多个连接共享，引用计数保证发送完成前不被释放
+    void send(const std::shared_ptr<const string> &message);
+    // data 位于 block 内部，block 在发送完成前保持存活
+    void send(const std::shared_ptr<const void> &block, const void *data, size_t len);
+    /// Takes over all slices of queue, written with one writev(2) when
+    /// nothing is pending, e.g. a batch of replies built in place.
+    // 整批发送，queue 被清空
+    void send(OutputQueue *queue);
+    // 借用用户的内存，发送完成（或连接关闭）后调用 release
+    void sendBorrowed(const void *data, size_t len,
+                      const OutputQueue::ReleaseCallback &release);
+    /// Sends [offset, offset+len) of file fd with sendfile(2), in order with
+    /// other sends, without copying it to user space. Pipes are spliced,
+    /// see OutputQueue::appendFile(). The connection is closed if the file
+    /// turns out shorter. Thread safe.
+    // 零拷贝发送文件片段，fd 被 dup，调用者可以随即关闭自己的 fd
+    void sendFile(int fd, off_t offset, size_t len);
+    // holder 在发送完成前保持 fd 打开，不用 dup，适合同一文件分多次发送
+    void sendFile(const std::shared_ptr<const void> &holder, int fd, off_t offset, size_t len);
     void shutdown();            // NOT thread safe, no simultaneous calling
     // void shutdownAndForceCloseAfter(double seconds); // NOT thread safe, no simultaneous calling
     void forceClose();
@@ -79,6 +116,18 @@ public:
     void startRead();
     void stopRead();
     bool isReading() const { return reading_; }; // NOT thread safe, may race with start/stopReadInLoop
+    int64_t bytesReceived() const { return bytesReceived_.load(std::memory_order_relaxed); }
+
+    /// Moves this connection to @c loop, with its Channel, buffers and
+    /// callbacks. Thread safe. Operations issued from any thread while
+    /// moving keep their order and run in whichever loop owns the
+    /// connection at that time.
+    /// Timers armed on the old loop stay there, forceCloseWithDelay() is
+    /// fine since forceClose() is thread safe. Re-arm other timers in
+    /// @c cb, which runs in @c loop once it owns the connection.
+    /// Only for connections of TcpServer.
+    // 把连接迁移到另一个 loop，用于热点均衡
+    void migrateTo(EventLoop *loop, const ConnectionCallback &cb = ConnectionCallback());
 
     void setContext(const boost::any &context)
     {
@@ -105,6 +154,12 @@ public:
         messageCallback_ = cb;
     }
 
+    /// Called instead of reading into inputBuffer() and calling the message
+    /// callback when the socket is readable, e.g. to splice(2) it into a pipe.
+    /// Returns as read(2) does, -1 with EAGAIN if it read nothing for now.
+    /// Empty to read as usual again. In loop thread.
+    void setRawReadCallback(const RawReadCallback &cb);
+
     void setWriteCompleteCallback(const WriteCompleteCallback &cb)
     {
         writeCompleteCallback_ = cb;
@@ -122,9 +177,9 @@ public:
         return &inputBuffer_;
     }
 
-    Buffer *outputBuffer()
+    OutputQueue *outputQueue()
     {
-        return &outputBuffer_;
+        return &outputQueue_;
     }
 
     /// Internal use only.
@@ -136,7 +191,7 @@ public:
     // called when TcpServer accepts a new connection
     void connectEstablished(); // should be called only once
     // called when TcpServer has removed me from its map
-    void connectDestroyed(); // should be called only once
+    void connectDestroyed(); // should be called only once, thread safe
 
 private:
     enum StateE
@@ -149,11 +204,21 @@ private:
     // 各种处理操作
     void handleRead(Timestamp receiveTime);
     void handleWrite();
+    void handleSent(ssize_t n, int savedErrno);
     void handleClose();
     void handleError();
     // void sendInLoop(string&& message);
     void sendInLoop(const StringPiece &message);
     void sendInLoop(const void *message, size_t len);
+    void sendInLoop(Buffer *buf);
+    void sendInLoop(const std::shared_ptr<const void> &block, const void *data, size_t len);
+    void sendInLoop(OutputQueue *queue);
+    void sendFileInLoop(const std::shared_ptr<const void> &holder, int fd, off_t offset, size_t len);
+    size_t writeDirectly(const void *data, size_t len, bool *faultError);
+    void scheduleWrite();
+    void checkHighWaterMark(size_t remaining);
+    void checkHighWaterMark(size_t oldLen, size_t newLen);
+    void reportPendingBytes();
     void shutdownInLoop();
     // void shutdownAndForceCloseInLoop(double seconds);
     void forceCloseInLoop();
@@ -161,9 +226,36 @@ private:
     const char *stateToString() const;
     void startReadInLoop();
     void stopReadInLoop();
+    void setupChannel();
+
+    typedef std::function<void()> Functor;
+    // 在当前拥有连接的 loop 中执行，见 migrateTo()
+    EventLoop *ownerLoop() const { return ownerLoop_.load(std::memory_order_acquire); }
+    bool isInOwnerLoop() const;
+    void runInOwnerLoop(Functor cb);
+    void queueInOwnerLoop(Functor cb);
+    void dispatch(Functor cb, bool queue);
+    void runOwned(const Functor &cb);
+    void migrateInLoop(EventLoop *loop, const ConnectionCallback &cb);
+    void queueHandOverInLoop(EventLoop *loop, const ConnectionCallback &cb);
+    void handOverInLoop(EventLoop *loop, const ConnectionCallback &cb);
+    void attachInLoop(const ConnectionCallback &cb);
 
-    EventLoop *loop_;    // 对应的 EventLoop
-    const string name_;  // name_，用来在 TcpServer 中进行区分
+    // 新的跨线程操作投递到这个 loop，迁移时在旧 loop 中持有 migrateMutex_ 修改
+    std::atomic<EventLoop *> loop_;
+    // 拥有 channel_ 和缓冲区的 loop，交接时在新 loop 中修改，dispatch() 会在任意线程中读
+    std::atomic<EventLoop *> ownerLoop_;
+    MutexLock migrateMutex_; // 只在迁移期间的跨线程投递中使用
+    // 最低位：迁移进行中；其余位：正在不加锁直接投递到 loop_ 的线程数
+    std::atomic<unsigned> dispatchState_;
+    // 迁移交接完成之前就到达新 loop 的操作，只在新 loop 中访问
+    std::vector<Functor> deferred_;
+    bool migrating_; // 从 migrateInLoop() 到 attachInLoop()
+    // name_，用来在 TcpServer 中进行区分，服务端连接在第一次用到时才生成
+    const std::shared_ptr<const string> namePrefix_;
+    const uint64_t id_;
+    mutable std::once_flag nameOnce_;
+    mutable string name_;
     StateE state_; // FIXME: use atomic variable 状态
     bool reading_; // 是否正在执行读操作
     // we don't expose those classes to client.
@@ -176,16 +268,19 @@ private:
     // 五种回调函数
     ConnectionCallback connectionCallback_;
     MessageCallback messageCallback_;
+    RawReadCallback rawReadCallback_;
     WriteCompleteCallback writeCompleteCallback_;
     HighWaterMarkCallback highWaterMarkCallback_;
     CloseCallback closeCallback_;
     size_t highWaterMark_;  // 高水位标识
+    size_t reportedPendingBytes_; // 已计入 loop_->pendingOutputBytes() 的字节数
     // 输入输出缓冲区
     Buffer inputBuffer_;
-    Buffer outputBuffer_; // FIXME: use list<Buffer> as output buffer.
+    OutputQueue outputQueue_; // 输出分片链，handleWrite 中用 writev 一次写出
     boost::any context_;
+    std::atomic<int64_t> bytesReceived_; // 只在所属 loop 中修改
     // FIXME: creationTime_, lastReceiveTime_
-    //        bytesReceived_, bytesSent_
+    //        bytesSent_
 };
 // 存储在 TcpServer 中的指针
 typedef std::shared_ptr<TcpConnection> TcpConnectionPtr;
@@ -8,14 +8,14 @@
 
 #include "muduo/net/TcpServer.h"
 
+#include "muduo/base/CountDownLatch.h"
 #include "muduo/base/Logging.h"
 #include "muduo/net/Acceptor.h"
+#include "muduo/net/ConnectionTable.h"
 #include "muduo/net/EventLoop.h"
 #include "muduo/net/EventLoopThreadPool.h"
 #include "muduo/net/SocketsOps.h"
 
-#include <stdio.h> // snprintf
-
 using namespace muduo;
 using namespace muduo::net;
 // 初始化一个 server，传入:主进程中初始化的 loop，和 inetaddress 对象
@@ -24,17 +24,27 @@ TcpServer::TcpServer(EventLoop *loop,
                      const string &nameArg,
                      Option option)
     : loop_(CHECK_NOTNULL(loop)),     // 主进程的 Loop
+      listenAddr_(listenAddr),
       ipPort_(listenAddr.toIpPort()), // 创建的 Loop 中的 port
       name_(nameArg),   // Server 的名字
-      acceptor_(new Acceptor(loop, listenAddr, option == kReusePort)), // 在 acceptor 初始划时，就已经进行了 shock(),bind(),但还没有执行 listen()
+      connNamePrefix_(std::make_shared<const string>(name_ + "-" + ipPort_)),
+      // 在 acceptor 初始划时，就已经进行了 shock(),bind(),但还没有执行 listen()
+      // kReusePortPerLoop 的 acceptor 在 start() 中线程池启动后才创建
+      acceptor_(option == kReusePortPerLoop ? NULL : new Acceptor(loop, listenAddr, option == kReusePort)),
+      cpuSteering_(false),
       threadPool_(new EventLoopThreadPool(loop, name_)),  // 创建 ThreadPool 但是默认初始化数量为 0
       connectionCallback_(defaultConnectionCallback),     // 默认的建立链接后的函数
       messageCallback_(defaultMessageCallback),           // 默认的消息处理函数
-      nextConnId_(1)    // conn 的 ID 从 1 开始累加
+      rebalanceInterval_(0),
+      rebalanceThreshold_(0),
+      connections_(new ConnectionTable)
 {
     // 使用 acceptor 调用 newConnection，初始化时注册回调，在 acceptor 中的连接建立回调函数调用 TcpServer::newConnection
-    acceptor_->setNewConnectionCallback(
-        std::bind(&TcpServer::newConnection, this, _1, _2));    // 使用 bind 函数来进行绑定，注意这里传入了 this 指针
+    if (acceptor_)
+    {
+        acceptor_->setNewConnectionCallback(
+            std::bind(&TcpServer::newConnection, this, _1, _2));    // 使用 bind 函数来进行绑定，注意这里传入了 this 指针
+    }
 }
 
 // 服务器析构函数
@@ -42,13 +52,41 @@ TcpServer::~TcpServer()
 {
     loop_->assertInLoopThread();
     LOG_TRACE << "TcpServer::~TcpServer [" << name_ << "] destructing";
+    if (rebalanceInterval_ > 0)
+    {
+        loop_->cancel(rebalanceTimer_);
+    }
+    // 每个 Acceptor 必须在自己的线程中析构，之后不会再有新连接
+    if (!loopAcceptors_.empty())
+    {
+        std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+        assert(loops.size() == loopAcceptors_.size());
+        for (size_t i = 0; i < loops.size(); ++i)
+        {
+            std::unique_ptr<Acceptor> &acceptor = loopAcceptors_[i];
+            if (loops[i] == loop_)
+            {
+                acceptor.reset();
+                continue;
+            }
+            CountDownLatch latch(1);
+            loops[i]->runInLoop([&acceptor, &latch]
+                                {
+                                    acceptor.reset();
+                                    latch.countDown();
+                                });
+            latch.wait();
+        }
+    }
+    std::vector<TcpConnectionPtr> connections;
+    connections_->takeAll(&connections);
     // 对所有链接需要进行断开操作
-    for (auto &item : connections_)
+    for (auto &item : connections)
     {
         // 获取链接指针，即 shared_ptr<TcpConnection>
-        TcpConnectionPtr conn(item.second);
+        TcpConnectionPtr conn;
         // 删除这个指针
-        item.second.reset();
+        conn.swap(item);
         // 在这个链接对应的线程中进行操作
         conn->getLoop()->runInLoop(
             std::bind(&TcpConnection::connectDestroyed, conn)); // 调用的是 TcpConnection 的方法，传入 conn
@@ -69,6 +107,16 @@ void TcpServer::start()
     {
         // 初始化线程池,并传入回调函数，根据 ThreadPoolNum 来初始化需要个数的线程
         threadPool_->start(threadInitCallback_);   // 注册 threadInitCallback_ 函数，可用可不用
+        if (rebalanceInterval_ > 0)
+        {
+            rebalanceTimer_ = loop_->runEvery(rebalanceInterval_,
+                                              std::bind(&TcpServer::rebalance, this));
+        }
+        if (!acceptor_)
+        {
+            startLoopAcceptors();
+            return;
+        }
         // 判断 acceptor 对象的监听状态，此时应该没有监听
         assert(!acceptor_->listenning());
         // 在 loop 中调用 Acceptor::listen 函数
@@ -77,65 +125,190 @@ void TcpServer::start()
     }
 }
 
+// 每个 IO loop 一个 SO_REUSEPORT 的 Acceptor
+// 依次 listen()，reuseport 组中的序号与 loop 的序号一致
+void TcpServer::startLoopAcceptors()
+{
+    std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+    for (EventLoop *ioLoop : loops)
+    {
+        loopAcceptors_.emplace_back(new Acceptor(ioLoop, listenAddr_, true));
+        Acceptor *acceptor = get_pointer(loopAcceptors_.back());
+        acceptor->setNewConnectionCallback(
+            std::bind(&TcpServer::newConnectionInLoop, this, ioLoop, _1, _2));
+        if (ioLoop == loop_)
+        {
+            // no IO threads, accepts in loop_ like kNoReusePort
+            loop_->runInLoop(std::bind(&Acceptor::listen, acceptor));
+            continue;
+        }
+        CountDownLatch latch(1);
+        ioLoop->runInLoop([acceptor, &latch]
+                          {
+                              acceptor->listen();
+                              latch.countDown();
+                          });
+        latch.wait();
+    }
+    if (cpuSteering_ && loops.size() > 1)
+    {
+        loopAcceptors_.front()->setReusePortCpuSteering(static_cast<int>(loops.size()));
+    }
+    LOG_INFO << "TcpServer::start [" << name_ << "] - "
+             << loops.size() << " acceptors on " << ipPort_;
+}
+
 // 建立新连接，主服务器只处理连接的建立和断开，通过将 newConnection 注册给 acceptor 的方式来使其在新链接建立的时候由 TcpServer 进行调用
 void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
 {
     loop_->assertInLoopThread();
-    // 获取一个 EventLoop 对象
-    EventLoop *ioLoop = threadPool_->getNextLoop();
-    char buf[64];
-    snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_);
-    ++nextConnId_;
-    // 根据 name_ 和 ConnId 来获取不同的名字
-    string connName = name_ + buf;
+    // 按线程池的策略获取一个 EventLoop 对象，默认 round-robin
+    EventLoop *ioLoop = threadPool_->getLoopForConnection(peerAddr);
+    // 建立之前就算进 ioLoop 的连接数，同一轮 accept 的后续连接才能看到它，不会都挤到同一个 loop
+    ioLoop->addConnections(1);
+    TcpConnectionPtr conn = createConnection(ioLoop, sockfd, peerAddr);
+    // 执行 connectEstablished 函数把 conn 添加到 eventPool 中的 poll 中，它会再计一次
+    ioLoop->runInLoop([ioLoop, conn]
+                      {
+                          ioLoop->addConnections(-1);
+                          conn->connectEstablished();
+                      });
+}
 
-    LOG_INFO << "TcpServer::newConnection [" << name_
-             << "] - new connection [" << connName
-             << "] from " << peerAddr.toIpPort();
+// kReusePortPerLoop：在接受连接的 IO 线程中直接建立，不用跨线程转交
+void TcpServer::newConnectionInLoop(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr)
+{
+    ioLoop->assertInLoopThread();
+    createConnection(ioLoop, sockfd, peerAddr)->connectEstablished();
+}
+
+TcpConnectionPtr TcpServer::createConnection(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr)
+{
     // 获取本地的 localAddr
     InetAddress localAddr(sockets::getLocalAddr(sockfd));
     // FIXME poll with zero timeout to double confirm the new connection
     // FIXME use make_shared if necessary
-    // 创建一个 TcpConnection 对象用来获取 fd，创建 TcpConnection 传入获取的 EventLoop、connName、fd、localAddr、peerAddr 即可
-    TcpConnectionPtr conn(new TcpConnection(ioLoop,
-                                            connName,
-                                            sockfd,
-                                            localAddr,
-                                            peerAddr));
-    // 创建好的 TcpConnection 添加到 TcpServer 管理下
-    connections_[connName] = conn;
+    // 创建一个 TcpConnection 对象用来获取 fd，并添加到 TcpServer 管理下
+    // 连接表分配的 id 就是连接的 key，名字 name_-ipPort_#id 在用到时才拼接
+    TcpConnectionPtr conn = connections_->add(
+        sockfd, [&](uint64_t id)
+        {
+            return TcpConnectionPtr(new TcpConnection(ioLoop,
+                                                      connNamePrefix_,
+                                                      id,
+                                                      sockfd,
+                                                      localAddr,
+                                                      peerAddr));
+        });
+
+    LOG_INFO << "TcpServer::newConnection [" << name_
+             << "] - new connection #" << conn->id()
+             << " from " << peerAddr.toIpPort();
     // 对处理函数进行一系列注册，包括连接和读、写，这些注册函数保存在 conn 中
     conn->setConnectionCallback(connectionCallback_);
     conn->setMessageCallback(messageCallback_);
     conn->setWriteCompleteCallback(writeCompleteCallback_);
     // 注册断开连接时的操作
     conn->setCloseCallback(
-        std::bind(&TcpServer::removeConnection, this, _1)); // FIXME: unsafe
-    // 执行 connectEstablished 函数把 conn 添加到 eventPool 中的 poll 中
-    ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
+        std::bind(&TcpServer::removeConnection,
+                  std::weak_ptr<ConnectionTable>(connections_), _1));
+    return conn;
 }
 
-// 断开连接时的操作，暂时不明白包装一次是为了啥，第一次可能是不在当前线程中（毕竟是 conn 对应的线程进行操作）
-// 将 removeConnectionInLoop 添加到主线程中进行执行
-void TcpServer::removeConnection(const TcpConnectionPtr &conn)
+TcpConnectionPtr TcpServer::getConnection(uint64_t id) const
 {
-    // FIXME: unsafe
-    loop_->runInLoop(std::bind(&TcpServer::removeConnectionInLoop, this, conn));
+    return connections_->get(id);
 }
 
-// 断开链接的操作
-void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn)
+size_t TcpServer::numConnections() const
 {
-    loop_->assertInLoopThread();
-    LOG_INFO << "TcpServer::removeConnectionInLoop [" << name_
-             << "] - connection " << conn->name();
-    // 删除 TcpConnection 数组中的数据
-    size_t n = connections_.erase(conn->name());
-    // tips: (void)n 是为了防止编辑器 warning 这个 n 没有使用
-    (void)n;
-    assert(n == 1);
+    return connections_->size();
+}
+
+// 断开连接时的操作，在连接所在的 IO 线程中调用
+// 连接表按分片加锁，直接在这里删除，不用再转到主线程
+void TcpServer::removeConnection(const std::weak_ptr<ConnectionTable> &weakTable,
+                                 const TcpConnectionPtr &conn)
+{
+    LOG_INFO << "TcpServer::removeConnection [" << conn->name() << "]";
+    // 删除连接表中的数据，失败说明 TcpServer 正在或已经析构，它会负责 connectDestroyed
+    std::shared_ptr<ConnectionTable> table(weakTable.lock());
+    if (!table || !table->remove(conn->id()))
+    {
+        return;
+    }
     // 在对应的 EventLoopThread 的 Poll 中删除 TcpConnection 关注的操作
     EventLoop *ioLoop = conn->getLoop();
     ioLoop->queueInLoop(
         std::bind(&TcpConnection::connectDestroyed, conn));  // 调用 TcpConnection::connectDestroyed
 }
+
+// 比较上一个周期各 loop 的忙碌比例，从最忙的 loop 迁走一个连接到最闲的 loop
+void TcpServer::rebalance()
+{
+    loop_->assertInLoopThread();
+    std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+    Timestamp now(Timestamp::now());
+    std::vector<int64_t> busy(loops.size());
+    for (size_t i = 0; i < loops.size(); ++i)
+    {
+        busy[i] = loops[i]->busyMicroSeconds();
+    }
+    double elapsed = timeDifference(now, lastRebalance_) * 1000 * 1000;
+    std::vector<int64_t> last;
+    last.swap(lastBusyMicroSeconds_);
+    lastBusyMicroSeconds_ = busy;
+    lastRebalance_ = now;
+    if (loops.size() < 2 || last.size() != loops.size())
+    {
+        return;
+    }
+
+    size_t hottest = 0;
+    size_t coldest = 0;
+    std::vector<double> ratio(loops.size());
+    for (size_t i = 0; i < loops.size(); ++i)
+    {
+        ratio[i] = static_cast<double>(busy[i] - last[i]) / elapsed;
+        if (ratio[i] > ratio[hottest])
+        {
+            hottest = i;
+        }
+        if (ratio[i] < ratio[coldest])
+        {
+            coldest = i;
+        }
+    }
+    bool imbalanced = ratio[hottest] - ratio[coldest] > rebalanceThreshold_;
+
+    // 按上一个周期内收到的字节数挑选，累计值只会选中最老的连接
+    TcpConnectionPtr heaviest;
+    int64_t heaviestBytes = 0;
+    int count = 0;
+    EventLoop *hot = loops[hottest];
+    // mark 是连接表槽位中保存的上次均衡时的 bytesReceived()
+    connections_->forEachMarked([&](const TcpConnectionPtr &conn, int64_t *mark)
+                                {
+                                    int64_t bytes = conn->bytesReceived();
+                                    int64_t delta = bytes - *mark;
+                                    *mark = bytes;
+                                    if (imbalanced && conn->getLoop() == hot)
+                                    {
+                                        ++count;
+                                        if (!heaviest || delta > heaviestBytes)
+                                        {
+                                            heaviest = conn;
+                                            heaviestBytes = delta;
+                                        }
+                                    }
+                                });
+    // 只有一个连接时迁走它只是把热点换个地方
+    if (count < 2)
+    {
+        return;
+    }
+    LOG_INFO << "TcpServer::rebalance [" << name_ << "] - busy "
+             << ratio[hottest] << " vs " << ratio[coldest]
+             << ", migrates " << heaviest->name();
+    heaviest->migrateTo(loops[coldest]);
+}
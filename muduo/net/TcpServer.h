@@ -13,9 +13,12 @@
 
 #include "muduo/base/Atomic.h"
 #include "muduo/base/Types.h"
+#include "muduo/net/InetAddress.h"
 #include "muduo/net/TcpConnection.h"
+#include "muduo/net/TimerId.h"
 
-#include <map>
+#include <map>  // not used here, kept for the users relying on it
+#include <vector>
 
 namespace muduo
 {
@@ -23,6 +26,7 @@ namespace net
 {
 
 class Acceptor;
+class ConnectionTable;
 class EventLoop;
 class EventLoopThreadPool;
 
@@ -40,6 +44,11 @@ public:
     {
         kNoReusePort,
         kReusePort,
+        /// Every IO loop owns an Acceptor listening on the same port with
+        /// SO_REUSEPORT, the kernel spreads new connections among them and
+        /// each connection stays in the loop that accepted it.
+        // 每个 IO 线程一个 Acceptor，不再经过主线程转交连接
+        kReusePortPerLoop,
     };
 
     //TcpServer(EventLoop* loop, const InetAddress& listenAddr);
@@ -55,20 +64,40 @@ public:
 
     /// Set the number of threads for handling input.
     ///
-    /// Always accepts new connection in loop's thread.
+    /// Always accepts new connection in loop's thread,
+    /// except with kReusePortPerLoop, which accepts in every IO thread.
     /// Must be called before @c start
     /// @param numThreads
     /// - 0 means all I/O in loop's thread, no thread will created.
     ///   this is the default value.
     /// - 1 means all I/O in another thread.
     /// - N means a thread pool with N threads, new connections
-    ///   are assigned on a round-robin basis.
+    ///   are assigned on a round-robin basis, or by the policy of
+    ///   threadPool()->setSelectionPolicy().
     // 设置线程池大小
     void setThreadNum(int numThreads);
     void setThreadInitCallback(const ThreadInitCallback &cb)
     {
         threadInitCallback_ = cb;
     }
+    /// With kReusePortPerLoop, let the kernel pick the Acceptor of loop
+    /// (CPU % numLoops) for a connection, instead of hashing the 4-tuple.
+    /// Pin IO thread i to CPU i in the ThreadInitCallback for locality.
+    /// Must be called before @c start
+    void setCpuSteering(bool on) { cpuSteering_ = on; }
+
+    /// Every @c interval seconds, if the busy ratios of the busiest and the
+    /// idlest IO loops differ by more than @c threshold, migrates the
+    /// connection with most bytes received in the last interval off the
+    /// busiest loop, which keeps at least one. See EventLoop::busyMicroSeconds().
+    /// Must be called before @c start
+    // 按各 loop 的忙碌时间自动迁移连接
+    void enableRebalancing(double interval, double threshold = 0.2)
+    {
+        rebalanceInterval_ = interval;
+        rebalanceThreshold_ = threshold;
+    }
+
     /// valid after calling start()
     // 返回线程池
     std::shared_ptr<EventLoopThreadPool> threadPool()
@@ -83,6 +112,13 @@ public:
     // 没有运行的话启动 server
     void start();
 
+    /// Returns null if connection @c id is closed. TcpConnection::id()
+    /// is a cheaper key than TcpConnection::name().
+    /// Thread safe.
+    TcpConnectionPtr getConnection(uint64_t id) const;
+    /// Thread safe.
+    size_t numConnections() const;
+
     /// Set connection callback.
     /// Not thread safe.
     void setConnectionCallback(const ConnectionCallback &cb)
@@ -108,20 +144,31 @@ private:
     /// Not thread safe, but in loop
     /// 不是线程安全的,但是在单个线程中进行执行，因为每个 acceptor 均占用一个 eventLoop
     void newConnection(int sockfd, const InetAddress &peerAddr);
-    /// Thread safe.线程安全操作
-    void removeConnection(const TcpConnectionPtr &conn);
-    /// Not thread safe, but in loop
-    void removeConnectionInLoop(const TcpConnectionPtr &conn);
-    // safe all Tcp connect,use string as key
-    // map[连接名字]连接对象
-    typedef std::map<string, TcpConnectionPtr> ConnectionMap;
+    /// kReusePortPerLoop, in ioLoop
+    void newConnectionInLoop(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr);
+    /// Thread safe.
+    TcpConnectionPtr createConnection(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr);
+    void startLoopAcceptors();
+    /// in loop
+    void rebalance();
+    /// Thread safe.线程安全操作，在连接所在的 IO 线程中直接删除
+    /// 只持有连接表的 weak_ptr，TcpServer 析构之后才关闭的连接也不会访问它
+    static void removeConnection(const std::weak_ptr<ConnectionTable> &weakTable,
+                                 const TcpConnectionPtr &conn);
     // 主循环的 EventLoop，一般仅仅执行 newConnect 操作
     // 该 loop_ 由客户进行创建，并不是在 TcpServer 中自动进行创建，这是因为会有多个监听接口，但是同一个线程只能有一个 Eventloop
     EventLoop *loop_;     // the acceptor loop
+    const InetAddress listenAddr_;
     const string ipPort_; // port
     const string name_;   // 服务器 name
+    // 连接名字的公共前缀 name_-ipPort_，所有连接共享
+    const std::shared_ptr<const string> connNamePrefix_;
     // 用来接受新的连接的 acceptor，使用 unique_ptr 包装指针
+    // kReusePortPerLoop 时为空
     std::unique_ptr<Acceptor> acceptor_; // avoid revealing Acceptor
+    // kReusePortPerLoop，与 threadPool_->getAllLoops() 一一对应
+    std::vector<std::unique_ptr<Acceptor>> loopAcceptors_;
+    bool cpuSteering_;
     // 线程池，使用 shared_ptr 包装
     std::shared_ptr<EventLoopThreadPool> threadPool_;
     // 注册的回调函数，由用户进行注册
@@ -131,11 +178,14 @@ private:
     ThreadInitCallback threadInitCallback_;
     // 保持原子操作，用来记录服务器是否正在 loop
     AtomicInt32 started_;
-    // always in loop thread
-    // 不用设置为 AtomicInt32 因为仅仅在本线程中进行调用
-    int nextConnId_;
-    // 用来保存所有连接对象
-    ConnectionMap connections_;
+    // 自动均衡，只在 loop_ 中访问
+    double rebalanceInterval_;
+    double rebalanceThreshold_;
+    TimerId rebalanceTimer_;
+    Timestamp lastRebalance_;
+    std::vector<int64_t> lastBusyMicroSeconds_;
+    // 用来保存所有连接对象，按整数 id 索引，分片加锁，各个 IO 线程都会访问
+    std::shared_ptr<ConnectionTable> connections_;
 };
 
 } // namespace net
@@ -24,3 +24,60 @@ void Timer::restart(Timestamp now)
     expiration_ = Timestamp::invalid();
   }
 }
+
+const int TimerPool::kChunkSize;
+
+TimerPool::TimerPool()
+  : freeList_(NULL)
+{
+}
+
+TimerPool::~TimerPool()
+{
+}
+
+Timer* TimerPool::construct(TimerCallback cb, Timestamp when, double interval)
+{
+  Timer* timer = NULL;
+  {
+    MutexLockGuard lock(mutex_);
+    if (freeList_ == NULL)
+    {
+      std::unique_ptr<Timer[]> chunk(new Timer[kChunkSize]);
+      for (int i = 0; i < kChunkSize; ++i)
+      {
+        chunk[i].next_ = freeList_;
+        freeList_ = &chunk[i];
+      }
+      chunks_.push_back(std::move(chunk));
+    }
+    timer = freeList_;
+    freeList_ = timer->next_;
+    timer->next_ = NULL;
+  }
+  // The links and slot_ belong to the loop thread, which may still check a
+  // stale TimerId against this Timer. slot_ is already NULL, see destroy(),
+  // and TimingWheel::insert() sets the links.
+  timer->callback_ = std::move(cb);
+  timer->expiration_ = when;
+  timer->interval_ = interval;
+  timer->repeat_ = interval > 0.0;
+  timer->sequence_.store(Timer::s_numCreated_.incrementAndGet(), std::memory_order_relaxed);
+  return timer;
+}
+
+void TimerPool::destroy(Timer* timer)
+{
+  assert(timer->slot_ == NULL);
+  timer->sequence_.store(0, std::memory_order_relaxed);
+  timer->callback_ = TimerCallback();
+  MutexLockGuard lock(mutex_);
+  timer->next_ = freeList_;
+  freeList_ = timer;
+}
+
+size_t TimerPool::capacity() const
+{
+  MutexLockGuard lock(mutex_);
+  return chunks_.size() * kChunkSize;
+}
@@ -12,9 +12,14 @@
 #define MUDUO_NET_TIMER_H
 
 #include "muduo/base/Atomic.h"
+#include "muduo/base/Mutex.h"
 #include "muduo/base/Timestamp.h"
 #include "muduo/net/Callbacks.h"
 
+#include <atomic>
+#include <memory>
+#include <vector>
+
 namespace muduo
 {
 namespace net
@@ -31,9 +36,24 @@ public:
           expiration_(when),
           interval_(interval),
           repeat_(interval > 0.0),
-          sequence_(s_numCreated_.incrementAndGet())
+          sequence_(s_numCreated_.incrementAndGet()),
+          prev_(NULL),
+          next_(NULL),
+          slot_(NULL)
     {
     }
+
+    // 池化的定时器，由 TimerPool 构造后反复使用
+    Timer()
+        : interval_(0.0),
+          repeat_(false),
+          sequence_(0),
+          prev_(NULL),
+          next_(NULL),
+          slot_(NULL)
+    {
+    }
+
     // 运行该函数
     void run() const
     {
@@ -42,27 +62,62 @@ public:
 
     Timestamp expiration() const { return expiration_; }
     bool repeat() const { return repeat_; }
-    int64_t sequence() const { return sequence_; }
+    int64_t sequence() const { return sequence_.load(std::memory_order_relaxed); }
+    bool inWheel() const { return slot_ != NULL; }
 
     void restart(Timestamp now);
 
     static int64_t numCreated() { return s_numCreated_.get(); }
 
 private:
+    friend class TimerPool;
+    friend class TimingWheel;
+
     // 时间到达时执行的操作
-    const TimerCallback callback_;
+    TimerCallback callback_;
     // 执行的时间
     Timestamp expiration_;
     // 间隔时间
-    const double interval_;
+    double interval_;
     // 是否是可重复执行的
-    const bool repeat_;
-    // 定时器的序列号
-    const int64_t sequence_;
+    bool repeat_;
+    // 定时器的序列号，0 表示空闲
+    // atomic because a stale TimerId may read it while the pool reuses this Timer
+    std::atomic<int64_t> sequence_;
+
+    // intrusive links, for TimingWheel slots and TimerPool free list
+    Timer *prev_;
+    Timer *next_;
+    Timer **slot_; // the wheel slot this timer is in, NULL if none, only in loop
 
     static AtomicInt64 s_numCreated_;
 };
 
+///
+/// Free list of Timers, allocated in chunks and only released with the pool,
+/// so that a stale TimerId still points to a (reused) Timer.
+///
+// 定时器对象池，避免每个定时器一次 new/delete
+class TimerPool : noncopyable
+{
+public:
+    TimerPool();
+    ~TimerPool();
+
+    // thread safe
+    Timer *construct(TimerCallback cb, Timestamp when, double interval);
+    void destroy(Timer *timer);
+
+    size_t capacity() const;
+
+private:
+    static const int kChunkSize = 256;
+
+    mutable MutexLock mutex_;
+    Timer *freeList_ GUARDED_BY(mutex_);
+    std::vector<std::unique_ptr<Timer[]>> chunks_ GUARDED_BY(mutex_);
+};
+
 } // namespace net
 } // namespace muduo
 
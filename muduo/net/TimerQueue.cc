@@ -17,6 +17,7 @@
 #include "muduo/net/Timer.h"
 #include "muduo/net/TimerId.h"
 
+#include <stdlib.h>
 #include <sys/timerfd.h>
 #include <unistd.h>
 
@@ -109,7 +110,13 @@ TimerQueue::TimerQueue(EventLoop *loop)
         std::bind(&TimerQueue::handleRead, this));
     // we are always reading the timerfd, we disarm it with timerfd_settime.
     // 从 channel 中读取数据
+    timerfdChannel_.setEdgeTriggered(true);
     timerfdChannel_.enableReading();
+    // 和 MUDUO_USE_POLL 一样，用环境变量选择默认实现
+    if (::getenv("MUDUO_USE_TIMING_WHEEL"))
+    {
+        wheel_.reset(new TimingWheel(Timestamp::now(), 1000));
+    }
 }
 
 TimerQueue::~TimerQueue()
@@ -120,10 +127,11 @@ TimerQueue::~TimerQueue()
     // close 对应的描述符
     ::close(timerfd_);
     // do not remove channel, since we're in EventLoop::dtor();
-    for (const Entry &timer : timers_)
+    // 定时器对象都在 pool_ 中，随之释放
+    if (wheel_)
     {
-        // 释放所有时间事件
-        delete timer.second;
+        std::vector<Timer *> timers;
+        wheel_->clear(&timers);
     }
 }
 
@@ -132,7 +140,7 @@ TimerId TimerQueue::addTimer(TimerCallback cb,
                              Timestamp when,
                              double interval)
 {
-    Timer *timer = new Timer(std::move(cb), when, interval);
+    Timer *timer = pool_.construct(std::move(cb), when, interval);
     loop_->runInLoop(
         std::bind(&TimerQueue::addTimerInLoop, this, timer));
     return TimerId(timer, timer->sequence());
@@ -149,6 +157,16 @@ void TimerQueue::cancel(TimerId timerId)
 void TimerQueue::addTimerInLoop(Timer *timer)
 {
     loop_->assertInLoopThread();
+    if (wheel_)
+    {
+        wheel_->insert(timer);
+        // 比 timerfd 设定的时间早才需要重设
+        if (!wheelArmed_.valid() || timer->expiration() < wheelArmed_)
+        {
+            armWheel(wheel_->nextExpiration());
+        }
+        return;
+    }
     // 插入事件，可能修改 timerfd 触发时间
     bool earliestChanged = insert(timer);
 
@@ -163,9 +181,25 @@ void TimerQueue::addTimerInLoop(Timer *timer)
 void TimerQueue::cancelInLoop(TimerId timerId)
 {
     loop_->assertInLoopThread();
-    assert(timers_.size() == activeTimers_.size());
     // 要取消的定时器 timer
     ActiveTimer timer(timerId.timer_, timerId.sequence_);
+    if (wheel_)
+    {
+        // Timer 来自对象池，不会被释放，可以直接用序列号判断是否过期
+        // 先比较序列号：其他线程可能正在 construct() 复用这个 Timer
+        Timer *t = timerId.timer_;
+        if (t && t->sequence() == timerId.sequence_ && t->inWheel())
+        {
+            wheel_->remove(t);
+            pool_.destroy(t);
+        }
+        else if (t && callingExpiredTimers_)
+        {
+            cancelingTimers_.insert(timer);
+        }
+        return;
+    }
+    assert(timers_.size() == activeTimers_.size());
     // 查找这个 timer
     ActiveTimerSet::iterator it = activeTimers_.find(timer);
     if (it != activeTimers_.end())
@@ -174,7 +208,7 @@ void TimerQueue::cancelInLoop(TimerId timerId)
         size_t n = timers_.erase(Entry(it->first->expiration(), it->first));
         assert(n == 1);
         (void)n;
-        delete it->first; // FIXME: no delete please
+        pool_.destroy(it->first);
         // 从 active 中删除
         activeTimers_.erase(it);
     }
@@ -195,6 +229,11 @@ void TimerQueue::handleRead()
     Timestamp now(Timestamp::now());
     // 读 timerfd
     readTimerfd(timerfd_, now);
+    if (wheel_)
+    {
+        handleWheelExpired(now);
+        return;
+    }
     // 获取可执行事件
     std::vector<Entry> expired = getExpired(now);
 
@@ -255,8 +294,7 @@ void TimerQueue::reset(const std::vector<Entry> &expired, Timestamp now)
         }
         else
         {
-            // FIXME move to a free list
-            delete it.second; // FIXME: no delete please
+            pool_.destroy(it.second);
         }
     }
 
@@ -302,3 +340,70 @@ bool TimerQueue::insert(Timer *timer)
     assert(timers_.size() == activeTimers_.size());
     return earliestChanged;
 }
+
+void TimerQueue::useTimingWheel(double tickSeconds)
+{
+    loop_->assertInLoopThread();
+    assert(!callingExpiredTimers_);
+    int64_t tick = static_cast<int64_t>(tickSeconds * Timestamp::kMicroSecondsPerSecond);
+    std::vector<Timer *> timers;
+    if (wheel_)
+    {
+        wheel_->clear(&timers);
+    }
+    else
+    {
+        for (const Entry &it : timers_)
+        {
+            timers.push_back(it.second);
+        }
+        timers_.clear();
+        activeTimers_.clear();
+    }
+    wheel_.reset(new TimingWheel(Timestamp::now(), tick > 0 ? tick : 1));
+    for (Timer *timer : timers)
+    {
+        wheel_->insert(timer);
+    }
+    wheelArmed_ = Timestamp::invalid();
+    armWheel(wheel_->nextExpiration());
+}
+
+void TimerQueue::armWheel(Timestamp when)
+{
+    if (when.valid())
+    {
+        resetTimerfd(timerfd_, when);
+    }
+    wheelArmed_ = when;
+}
+
+void TimerQueue::handleWheelExpired(Timestamp now)
+{
+    wheelArmed_ = Timestamp::invalid();
+    std::vector<Timer *> expired;
+    wheel_->expire(now, &expired);
+
+    callingExpiredTimers_ = true;
+    cancelingTimers_.clear();
+    for (Timer *timer : expired)
+    {
+        timer->run();
+    }
+    callingExpiredTimers_ = false;
+
+    for (Timer *timer : expired)
+    {
+        ActiveTimer active(timer, timer->sequence());
+        if (timer->repeat() && cancelingTimers_.find(active) == cancelingTimers_.end())
+        {
+            timer->restart(now);
+            wheel_->insert(timer);
+        }
+        else
+        {
+            pool_.destroy(timer);
+        }
+    }
+    armWheel(wheel_->nextExpiration());
+}
@@ -18,6 +18,10 @@
 #include "muduo/base/Timestamp.h"
 #include "muduo/net/Callbacks.h"
 #include "muduo/net/Channel.h"
+#include "muduo/net/Timer.h"
+#include "muduo/net/TimingWheel.h"
+
+#include <memory>
 
 namespace muduo
 {
@@ -25,7 +29,6 @@ namespace net
 {
 
 class EventLoop;
-class Timer;
 class TimerId;
 
 ///
@@ -50,6 +53,12 @@ public:
 
     void cancel(TimerId timerId);
 
+    /// Switches from the two std::sets to a hierarchical timing wheel,
+    /// existing timers are moved over. Must be called in loop thread.
+    // 切换到时间轮实现，插入和取消都是 O(1)，定时精度为 tickSeconds
+    void useTimingWheel(double tickSeconds);
+    bool usingTimingWheel() const { return wheel_ != nullptr; }
+
 private:
     // FIXME: use unique_ptr<Timer> instead of raw pointers.
     // This requires heterogeneous comparison lookup (N3465) from C++14
@@ -72,6 +81,10 @@ private:
 
     bool insert(Timer *timer);
 
+    // timing wheel backend
+    void handleWheelExpired(Timestamp now);
+    void armWheel(Timestamp when);
+
     EventLoop *loop_;        // 持有这个队列的 EventLoop
     const int timerfd_;      // 注册到 Poll 中和 timeEvent 相关的 fd
     Channel timerfdChannel_; // timefd 对应的 channel
@@ -84,6 +97,11 @@ private:
     ActiveTimerSet activeTimers_;
     bool callingExpiredTimers_; /* atomic */ // 是否正在处理超时事件
     ActiveTimerSet cancelingTimers_;         // 保存的是被取消的定时器
+
+    TimerPool pool_; // Timer 对象池，取代 new/delete
+    // non-null if using the timing wheel instead of timers_ and activeTimers_
+    std::unique_ptr<TimingWheel> wheel_;
+    Timestamp wheelArmed_; // timerfd 当前设定的时间，invalid 表示未设定
 };
 
 } // namespace net
@@ -0,0 +1,209 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+#include "muduo/net/TimingWheel.h"
+
+#include "muduo/net/Timer.h"
+
+#include <assert.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+const int TimingWheel::kLevel0Bits;
+const int TimingWheel::kLevelBits;
+const int TimingWheel::kLevels;
+const int TimingWheel::kLevel0Size;
+const int TimingWheel::kLevelSize;
+
+TimingWheel::TimingWheel(Timestamp now, int64_t tickMicroSeconds)
+    : tick_(tickMicroSeconds),
+      current_(now.microSecondsSinceEpoch() / tickMicroSeconds),
+      size_(0),
+      level0Size_(0),
+      slots_(kLevel0Size + (kLevels - 1) * kLevelSize, NULL)
+{
+    assert(tick_ > 0);
+}
+
+TimingWheel::~TimingWheel()
+{
+    assert(size_ == 0);
+}
+
+Timer **TimingWheel::slotAt(int level, int index)
+{
+    if (level == 0)
+    {
+        return &slots_[index];
+    }
+    return &slots_[kLevel0Size + (level - 1) * kLevelSize + index];
+}
+
+// 到期时间向上取整到 tick，保证不会提前触发
+int64_t TimingWheel::tickOf(Timestamp when) const
+{
+    return (when.microSecondsSinceEpoch() + tick_ - 1) / tick_;
+}
+
+void TimingWheel::insert(Timer *timer)
+{
+    assert(timer->slot_ == NULL);
+    place(timer, tickOf(timer->expiration()));
+    ++size_;
+}
+
+// 根据距离当前 tick 的远近选择层级和槽位
+void TimingWheel::place(Timer *timer, int64_t tick)
+{
+    int64_t delta = tick - current_;
+    Timer **slot = NULL;
+    if (delta < kLevel0Size)
+    {
+        if (delta < 0)
+        {
+            tick = current_; // already expired, run at next tick
+        }
+        slot = slotAt(0, static_cast<int>(tick & (kLevel0Size - 1)));
+        ++level0Size_;
+    }
+    else
+    {
+        int level = 1;
+        int shift = kLevel0Bits;
+        while (level < kLevels - 1 && delta >= (int64_t(1) << (shift + kLevelBits)))
+        {
+            ++level;
+            shift += kLevelBits;
+        }
+        const int64_t maxDelta = (int64_t(1) << (shift + kLevelBits)) - 1;
+        if (delta > maxDelta)
+        {
+            tick = current_ + maxDelta; // parked, placed again when cascaded
+        }
+        slot = slotAt(level, static_cast<int>((tick >> shift) & (kLevelSize - 1)));
+    }
+    timer->slot_ = slot;
+    timer->prev_ = NULL;
+    timer->next_ = *slot;
+    if (*slot)
+    {
+        (*slot)->prev_ = timer;
+    }
+    *slot = timer;
+}
+
+void TimingWheel::remove(Timer *timer)
+{
+    assert(timer->slot_ != NULL);
+    if (timer->prev_)
+    {
+        timer->prev_->next_ = timer->next_;
+    }
+    else
+    {
+        *timer->slot_ = timer->next_;
+    }
+    if (timer->next_)
+    {
+        timer->next_->prev_ = timer->prev_;
+    }
+    if (timer->slot_ < &slots_[kLevel0Size])
+    {
+        --level0Size_;
+    }
+    timer->slot_ = NULL;
+    timer->prev_ = NULL;
+    timer->next_ = NULL;
+    --size_;
+}
+
+// 把高层一个槽里的定时器重新分配到低层
+void TimingWheel::cascade(int level)
+{
+    const int shift = kLevel0Bits + (level - 1) * kLevelBits;
+    Timer **slot = slotAt(level, static_cast<int>((current_ >> shift) & (kLevelSize - 1)));
+    Timer *timer = *slot;
+    *slot = NULL;
+    while (timer)
+    {
+        Timer *next = timer->next_;
+        place(timer, tickOf(timer->expiration()));
+        timer = next;
+    }
+}
+
+void TimingWheel::expire(Timestamp now, std::vector<Timer *> *expired)
+{
+    const int64_t nowTick = now.microSecondsSinceEpoch() / tick_;
+    while (current_ <= nowTick)
+    {
+        if (size_ == 0)
+        {
+            current_ = nowTick + 1;
+            break;
+        }
+        const int index = static_cast<int>(current_ & (kLevel0Size - 1));
+        if (index == 0)
+        {
+            // 低层转完一圈，依次从高层取下一个槽
+            for (int level = 1; level < kLevels; ++level)
+            {
+                cascade(level);
+                const int shift = kLevel0Bits + (level - 1) * kLevelBits;
+                if (((current_ >> shift) & (kLevelSize - 1)) != 0)
+                {
+                    break;
+                }
+            }
+        }
+        if (level0Size_ == 0)
+        {
+            // nothing in level 0, jump to the next cascade
+            int64_t next = (current_ | (kLevel0Size - 1)) + 1;
+            current_ = next <= nowTick ? next : nowTick + 1;
+            continue;
+        }
+        Timer **slot = slotAt(0, index);
+        while (Timer *timer = *slot)
+        {
+            remove(timer);
+            expired->push_back(timer);
+        }
+        ++current_;
+    }
+}
+
+Timestamp TimingWheel::nextExpiration() const
+{
+    if (size_ == 0)
+    {
+        return Timestamp::invalid();
+    }
+    // 下一次 cascade 之前 level 0 中最早的槽
+    const int64_t cascadeTick = (current_ | (kLevel0Size - 1)) + 1;
+    if (level0Size_ > 0)
+    {
+        for (int64_t tick = current_; tick < cascadeTick; ++tick)
+        {
+            if (slots_[static_cast<size_t>(tick & (kLevel0Size - 1))])
+            {
+                return Timestamp(tick * tick_);
+            }
+        }
+    }
+    return Timestamp(cascadeTick * tick_);
+}
+
+void TimingWheel::clear(std::vector<Timer *> *timers)
+{
+    for (Timer *&slot : slots_)
+    {
+        while (Timer *timer = slot)
+        {
+            remove(timer);
+            timers->push_back(timer);
+        }
+    }
+    assert(size_ == 0);
+}
@@ -0,0 +1,73 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// This is an internal header file, you should not include this.
+
+#ifndef MUDUO_NET_TIMINGWHEEL_H
+#define MUDUO_NET_TIMINGWHEEL_H
+
+#include "muduo/base/noncopyable.h"
+#include "muduo/base/Timestamp.h"
+
+#include <vector>
+
+namespace muduo
+{
+namespace net
+{
+
+class Timer;
+
+///
+/// Hierarchical timing wheel, O(1) insert and remove.
+///
+/// Four levels of 256, 64, 64 and 64 slots, like the Linux kernel timers.
+/// With 1ms ticks, level 0 covers 256ms and all levels cover 18.6 hours,
+/// timers further away are parked in the last slot and re-cascaded.
+/// Timers are linked through Timer::prev_/next_, no allocation.
+// 分层时间轮，插入和删除都是 O(1)
+class TimingWheel : noncopyable
+{
+public:
+    TimingWheel(Timestamp now, int64_t tickMicroSeconds);
+    ~TimingWheel();
+
+    void insert(Timer *timer);
+    void remove(Timer *timer);
+
+    /// Moves timers expired by @c now to @c expired, removed from the wheel.
+    void expire(Timestamp now, std::vector<Timer *> *expired);
+
+    /// Time to arm the timerfd, either the earliest expiration in level 0
+    /// or the next cascade. Invalid if empty.
+    Timestamp nextExpiration() const;
+
+    size_t size() const { return size_; }
+    int64_t tickMicroSeconds() const { return tick_; }
+
+    /// Moves all timers out, for destruction.
+    void clear(std::vector<Timer *> *timers);
+
+private:
+    static const int kLevel0Bits = 8;
+    static const int kLevelBits = 6;
+    static const int kLevels = 4;
+    static const int kLevel0Size = 1 << kLevel0Bits;
+    static const int kLevelSize = 1 << kLevelBits;
+
+    int64_t tickOf(Timestamp when) const;
+    void place(Timer *timer, int64_t tick);
+    void cascade(int level);
+    Timer **slotAt(int level, int index);
+
+    const int64_t tick_;  // microseconds per tick
+    int64_t current_;     // next tick to be processed
+    size_t size_;
+    size_t level0Size_;   // timers in level 0
+    std::vector<Timer *> slots_; // kLevel0Size + (kLevels-1) * kLevelSize lists
+};
+
+} // namespace net
+} // namespace muduo
+
+#endif // MUDUO_NET_TIMINGWHEEL_H
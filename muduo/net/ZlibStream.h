@@ -45,6 +45,12 @@ class ZlibInputStream : noncopyable
 class ZlibOutputStream : noncopyable
 {
  public:
+  enum Format
+  {
+    kZlib,  // RFC 1950, HTTP Content-Encoding: deflate
+    kGzip,  // RFC 1952
+  };
+
   explicit ZlibOutputStream(Buffer* output)
     : output_(output),
       zerror_(Z_OK),
@@ -54,6 +60,18 @@ class ZlibOutputStream : noncopyable
     zerror_ = deflateInit(&zstream_, Z_DEFAULT_COMPRESSION);
   }
 
+  ZlibOutputStream(Buffer* output, Format format, int level = Z_DEFAULT_COMPRESSION)
+    : output_(output),
+      zerror_(Z_OK),
+      bufferSize_(1024)
+  {
+    memZero(&zstream_, sizeof zstream_);
+    const int kWindowBits = 15;
+    zerror_ = deflateInit2(&zstream_, level, Z_DEFLATED,
+                           format == kGzip ? kWindowBits + 16 : kWindowBits,
+                           8, Z_DEFAULT_STRATEGY);
+  }
+
   ~ZlibOutputStream()
   {
     finish();
@@ -105,6 +123,21 @@ class ZlibOutputStream : noncopyable
     return zerror_ == Z_OK;
   }
 
+  // output all data written so far, for the peer to decompress it now.
+  bool flush()
+  {
+    if (zerror_ != Z_OK)
+      return false;
+
+    while (zerror_ == Z_OK)
+    {
+      zerror_ = compress(Z_SYNC_FLUSH);
+      if (zstream_.avail_out > 0)
+        break;
+    }
+    return zerror_ == Z_OK;
+  }
+
   bool finish()
   {
     if (zerror_ != Z_OK)
@@ -0,0 +1,353 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+#include "muduo/net/http/HttpCompressor.h"
+
+#include "muduo/base/Logging.h"
+#include "muduo/base/ThreadPool.h"
+#include "muduo/net/http/HttpRequest.h"
+#include "muduo/net/http/HttpResponse.h"
+#include "muduo/net/ZlibStream.h"
+
+#include <algorithm>
+#include <functional>
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <strings.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+namespace
+{
+
+// counted for every cache entry besides the compressed bytes
+const size_t kEntryOverhead = 64;
+
+StringPiece trim(const char* begin, const char* end)
+{
+  while (begin < end && isspace(*begin))
+  {
+    ++begin;
+  }
+  while (begin < end && isspace(end[-1]))
+  {
+    --end;
+  }
+  return StringPiece(begin, static_cast<int>(end - begin));
+}
+
+bool equalsIgnoreCase(const StringPiece& s, const char* literal)
+{
+  size_t len = ::strlen(literal);
+  return static_cast<size_t>(s.size()) == len && ::strncasecmp(s.data(), literal, len) == 0;
+}
+
+const char* encodingName(HttpCompressor::Encoding encoding)
+{
+  return encoding == HttpCompressor::kGzip ? "gzip" : "deflate";
+}
+
+ZlibOutputStream::Format zlibFormat(HttpCompressor::Encoding encoding)
+{
+  return encoding == HttpCompressor::kGzip ? ZlibOutputStream::kGzip : ZlibOutputStream::kZlib;
+}
+
+// compresses the body of an HttpStream, flushed after every write
+struct StreamEncoder : noncopyable
+{
+  StreamEncoder(HttpCompressor::Encoding encoding, int level)
+    : zlib(&output, zlibFormat(encoding), level)
+  {
+  }
+
+  void encode(const StringPiece& data, bool last, Buffer* out)
+  {
+    bool written = false;
+    if (!head.empty())
+    {
+      zlib.write(head);
+      string().swap(head);
+      written = true;
+    }
+    if (!data.empty())
+    {
+      zlib.write(data);
+      written = true;
+    }
+    if (last)
+    {
+      zlib.finish();
+    }
+    else if (written)
+    {
+      zlib.flush();
+    }
+    out->append(output.peek(), output.readableBytes());
+    output.retrieveAll();
+  }
+
+  Buffer output;
+  ZlibOutputStream zlib;
+  string head;  // the body set on the response, goes first
+};
+
+}  // namespace
+
+HttpCompressor::HttpCompressor()
+  : minSize_(1024),
+    level_(6),
+    maxCacheBytes_(16 * 1024 * 1024),
+    offloadThreshold_(64 * 1024),
+    cacheBytes_(0),
+    cacheHits_(0),
+    cacheMisses_(0)
+{
+}
+
+HttpCompressor::~HttpCompressor()
+{
+  if (pool_)
+  {
+    pool_->stop();
+  }
+}
+
+HttpCompressor::Encoding HttpCompressor::negotiate(const StringPiece& acceptEncoding)
+{
+  // -1 if not mentioned
+  double gzip = -1;
+  double deflate = -1;
+  double any = -1;
+  const char* p = acceptEncoding.begin();
+  const char* end = acceptEncoding.end();
+  while (p < end)
+  {
+    const char* comma = std::find(p, end, ',');
+    const char* semicolon = std::find(p, comma, ';');
+    StringPiece coding = trim(p, semicolon);
+    double q = 1;
+    if (semicolon != comma)
+    {
+      StringPiece param = trim(semicolon + 1, comma);
+      if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=')
+      {
+        q = ::atof(string(param.data() + 2, param.size() - 2).c_str());
+      }
+    }
+    if (equalsIgnoreCase(coding, "gzip") || equalsIgnoreCase(coding, "x-gzip"))
+    {
+      gzip = q;
+    }
+    else if (equalsIgnoreCase(coding, "deflate"))
+    {
+      deflate = q;
+    }
+    else if (equalsIgnoreCase(coding, "*"))
+    {
+      any = q;
+    }
+    p = comma == end ? end : comma + 1;
+  }
+  if (gzip < 0)
+  {
+    gzip = any;
+  }
+  if (deflate < 0)
+  {
+    deflate = any;
+  }
+  if (gzip > 0 && gzip >= deflate)
+  {
+    return kGzip;
+  }
+  return deflate > 0 ? kDeflate : kIdentity;
+}
+
+bool HttpCompressor::compressible(const StringPiece& contentType)
+{
+  string type(contentType.data(), contentType.size());
+  std::transform(type.begin(), type.end(), type.begin(), ::tolower);
+  type = type.substr(0, type.find(';'));
+  return type.compare(0, 5, "text/") == 0 ||
+    type.find("json") != string::npos ||
+    type.find("javascript") != string::npos ||
+    type.find("xml") != string::npos;
+}
+
+bool HttpCompressor::compress(const StringPiece& data, Encoding encoding, int level, string* output)
+{
+  Buffer buf;
+  ZlibOutputStream zlib(&buf, zlibFormat(encoding), level);
+  if (!zlib.write(data) || !zlib.finish())
+  {
+    LOG_ERROR << "HttpCompressor::compress " << zlib.zlibErrorCode();
+    return false;
+  }
+  output->assign(buf.peek(), buf.readableBytes());
+  return true;
+}
+
+void HttpCompressor::startThreads(int numThreads)
+{
+  assert(!pool_);
+  pool_.reset(new ThreadPool("HttpCompressor"));
+  pool_->start(numThreads);
+}
+
+void HttpCompressor::filter(const HttpRequest& req, HttpResponse* resp)
+{
+  if (resp->hasBodyFile() || !resp->getHeader("Content-Encoding").empty() ||
+      !compressible(resp->getHeader("Content-Type")))
+  {
+    return;
+  }
+  size_t size = resp->body().size();
+  if (!resp->chunked() && size < minSize_)
+  {
+    return;
+  }
+  resp->addHeader("Vary", "Accept-Encoding");
+  Encoding encoding = negotiate(req.findHeader("Accept-Encoding"));
+  if (encoding == kIdentity)
+  {
+    return;
+  }
+
+  if (resp->chunked())
+  {
+    filterStream(resp, encoding);
+    return;
+  }
+
+  // the cache is keyed by a hash of the whole body, skip it if disabled
+  bool cached = maxCacheBytes_ > 0;
+  Key key = cached ? makeKey(resp->body(), encoding) : Key();
+  if (StringPtr compressed = cached ? find(key) : StringPtr())
+  {
+    cacheHits_.fetch_add(1, std::memory_order_relaxed);
+    // empty if it didn't get smaller
+    if (!compressed->empty())
+    {
+      resp->setBody(*compressed);
+      resp->addHeader("Content-Encoding", encodingName(encoding));
+    }
+    return;
+  }
+  if (cached)
+  {
+    cacheMisses_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  if (pool_ && size > offloadThreshold_ &&
+      req.getVersion() == HttpRequest::kHttp11 && req.method() != HttpRequest::kHead)
+  {
+    std::shared_ptr<string> body(new string);
+    resp->swapBody(body.get());
+    resp->addHeader("Content-Encoding", encodingName(encoding));
+    HttpStreamPtr stream = resp->stream();
+    int level = level_;
+    pool_->run([this, body, encoding, level, cached, key, stream]
+        {
+          std::shared_ptr<string> compressed(new string);
+          if (!compress(*body, encoding, level, compressed.get()))
+          {
+            // Content-Encoding is already set, an empty body would look valid
+            stream->abort();
+            return;
+          }
+          stream->write(*compressed);
+          if (cached)
+          {
+            insert(key, compressed);
+          }
+          stream->finish();
+        });
+    return;
+  }
+
+  std::shared_ptr<string> compressed(new string);
+  if (!compress(resp->body(), encoding, level_, compressed.get()))
+  {
+    return;
+  }
+  if (compressed->size() >= size)
+  {
+    compressed->clear();
+  }
+  else
+  {
+    resp->swapBody(compressed.get());
+    resp->addHeader("Content-Encoding", encodingName(encoding));
+    if (cached)
+    {
+      *compressed = resp->body();
+    }
+  }
+  if (cached)
+  {
+    insert(key, compressed);
+  }
+}
+
+void HttpCompressor::filterStream(HttpResponse* resp, Encoding encoding)
+{
+  std::shared_ptr<StreamEncoder> encoder(new StreamEncoder(encoding, level_));
+  resp->swapBody(&encoder->head);
+  resp->addHeader("Content-Encoding", encodingName(encoding));
+  resp->stream()->setEncoder(
+      std::bind(&StreamEncoder::encode, encoder, _1, _2, _3));
+}
+
+size_t HttpCompressor::cacheBytes() const
+{
+  MutexLockGuard lock(mutex_);
+  return cacheBytes_;
+}
+
+HttpCompressor::Key HttpCompressor::makeKey(const string& body, Encoding encoding)
+{
+  Key key;
+  key.hash = std::hash<string>()(body);
+  key.crc = static_cast<uint32_t>(::crc32(0, reinterpret_cast<const Bytef*>(body.data()),
+                                          static_cast<uInt>(body.size())));
+  key.size = body.size();
+  key.encoding = encoding;
+  return key;
+}
+
+HttpCompressor::StringPtr HttpCompressor::find(const Key& key)
+{
+  MutexLockGuard lock(mutex_);
+  auto it = cache_.find(key);
+  if (it == cache_.end())
+  {
+    return StringPtr();
+  }
+  lru_.splice(lru_.begin(), lru_, it->second);
+  return it->second->second;
+}
+
+void HttpCompressor::insert(const Key& key, const StringPtr& compressed)
+{
+  size_t bytes = compressed->size() + kEntryOverhead;
+  if (bytes > maxCacheBytes_)
+  {
+    return;
+  }
+  MutexLockGuard lock(mutex_);
+  if (cache_.find(key) != cache_.end())
+  {
+    return;
+  }
+  lru_.emplace_front(key, compressed);
+  cache_[key] = lru_.begin();
+  cacheBytes_ += bytes;
+  while (cacheBytes_ > maxCacheBytes_)
+  {
+    cacheBytes_ -= lru_.back().second->size() + kEntryOverhead;
+    cache_.erase(lru_.back().first);
+    lru_.pop_back();
+  }
+}
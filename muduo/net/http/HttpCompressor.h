@@ -0,0 +1,132 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_HTTP_HTTPCOMPRESSOR_H
+#define MUDUO_NET_HTTP_HTTPCOMPRESSOR_H
+
+#include "muduo/base/Mutex.h"
+#include "muduo/base/StringPiece.h"
+#include "muduo/base/Types.h"
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+namespace muduo
+{
+
+class ThreadPool;
+
+namespace net
+{
+
+class HttpRequest;
+class HttpResponse;
+
+///
+/// Content-Encoding: gzip or deflate of textual responses, negotiated with
+/// the Accept-Encoding of the request, a response filter of HttpServer.
+///
+/// Bodies are compressed in the loop, or, if larger than the offload
+/// threshold and startThreads() was called, in a ThreadPool while the
+/// response is sent as an HttpStream. Compressed bodies are kept in an LRU
+/// cache keyed by their content. Streamed responses are compressed chunk
+/// by chunk. File bodies are sent as they are.
+///
+/// @code
+/// HttpCompressor compressor;
+/// server.setResponseFilter(std::bind(&HttpCompressor::filter, &compressor, _1, _2));
+/// @endcode
+/// The compressor must outlive the server.
+///
+/// Thread safe.
+class HttpCompressor : noncopyable
+{
+ public:
+  enum Encoding
+  {
+    kIdentity,
+    kGzip,
+    kDeflate,
+  };
+
+  HttpCompressor();
+  ~HttpCompressor();
+
+  /// Picks gzip or deflate, by q-values then gzip first, kIdentity if neither.
+  static Encoding negotiate(const StringPiece& acceptEncoding);
+  static bool compressible(const StringPiece& contentType);
+  /// Returns false if zlib failed.
+  static bool compress(const StringPiece& data, Encoding encoding, int level, string* output);
+
+  /// Smaller bodies are sent as they are. 1KiB by default.
+  /// Must be called before use.
+  void setMinSize(size_t size) { minSize_ = size; }
+  /// zlib level, 1 to 9, 6 by default. Must be called before use.
+  void setLevel(int level) { level_ = level; }
+  /// Bytes of compressed bodies kept, 0 disables the cache and its hashing
+  /// of bodies. 16MiB by default.
+  /// Must be called before use.
+  void setCacheSize(size_t bytes) { maxCacheBytes_ = bytes; }
+  /// Bodies larger than this are compressed off the loop. 64KiB by default.
+  /// Must be called before startThreads().
+  void setOffloadThreshold(size_t size) { offloadThreshold_ = size; }
+  void startThreads(int numThreads);
+
+  /// Compresses the body of resp if req accepts it.
+  void filter(const HttpRequest& req, HttpResponse* resp);
+
+  int64_t cacheHits() const { return cacheHits_.load(std::memory_order_relaxed); }
+  int64_t cacheMisses() const { return cacheMisses_.load(std::memory_order_relaxed); }
+  size_t cacheBytes() const;
+
+ private:
+  struct Key
+  {
+    size_t hash;
+    uint32_t crc;
+    size_t size;
+    Encoding encoding;
+
+    bool operator==(const Key& rhs) const
+    {
+      return hash == rhs.hash && crc == rhs.crc &&
+        size == rhs.size && encoding == rhs.encoding;
+    }
+  };
+
+  struct KeyHash
+  {
+    size_t operator()(const Key& key) const
+    { return key.hash ^ key.crc ^ key.encoding; }
+  };
+
+  typedef std::shared_ptr<const string> StringPtr;
+  typedef std::list<std::pair<Key, StringPtr>> LruList;
+
+  static Key makeKey(const string& body, Encoding encoding);
+  StringPtr find(const Key& key);
+  void insert(const Key& key, const StringPtr& compressed);
+  void filterStream(HttpResponse* resp, Encoding encoding);
+
+  size_t minSize_;
+  int level_;
+  size_t maxCacheBytes_;
+  size_t offloadThreshold_;
+  std::unique_ptr<ThreadPool> pool_;
+
+  mutable MutexLock mutex_;
+  LruList lru_ GUARDED_BY(mutex_);  // most recently used first
+  std::unordered_map<Key, LruList::iterator, KeyHash> cache_ GUARDED_BY(mutex_);
+  size_t cacheBytes_ GUARDED_BY(mutex_);
+  std::atomic<int64_t> cacheHits_;
+  std::atomic<int64_t> cacheMisses_;
+};
+
+}  // namespace net
+}  // namespace muduo
+
+#endif  // MUDUO_NET_HTTP_HTTPCOMPRESSOR_H
@@ -10,9 +10,125 @@
 #include "muduo/net/Buffer.h"
 #include "muduo/net/http/HttpContext.h"
 
+#include <algorithm>
+
+#include <string.h>
+#include <strings.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 using namespace muduo;
 using namespace muduo::net;
 
+const size_t HttpContext::kMaxHeaderSize;
+
+namespace
+{
+
+// p points to a '\n', is it the end of "\r\n\r\n" ?
+inline bool isHeaderEnd(const char* start, const char* p)
+{
+  return p - start >= 3 && p[-1] == '\r' && p[-2] == '\n' && p[-3] == '\r';
+}
+
+// Searches [from, end) for the end of the header block, "\r\n\r\n" may
+// begin before from, but not before start. Returns one past it, or NULL.
+// Compares 32 or 16 bytes at a time against '\n', few of them are left to
+// check one by one.
+const char* findHeaderEnd(const char* start, const char* from, const char* end)
+{
+  const char* p = from;
+#if defined(__AVX2__)
+  const __m256i lf32 = _mm256_set1_epi8('\n');
+  for (; end - p >= 32; p += 32)
+  {
+    __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, lf32)));
+    while (mask)
+    {
+      const char* lf = p + __builtin_ctz(mask);
+      if (isHeaderEnd(start, lf))
+      {
+        return lf + 1;
+      }
+      mask &= mask - 1;
+    }
+  }
+#endif
+#if defined(__SSE2__)
+  const __m128i lf16 = _mm_set1_epi8('\n');
+  for (; end - p >= 16; p += 16)
+  {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, lf16)));
+    while (mask)
+    {
+      const char* lf = p + __builtin_ctz(mask);
+      if (isHeaderEnd(start, lf))
+      {
+        return lf + 1;
+      }
+      mask &= mask - 1;
+    }
+  }
+#endif
+  for (; p < end; ++p)
+  {
+    if (*p == '\n' && isHeaderEnd(start, p))
+    {
+      return p + 1;
+    }
+  }
+  return NULL;
+}
+
+// returns false if value is not a number
+bool parseLength(const StringPiece& value, size_t* length)
+{
+  const size_t kMaxLength = static_cast<size_t>(1) << 40;
+  size_t n = 0;
+  for (char c : value)
+  {
+    if (c < '0' || c > '9' || n > kMaxLength)
+    {
+      return false;
+    }
+    n = n * 10 + static_cast<size_t>(c - '0');
+  }
+  *length = n;
+  return !value.empty();
+}
+
+int hexDigit(char c)
+{
+  if (c >= '0' && c <= '9')
+  {
+    return c - '0';
+  }
+  c = static_cast<char>(c | 0x20);
+  return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+// [begin, end) is a chunk-size line, with optional chunk extensions
+bool parseChunkSize(const char* begin, const char* end, size_t* size)
+{
+  const size_t kMaxSize = static_cast<size_t>(1) << 40;
+  size_t n = 0;
+  const char* p = begin;
+  for (int digit; p < end && n <= kMaxSize && (digit = hexDigit(*p)) >= 0; ++p)
+  {
+    n = n * 16 + static_cast<size_t>(digit);
+  }
+  *size = n;
+  return p > begin && n <= kMaxSize && (p == end || *p == ';' || *p == ' ' || *p == '\t');
+}
+
+const size_t kMaxChunkSizeLine = 1024;
+
+}  // namespace
+
 bool HttpContext::processRequestLine(const char* begin, const char* end)
 {
   bool succeed = false;
@@ -56,63 +172,207 @@ bool HttpContext::processRequestLine(const char* begin, const char* end)
   return succeed;
 }
 
+bool HttpContext::processHeaders(const char* begin, const char* end)
+{
+  const char* lf = static_cast<const char*>(memchr(begin, '\n', end - begin));
+  assert(lf != NULL && lf[-1] == '\r');
+  if (!processRequestLine(begin, lf - 1))
+  {
+    return false;
+  }
+  for (const char* line = lf + 1; line < end; line = lf + 1)
+  {
+    lf = static_cast<const char*>(memchr(line, '\n', end - line));
+    const char* eol = lf > line && lf[-1] == '\r' ? lf - 1 : lf;
+    if (eol == line)
+    {
+      break;  // empty line, end of header
+    }
+    const char* colon = static_cast<const char*>(memchr(line, ':', eol - line));
+    if (colon)
+    {
+      request_.addHeader(line, colon, eol);
+    }
+  }
+  return true;
+}
+
 // return false if any error
 bool HttpContext::parseRequest(Buffer* buf, Timestamp receiveTime)
 {
-  bool ok = true;
-  bool hasMore = true;
-  while (hasMore)
+  if (gotBodyPiece_)
+  {
+    gotBodyPiece_ = false;
+    request_.setBody(NULL, NULL);
+  }
+
+  if (state_ == kExpectRequestLine)
+  {
+    const char* headerEnd = findHeaderEnd(buf->peek(), buf->peek() + scanned_, buf->beginWrite());
+    if (!headerEnd)
+    {
+      scanned_ = buf->readableBytes();
+      return scanned_ <= kMaxHeaderSize;
+    }
+    if (!processHeaders(buf->peek(), headerEnd))
+    {
+      return false;
+    }
+    request_.setReceiveTime(receiveTime);
+    headerSize_ = headerEnd - buf->peek();
+    if (!startBody(buf))
+    {
+      return false;
+    }
+  }
+
+  if (state_ == kExpectBody)
+  {
+    if (buf->readableBytes() < headerSize_ + bodySize_)
+    {
+      // slices would dangle once the Buffer grows, parse again when complete
+      request_.clear();
+      return true;
+    }
+    if (request_.method() == HttpRequest::kInvalid)
+    {
+      processHeaders(buf->peek(), buf->peek() + headerSize_);
+      request_.setReceiveTime(receiveTime);
+    }
+    const char* body = buf->peek() + headerSize_;
+    request_.setBody(body, body + bodySize_);
+    // the bytes stay in place until the Buffer is written again
+    buf->retrieve(headerSize_ + bodySize_);
+    state_ = kGotAll;
+    return true;
+  }
+  return parseBody(buf);
+}
+
+// Decides how the body is read, after the header block is parsed.
+bool HttpContext::startBody(Buffer* buf)
+{
+  bodySize_ = 0;
+  StringPiece encoding = request_.findHeader("Transfer-Encoding");
+  chunked_ = !encoding.empty();
+  if (chunked_)
   {
-    if (state_ == kExpectRequestLine)
+    if (encoding.size() != 7 || ::strncasecmp(encoding.data(), "chunked", 7) != 0)
+    {
+      return false;  // FIXME: 501 Not Implemented
+    }
+  }
+  else
+  {
+    StringPiece length = request_.findHeader("Content-Length");
+    if (!length.empty() && !parseLength(length, &bodySize_))
+    {
+      return false;
+    }
+    if (!streamingBody_ || bodySize_ == 0)
+    {
+      state_ = kExpectBody;
+      return bodySize_ <= maxBodySize_;
+    }
+  }
+
+  // the Buffer is retrieved before the body is complete
+  HttpRequest owned(request_);
+  request_.swap(owned);
+  buf->retrieve(headerSize_);
+  state_ = chunked_ ? kExpectChunkSize : kExpectBodyPiece;
+  return true;
+}
+
+// Chunked bodies, and streamed bodies, which stop at every piece.
+bool HttpContext::parseBody(Buffer* buf)
+{
+  while (state_ != kGotAll)
+  {
+    if (state_ == kExpectChunkSize)
     {
       const char* crlf = buf->findCRLF();
-      if (crlf)
+      if (!crlf)
       {
-        ok = processRequestLine(buf->peek(), crlf);
-        if (ok)
-        {
-          request_.setReceiveTime(receiveTime);
-          buf->retrieveUntil(crlf + 2);
-          state_ = kExpectHeaders;
-        }
-        else
-        {
-          hasMore = false;
-        }
+        return buf->readableBytes() <= kMaxChunkSizeLine;
+      }
+      size_t size = 0;
+      if (!parseChunkSize(buf->peek(), crlf, &size))
+      {
+        return false;
+      }
+      buf->retrieveUntil(crlf + 2);
+      if (size == 0)
+      {
+        state_ = kExpectTrailer;
+      }
+      else if (!streamingBody_ && chunkedBody_.size() + size > maxBodySize_)
+      {
+        return false;
       }
       else
       {
-        hasMore = false;
+        bodySize_ = size;
+        state_ = kExpectBodyPiece;
       }
     }
-    else if (state_ == kExpectHeaders)
+    else if (state_ == kExpectBodyPiece)
     {
-      const char* crlf = buf->findCRLF();
-      if (crlf)
+      if (bodySize_ == 0)
       {
-        const char* colon = std::find(buf->peek(), crlf, ':');
-        if (colon != crlf)
-        {
-          request_.addHeader(buf->peek(), colon, crlf);
-        }
-        else
-        {
-          // empty line, end of header
-          // FIXME:
-          state_ = kGotAll;
-          hasMore = false;
-        }
-        buf->retrieveUntil(crlf + 2);
+        state_ = chunked_ ? kExpectChunkEnd : kGotAll;
+        continue;
       }
-      else
+      size_t n = std::min(buf->readableBytes(), bodySize_);
+      if (n == 0)
       {
-        hasMore = false;
+        return true;
       }
+      const char* piece = buf->peek();
+      bodySize_ -= n;
+      if (streamingBody_)
+      {
+        request_.setBody(piece, piece + n);
+        // the bytes stay in place until the Buffer is written again
+        buf->retrieve(n);
+        gotBodyPiece_ = true;
+        return true;
+      }
+      chunkedBody_.append(piece, n);
+      buf->retrieve(n);
+    }
+    else if (state_ == kExpectChunkEnd)
+    {
+      if (buf->readableBytes() < 2)
+      {
+        return true;
+      }
+      if (buf->peek()[0] != '\r' || buf->peek()[1] != '\n')
+      {
+        return false;
+      }
+      buf->retrieve(2);
+      state_ = kExpectChunkSize;
     }
-    else if (state_ == kExpectBody)
+    else
     {
-      // FIXME:
+      assert(state_ == kExpectTrailer);
+      const char* crlf = buf->findCRLF();
+      if (!crlf)
+      {
+        return buf->readableBytes() <= kMaxHeaderSize;
+      }
+      bool last = crlf == buf->peek();
+      buf->retrieveUntil(crlf + 2);  // trailer fields are ignored
+      if (last)
+      {
+        if (!streamingBody_)
+        {
+          request_.setBody(chunkedBody_.data(), chunkedBody_.data() + chunkedBody_.size());
+        }
+        state_ = kGotAll;
+      }
     }
   }
-  return ok;
+  return true;
 }
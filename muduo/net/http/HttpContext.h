@@ -15,26 +15,53 @@
 
 #include "muduo/net/http/HttpRequest.h"
 
+#include <memory>
+
 namespace muduo
 {
 namespace net
 {
 
 class Buffer;
-
+class HttpStream;
+
+/// Incremental parser of HTTP requests.
+///
+/// Waits for the whole header block, found with SIMD, then parses it in
+/// one pass, with headers and body kept as slices of the Buffer. Bytes of
+/// a request are retrieved once it's complete, the Buffer may hold more
+/// pipelined requests after it.
+///
+/// Chunked bodies are decoded. A request with a chunked body, or any body
+/// if streaming bodies, owns its headers since the Buffer is retrieved
+/// piece by piece. When streaming bodies, every parseRequest() with new
+/// body bytes stops at gotBodyPiece(), with the piece as request().body().
 class HttpContext : public muduo::copyable
 {
  public:
   enum HttpRequestParseState
   {
     kExpectRequestLine,
-    kExpectHeaders,
+    kExpectHeaders,  // unused, the header block is parsed with the request line
     kExpectBody,
     kGotAll,
+    kExpectChunkSize,
+    kExpectBodyPiece,  // of a chunk, or of a streamed body
+    kExpectChunkEnd,
+    kExpectTrailer,
   };
 
+  static const size_t kMaxHeaderSize = 64 * 1024;
+
   HttpContext()
-    : state_(kExpectRequestLine)
+    : state_(kExpectRequestLine),
+      scanned_(0),
+      headerSize_(0),
+      bodySize_(0),
+      maxBodySize_(64 * 1024 * 1024),
+      streamingBody_(false),
+      chunked_(false),
+      gotBodyPiece_(false)
   {
   }
 
@@ -46,13 +73,35 @@ class HttpContext : public muduo::copyable
   bool gotAll() const
   { return state_ == kGotAll; }
 
+  /// Streaming bodies only, request().body() is the piece.
+  bool gotBodyPiece() const
+  { return gotBodyPiece_; }
+
+  /// Delivers bodies in pieces, instead of waiting for the whole body.
+  void setStreamingBody(bool on)
+  { streamingBody_ = on; }
+
+  /// Larger bodies are errors, if not streaming bodies.
+  void setMaxBodySize(size_t size)
+  { maxBodySize_ = size; }
+
   void reset()
   {
     state_ = kExpectRequestLine;
-    HttpRequest dummy;
-    request_.swap(dummy);
+    scanned_ = 0;
+    gotBodyPiece_ = false;
+    request_.clear();
+    chunkedBody_.clear();
   }
 
+  /// The chunked response being written, HttpServer serves no other
+  /// request of this connection meanwhile.
+  const std::shared_ptr<HttpStream>& stream() const
+  { return stream_; }
+
+  void setStream(const std::shared_ptr<HttpStream>& stream)
+  { stream_ = stream; }
+
   const HttpRequest& request() const
   { return request_; }
 
@@ -61,9 +110,22 @@ class HttpContext : public muduo::copyable
 
  private:
   bool processRequestLine(const char* begin, const char* end);
+  // [begin, end) is the header block, ends with an empty line
+  bool processHeaders(const char* begin, const char* end);
+  bool startBody(Buffer* buf);
+  bool parseBody(Buffer* buf);
 
   HttpRequestParseState state_;
+  size_t scanned_;     // bytes searched for the end of headers
+  size_t headerSize_;  // kExpectBody
+  size_t bodySize_;    // or bytes left of the chunk or the streamed body
+  size_t maxBodySize_;
+  bool streamingBody_;
+  bool chunked_;
+  bool gotBodyPiece_;
   HttpRequest request_;
+  string chunkedBody_;  // decoded, if not streaming bodies
+  std::shared_ptr<HttpStream> stream_;
 };
 
 }  // namespace net
@@ -0,0 +1,172 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+#include "muduo/net/http/HttpFileHandler.h"
+
+#include "muduo/net/http/HttpRequest.h"
+#include "muduo/net/http/HttpResponse.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+namespace
+{
+
+struct ContentType
+{
+  const char* extension;
+  const char* type;
+};
+
+const ContentType kContentTypes[] =
+{
+  { ".html", "text/html" },
+  { ".htm", "text/html" },
+  { ".css", "text/css" },
+  { ".js", "application/javascript" },
+  { ".json", "application/json" },
+  { ".txt", "text/plain" },
+  { ".xml", "text/xml" },
+  { ".png", "image/png" },
+  { ".jpg", "image/jpeg" },
+  { ".jpeg", "image/jpeg" },
+  { ".gif", "image/gif" },
+  { ".svg", "image/svg+xml" },
+  { ".ico", "image/x-icon" },
+  { ".pdf", "application/pdf" },
+  { ".gz", "application/gzip" },
+};
+
+// closes the fd when the last reference is gone, after it has been sent
+struct FileCloser
+{
+  explicit FileCloser(int f)
+    : fd(f)
+  {
+  }
+
+  void operator()(const void*) const
+  {
+    ::close(fd);
+  }
+
+  int fd;
+};
+
+bool isSafePath(const string& path)
+{
+  return path.find("..") == string::npos && path.find('\0') == string::npos;
+}
+
+// Opens path under the directory dirfd without following symlinks,
+// which could lead out of it, nor blocking on a FIFO. -1 on failure.
+int openBeneath(int dirfd, const string& path)
+{
+  int fd = -1;
+  int dir = dirfd;
+  size_t begin = 0;
+  while (true)
+  {
+    size_t end = path.find('/', begin);
+    string name = path.substr(begin, end == string::npos ? string::npos : end - begin);
+    if (end == string::npos)
+    {
+      fd = ::openat(dir, name.c_str(), O_RDONLY | O_NONBLOCK | O_NOFOLLOW | O_CLOEXEC);
+      break;
+    }
+    if (!name.empty())
+    {
+      int next = ::openat(dir, name.c_str(), O_PATH | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+      if (dir != dirfd)
+      {
+        ::close(dir);
+      }
+      if (next < 0)
+      {
+        return -1;
+      }
+      dir = next;
+    }
+    begin = end + 1;
+  }
+  if (dir != dirfd)
+  {
+    ::close(dir);
+  }
+  return fd;
+}
+
+void notFound(HttpResponse* resp)
+{
+  resp->setStatusCode(HttpResponse::k404NotFound);
+  resp->setStatusMessage("Not Found");
+  resp->setCloseConnection(true);
+}
+
+}  // namespace
+
+HttpFileHandler::HttpFileHandler(const string& root, const string& prefix)
+  : prefix_(prefix),
+    rootFd_(::open(root.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC))
+{
+}
+
+HttpFileHandler::~HttpFileHandler()
+{
+  if (rootFd_ >= 0)
+  {
+    ::close(rootFd_);
+  }
+}
+
+const char* HttpFileHandler::contentType(const string& path)
+{
+  for (const ContentType& ct : kContentTypes)
+  {
+    size_t len = strlen(ct.extension);
+    if (path.size() >= len
+        && ::strcasecmp(path.c_str() + path.size() - len, ct.extension) == 0)
+    {
+      return ct.type;
+    }
+  }
+  return "application/octet-stream";
+}
+
+bool HttpFileHandler::handle(const HttpRequest& req, HttpResponse* resp) const
+{
+  const string& path = req.path();
+  if ((req.method() != HttpRequest::kGet && req.method() != HttpRequest::kHead)
+      || path.compare(0, prefix_.size(), prefix_) != 0)
+  {
+    return false;
+  }
+  string file = path.substr(prefix_.size());
+  if (file.empty() || file[file.size() - 1] == '/')
+  {
+    file += "index.html";
+  }
+  int fd = rootFd_ >= 0 && isSafePath(path) ? openBeneath(rootFd_, file) : -1;
+  if (fd < 0)
+  {
+    notFound(resp);
+    return true;
+  }
+  std::shared_ptr<const void> holder(NULL, FileCloser(fd));
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+  {
+    notFound(resp);
+    return true;
+  }
+  resp->setStatusCode(HttpResponse::k200Ok);
+  resp->setStatusMessage("OK");
+  resp->setContentType(contentType(file));
+  resp->setBodyFile(holder, fd, 0, static_cast<size_t>(st.st_size));
+  return true;
+}
@@ -0,0 +1,57 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_HTTP_HTTPFILEHANDLER_H
+#define MUDUO_NET_HTTP_HTTPFILEHANDLER_H
+
+#include "muduo/base/noncopyable.h"
+#include "muduo/base/Types.h"
+
+namespace muduo
+{
+namespace net
+{
+
+class HttpRequest;
+class HttpResponse;
+
+///
+/// Serves static files under a directory, the body is sent with
+/// TcpConnection::sendFile() without being read into memory.
+///
+/// @code
+/// HttpFileHandler files("/var/www", "/static/");
+/// server.setHttpCallback([&](const HttpRequest& req, HttpResponse* resp)
+///     {
+///       if (!files.handle(req, resp))
+///       {
+///         ...
+///       }
+///     });
+/// @endcode
+class HttpFileHandler : noncopyable
+{
+ public:
+  /// Paths beginning with @c prefix map to files under @c root.
+  HttpFileHandler(const string& root, const string& prefix = "/");
+  ~HttpFileHandler();
+
+  /// Returns false if req is not a GET or HEAD of a path under the prefix,
+  /// otherwise fills resp, with 404 if there is no such regular file.
+  /// Paths are not percent-decoded, and must not contain "..".
+  /// Symlinks under root are not followed.
+  bool handle(const HttpRequest& req, HttpResponse* resp) const;
+
+  static const char* contentType(const string& path);
+
+ private:
+  const string prefix_;
+  const int rootFd_;  // opened with O_PATH, files are opened beneath it
+};
+
+}  // namespace net
+}  // namespace muduo
+
+#endif  // MUDUO_NET_HTTP_HTTPFILEHANDLER_H
@@ -12,21 +12,29 @@
 #define MUDUO_NET_HTTP_HTTPREQUEST_H
 
 #include "muduo/base/copyable.h"
+#include "muduo/base/StringPiece.h"
 #include "muduo/base/Timestamp.h"
 #include "muduo/base/Types.h"
 
-#include <map>
+#include <utility>
+#include <vector>
 #include <assert.h>
 #include <stdio.h>
+#include <strings.h>
 
 namespace muduo
 {
 namespace net
 {
 
+/// Headers and body are slices of the input Buffer, valid until it is
+/// written again, which is after HttpServer's callback returns.
+/// Copies own their headers and body.
 class HttpRequest : public muduo::copyable
 {
  public:
+  typedef std::pair<StringPiece, StringPiece> Header;
+
   enum Method
   {
     kInvalid, kGet, kPost, kHead, kPut, kDelete
@@ -42,6 +50,35 @@ class HttpRequest : public muduo::copyable
   {
   }
 
+  HttpRequest(const HttpRequest& rhs)
+    : method_(rhs.method_),
+      version_(rhs.version_),
+      path_(rhs.path_),
+      query_(rhs.query_),
+      receiveTime_(rhs.receiveTime_)
+  {
+    size_t total = rhs.body_.size();
+    for (const Header& header : rhs.headers_)
+    {
+      total += header.first.size() + header.second.size();
+    }
+    storage_.reserve(total);
+    headers_.reserve(rhs.headers_.size());
+    for (const Header& header : rhs.headers_)
+    {
+      StringPiece field = own(header.first);
+      headers_.push_back(Header(field, own(header.second)));
+    }
+    body_ = own(rhs.body_);
+  }
+
+  HttpRequest& operator=(const HttpRequest& rhs)
+  {
+    HttpRequest copy(rhs);
+    swap(copy);
+    return *this;
+  }
+
   void setVersion(Version v)
   {
     version_ = v;
@@ -53,7 +90,7 @@ class HttpRequest : public muduo::copyable
   bool setMethod(const char* start, const char* end)
   {
     assert(method_ == kInvalid);
-    string m(start, end);
+    StringPiece m(start, static_cast<int>(end - start));
     if (m == "GET")
     {
       method_ = kGet;
@@ -132,36 +169,65 @@ class HttpRequest : public muduo::copyable
   Timestamp receiveTime() const
   { return receiveTime_; }
 
+  /// [start, end) must outlive this request, see class comment.
   void addHeader(const char* start, const char* colon, const char* end)
   {
-    string field(start, colon);
-    ++colon;
-    while (colon < end && isspace(*colon))
+    const char* value = colon + 1;
+    while (value < end && isspace(*value))
     {
-      ++colon;
+      ++value;
     }
-    string value(colon, end);
-    while (!value.empty() && isspace(value[value.size()-1]))
+    while (value < end && isspace(end[-1]))
     {
-      value.resize(value.size()-1);
+      --end;
     }
-    headers_[field] = value;
+    headers_.push_back(Header(StringPiece(start, static_cast<int>(colon - start)),
+                              StringPiece(value, static_cast<int>(end - value))));
   }
 
-  string getHeader(const string& field) const
+  /// Field names are case-insensitive, the last one wins.
+  /// Returns an empty piece if not found.
+  StringPiece findHeader(const StringPiece& field) const
   {
-    string result;
-    std::map<string, string>::const_iterator it = headers_.find(field);
-    if (it != headers_.end())
+    for (size_t i = headers_.size(); i > 0; --i)
     {
-      result = it->second;
+      const StringPiece& f = headers_[i-1].first;
+      if (f.size() == field.size()
+          && ::strncasecmp(f.data(), field.data(), static_cast<size_t>(f.size())) == 0)
+      {
+        return headers_[i-1].second;
+      }
     }
-    return result;
+    return StringPiece();
   }
 
-  const std::map<string, string>& headers() const
+  string getHeader(const string& field) const
+  { return findHeader(field).as_string(); }
+
+  /// In arrival order, without copying, look up with findHeader().
+  const std::vector<Header>& headerList() const
   { return headers_; }
 
+  /// [start, end) must outlive this request, see class comment.
+  void setBody(const char* start, const char* end)
+  { body_.set(start, static_cast<int>(end - start)); }
+
+  StringPiece body() const
+  { return body_; }
+
+  /// Empties this request, keeping the memory for the next one.
+  void clear()
+  {
+    method_ = kInvalid;
+    version_ = kUnknown;
+    path_.clear();
+    query_.clear();
+    receiveTime_ = Timestamp();
+    headers_.clear();
+    body_.clear();
+    storage_.clear();
+  }
+
   void swap(HttpRequest& that)
   {
     std::swap(method_, that.method_);
@@ -170,15 +236,27 @@ class HttpRequest : public muduo::copyable
     query_.swap(that.query_);
     receiveTime_.swap(that.receiveTime_);
     headers_.swap(that.headers_);
+    std::swap(body_, that.body_);
+    storage_.swap(that.storage_);  // heap blocks, the slices stay valid
   }
 
  private:
+  // copies piece into storage_, which has been reserved
+  StringPiece own(const StringPiece& piece)
+  {
+    const char* data = storage_.data() + storage_.size();
+    storage_.insert(storage_.end(), piece.begin(), piece.end());
+    return StringPiece(data, piece.size());
+  }
+
   Method method_;
   Version version_;
   string path_;
   string query_;
   Timestamp receiveTime_;
-  std::map<string, string> headers_;
+  std::vector<Header> headers_;
+  StringPiece body_;
+  std::vector<char> storage_;  // for copies
 };
 
 }  // namespace net
@@ -10,38 +10,72 @@
 #include "muduo/net/http/HttpResponse.h"
 #include "muduo/net/Buffer.h"
 
-#include <stdio.h>
-
 using namespace muduo;
 using namespace muduo::net;
 
-void HttpResponse::appendToBuffer(Buffer* output) const
+namespace
+{
+
+void appendNumber(Buffer* output, size_t n, size_t base = 10)
 {
+  const char digits[] = "0123456789abcdef";
   char buf[32];
-  snprintf(buf, sizeof buf, "HTTP/1.1 %d ", statusCode_);
-  output->append(buf);
+  char* p = buf + sizeof buf;
+  do
+  {
+    *--p = digits[n % base];
+    n /= base;
+  } while (n != 0);
+  output->append(p, static_cast<size_t>(buf + sizeof buf - p));
+}
+
+}  // namespace
+
+void HttpResponse::appendToBuffer(Buffer* output) const
+{
+  output->append("HTTP/1.1 ", 9);
+  appendNumber(output, static_cast<size_t>(statusCode_));
+  output->append(" ", 1);
   output->append(statusMessage_);
-  output->append("\r\n");
+  output->append("\r\n", 2);
 
-  if (closeConnection_)
+  if (stream_)
+  {
+    output->append("Transfer-Encoding: chunked\r\n");
+    output->append(closeConnection_ ? "Connection: close\r\n" : "Connection: Keep-Alive\r\n");
+  }
+  else if (closeConnection_)
   {
     output->append("Connection: close\r\n");
   }
   else
   {
-    snprintf(buf, sizeof buf, "Content-Length: %zd\r\n", body_.size());
-    output->append(buf);
-    output->append("Connection: Keep-Alive\r\n");
+    output->append("Content-Length: ");
+    appendNumber(output, hasBodyFile() ? fileLength_ : body_.size());
+    output->append("\r\nConnection: Keep-Alive\r\n");
   }
 
   for (const auto& header : headers_)
   {
     output->append(header.first);
-    output->append(": ");
+    output->append(": ", 2);
     output->append(header.second);
-    output->append("\r\n");
+    output->append("\r\n", 2);
   }
 
-  output->append("\r\n");
-  output->append(body_);
+  output->append("\r\n", 2);
+  if (stream_)
+  {
+    if (!body_.empty())
+    {
+      appendNumber(output, body_.size(), 16);
+      output->append("\r\n", 2);
+      output->append(body_);
+      output->append("\r\n", 2);
+    }
+  }
+  else if (!hasBodyFile())
+  {
+    output->append(body_);
+  }
 }
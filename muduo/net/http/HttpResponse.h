@@ -13,8 +13,12 @@
 
 #include "muduo/base/copyable.h"
 #include "muduo/base/Types.h"
+#include "muduo/net/http/HttpStream.h"
 
 #include <map>
+#include <memory>
+
+#include <sys/types.h>
 
 namespace muduo
 {
@@ -36,7 +40,10 @@ class HttpResponse : public muduo::copyable
 
   explicit HttpResponse(bool close)
     : statusCode_(kUnknown),
-      closeConnection_(close)
+      closeConnection_(close),
+      fileFd_(-1),
+      fileOffset_(0),
+      fileLength_(0)
   {
   }
 
@@ -59,9 +66,62 @@ class HttpResponse : public muduo::copyable
   void addHeader(const string& key, const string& value)
   { headers_[key] = value; }
 
+  string getHeader(const string& key) const
+  {
+    std::map<string, string>::const_iterator it = headers_.find(key);
+    return it != headers_.end() ? it->second : string();
+  }
+
   void setBody(const string& body)
   { body_ = body; }
 
+  const string& body() const
+  { return body_; }
+
+  void swapBody(string* body)
+  { body_.swap(*body); }
+
+  /// The body is [offset, offset+len) of file fd instead, sent with
+  /// TcpConnection::sendFile(), but not for HEAD requests.
+  /// file keeps fd open until it's sent.
+  void setBodyFile(const std::shared_ptr<const void>& file, int fd, off_t offset, size_t len)
+  {
+    file_ = file;
+    fileFd_ = fd;
+    fileOffset_ = offset;
+    fileLength_ = len;
+  }
+
+  bool hasBodyFile() const
+  { return fileFd_ >= 0; }
+
+  const std::shared_ptr<const void>& bodyFile() const
+  { return file_; }
+
+  int bodyFileFd() const
+  { return fileFd_; }
+
+  off_t bodyFileOffset() const
+  { return fileOffset_; }
+
+  size_t bodyFileLength() const
+  { return fileLength_; }
+
+  /// Switches to Transfer-Encoding: chunked, the body is written with the
+  /// returned stream, after the body set here if any, see HttpStream.
+  /// For HTTP/1.1 requests.
+  const HttpStreamPtr& stream()
+  {
+    if (!stream_)
+    {
+      stream_ = std::make_shared<HttpStream>();
+    }
+    return stream_;
+  }
+
+  bool chunked() const
+  { return static_cast<bool>(stream_); }
+
   void appendToBuffer(Buffer* output) const;
 
  private:
@@ -71,6 +131,11 @@ class HttpResponse : public muduo::copyable
   string statusMessage_;
   bool closeConnection_;
   string body_;
+  HttpStreamPtr stream_;
+  std::shared_ptr<const void> file_;
+  int fileFd_;
+  off_t fileOffset_;
+  size_t fileLength_;
 };
 
 }  // namespace net
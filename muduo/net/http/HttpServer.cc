@@ -10,9 +10,11 @@
 #include "muduo/net/http/HttpServer.h"
 
 #include "muduo/base/Logging.h"
+#include "muduo/net/EventLoop.h"
 #include "muduo/net/http/HttpContext.h"
 #include "muduo/net/http/HttpRequest.h"
 #include "muduo/net/http/HttpResponse.h"
+#include "muduo/net/http/HttpStream.h"
 
 using namespace muduo;
 using namespace muduo::net;
@@ -40,12 +42,16 @@ HttpServer::HttpServer(EventLoop* loop,
                        const string& name,
                        TcpServer::Option option)
   : server_(loop, listenAddr, name, option),
-    httpCallback_(detail::defaultHttpCallback)
+    httpCallback_(detail::defaultHttpCallback),
+    maxBodySize_(64 * 1024 * 1024),
+    streamHighWaterMark_(1024 * 1024)
 {
   server_.setConnectionCallback(
       std::bind(&HttpServer::onConnection, this, _1));
   server_.setMessageCallback(
       std::bind(&HttpServer::onMessage, this, _1, _2, _3));
+  server_.setWriteCompleteCallback(
+      std::bind(&HttpServer::onWriteComplete, this, _1));
 }
 
 void HttpServer::start()
@@ -59,42 +65,148 @@ void HttpServer::onConnection(const TcpConnectionPtr& conn)
 {
   if (conn->connected())
   {
-    conn->setContext(HttpContext());
+    HttpContext context;
+    context.setStreamingBody(static_cast<bool>(bodyCallback_));
+    context.setMaxBodySize(maxBodySize_);
+    conn->setContext(context);
+    conn->setHighWaterMarkCallback(
+        std::bind(&HttpServer::onHighWaterMark, this, _1, _2), streamHighWaterMark_);
   }
+  else
+  {
+    HttpContext* context = boost::any_cast<HttpContext>(conn->getMutableContext());
+    if (context && context->stream())
+    {
+      context->stream()->onClose();
+      context->setStream(HttpStreamPtr());
+    }
+  }
+}
+
+void HttpServer::onHighWaterMark(const TcpConnectionPtr& conn, size_t)
+{
+  HttpContext* context = boost::any_cast<HttpContext>(conn->getMutableContext());
+  if (context->stream())
+  {
+    context->stream()->onHighWaterMark();
+  }
+}
+
+void HttpServer::onWriteComplete(const TcpConnectionPtr& conn)
+{
+  HttpContext* context = boost::any_cast<HttpContext>(conn->getMutableContext());
+  if (context->stream())
+  {
+    context->stream()->onWriteComplete();
+  }
+}
+
+// The last chunk has been sent, serves the requests received meanwhile.
+void HttpServer::onStreamDone(const TcpConnectionPtr& conn)
+{
+  HttpContext* context = boost::any_cast<HttpContext>(conn->getMutableContext());
+  if (!conn->connected() || !context->stream())
+  {
+    return;
+  }
+  bool close = context->stream()->closeConnection();
+  context->setStream(HttpStreamPtr());
+  if (close)
+  {
+    conn->inputBuffer()->retrieveAll();
+    conn->shutdown();
+    return;
+  }
+  if (!conn->isReading())
+  {
+    conn->startRead();
+  }
+  onMessage(conn, conn->inputBuffer(), Timestamp::now());
 }
 
+// Answers all complete requests in buf, pipelined ones in order,
+// with one send() for all responses, until a response is streamed.
 void HttpServer::onMessage(const TcpConnectionPtr& conn,
                            Buffer* buf,
                            Timestamp receiveTime)
 {
   HttpContext* context = boost::any_cast<HttpContext>(conn->getMutableContext());
+  if (context->stream())
+  {
+    // pipelined requests wait for the stream, stop reading beyond a header
+    if (buf->readableBytes() > HttpContext::kMaxHeaderSize)
+    {
+      conn->stopRead();
+    }
+    return;
+  }
 
-  if (!context->parseRequest(buf, receiveTime))
+  Buffer output(conn->getLoop()->bufferPool());
+  bool close = false;
+  while (!close && !context->stream())
   {
-    conn->send("HTTP/1.1 400 Bad Request\r\n\r\n");
-    conn->shutdown();
+    if (!context->parseRequest(buf, receiveTime))
+    {
+      output.append("HTTP/1.1 400 Bad Request\r\n\r\n");
+      close = true;
+    }
+    else if (context->gotBodyPiece())
+    {
+      bodyCallback_(context->request(), context->request().body());
+    }
+    else if (context->gotAll())
+    {
+      close = onRequest(conn, context, &output);
+      context->reset();
+    }
+    else
+    {
+      break;
+    }
   }
 
-  if (context->gotAll())
+  if (output.readableBytes() > 0)
   {
-    onRequest(conn, context->request());
-    context->reset();
+    conn->send(&output);
+  }
+  if (close)
+  {
+    buf->retrieveAll();
+    conn->shutdown();
   }
 }
 
-void HttpServer::onRequest(const TcpConnectionPtr& conn, const HttpRequest& req)
+bool HttpServer::onRequest(const TcpConnectionPtr& conn, HttpContext* context, Buffer* output)
 {
-  const string& connection = req.getHeader("Connection");
-  bool close = connection == "close" ||
-    (req.getVersion() == HttpRequest::kHttp10 && connection != "Keep-Alive");
+  const HttpRequest& req = context->request();
+  StringPiece connection = req.findHeader("Connection");
+  bool close = (connection.size() == 5 && ::strncasecmp(connection.data(), "close", 5) == 0) ||
+    (req.getVersion() == HttpRequest::kHttp10 &&
+     !(connection.size() == 10 && ::strncasecmp(connection.data(), "keep-alive", 10) == 0));
   HttpResponse response(close);
   httpCallback_(req, &response);
-  Buffer buf;
-  response.appendToBuffer(&buf);
-  conn->send(&buf);
-  if (response.closeConnection())
+  if (responseFilter_)
   {
-    conn->shutdown();
+    responseFilter_(req, &response);
+  }
+  response.appendToBuffer(output);
+  if (response.hasBodyFile() && req.method() != HttpRequest::kHead)
+  {
+    // the header and earlier responses go first
+    conn->send(output);
+    conn->sendFile(response.bodyFile(), response.bodyFileFd(),
+                   response.bodyFileOffset(), response.bodyFileLength());
+  }
+  else if (response.chunked())
+  {
+    HttpStreamPtr stream = response.stream();
+    if (stream->start(conn, output, response.closeConnection(), streamHighWaterMark_,
+                      std::bind(&HttpServer::onStreamDone, this, _1)))
+    {
+      context->setStream(stream);
+      return false;
+    }
   }
+  return response.closeConnection();
 }
 
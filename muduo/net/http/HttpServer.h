@@ -18,6 +18,7 @@ namespace muduo
 namespace net
 {
 
+class HttpContext;
 class HttpRequest;
 class HttpResponse;
 
@@ -25,11 +26,17 @@ class HttpResponse;
 /// It is not a fully HTTP 1.1 compliant server, but provides minimum features
 /// that can communicate with HttpClient and Web browser.
 /// It is synchronous, just like Java Servlet.
+/// Pipelined requests are answered in order.
+/// Large bodies can be streamed both ways, see setBodyCallback() and
+/// HttpResponse::stream().
 class HttpServer : noncopyable
 {
  public:
   typedef std::function<void (const HttpRequest&,
                               HttpResponse*)> HttpCallback;
+  /// A piece of the body of the request, whose own body() is empty.
+  typedef std::function<void (const HttpRequest&,
+                              const StringPiece&)> BodyCallback;
 
   HttpServer(EventLoop* loop,
              const InetAddress& listenAddr,
@@ -44,6 +51,36 @@ class HttpServer : noncopyable
     httpCallback_ = cb;
   }
 
+  /// Runs after the HttpCallback on every response, e.g. HttpCompressor.
+  /// Not thread safe, callback be registered before calling start().
+  void setResponseFilter(const HttpCallback& cb)
+  {
+    responseFilter_ = cb;
+  }
+
+  /// Delivers request bodies in pieces as they arrive, then calls the
+  /// HttpCallback, instead of buffering whole bodies for it.
+  /// Not thread safe, callback be registered before calling start().
+  void setBodyCallback(const BodyCallback& cb)
+  {
+    bodyCallback_ = cb;
+  }
+
+  /// Larger request bodies are rejected, if not streamed. 64MiB by default.
+  /// Must be called before start().
+  void setMaxBodySize(size_t size)
+  {
+    maxBodySize_ = size;
+  }
+
+  /// HttpStream::write() asks the writer to wait while the output of the
+  /// connection, or its chunks not yet sent, are above this. 1MiB by default.
+  /// Must be called before start().
+  void setStreamHighWaterMark(size_t bytes)
+  {
+    streamHighWaterMark_ = bytes;
+  }
+
   void setThreadNum(int numThreads)
   {
     server_.setThreadNum(numThreads);
@@ -56,10 +93,18 @@ class HttpServer : noncopyable
   void onMessage(const TcpConnectionPtr& conn,
                  Buffer* buf,
                  Timestamp receiveTime);
-  void onRequest(const TcpConnectionPtr&, const HttpRequest&);
+  // returns true if the connection is to be closed
+  bool onRequest(const TcpConnectionPtr& conn, HttpContext* context, Buffer* output);
+  void onHighWaterMark(const TcpConnectionPtr& conn, size_t len);
+  void onWriteComplete(const TcpConnectionPtr& conn);
+  void onStreamDone(const TcpConnectionPtr& conn);
 
   TcpServer server_;
   HttpCallback httpCallback_;
+  HttpCallback responseFilter_;
+  BodyCallback bodyCallback_;
+  size_t maxBodySize_;
+  size_t streamHighWaterMark_;
 };
 
 }  // namespace net
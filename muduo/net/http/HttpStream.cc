@@ -0,0 +1,244 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+#include "muduo/net/http/HttpStream.h"
+
+#include "muduo/net/EventLoop.h"
+#include "muduo/net/TcpConnection.h"
+
+#include <stdio.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+namespace
+{
+
+const char kLastChunk[] = "0\r\n\r\n";
+
+void appendChunk(Buffer* output, const StringPiece& data)
+{
+  if (data.empty())
+  {
+    return;
+  }
+  char size[32];
+  int len = snprintf(size, sizeof size, "%zx\r\n", static_cast<size_t>(data.size()));
+  output->append(size, static_cast<size_t>(len));
+  output->append(data);
+  output->append("\r\n", 2);
+}
+
+}  // namespace
+
+HttpStream::HttpStream()
+  : finished_(false),
+    aborted_(false),
+    closeConnection_(false),
+    highWaterMark_(0),
+    started_(false),
+    paused_(false),
+    closed_(false),
+    waiting_(false),
+    unsent_(0)
+{
+}
+
+bool HttpStream::write(const StringPiece& data)
+{
+  if (!data.empty())
+  {
+    MutexLockGuard lock(mutex_);
+    if (finished_)
+    {
+      return false;
+    }
+    if (!started_)
+    {
+      pending_.append(data);
+    }
+    else if (TcpConnectionPtr conn = conn_.lock())
+    {
+      std::shared_ptr<Buffer> chunk(std::make_shared<Buffer>());
+      appendBody(data, false, chunk.get());
+      size_t len = chunk->readableBytes();
+      if (len > 0)
+      {
+        // counted until sent, the output of the connection only sees it
+        // once the loop runs the send of another thread
+        unsent_ += len;
+        std::weak_ptr<TcpConnection> weakConn(conn);
+        HttpStreamPtr self(shared_from_this());
+        conn->sendBorrowed(chunk->peek(), len,
+                           [self, chunk, weakConn, len] { self->onSent(weakConn, len); });
+      }
+    }
+  }
+  // set before checking, so a concurrent notifyWritable() is not lost
+  waiting_ = true;
+  if (writable())
+  {
+    waiting_ = false;
+    return true;
+  }
+  return false;
+}
+
+void HttpStream::finish()
+{
+  TcpConnectionPtr conn;
+  DoneCallback done;
+  {
+    MutexLockGuard lock(mutex_);
+    if (finished_)
+    {
+      return;
+    }
+    finished_ = true;
+    writableCallback_ = WritableCallback();
+    if (!started_)
+    {
+      return;
+    }
+    conn = conn_.lock();
+    if (!conn)
+    {
+      return;
+    }
+    Buffer chunk;
+    appendBody(StringPiece(), true, &chunk);
+    conn->send(std::move(chunk));
+    done.swap(doneCallback_);
+  }
+  // after the last chunk, which is also queued if not in the loop
+  conn->getLoop()->queueInLoop(std::bind(done, conn));
+}
+
+void HttpStream::abort()
+{
+  TcpConnectionPtr conn;
+  {
+    MutexLockGuard lock(mutex_);
+    if (finished_)
+    {
+      return;
+    }
+    finished_ = true;
+    aborted_ = true;
+    writableCallback_ = WritableCallback();
+    if (!started_)
+    {
+      // start() closes it
+      return;
+    }
+    conn = conn_.lock();
+    doneCallback_ = DoneCallback();
+  }
+  if (conn)
+  {
+    conn->forceClose();
+  }
+}
+
+bool HttpStream::start(const TcpConnectionPtr& conn, Buffer* output,
+                       bool close, size_t highWaterMark, const DoneCallback& done)
+{
+  conn->getLoop()->assertInLoopThread();
+  closeConnection_ = close;
+  highWaterMark_ = highWaterMark;
+  MutexLockGuard lock(mutex_);
+  conn_ = conn;
+  if (aborted_)
+  {
+    encoder_ = Encoder();
+    pending_.retrieveAll();
+    started_ = true;
+    conn->forceClose();
+    return false;
+  }
+  appendBody(StringPiece(pending_.peek(), static_cast<int>(pending_.readableBytes())),
+             finished_, output);
+  pending_.retrieveAll();
+  started_ = true;
+  if (finished_)
+  {
+    encoder_ = Encoder();
+    return false;
+  }
+  doneCallback_ = done;
+  // after output is sent
+  conn->getLoop()->queueInLoop(std::bind(&HttpStream::notifyWritable, shared_from_this(), false));
+  return true;
+}
+
+void HttpStream::appendBody(const StringPiece& data, bool last, Buffer* output)
+{
+  if (encoder_)
+  {
+    Buffer encoded;
+    encoder_(data, last, &encoded);
+    appendChunk(output, StringPiece(encoded.peek(), static_cast<int>(encoded.readableBytes())));
+  }
+  else
+  {
+    appendChunk(output, data);
+  }
+  if (last)
+  {
+    output->append(kLastChunk, sizeof kLastChunk - 1);
+  }
+}
+
+void HttpStream::onHighWaterMark()
+{
+  paused_ = true;
+}
+
+void HttpStream::onWriteComplete()
+{
+  if (paused_.exchange(false))
+  {
+    notifyWritable(false);
+  }
+}
+
+// when a chunk of write() is sent, or dropped with the connection,
+// maybe in write() holding mutex_, so notifies in the loop
+void HttpStream::onSent(const std::weak_ptr<TcpConnection>& weakConn, size_t len)
+{
+  size_t unsent = unsent_.fetch_sub(len);
+  if (unsent >= highWaterMark_ && unsent - len < highWaterMark_)
+  {
+    TcpConnectionPtr conn(weakConn.lock());
+    if (conn)
+    {
+      conn->getLoop()->queueInLoop(
+          std::bind(&HttpStream::notifyWritable, shared_from_this(), false));
+    }
+  }
+}
+
+void HttpStream::onClose()
+{
+  closed_ = true;
+  notifyWritable(true);
+  MutexLockGuard lock(mutex_);
+  writableCallback_ = WritableCallback();
+  doneCallback_ = DoneCallback();
+}
+
+void HttpStream::notifyWritable(bool always)
+{
+  if (waiting_.exchange(false) || always)
+  {
+    WritableCallback cb;
+    {
+      MutexLockGuard lock(mutex_);
+      cb = writableCallback_;
+    }
+    if (cb)
+    {
+      cb();
+    }
+  }
+}
@@ -0,0 +1,117 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_HTTP_HTTPSTREAM_H
+#define MUDUO_NET_HTTP_HTTPSTREAM_H
+
+#include "muduo/base/Mutex.h"
+#include "muduo/base/StringPiece.h"
+#include "muduo/net/Buffer.h"
+#include "muduo/net/Callbacks.h"
+
+#include <atomic>
+#include <memory>
+
+namespace muduo
+{
+namespace net
+{
+
+class HttpStream;
+typedef std::shared_ptr<HttpStream> HttpStreamPtr;
+
+///
+/// Body of a response with Transfer-Encoding: chunked, see
+/// HttpResponse::stream(), written during or after HttpServer's callback.
+///
+/// The connection serves no other request until finish(). Writers keep
+/// the memory of a connection bounded by waiting for the writable callback
+/// whenever write() returns false, which is until the response header is
+/// sent, and while the output of the connection, or the chunks written
+/// but not yet sent, are above HttpServer::setStreamHighWaterMark().
+/// The callback is also called when the connection is closed, the writer
+/// gives up if closed().
+///
+/// Thread safe, the writable callback runs in the loop of the connection.
+class HttpStream : noncopyable,
+                   public std::enable_shared_from_this<HttpStream>
+{
+ public:
+  typedef std::function<void ()> WritableCallback;
+  /// Appends the transformed data to output, last is true once at the end.
+  typedef std::function<void (const StringPiece& data, bool last,
+                              Buffer* output)> Encoder;
+
+  HttpStream();
+
+  /// Sends data as one chunk, empty data is ignored.
+  /// Returns false if the writer is to wait for the writable callback.
+  bool write(const StringPiece& data);
+
+  /// Sends the last chunk, then the connection is shut down, or serves
+  /// the next request.
+  void finish();
+
+  /// Closes the connection instead of sending the last chunk, e.g. if the
+  /// writer failed, so the client sees a truncated response.
+  void abort();
+
+  bool writable() const
+  { return started_ && !paused_ && !closed_ && unsent_ < highWaterMark_; }
+
+  bool closed() const
+  { return closed_; }
+
+  void setWritableCallback(const WritableCallback& cb)
+  {
+    MutexLockGuard lock(mutex_);
+    writableCallback_ = cb;
+  }
+
+  /// Transforms the body before it's chunked, e.g. compresses it, see
+  /// HttpCompressor. Only in HttpServer's callbacks.
+  void setEncoder(const Encoder& encoder)
+  {
+    MutexLockGuard lock(mutex_);
+    encoder_ = encoder;
+  }
+
+ private:
+  friend class HttpServer;
+  typedef std::function<void (const TcpConnectionPtr&)> DoneCallback;
+
+  // in loop, appends chunks written so far to output, which is sent next.
+  // Returns false if already finished.
+  bool start(const TcpConnectionPtr& conn, Buffer* output,
+             bool close, size_t highWaterMark, const DoneCallback& done);
+  bool closeConnection() const { return closeConnection_; }
+  void onHighWaterMark();
+  void onWriteComplete();
+  void onSent(const std::weak_ptr<TcpConnection>& weakConn, size_t len);
+  void onClose();
+  void notifyWritable(bool always);
+  void appendBody(const StringPiece& data, bool last, Buffer* output) REQUIRES(mutex_);
+
+  mutable MutexLock mutex_;
+  std::weak_ptr<TcpConnection> conn_ GUARDED_BY(mutex_);
+  DoneCallback doneCallback_ GUARDED_BY(mutex_);
+  WritableCallback writableCallback_ GUARDED_BY(mutex_);
+  Encoder encoder_ GUARDED_BY(mutex_);
+  Buffer pending_ GUARDED_BY(mutex_);  // data written before start()
+  bool finished_ GUARDED_BY(mutex_);
+  bool aborted_ GUARDED_BY(mutex_);
+  bool closeConnection_;  // in loop
+  size_t highWaterMark_;  // set before started_
+  std::atomic<bool> started_;
+  std::atomic<bool> paused_;
+  std::atomic<bool> closed_;
+  std::atomic<bool> waiting_;  // write() returned false
+  std::atomic<size_t> unsent_;  // bytes of chunks passed to the connection
+};
+
+}  // namespace net
+}  // namespace muduo
+
+#endif  // MUDUO_NET_HTTP_HTTPSTREAM_H
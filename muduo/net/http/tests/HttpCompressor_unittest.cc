@@ -0,0 +1,201 @@
+#include "muduo/net/http/HttpCompressor.h"
+#include "muduo/net/http/HttpContext.h"
+#include "muduo/net/http/HttpResponse.h"
+#include "muduo/net/Buffer.h"
+
+#include <zlib.h>
+
+//#define BOOST_TEST_MODULE HttpCompressorTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+using muduo::string;
+using muduo::Timestamp;
+using muduo::net::Buffer;
+using muduo::net::HttpCompressor;
+using muduo::net::HttpContext;
+using muduo::net::HttpRequest;
+using muduo::net::HttpResponse;
+
+namespace
+{
+
+string inflateAll(const string& compressed, bool gzip)
+{
+  z_stream zs;
+  muduo::memZero(&zs, sizeof zs);
+  if (inflateInit2(&zs, gzip ? 15 + 16 : 15) != Z_OK)
+  {
+    return string();
+  }
+  string output;
+  char buf[4096];
+  zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+  zs.avail_in = static_cast<uInt>(compressed.size());
+  int err = Z_OK;
+  while (err == Z_OK)
+  {
+    zs.next_out = reinterpret_cast<Bytef*>(buf);
+    zs.avail_out = sizeof buf;
+    err = inflate(&zs, Z_NO_FLUSH);
+    output.append(buf, sizeof buf - zs.avail_out);
+  }
+  inflateEnd(&zs);
+  return err == Z_STREAM_END ? output : string();
+}
+
+void parse(HttpContext* context, Buffer* input, const char* acceptEncoding)
+{
+  input->append("GET /index.html HTTP/1.1\r\nHost: localhost\r\n");
+  if (acceptEncoding)
+  {
+    input->append("Accept-Encoding: ");
+    input->append(acceptEncoding);
+    input->append("\r\n");
+  }
+  input->append("\r\n");
+  BOOST_REQUIRE(context->parseRequest(input, Timestamp::now()));
+  BOOST_REQUIRE(context->gotAll());
+}
+
+string textBody()
+{
+  string body;
+  for (int i = 0; i < 200; ++i)
+  {
+    body += "<p>hello, world!</p>\n";
+  }
+  return body;
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(testNegotiate)
+{
+  BOOST_CHECK_EQUAL(HttpCompressor::negotiate(""), HttpCompressor::kIdentity);
+  BOOST_CHECK_EQUAL(HttpCompressor::negotiate("gzip, deflate, br"), HttpCompressor::kGzip);
+  BOOST_CHECK_EQUAL(HttpCompressor::negotiate("deflate"), HttpCompressor::kDeflate);
+  BOOST_CHECK_EQUAL(HttpCompressor::negotiate("GZIP;q=0.5, deflate"), HttpCompressor::kDeflate);
+  BOOST_CHECK_EQUAL(HttpCompressor::negotiate("gzip;q=0, deflate;q=0"), HttpCompressor::kIdentity);
+  BOOST_CHECK_EQUAL(HttpCompressor::negotiate("*"), HttpCompressor::kGzip);
+  BOOST_CHECK_EQUAL(HttpCompressor::negotiate("gzip;q=0, *"), HttpCompressor::kDeflate);
+  BOOST_CHECK_EQUAL(HttpCompressor::negotiate("identity"), HttpCompressor::kIdentity);
+}
+
+BOOST_AUTO_TEST_CASE(testCompressible)
+{
+  BOOST_CHECK(HttpCompressor::compressible("text/html; charset=utf-8"));
+  BOOST_CHECK(HttpCompressor::compressible("application/json"));
+  BOOST_CHECK(HttpCompressor::compressible("application/javascript"));
+  BOOST_CHECK(HttpCompressor::compressible("image/svg+xml"));
+  BOOST_CHECK(!HttpCompressor::compressible("image/png"));
+  BOOST_CHECK(!HttpCompressor::compressible(""));
+}
+
+BOOST_AUTO_TEST_CASE(testFilter)
+{
+  HttpCompressor compressor;
+  HttpContext context;
+  Buffer input;
+  parse(&context, &input, "gzip, deflate");
+  const string body = textBody();
+
+  HttpResponse resp(false);
+  resp.setContentType("text/html");
+  resp.setBody(body);
+  compressor.filter(context.request(), &resp);
+  BOOST_CHECK_EQUAL(resp.getHeader("Content-Encoding"), string("gzip"));
+  BOOST_CHECK_EQUAL(resp.getHeader("Vary"), string("Accept-Encoding"));
+  BOOST_CHECK(resp.body().size() < body.size());
+  BOOST_CHECK(inflateAll(resp.body(), true) == body);
+  BOOST_CHECK_EQUAL(compressor.cacheMisses(), 1);
+
+  // the same content again comes from the cache
+  HttpResponse again(false);
+  again.setContentType("text/html");
+  again.setBody(body);
+  compressor.filter(context.request(), &again);
+  BOOST_CHECK_EQUAL(compressor.cacheHits(), 1);
+  BOOST_CHECK(again.body() == resp.body());
+  BOOST_CHECK(compressor.cacheBytes() > resp.body().size());
+}
+
+BOOST_AUTO_TEST_CASE(testFilterSkipped)
+{
+  HttpCompressor compressor;
+  HttpContext context;
+  Buffer input;
+  parse(&context, &input, NULL);
+  const string body = textBody();
+
+  HttpResponse notAccepted(false);
+  notAccepted.setContentType("text/html");
+  notAccepted.setBody(body);
+  compressor.filter(context.request(), &notAccepted);
+  BOOST_CHECK(notAccepted.getHeader("Content-Encoding").empty());
+  BOOST_CHECK_EQUAL(notAccepted.getHeader("Vary"), string("Accept-Encoding"));
+  BOOST_CHECK(notAccepted.body() == body);
+
+  context.reset();
+  parse(&context, &input, "deflate");
+  HttpResponse image(false);
+  image.setContentType("image/png");
+  image.setBody(body);
+  compressor.filter(context.request(), &image);
+  BOOST_CHECK(image.getHeader("Content-Encoding").empty());
+
+  HttpResponse small(false);
+  small.setContentType("text/plain");
+  small.setBody("hello");
+  compressor.filter(context.request(), &small);
+  BOOST_CHECK(small.getHeader("Content-Encoding").empty());
+
+  HttpResponse deflated(false);
+  deflated.setContentType("text/plain");
+  deflated.setBody(body);
+  compressor.filter(context.request(), &deflated);
+  BOOST_CHECK_EQUAL(deflated.getHeader("Content-Encoding"), string("deflate"));
+  BOOST_CHECK(inflateAll(deflated.body(), false) == body);
+}
+
+BOOST_AUTO_TEST_CASE(testCacheEviction)
+{
+  HttpCompressor compressor;
+  compressor.setCacheSize(4096);
+  HttpContext context;
+  Buffer input;
+  parse(&context, &input, "gzip");
+  for (int i = 0; i < 100; ++i)
+  {
+    HttpResponse resp(false);
+    resp.setContentType("text/plain");
+    resp.setBody(textBody() + std::to_string(i));
+    compressor.filter(context.request(), &resp);
+  }
+  BOOST_CHECK_EQUAL(compressor.cacheMisses(), 100);
+  BOOST_CHECK(compressor.cacheBytes() <= 4096);
+  BOOST_CHECK(compressor.cacheBytes() > 0);
+}
+
+BOOST_AUTO_TEST_CASE(testCacheDisabled)
+{
+  HttpCompressor compressor;
+  compressor.setCacheSize(0);
+  HttpContext context;
+  Buffer input;
+  parse(&context, &input, "gzip");
+  const string body = textBody();
+  for (int i = 0; i < 2; ++i)
+  {
+    HttpResponse resp(false);
+    resp.setContentType("text/plain");
+    resp.setBody(body);
+    compressor.filter(context.request(), &resp);
+    BOOST_CHECK_EQUAL(resp.getHeader("Content-Encoding"), string("gzip"));
+    BOOST_CHECK(inflateAll(resp.body(), true) == body);
+  }
+  BOOST_CHECK_EQUAL(compressor.cacheHits(), 0);
+  BOOST_CHECK_EQUAL(compressor.cacheMisses(), 0);
+  BOOST_CHECK_EQUAL(compressor.cacheBytes(), 0);
+}
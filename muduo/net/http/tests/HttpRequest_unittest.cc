@@ -77,3 +77,246 @@ BOOST_AUTO_TEST_CASE(testParseRequestEmptyHeaderValue)
   BOOST_CHECK_EQUAL(request.getHeader("User-Agent"), string(""));
   BOOST_CHECK_EQUAL(request.getHeader("Accept-Encoding"), string(""));
 }
+
+BOOST_AUTO_TEST_CASE(testParseRequestPipelined)
+{
+  HttpContext context;
+  Buffer input;
+  input.append("GET /a HTTP/1.1\r\n"
+       "Host: www.chenshuo.com\r\n"
+       "\r\n"
+       "GET /b HTTP/1.1\r\n"
+       "\r\n"
+       "GET /c HT");
+
+  BOOST_CHECK(context.parseRequest(&input, Timestamp::now()));
+  BOOST_CHECK(context.gotAll());
+  BOOST_CHECK_EQUAL(context.request().path(), string("/a"));
+  BOOST_CHECK_EQUAL(context.request().getHeader("Host"), string("www.chenshuo.com"));
+  context.reset();
+
+  BOOST_CHECK(context.parseRequest(&input, Timestamp::now()));
+  BOOST_CHECK(context.gotAll());
+  BOOST_CHECK_EQUAL(context.request().path(), string("/b"));
+  BOOST_CHECK_EQUAL(context.request().getHeader("Host"), string(""));
+  context.reset();
+
+  BOOST_CHECK(context.parseRequest(&input, Timestamp::now()));
+  BOOST_CHECK(!context.gotAll());
+  input.append("TP/1.1\r\n\r\n");
+  BOOST_CHECK(context.parseRequest(&input, Timestamp::now()));
+  BOOST_CHECK(context.gotAll());
+  BOOST_CHECK_EQUAL(context.request().path(), string("/c"));
+  BOOST_CHECK_EQUAL(input.readableBytes(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(testParseRequestBodyInPieces)
+{
+  string all("POST /form HTTP/1.1\r\n"
+       "content-length: 11\r\n"
+       "\r\n"
+       "hello world");
+
+  for (size_t sz1 = 0; sz1 < all.size(); ++sz1)
+  {
+    HttpContext context;
+    Buffer input;
+    input.append(all.c_str(), sz1);
+    BOOST_CHECK(context.parseRequest(&input, Timestamp::now()));
+    BOOST_CHECK(!context.gotAll());
+
+    input.append(all.c_str() + sz1, all.size() - sz1);
+    BOOST_CHECK(context.parseRequest(&input, Timestamp::now()));
+    BOOST_CHECK(context.gotAll());
+    const HttpRequest& request = context.request();
+    BOOST_CHECK_EQUAL(request.method(), HttpRequest::kPost);
+    BOOST_CHECK_EQUAL(request.getHeader("Content-Length"), string("11"));
+    BOOST_CHECK_EQUAL(request.body().as_string(), string("hello world"));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testParseRequestBadLength)
+{
+  HttpContext context;
+  Buffer input;
+  input.append("POST /form HTTP/1.1\r\n"
+       "Content-Length: 1x\r\n"
+       "\r\n");
+  BOOST_CHECK(!context.parseRequest(&input, Timestamp::now()));
+}
+
+BOOST_AUTO_TEST_CASE(testParseRequestHeaderTooLong)
+{
+  HttpContext context;
+  Buffer input;
+  input.append("GET / HTTP/1.1\r\n");
+  string line("X-Pad: " + string(1000, 'x') + "\r\n");
+  bool ok = true;
+  for (int i = 0; i < 100 && ok; ++i)
+  {
+    input.append(line);
+    ok = context.parseRequest(&input, Timestamp::now());
+  }
+  BOOST_CHECK(!ok);
+}
+
+BOOST_AUTO_TEST_CASE(testHeaderCaseInsensitive)
+{
+  HttpContext context;
+  Buffer input;
+  input.append("GET / HTTP/1.1\r\n"
+       "CONNECTION: Keep-Alive\r\n"
+       "accept:  text/html  \r\n"
+       "\r\n");
+
+  BOOST_CHECK(context.parseRequest(&input, Timestamp::now()));
+  BOOST_CHECK(context.gotAll());
+  const HttpRequest& request = context.request();
+  BOOST_CHECK(request.findHeader("connection") == "Keep-Alive");
+  BOOST_CHECK_EQUAL(request.getHeader("Accept"), string("text/html"));
+  BOOST_CHECK_EQUAL(request.headerList().size(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(testRequestCopyOwnsData)
+{
+  HttpRequest copy;
+  {
+    HttpContext context;
+    Buffer input;
+    input.append("PUT /x HTTP/1.0\r\n"
+         "Host: www.chenshuo.com\r\n"
+         "Content-Length: 4\r\n"
+         "\r\n"
+         "body");
+    BOOST_CHECK(context.parseRequest(&input, Timestamp::now()));
+    BOOST_CHECK(context.gotAll());
+    copy = context.request();
+    input.append(string(4096, 'z'));
+  }
+  BOOST_CHECK_EQUAL(copy.method(), HttpRequest::kPut);
+  BOOST_CHECK_EQUAL(copy.getVersion(), HttpRequest::kHttp10);
+  BOOST_CHECK_EQUAL(copy.getHeader("Host"), string("www.chenshuo.com"));
+  BOOST_CHECK_EQUAL(copy.body().as_string(), string("body"));
+  HttpRequest copy2(copy);
+  BOOST_CHECK_EQUAL(copy2.getHeader("content-length"), string("4"));
+}
+
+BOOST_AUTO_TEST_CASE(testParseRequestChunked)
+{
+  string all("POST /upload HTTP/1.1\r\n"
+       "Transfer-Encoding: chunked\r\n"
+       "\r\n"
+       "5\r\nhello\r\n"
+       "7;ext=1\r\n, world\r\n"
+       "0\r\n"
+       "Trailer: x\r\n"
+       "\r\n"
+       "GET / HTTP/1.1\r\n\r\n");
+
+  for (size_t sz1 = 0; sz1 < all.size(); ++sz1)
+  {
+    HttpContext context;
+    Buffer input;
+    input.append(all.c_str(), sz1);
+    BOOST_CHECK(context.parseRequest(&input, Timestamp::now()));
+    input.append(all.c_str() + sz1, all.size() - sz1);
+    BOOST_CHECK(context.parseRequest(&input, Timestamp::now()));
+    BOOST_CHECK(context.gotAll());
+    const HttpRequest& request = context.request();
+    BOOST_CHECK_EQUAL(request.method(), HttpRequest::kPost);
+    BOOST_CHECK_EQUAL(request.getHeader("Transfer-Encoding"), string("chunked"));
+    BOOST_CHECK_EQUAL(request.body().as_string(), string("hello, world"));
+    context.reset();
+    BOOST_CHECK(context.parseRequest(&input, Timestamp::now()));
+    BOOST_CHECK(context.gotAll());
+    BOOST_CHECK_EQUAL(context.request().path(), string("/"));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testParseRequestChunkedBad)
+{
+  HttpContext context;
+  Buffer input;
+  input.append("POST /upload HTTP/1.1\r\n"
+       "Transfer-Encoding: chunked\r\n"
+       "\r\n"
+       "5\r\nhello!!\r\n");
+  BOOST_CHECK(!context.parseRequest(&input, Timestamp::now()));
+
+  HttpContext context2;
+  input.retrieveAll();
+  input.append("POST /upload HTTP/1.1\r\n"
+       "Transfer-Encoding: gzip\r\n"
+       "\r\n");
+  BOOST_CHECK(!context2.parseRequest(&input, Timestamp::now()));
+}
+
+BOOST_AUTO_TEST_CASE(testParseRequestMaxBodySize)
+{
+  HttpContext context;
+  context.setMaxBodySize(10);
+  Buffer input;
+  input.append("POST /form HTTP/1.1\r\n"
+       "Content-Length: 11\r\n"
+       "\r\n");
+  BOOST_CHECK(!context.parseRequest(&input, Timestamp::now()));
+
+  HttpContext context2;
+  context2.setMaxBodySize(10);
+  input.retrieveAll();
+  input.append("POST /upload HTTP/1.1\r\n"
+       "Transfer-Encoding: chunked\r\n"
+       "\r\n"
+       "6\r\nhello,\r\n"
+       "6\r\n world\r\n");
+  BOOST_CHECK(!context2.parseRequest(&input, Timestamp::now()));
+}
+
+// collects pieces until the request is complete
+string streamBody(HttpContext* context, Buffer* input, const string& data, size_t step)
+{
+  string body;
+  for (size_t i = 0; i < data.size() && !context->gotAll(); i += step)
+  {
+    input->append(data.data() + i, std::min(step, data.size() - i));
+    bool ok = true;
+    while ((ok = context->parseRequest(input, Timestamp::now())) && context->gotBodyPiece())
+    {
+      BOOST_CHECK(context->request().getHeader("Host") == "www.chenshuo.com");
+      body += context->request().body().as_string();
+    }
+    BOOST_CHECK(ok);
+  }
+  BOOST_CHECK(context->gotAll());
+  BOOST_CHECK(context->request().body().empty());
+  return body;
+}
+
+BOOST_AUTO_TEST_CASE(testParseRequestStreamingBody)
+{
+  string length("PUT /file HTTP/1.1\r\n"
+       "Host: www.chenshuo.com\r\n"
+       "Content-Length: 26\r\n"
+       "\r\n"
+       "abcdefghijklmnopqrstuvwxyz");
+  string chunked("PUT /file HTTP/1.1\r\n"
+       "Host: www.chenshuo.com\r\n"
+       "Transfer-Encoding: chunked\r\n"
+       "\r\n"
+       "a\r\nabcdefghij\r\n"
+       "10\r\nklmnopqrstuvwxyz\r\n"
+       "0\r\n\r\n");
+  for (size_t step = 1; step < chunked.size(); step += 7)
+  {
+    HttpContext context;
+    context.setStreamingBody(true);
+    context.setMaxBodySize(1);  // not for streamed bodies
+    Buffer input;
+    BOOST_CHECK_EQUAL(streamBody(&context, &input, length, step),
+                      string("abcdefghijklmnopqrstuvwxyz"));
+    context.reset();
+    BOOST_CHECK_EQUAL(streamBody(&context, &input, chunked, step),
+                      string("abcdefghijklmnopqrstuvwxyz"));
+    BOOST_CHECK_EQUAL(input.readableBytes(), 0);
+  }
+}
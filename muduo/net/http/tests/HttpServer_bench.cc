@@ -0,0 +1,291 @@
+// Benchmark of the HTTP request parser, against the previous line-by-line
+// one, and of HttpServer under pipelined keep-alive load, like wrk.
+//
+// Usage: httpserver_bench [connections [pipeline [seconds]]]
+
+#include "muduo/base/CountDownLatch.h"
+#include "muduo/base/Logging.h"
+#include "muduo/base/Timestamp.h"
+#include "muduo/net/Buffer.h"
+#include "muduo/net/EventLoop.h"
+#include "muduo/net/EventLoopThread.h"
+#include "muduo/net/TcpClient.h"
+#include "muduo/net/http/HttpContext.h"
+#include "muduo/net/http/HttpRequest.h"
+#include "muduo/net/http/HttpResponse.h"
+#include "muduo/net/http/HttpServer.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+const char kRequest[] =
+  "GET /hello HTTP/1.1\r\n"
+  "Host: localhost:8000\r\n"
+  "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/115.0\r\n"
+  "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+  "Accept-Language: en-US,en;q=0.5\r\n"
+  "Accept-Encoding: gzip, deflate\r\n"
+  "Connection: keep-alive\r\n"
+  "Upgrade-Insecure-Requests: 1\r\n"
+  "\r\n";
+
+// The old HttpContext::parseRequest(), one findCRLF() per line,
+// headers copied into a std::map.
+class LegacyContext
+{
+ public:
+  LegacyContext()
+    : state_(kExpectRequestLine)
+  {
+  }
+
+  bool parseRequest(Buffer* buf, Timestamp)
+  {
+    bool ok = true;
+    bool hasMore = true;
+    while (hasMore)
+    {
+      const char* crlf = buf->findCRLF();
+      if (!crlf)
+      {
+        break;
+      }
+      if (state_ == kExpectRequestLine)
+      {
+        const char* space = std::find(buf->peek(), crlf, ' ');
+        ok = space != crlf;
+        if (ok)
+        {
+          method_.assign(buf->peek(), space);
+          const char* start = space + 1;
+          space = std::find(start, crlf, ' ');
+          path_.assign(start, space);
+          state_ = kExpectHeaders;
+        }
+        hasMore = ok;
+      }
+      else
+      {
+        const char* colon = std::find(buf->peek(), crlf, ':');
+        if (colon != crlf)
+        {
+          string field(buf->peek(), colon);
+          ++colon;
+          while (colon < crlf && isspace(*colon))
+          {
+            ++colon;
+          }
+          headers_[field] = string(colon, crlf);
+        }
+        else
+        {
+          state_ = kGotAll;
+          hasMore = false;
+        }
+      }
+      buf->retrieveUntil(crlf + 2);
+    }
+    return ok;
+  }
+
+  bool gotAll() const { return state_ == kGotAll; }
+
+  void reset()
+  {
+    state_ = kExpectRequestLine;
+    method_.clear();
+    path_.clear();
+    headers_.clear();
+  }
+
+ private:
+  enum State { kExpectRequestLine, kExpectHeaders, kGotAll };
+  State state_;
+  string method_;
+  string path_;
+  std::map<string, string> headers_;
+};
+
+template <typename Context>
+double benchParser(const char* name, int batches, int pipeline)
+{
+  Buffer buf;
+  Context context;
+  int64_t requests = 0;
+  Timestamp start(Timestamp::now());
+  for (int i = 0; i < batches; ++i)
+  {
+    for (int j = 0; j < pipeline; ++j)
+    {
+      buf.append(kRequest, sizeof kRequest - 1);
+    }
+    while (context.parseRequest(&buf, Timestamp()) && context.gotAll())
+    {
+      context.reset();
+      ++requests;
+    }
+  }
+  double seconds = timeDifference(Timestamp::now(), start);
+  if (requests != static_cast<int64_t>(batches) * pipeline)
+  {
+    printf("%s parsed %" PRId64 " requests, wrong\n", name, requests);
+    abort();
+  }
+  double rate = static_cast<double>(requests) / seconds;
+  printf("%-8s %8.3f Mreq/s %8.1f ns/req %8.1f MiB/s\n", name, rate / 1e6, 1e9 / rate,
+         rate * (sizeof kRequest - 1) / 1024 / 1024);
+  return rate;
+}
+
+void onRequest(const HttpRequest& req, HttpResponse* resp)
+{
+  resp->setStatusCode(HttpResponse::k200Ok);
+  resp->setStatusMessage("OK");
+  resp->setContentType("text/plain");
+  resp->addHeader("Server", "Muduo");
+  resp->setBody("hello, world!\n");
+}
+
+size_t responseSize()
+{
+  HttpRequest req;
+  HttpResponse resp(false);
+  onRequest(req, &resp);
+  Buffer buf;
+  resp.appendToBuffer(&buf);
+  return buf.readableBytes();
+}
+
+// Keeps pipeline requests in flight on one keep-alive connection.
+class Client : noncopyable
+{
+ public:
+  Client(EventLoop* loop, const InetAddress& serverAddr, int pipeline, size_t responseSize)
+    : client_(loop, serverAddr, "Client"),
+      pipeline_(pipeline),
+      responseSize_(responseSize),
+      responses_(0)
+  {
+    client_.setConnectionCallback(std::bind(&Client::onConnection, this, _1));
+    client_.setMessageCallback(std::bind(&Client::onMessage, this, _1, _2));
+  }
+
+  void connect() { client_.connect(); }
+
+  int64_t responses() const { return responses_; }
+
+ private:
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      sendRequests(conn, pipeline_);
+    }
+  }
+
+  void onMessage(const TcpConnectionPtr& conn, Buffer* buf)
+  {
+    size_t n = buf->readableBytes() / responseSize_;
+    buf->retrieve(n * responseSize_);
+    responses_ += static_cast<int64_t>(n);
+    sendRequests(conn, static_cast<int>(n));
+  }
+
+  void sendRequests(const TcpConnectionPtr& conn, int n)
+  {
+    Buffer out;
+    for (int i = 0; i < n; ++i)
+    {
+      out.append(kRequest, sizeof kRequest - 1);
+    }
+    conn->send(&out);
+  }
+
+  TcpClient client_;
+  const int pipeline_;
+  const size_t responseSize_;
+  int64_t responses_;
+};
+
+void benchServer(int connections, int pipeline, double seconds)
+{
+  EventLoop loop;
+  InetAddress listenAddr(18000, true);
+  HttpServer server(&loop, listenAddr, "bench");
+  server.setHttpCallback(onRequest);
+  server.start();
+
+  EventLoopThread clientThread;
+  EventLoop* clientLoop = clientThread.startLoop();
+  std::vector<std::unique_ptr<Client>> clients;
+  size_t size = responseSize();
+  clientLoop->runInLoop([&]
+      {
+        for (int i = 0; i < connections; ++i)
+        {
+          clients.emplace_back(new Client(clientLoop, listenAddr, pipeline, size));
+          clients.back()->connect();
+        }
+      });
+
+  int64_t before = 0;
+  loop.runAfter(1.0, [&]
+      {
+        // warmed up
+        CountDownLatch latch(1);
+        clientLoop->runInLoop([&]
+            {
+              for (const auto& client : clients)
+              {
+                before += client->responses();
+              }
+              latch.countDown();
+            });
+        latch.wait();
+      });
+  loop.runAfter(1.0 + seconds, std::bind(&EventLoop::quit, &loop));
+  loop.loop();
+
+  CountDownLatch latch(1);
+  int64_t after = 0;
+  clientLoop->runInLoop([&]
+      {
+        for (const auto& client : clients)
+        {
+          after += client->responses();
+        }
+        clients.clear();
+        latch.countDown();
+      });
+  latch.wait();
+  printf("%d connections, pipeline %d: %.0f req/s\n",
+         connections, pipeline, static_cast<double>(after - before) / seconds);
+}
+
+int main(int argc, char* argv[])
+{
+  int connections = argc > 1 ? atoi(argv[1]) : 10;
+  int pipeline = argc > 2 ? atoi(argv[2]) : 16;
+  double seconds = argc > 3 ? atof(argv[3]) : 3.0;
+  Logger::setLogLevel(Logger::WARN);
+
+  const int kRequests = 1000 * 1000;
+  for (int depth : { 1, 16 })
+  {
+    printf("parser, %zd bytes per request, pipeline %d\n", sizeof kRequest - 1, depth);
+    double legacy = benchParser<LegacyContext>("legacy", kRequests / depth, depth);
+    double current = benchParser<HttpContext>("current", kRequests / depth, depth);
+    printf("speedup %.2fx\n", current / legacy);
+  }
+
+  benchServer(connections, pipeline, seconds);
+}
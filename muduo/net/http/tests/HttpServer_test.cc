@@ -1,4 +1,5 @@
 #include "muduo/net/http/HttpServer.h"
+#include "muduo/net/http/HttpFileHandler.h"
 #include "muduo/net/http/HttpRequest.h"
 #include "muduo/net/http/HttpResponse.h"
 #include "muduo/net/EventLoop.h"
@@ -12,20 +13,56 @@ using namespace muduo::net;
 
 extern char favicon[555];
 bool benchmark = false;
+__thread int64_t t_bodyBytes = 0;
+HttpFileHandler g_files(".", "/files/");  // the current directory
+
+void onBody(const HttpRequest&, const StringPiece& piece)
+{
+  t_bodyBytes += piece.size();
+}
+
+// Writes 1000 lines of chunks, no faster than the client reads them.
+void streamLines(HttpResponse* resp)
+{
+  HttpStreamPtr stream = resp->stream();
+  std::weak_ptr<HttpStream> weakStream(stream);
+  std::shared_ptr<int> line = std::make_shared<int>(0);
+  auto writeMore = [weakStream, line]
+  {
+    HttpStreamPtr s = weakStream.lock();
+    if (!s || s->closed())
+    {
+      return;
+    }
+    while (*line < 1000)
+    {
+      string text = "line " + std::to_string(++*line) + " " + string(1000, 'x') + "\n";
+      if (!s->write(text))
+      {
+        return;
+      }
+    }
+    s->finish();
+  };
+  stream->setWritableCallback(writeMore);
+  writeMore();
+}
 
 void onRequest(const HttpRequest& req, HttpResponse* resp)
 {
   std::cout << "Headers " << req.methodString() << " " << req.path() << std::endl;
   if (!benchmark)
   {
-    const std::map<string, string>& headers = req.headers();
-    for (const auto& header : headers)
+    for (const HttpRequest::Header& header : req.headerList())
     {
-      std::cout << header.first << ": " << header.second << std::endl;
+      std::cout << header.first.as_string() << ": " << header.second.as_string() << std::endl;
     }
   }
 
-  if (req.path() == "/")
+  if (g_files.handle(req, resp))
+  {
+  }
+  else if (req.path() == "/")
   {
     resp->setStatusCode(HttpResponse::k200Ok);
     resp->setStatusMessage("OK");
@@ -43,6 +80,21 @@ void onRequest(const HttpRequest& req, HttpResponse* resp)
     resp->setContentType("image/png");
     resp->setBody(string(favicon, sizeof favicon));
   }
+  else if (req.path() == "/stream")
+  {
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setStatusMessage("OK");
+    resp->setContentType("text/plain");
+    streamLines(resp);
+  }
+  else if (req.path() == "/upload")
+  {
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setStatusMessage("OK");
+    resp->setContentType("text/plain");
+    resp->setBody("received " + std::to_string(t_bodyBytes) + " bytes\n");
+    t_bodyBytes = 0;
+  }
   else if (req.path() == "/hello")
   {
     resp->setStatusCode(HttpResponse::k200Ok);
@@ -71,6 +123,7 @@ int main(int argc, char* argv[])
   EventLoop loop;
   HttpServer server(&loop, InetAddress(8000), "dummy");
   server.setHttpCallback(onRequest);
+  server.setBodyCallback(onBody);
   server.setThreadNum(numThreads);
   server.start();
   loop.loop();
@@ -9,6 +9,9 @@
 #include "muduo/net/Poller.h"
 #include "muduo/net/poller/PollPoller.h"
 #include "muduo/net/poller/EPollPoller.h"
+#include "muduo/net/poller/IoUringPoller.h"
+
+#include "muduo/base/Logging.h"
 
 #include <stdlib.h>
 
@@ -20,6 +23,15 @@ Poller* Poller::newDefaultPoller(EventLoop* loop)
   {
     return new PollPoller(loop);
   }
+  else if (::getenv("MUDUO_USE_IO_URING"))
+  {
+    if (Poller* poller = IoUringPoller::create(loop))
+    {
+      return poller;
+    }
+    LOG_WARN << "io_uring unavailable, fall back to epoll";
+    return new EPollPoller(loop);
+  }
   else
   {
     return new EPollPoller(loop);
@@ -0,0 +1,630 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+#include "muduo/net/poller/IoUringPoller.h"
+
+#include "muduo/base/Logging.h"
+#include "muduo/net/Buffer.h"
+#include "muduo/net/Channel.h"
+#include "muduo/net/OutputQueue.h"
+
+#include <algorithm>
+
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifndef NO_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+using namespace muduo;
+using namespace muduo::net;
+
+namespace
+{
+const int kNew = -1;
+const int kAdded = 1;
+const int kDeleted = 2;
+}
+
+#ifdef NO_IO_URING
+
+// built against headers older than Linux 5.13, always use epoll
+
+IoUringPoller* IoUringPoller::create(EventLoop*)
+{
+  return NULL;
+}
+
+#else
+
+namespace
+{
+// user_data of POLL_REMOVE requests, their completions are ignored.
+// Poll requests carry (generation << 32) | fd, with 31 bits of generation,
+// recv and send requests kIoTag | index in ioRequests_.
+const uint64_t kRemoveTag = ~static_cast<uint64_t>(0);
+const uint64_t kIoTag = static_cast<uint64_t>(1) << 63;
+const uint32_t kGenerationMask = 0x7fffffff;
+
+int ioUringSetup(unsigned entries, struct io_uring_params* params)
+{
+  return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ioUringEnter(int ringfd, unsigned toSubmit, unsigned minComplete,
+                 unsigned flags, const void* arg, size_t argSize)
+{
+  return static_cast<int>(::syscall(__NR_io_uring_enter, ringfd, toSubmit,
+                                    minComplete, flags, arg, argSize));
+}
+
+unsigned* ringField(void* ring, unsigned offset)
+{
+  return reinterpret_cast<unsigned*>(static_cast<char*>(ring) + offset);
+}
+
+uint64_t userData(uint32_t generation, int fd)
+{
+  return (static_cast<uint64_t>(generation & kGenerationMask) << 32)
+       | static_cast<uint32_t>(fd);
+}
+}  // namespace
+
+// A recv or send of the batch in flight, its iovecs stay put until done.
+struct IoUringPoller::IoRequest
+{
+  Channel* channel;
+  int res;
+  struct msghdr msg;
+  struct iovec vec[OutputQueue::kMaxIovecs];
+};
+
+IoUringPoller* IoUringPoller::create(EventLoop* loop)
+{
+  struct io_uring_params params;
+  memZero(&params, sizeof params);
+  int ringfd = ioUringSetup(kRingEntries, &params);
+  if (ringfd < 0)
+  {
+    LOG_SYSERR << "io_uring_setup";
+    return NULL;
+  }
+  // EXT_ARG for the timeout of io_uring_enter, Linux 5.11.
+  // Multishot poll has no feature bit, RSRC_TAGS came with it in 5.13.
+  const unsigned required = IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG
+                          | IORING_FEAT_RSRC_TAGS;
+  if ((params.features & required) != required)
+  {
+    LOG_WARN << "io_uring features 0x" << Fmt("%x", params.features)
+             << " lack multishot poll, Linux 5.13 is required";
+    ::close(ringfd);
+    return NULL;
+  }
+  IoUringPoller* poller = new IoUringPoller(loop, ringfd);
+  if (!poller->mapRings(params))
+  {
+    delete poller;
+    return NULL;
+  }
+  return poller;
+}
+
+IoUringPoller::IoUringPoller(EventLoop* loop, int ringfd)
+  : Poller(loop),
+    ringfd_(ringfd),
+    sqRing_(MAP_FAILED),
+    sqRingSize_(0),
+    sqHead_(NULL),
+    sqTail_(NULL),
+    sqMask_(0),
+    sqArray_(NULL),
+    sqes_(static_cast<io_uring_sqe*>(MAP_FAILED)),
+    sqesSize_(0),
+    toSubmit_(0),
+    cqRing_(MAP_FAILED),
+    cqRingSize_(0),
+    cqHead_(NULL),
+    cqTail_(NULL),
+    cqMask_(0),
+    cqes_(NULL),
+    ioRequests_(new IoRequest[kMaxBatch]),
+    ioInFlight_(0)
+{
+}
+
+IoUringPoller::~IoUringPoller()
+{
+  if (sqes_ != MAP_FAILED)
+  {
+    ::munmap(sqes_, sqesSize_);
+  }
+  if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_)
+  {
+    ::munmap(cqRing_, cqRingSize_);
+  }
+  if (sqRing_ != MAP_FAILED)
+  {
+    ::munmap(sqRing_, sqRingSize_);
+  }
+  // closing the ring cancels all outstanding polls
+  ::close(ringfd_);
+}
+
+bool IoUringPoller::mapRings(const struct io_uring_params& params)
+{
+  sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  const bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (singleMmap)
+  {
+    sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+  }
+
+  sqRing_ = ::mmap(NULL, sqRingSize_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ringfd_, IORING_OFF_SQ_RING);
+  if (sqRing_ == MAP_FAILED)
+  {
+    LOG_SYSERR << "IoUringPoller mmap sq ring";
+    return false;
+  }
+  if (singleMmap)
+  {
+    cqRing_ = sqRing_;
+  }
+  else
+  {
+    cqRing_ = ::mmap(NULL, cqRingSize_, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ringfd_, IORING_OFF_CQ_RING);
+    if (cqRing_ == MAP_FAILED)
+    {
+      LOG_SYSERR << "IoUringPoller mmap cq ring";
+      return false;
+    }
+  }
+  sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+  sqes_ = static_cast<io_uring_sqe*>(
+      ::mmap(NULL, sqesSize_, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, ringfd_, IORING_OFF_SQES));
+  if (sqes_ == MAP_FAILED)
+  {
+    LOG_SYSERR << "IoUringPoller mmap sqes";
+    return false;
+  }
+
+  sqHead_ = ringField(sqRing_, params.sq_off.head);
+  sqTail_ = ringField(sqRing_, params.sq_off.tail);
+  sqMask_ = *ringField(sqRing_, params.sq_off.ring_mask);
+  sqArray_ = ringField(sqRing_, params.sq_off.array);
+  cqHead_ = ringField(cqRing_, params.cq_off.head);
+  cqTail_ = ringField(cqRing_, params.cq_off.tail);
+  cqMask_ = *ringField(cqRing_, params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<io_uring_cqe*>(
+      static_cast<char*>(cqRing_) + params.cq_off.cqes);
+  return true;
+}
+
+Timestamp IoUringPoller::poll(int timeoutMs, ChannelList* activeChannels)
+{
+  LOG_TRACE << "fd total count " << channels_.size();
+  // one-shot polls completed in the last round, the handlers have run
+  for (int fd : pendingRearms_)
+  {
+    PollState& state = stateOf(fd);
+    if (state.channel && !state.armed && state.channel->index() == kAdded)
+    {
+      arm(fd);
+    }
+  }
+  pendingRearms_.clear();
+
+  const size_t first = activeChannels->size();
+  // output queued by the handlers, its write callbacks run this round
+  sendQueued(activeChannels);
+  submitAndWait(activeChannels->size() > first ? 0 : timeoutMs);
+  Timestamp now(Timestamp::now());
+  reapCompletions(activeChannels);
+  receive(first, activeChannels);
+
+  // multishot polls may complete more than once per round
+  for (size_t i = first; i < activeChannels->size(); ++i)
+  {
+    Channel* channel = (*activeChannels)[i];
+    PollState& state = states_[channel->fd()];
+    channel->set_revents(state.revents);
+    state.revents = 0;
+    state.active = false;
+  }
+  const size_t numEvents = activeChannels->size() - first;
+  if (numEvents > 0)
+  {
+    LOG_TRACE << numEvents << " events happened";
+  }
+  else
+  {
+    LOG_TRACE << "nothing happened";
+  }
+  return now;
+}
+
+// Submits all queued SQEs and waits for a completion, one system call.
+void IoUringPoller::submitAndWait(int timeoutMs)
+{
+  struct __kernel_timespec ts;
+  struct io_uring_getevents_arg arg;
+  memZero(&arg, sizeof arg);
+  arg.sigmask_sz = _NSIG / 8;
+  if (timeoutMs >= 0)
+  {
+    ts.tv_sec = timeoutMs / 1000;
+    ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000 * 1000;
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+  }
+  int ret = ioUringEnter(ringfd_, publishSqes(), 1,
+                         IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                         &arg, sizeof arg);
+  if (ret < 0 && errno != EINTR && errno != ETIME)
+  {
+    LOG_SYSERR << "IoUringPoller::poll()";
+  }
+}
+
+// Makes queued SQEs visible to the kernel,
+// returns the number not yet consumed by it.
+unsigned IoUringPoller::publishSqes()
+{
+  const unsigned tail = *sqTail_ + toSubmit_;
+  __atomic_store_n(sqTail_, tail, __ATOMIC_RELEASE);
+  toSubmit_ = 0;
+  return tail - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+}
+
+void IoUringPoller::reapCompletions(ChannelList* activeChannels)
+{
+  unsigned head = *cqHead_;
+  const unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+  for (; head != tail; ++head)
+  {
+    const io_uring_cqe& cqe = cqes_[head & cqMask_];
+    if (cqe.user_data == kRemoveTag)
+    {
+      continue;
+    }
+    if (cqe.user_data & kIoTag)
+    {
+      ioRequests_[cqe.user_data & ~kIoTag].res = cqe.res;
+      --ioInFlight_;
+      continue;
+    }
+    const int fd = static_cast<int>(cqe.user_data & 0xffffffff);
+    const uint32_t generation = static_cast<uint32_t>(cqe.user_data >> 32);
+    if (static_cast<size_t>(fd) >= states_.size())
+    {
+      continue;
+    }
+    PollState& state = states_[fd];
+    if ((state.generation & kGenerationMask) != generation || state.channel == NULL)
+    {
+      continue;  // disarmed or the fd was reused
+    }
+    if (!(cqe.flags & IORING_CQE_F_MORE))
+    {
+      state.armed = false;
+      pendingRearms_.push_back(fd);
+    }
+    if (cqe.res > 0)
+    {
+      activate(state, cqe.res, activeChannels);
+    }
+    else if (cqe.res < 0 && cqe.res != -ECANCELED)
+    {
+      errno = -cqe.res;
+      LOG_SYSERR << "IoUringPoller poll fd = " << fd;
+    }
+  }
+  __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+}
+
+void IoUringPoller::activate(PollState& state, int revents, ChannelList* activeChannels)
+{
+  state.revents |= revents;
+  if (!state.active)
+  {
+    state.active = true;
+    activeChannels->push_back(state.channel);
+  }
+}
+
+// Sends the output queued with queueSend(), a batch per io_uring_enter(2).
+// The write callbacks take the results, with POLLOUT as if it were polled.
+void IoUringPoller::sendQueued(ChannelList* activeChannels)
+{
+  size_t i = 0;
+  while (i < sendQueue_.size())
+  {
+    unsigned count = 0;
+    for (; i < sendQueue_.size() && count < kMaxBatch; ++i)
+    {
+      PollState& state = states_[sendQueue_[i]];
+      if (!state.sendQueued)
+      {
+        continue;  // removed
+      }
+      state.sendQueued = false;
+      Channel* channel = state.channel;
+      if (!channel->sendQueued())
+      {
+        continue;  // Channel::disableAll()
+      }
+      IoRequest& req = ioRequests_[count];
+      req.channel = channel;
+      const int iovcnt = channel->sendQueue()->gather(req.vec, OutputQueue::kMaxIovecs);
+      if (iovcnt == 0)
+      {
+        // a file segment in front, it's sent when writable
+        req.res = channel->sendQueue()->empty() ? 0 : -EAGAIN;
+        ++count;
+        continue;
+      }
+      memZero(&req.msg, sizeof req.msg);
+      req.msg.msg_iov = req.vec;
+      req.msg.msg_iovlen = iovcnt;
+      io_uring_sqe* sqe = getSqe();
+      sqe->opcode = IORING_OP_SENDMSG;
+      sqe->fd = channel->fd();
+      sqe->addr = reinterpret_cast<uint64_t>(&req.msg);
+      sqe->len = 1;
+      sqe->msg_flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+      sqe->user_data = kIoTag | count;
+      ++ioInFlight_;
+      ++count;
+    }
+    waitForIo(activeChannels);
+    for (unsigned j = 0; j < count; ++j)
+    {
+      IoRequest& req = ioRequests_[j];
+      if (req.res > 0)
+      {
+        req.channel->sendQueue()->retrieve(static_cast<size_t>(req.res));
+      }
+      req.channel->setSent(req.res < 0 ? -1 : req.res, req.res < 0 ? -req.res : 0);
+      activate(states_[req.channel->fd()], POLLOUT, activeChannels);
+    }
+  }
+  sendQueue_.clear();
+}
+
+// Receives into the buffers of readable channels, a batch per
+// io_uring_enter(2), before their read callbacks run.
+void IoUringPoller::receive(size_t first, ChannelList* activeChannels)
+{
+  // channels activated while waiting for a batch read by themselves
+  const size_t last = activeChannels->size();
+  size_t i = first;
+  while (i < last)
+  {
+    unsigned count = 0;
+    for (; i < last && count < kMaxBatch; ++i)
+    {
+      Channel* channel = (*activeChannels)[i];
+      Buffer* buf = channel->receiveBuffer();
+      if (buf == NULL || !channel->isReading() ||
+          !(states_[channel->fd()].revents & POLLIN))
+      {
+        continue;
+      }
+      // pooled storage is taken when there is something to read
+      buf->ensureWritableBytes(Buffer::kInitialSize);
+      IoRequest& req = ioRequests_[count];
+      req.channel = channel;
+      io_uring_sqe* sqe = getSqe();
+      sqe->opcode = IORING_OP_RECV;
+      sqe->fd = channel->fd();
+      sqe->addr = reinterpret_cast<uint64_t>(buf->beginWrite());
+      sqe->len = static_cast<uint32_t>(buf->writableBytes());
+      sqe->msg_flags = MSG_DONTWAIT;
+      sqe->user_data = kIoTag | count;
+      ++ioInFlight_;
+      ++count;
+    }
+    if (count == 0)
+    {
+      break;
+    }
+    waitForIo(activeChannels);
+    for (unsigned j = 0; j < count; ++j)
+    {
+      IoRequest& req = ioRequests_[j];
+      if (req.res > 0)
+      {
+        req.channel->receiveBuffer()->hasWritten(static_cast<size_t>(req.res));
+      }
+      req.channel->setReceived(req.res < 0 ? -1 : req.res, req.res < 0 ? -req.res : 0);
+    }
+  }
+}
+
+// Submits the batch and reaps until all of it completed. MSG_DONTWAIT
+// requests complete at once, with -EAGAIN if the socket isn't ready.
+void IoUringPoller::waitForIo(ChannelList* activeChannels)
+{
+  while (ioInFlight_ > 0)
+  {
+    int ret = ioUringEnter(ringfd_, publishSqes(), 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    if (ret < 0 && errno != EINTR)
+    {
+      LOG_SYSFATAL << "IoUringPoller io_uring_enter";
+    }
+    reapCompletions(activeChannels);
+  }
+}
+
+io_uring_sqe* IoUringPoller::getSqe()
+{
+  unsigned tail = *sqTail_ + toSubmit_;
+  if (tail - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) == kRingEntries)
+  {
+    // submission queue is full, flush it without waiting
+    if (ioUringEnter(ringfd_, publishSqes(), 0, 0, NULL, 0) < 0)
+    {
+      LOG_SYSFATAL << "IoUringPoller io_uring_enter";
+    }
+    tail = *sqTail_;
+    if (tail - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) == kRingEntries)
+    {
+      LOG_FATAL << "IoUringPoller submission queue stalled";
+    }
+  }
+  const unsigned index = tail & sqMask_;
+  sqArray_[index] = index;
+  ++toSubmit_;
+  io_uring_sqe* sqe = &sqes_[index];
+  memZero(sqe, sizeof *sqe);
+  return sqe;
+}
+
+IoUringPoller::PollState& IoUringPoller::stateOf(int fd)
+{
+  assert(fd >= 0);
+  if (static_cast<size_t>(fd) >= states_.size())
+  {
+    states_.resize(fd + 1);
+  }
+  return states_[fd];
+}
+
+void IoUringPoller::arm(int fd)
+{
+  PollState& state = stateOf(fd);
+  Channel* channel = state.channel;
+  assert(channel != NULL);
+  assert(!state.armed);
+  ++state.generation;
+  state.events = channel->events();
+  state.multishot = channel->edgeTriggered();
+  state.armed = true;
+
+  io_uring_sqe* sqe = getSqe();
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  sqe->poll32_events = static_cast<uint32_t>(state.events);
+  sqe->len = state.multishot ? IORING_POLL_ADD_MULTI : 0;
+  sqe->user_data = userData(state.generation, fd);
+  LOG_TRACE << "poll add fd = " << fd << " event = { "
+            << channel->eventsToString() << " }"
+            << (state.multishot ? " multishot" : "");
+}
+
+void IoUringPoller::disarm(int fd)
+{
+  PollState& state = stateOf(fd);
+  if (state.armed)
+  {
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = userData(state.generation, fd);
+    sqe->user_data = kRemoveTag;
+    state.armed = false;
+    LOG_TRACE << "poll remove fd = " << fd;
+  }
+  // completions still in flight no longer match
+  ++state.generation;
+}
+
+void IoUringPoller::updateChannel(Channel* channel)
+{
+  Poller::assertInLoopThread();
+  const int index = channel->index();
+  const int fd = channel->fd();
+  LOG_TRACE << "fd = " << fd
+    << " events = " << channel->events() << " index = " << index;
+  PollState& state = stateOf(fd);
+  if (index == kNew || index == kDeleted)
+  {
+    if (index == kNew)
+    {
+      assert(channels_.find(fd) == channels_.end());
+      channels_[fd] = channel;
+    }
+    else // index == kDeleted
+    {
+      assert(channels_.find(fd) != channels_.end());
+      assert(channels_[fd] == channel);
+    }
+    channel->set_index(kAdded);
+    state.channel = channel;
+    disarm(fd);
+    arm(fd);
+  }
+  else
+  {
+    assert(channels_.find(fd) != channels_.end());
+    assert(channels_[fd] == channel);
+    assert(index == kAdded);
+    assert(state.channel == channel);
+    if (channel->isNoneEvent())
+    {
+      disarm(fd);
+      channel->set_index(kDeleted);
+    }
+    else if (state.armed
+             && (state.events != channel->events()
+                 || state.multishot != channel->edgeTriggered()))
+    {
+      disarm(fd);
+      arm(fd);
+    }
+    // a completed one-shot poll is re-armed with the new events in poll()
+  }
+}
+
+bool IoUringPoller::queueSend(Channel* channel)
+{
+  Poller::assertInLoopThread();
+  PollState& state = stateOf(channel->fd());
+  if (state.channel != channel)
+  {
+    return false;  // not added yet
+  }
+  if (!state.sendQueued)
+  {
+    state.sendQueued = true;
+    sendQueue_.push_back(channel->fd());
+  }
+  return true;
+}
+
+void IoUringPoller::removeChannel(Channel* channel)
+{
+  Poller::assertInLoopThread();
+  int fd = channel->fd();
+  LOG_TRACE << "fd = " << fd;
+  assert(channels_.find(fd) != channels_.end());
+  assert(channels_[fd] == channel);
+  assert(channel->isNoneEvent());
+  int index = channel->index();
+  assert(index == kAdded || index == kDeleted);
+  (void)index;
+  size_t n = channels_.erase(fd);
+  (void)n;
+  assert(n == 1);
+
+  disarm(fd);
+  PollState& state = stateOf(fd);
+  state.channel = NULL;
+  state.revents = 0;
+  state.active = false;
+  state.sendQueued = false;
+  channel->set_index(kNew);
+}
+
+#endif  // NO_IO_URING
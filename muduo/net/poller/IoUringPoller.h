@@ -0,0 +1,119 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// This is an internal header file, you should not include this.
+
+#ifndef MUDUO_NET_POLLER_IOURINGPOLLER_H
+#define MUDUO_NET_POLLER_IOURINGPOLLER_H
+
+#include "muduo/net/Poller.h"
+
+#include <memory>
+#include <vector>
+
+struct io_uring_params;
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace muduo
+{
+namespace net
+{
+
+///
+/// IO Multiplexing with io_uring(7) poll requests.
+///
+/// Interest changes become SQEs and are submitted together with the wait
+/// in one io_uring_enter(2) per loop iteration, instead of one epoll_ctl(2)
+/// per change. Polls are one-shot and re-armed after the handlers ran,
+/// which keeps the level-triggered semantics of EPollPoller. Channels that
+/// drain their fd (Channel::edgeTriggered()) use multishot poll.
+///
+/// Socket I/O of TcpConnection is batched too, see Channel::setBatchedIo().
+/// Before the wait, queued output of all connections is sent with SENDMSG
+/// requests, after it, all readable connections receive with RECV requests,
+/// one io_uring_enter(2) for each batch. Requests are MSG_DONTWAIT and
+/// complete before poll() returns, so buffers are never in flight while
+/// handlers run.
+///
+class IoUringPoller : public Poller
+{
+public:
+    /// Returns NULL if the kernel lacks io_uring or multishot poll.
+    static IoUringPoller *create(EventLoop *loop);
+
+    ~IoUringPoller() override;
+
+    Timestamp poll(int timeoutMs, ChannelList *activeChannels) override;
+    void updateChannel(Channel *channel) override;
+    void removeChannel(Channel *channel) override;
+    bool queueSend(Channel *channel) override;
+
+private:
+    struct IoRequest;
+
+    struct PollState
+    {
+        PollState() : channel(NULL), generation(0), events(0), revents(0),
+                      armed(false), multishot(false), active(false),
+                      sendQueued(false) {}
+
+        Channel *channel;
+        uint32_t generation; // user_data of stale completions won't match
+        int events;          // events the armed poll waits for
+        int revents;
+        bool armed;
+        bool multishot;
+        bool active;         // already in activeChannels of this round
+        bool sendQueued;     // in sendQueue_
+    };
+
+    static const unsigned kRingEntries = 1024;
+    // recv or send requests per io_uring_enter
+    static const unsigned kMaxBatch = 256;
+
+    IoUringPoller(EventLoop *loop, int ringfd);
+    bool mapRings(const struct io_uring_params &params);
+
+    io_uring_sqe *getSqe();
+    void submitAndWait(int timeoutMs);
+    unsigned publishSqes();
+    void reapCompletions(ChannelList *activeChannels);
+    void activate(PollState &state, int revents, ChannelList *activeChannels);
+    void sendQueued(ChannelList *activeChannels);
+    void receive(size_t first, ChannelList *activeChannels);
+    void waitForIo(ChannelList *activeChannels);
+
+    PollState &stateOf(int fd);
+    void arm(int fd);
+    void disarm(int fd);
+
+    int ringfd_;
+    // submission queue
+    void *sqRing_;
+    size_t sqRingSize_;
+    unsigned *sqHead_;
+    unsigned *sqTail_;
+    unsigned sqMask_;
+    unsigned *sqArray_;
+    io_uring_sqe *sqes_;
+    size_t sqesSize_;
+    unsigned toSubmit_;  // queued after *sqTail_, not yet published
+    // completion queue
+    void *cqRing_;
+    size_t cqRingSize_;
+    unsigned *cqHead_;
+    unsigned *cqTail_;
+    unsigned cqMask_;
+    io_uring_cqe *cqes_;
+
+    std::vector<PollState> states_;   // indexed by fd
+    std::vector<int> pendingRearms_;  // one-shot polls completed last round
+    std::vector<int> sendQueue_;      // fds of Channel::queueSend()
+    std::unique_ptr<IoRequest[]> ioRequests_;  // kMaxBatch, of the batch in flight
+    unsigned ioInFlight_;
+};
+
+} // namespace net
+} // namespace muduo
+#endif // MUDUO_NET_POLLER_IOURINGPOLLER_H
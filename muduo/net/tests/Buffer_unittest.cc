@@ -1,4 +1,5 @@
 #include "muduo/net/Buffer.h"
+#include "muduo/base/Thread.h"
 
 //#define BOOST_TEST_MODULE BufferTest
 #define BOOST_TEST_MAIN
@@ -7,6 +8,7 @@
 
 using muduo::string;
 using muduo::net::Buffer;
+using muduo::net::BufferPool;
 
 BOOST_AUTO_TEST_CASE(testBufferAppendRetrieve)
 {
@@ -168,3 +170,60 @@ BOOST_AUTO_TEST_CASE(testMove)
   // printf("Buffer at %p, inner %p\n", &buf, inner);
   output(std::move(buf), inner);
 }
+
+BOOST_AUTO_TEST_CASE(testBufferPool)
+{
+  std::shared_ptr<BufferPool> pool(std::make_shared<BufferPool>());
+  Buffer buf(pool);
+  BOOST_CHECK(buf.pooled());
+  BOOST_CHECK_EQUAL(buf.internalCapacity(), 0);
+  BOOST_CHECK_EQUAL(buf.writableBytes(), 0);
+  BOOST_CHECK_EQUAL(buf.prependableBytes(), Buffer::kCheapPrepend);
+
+  buf.append(string(100, 'x'));
+  BOOST_CHECK_EQUAL(buf.internalCapacity(), BufferPool::kMinClassSize);
+  BOOST_CHECK_EQUAL(buf.writableBytes(), BufferPool::kMinClassSize - Buffer::kCheapPrepend - 100);
+  buf.append(string(2000, 'y'));
+  BOOST_CHECK_EQUAL(buf.internalCapacity(), 4096);
+  BOOST_CHECK_EQUAL(pool->liveBytes(), 4096);
+
+  buf.release();  // not drained
+  BOOST_CHECK_EQUAL(buf.readableBytes(), 2100);
+  buf.retrieveAll();
+  buf.release();
+  BOOST_CHECK_EQUAL(buf.internalCapacity(), 0);
+  BOOST_CHECK_EQUAL(pool->liveBytes(), 0);
+  BOOST_CHECK_EQUAL(pool->pooledBytes(), 1024 + 4096);
+
+  // the next one of the same class comes from the free list
+  buf.append(string(3000, 'z'));
+  BOOST_CHECK_EQUAL(pool->hits(), 1);
+  BOOST_CHECK_EQUAL(pool->pooledBytes(), 1024);
+
+  // copies are not pooled, swaps take the pool along
+  Buffer copy(buf);
+  BOOST_CHECK(!copy.pooled());
+  BOOST_CHECK_EQUAL(copy.retrieveAllAsString(), string(3000, 'z'));
+  Buffer other;
+  other.swap(buf);
+  BOOST_CHECK(other.pooled());
+  BOOST_CHECK(!buf.pooled());
+
+  other.setPool(std::shared_ptr<BufferPool>());
+  BOOST_CHECK(!other.pooled());
+  BOOST_CHECK_EQUAL(other.retrieveAllAsString(), string(3000, 'z'));
+  BOOST_CHECK_EQUAL(pool->liveBytes(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(testBufferPoolOtherThread)
+{
+  std::shared_ptr<BufferPool> pool(std::make_shared<BufferPool>());
+  Buffer buf(pool);
+  buf.append(string(100, 'x'));
+  // storage freed in another thread goes back to the heap
+  muduo::Thread thread([&buf] { Buffer().swap(buf); });
+  thread.start();
+  thread.join();
+  BOOST_CHECK_EQUAL(pool->liveBytes(), 0);
+  BOOST_CHECK_EQUAL(pool->pooledBytes(), 0);
+}
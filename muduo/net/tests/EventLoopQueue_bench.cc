@@ -0,0 +1,148 @@
+// Benchmark of EventLoop::queueInLoop(), the lock-free MPSC queue,
+// against the previous design, a mutex guarded vector swapped in the loop.
+
+#include "muduo/base/CountDownLatch.h"
+#include "muduo/base/Mutex.h"
+#include "muduo/base/Thread.h"
+#include "muduo/base/Timestamp.h"
+#include "muduo/net/Channel.h"
+#include "muduo/net/EventLoop.h"
+#include "muduo/net/EventLoopThread.h"
+
+#include <memory>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// The old EventLoop::queueInLoop() and doPendingFunctors(),
+// driven by its own eventfd in the same loop.
+class MutexSwapQueue : noncopyable
+{
+ public:
+  typedef EventLoop::Functor Functor;
+
+  explicit MutexSwapQueue(EventLoop* loop)
+    : loop_(loop),
+      wakeupFd_(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+      channel_(new Channel(loop, wakeupFd_))
+  {
+    channel_->setReadCallback(std::bind(&MutexSwapQueue::handleRead, this));
+    loop_->runInLoop(std::bind(&Channel::enableReading, get_pointer(channel_)));
+  }
+
+  ~MutexSwapQueue()
+  {
+    CountDownLatch latch(1);
+    loop_->runInLoop([this, &latch]
+        {
+          channel_->disableAll();
+          channel_->remove();
+          latch.countDown();
+        });
+    latch.wait();
+    ::close(wakeupFd_);
+  }
+
+  void queueInLoop(Functor cb)
+  {
+    {
+      MutexLockGuard lock(mutex_);
+      pendingFunctors_.push_back(std::move(cb));
+    }
+    uint64_t one = 1;
+    ssize_t n = ::write(wakeupFd_, &one, sizeof one);
+    (void)n;
+  }
+
+ private:
+  void handleRead()
+  {
+    uint64_t one = 1;
+    ssize_t n = ::read(wakeupFd_, &one, sizeof one);
+    (void)n;
+    std::vector<Functor> functors;
+    {
+      MutexLockGuard lock(mutex_);
+      functors.swap(pendingFunctors_);
+    }
+    for (const Functor& functor : functors)
+    {
+      functor();
+    }
+  }
+
+  EventLoop* loop_;
+  int wakeupFd_;
+  std::unique_ptr<Channel> channel_;
+  MutexLock mutex_;
+  std::vector<Functor> pendingFunctors_ GUARDED_BY(mutex_);
+};
+
+int g_count = 0;  // modified in loop thread only
+
+void increase(int* total, CountDownLatch* done)
+{
+  if (++g_count == *total)
+  {
+    done->countDown();
+  }
+}
+
+template<typename Queue>
+double bench(Queue* queue, int numProducers, int numFunctors)
+{
+  g_count = 0;
+  int total = numProducers * numFunctors;
+  CountDownLatch ready(numProducers);
+  CountDownLatch go(1);
+  CountDownLatch done(1);
+  std::vector<std::unique_ptr<Thread>> producers;
+  for (int i = 0; i < numProducers; ++i)
+  {
+    producers.emplace_back(new Thread([&]
+        {
+          ready.countDown();
+          go.wait();
+          for (int j = 0; j < numFunctors; ++j)
+          {
+            queue->queueInLoop(std::bind(increase, &total, &done));
+          }
+        }));
+    producers.back()->start();
+  }
+  ready.wait();
+  Timestamp start(Timestamp::now());
+  go.countDown();
+  done.wait();
+  double seconds = timeDifference(Timestamp::now(), start);
+  for (auto& thr : producers)
+  {
+    thr->join();
+  }
+  return seconds;
+}
+
+int main(int argc, char* argv[])
+{
+  int maxProducers = argc > 1 ? atoi(argv[1]) : 16;
+  int numFunctors = argc > 2 ? atoi(argv[2]) : 200000;
+
+  EventLoopThread loopThread;
+  EventLoop* loop = loopThread.startLoop();
+  MutexSwapQueue mutexQueue(loop);
+
+  printf("%9s %16s %16s\n", "producers", "mutex+swap Mop/s", "mpsc Mop/s");
+  for (int n = 1; n <= maxProducers; n *= 2)
+  {
+    double total = static_cast<double>(n) * numFunctors / 1e6;
+    double mutexSeconds = bench(&mutexQueue, n, numFunctors);
+    double mpscSeconds = bench(loop, n, numFunctors);
+    printf("%9d %16.2f %16.2f\n", n, total / mutexSeconds, total / mpscSeconds);
+  }
+}
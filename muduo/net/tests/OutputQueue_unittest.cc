@@ -0,0 +1,198 @@
+#include "muduo/net/OutputQueue.h"
+#include "muduo/net/Buffer.h"
+
+//#define BOOST_TEST_MODULE OutputQueueTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <errno.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using muduo::string;
+using muduo::net::Buffer;
+using muduo::net::OutputQueue;
+
+namespace
+{
+
+string readAll(int fd, size_t len)
+{
+  string result(len, '\0');
+  size_t n = 0;
+  while (n < len)
+  {
+    ssize_t nr = ::read(fd, &result[n], len - n);
+    BOOST_REQUIRE(nr > 0);
+    n += static_cast<size_t>(nr);
+  }
+  return result;
+}
+
+void increase(int* count)
+{
+  ++*count;
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(testOutputQueueCoalesce)
+{
+  OutputQueue queue;
+  BOOST_CHECK(queue.empty());
+  queue.append(string(100, 'x'));
+  queue.append(string(200, 'y'));
+  BOOST_CHECK_EQUAL(queue.readableBytes(), 300);
+  BOOST_CHECK_EQUAL(queue.numSlices(), 1);
+
+  queue.append(string(OutputQueue::kBlockSize, 'z'));
+  BOOST_CHECK_EQUAL(queue.readableBytes(), 300 + OutputQueue::kBlockSize);
+  BOOST_CHECK_EQUAL(queue.numSlices(), 2);
+
+  queue.retrieve(250);
+  BOOST_CHECK_EQUAL(queue.readableBytes(), 50 + OutputQueue::kBlockSize);
+  BOOST_CHECK_EQUAL(queue.numSlices(), 2);
+  queue.retrieve(50);
+  BOOST_CHECK_EQUAL(queue.numSlices(), 1);
+  queue.retrieveAll();
+  BOOST_CHECK(queue.empty());
+  BOOST_CHECK_EQUAL(queue.numSlices(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(testOutputQueueSwapBuffer)
+{
+  OutputQueue queue;
+  Buffer small;
+  small.append(string(10, 'a'));
+  queue.append(&small);
+  BOOST_CHECK_EQUAL(small.readableBytes(), 0);
+
+  Buffer large;
+  large.append(string(OutputQueue::kSwapThreshold, 'b'));
+  queue.append(&large);
+  BOOST_CHECK_EQUAL(large.readableBytes(), 0);
+  BOOST_CHECK_EQUAL(queue.readableBytes(), 10 + OutputQueue::kSwapThreshold);
+  BOOST_CHECK_EQUAL(queue.numSlices(), 2);
+
+  queue.retrieve(10);
+  BOOST_CHECK_EQUAL(queue.numSlices(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(testOutputQueueSharedAndBorrowed)
+{
+  int released = 0;
+  std::shared_ptr<const string> message(new string("shared"));
+  static const char borrowed[] = "borrowed";
+  {
+    OutputQueue queue;
+    queue.append(message);
+    BOOST_CHECK_EQUAL(message.use_count(), 2);
+    queue.appendBorrowed(borrowed, sizeof borrowed - 1,
+                         std::bind(increase, &released));
+    BOOST_CHECK_EQUAL(queue.readableBytes(), 14);
+    BOOST_CHECK_EQUAL(released, 0);
+
+    queue.retrieve(6);
+    BOOST_CHECK_EQUAL(message.use_count(), 1);
+    BOOST_CHECK_EQUAL(released, 0);
+    queue.retrieve(4);
+    BOOST_CHECK_EQUAL(released, 0);
+  }
+  BOOST_CHECK_EQUAL(released, 1);
+}
+
+BOOST_AUTO_TEST_CASE(testOutputQueueAppendQueue)
+{
+  int released = 0;
+  static const char borrowed[] = "borrowed";
+  OutputQueue queue;
+  queue.append("head ", 5);
+
+  OutputQueue batch;
+  batch.append("small ", 6);
+  batch.appendBorrowed(borrowed, sizeof borrowed - 1,
+                       std::bind(increase, &released));
+  batch.append(string(OutputQueue::kBlockSize, 'x'));
+  BOOST_CHECK_EQUAL(batch.numSlices(), 3);
+
+  queue.append(&batch);
+  BOOST_CHECK(batch.empty());
+  BOOST_CHECK_EQUAL(batch.numSlices(), 0);
+  BOOST_CHECK_EQUAL(queue.readableBytes(), 19 + OutputQueue::kBlockSize);
+  // the small block is copied into the tail of queue
+  BOOST_CHECK_EQUAL(queue.numSlices(), 3);
+  BOOST_CHECK_EQUAL(released, 0);
+
+  queue.retrieve(11);
+  BOOST_CHECK_EQUAL(queue.numSlices(), 2);
+  queue.retrieve(8);
+  BOOST_CHECK_EQUAL(released, 1);
+
+  batch.append("again", 5);
+  BOOST_CHECK_EQUAL(batch.readableBytes(), 5);
+}
+
+BOOST_AUTO_TEST_CASE(testOutputQueueWriteFd)
+{
+  int fds[2];
+  BOOST_REQUIRE(::pipe(fds) == 0);
+
+  int released = 0;
+  static const char borrowed[] = "world";
+  OutputQueue queue;
+  queue.append("hello ", 6);
+  queue.appendBorrowed(borrowed, 5, std::bind(increase, &released));
+  queue.append(std::shared_ptr<const string>(new string("!\n")));
+  queue.append("bye", 3);
+  BOOST_CHECK_EQUAL(queue.numSlices(), 4);
+
+  int savedErrno = 0;
+  ssize_t n = queue.writeFd(fds[1], &savedErrno);
+  BOOST_CHECK_EQUAL(n, 16);
+  BOOST_CHECK(queue.empty());
+  BOOST_CHECK_EQUAL(released, 1);
+  BOOST_CHECK_EQUAL(readAll(fds[0], 16), "hello world!\nbye");
+
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+BOOST_AUTO_TEST_CASE(testOutputQueueFile)
+{
+  int fds[2];
+  BOOST_REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+  FILE* fp = ::tmpfile();
+  BOOST_REQUIRE(fp != NULL);
+  BOOST_REQUIRE(::fwrite("0123456789", 1, 10, fp) == 10);
+  ::fflush(fp);
+
+  int released = 0;
+  OutputQueue queue;
+  queue.append("head ", 5);
+  queue.appendFile(OutputQueue::borrow(NULL, std::bind(increase, &released)),
+                   ::fileno(fp), 2, 6);
+  queue.append(" tail", 5);
+  BOOST_CHECK_EQUAL(queue.readableBytes(), 16);
+
+  // memory slices are written up to the file segment, then the segment alone
+  int savedErrno = 0;
+  BOOST_CHECK_EQUAL(queue.writeFd(fds[1], &savedErrno), 5);
+  queue.retrieve(1);
+  BOOST_CHECK_EQUAL(queue.writeFd(fds[1], &savedErrno), 5);
+  BOOST_CHECK_EQUAL(released, 1);
+  BOOST_CHECK_EQUAL(queue.writeFd(fds[1], &savedErrno), 5);
+  BOOST_CHECK(queue.empty());
+  BOOST_CHECK_EQUAL(readAll(fds[0], 15), "head 34567 tail");
+
+  // a file shorter than queued
+  queue.appendFile(std::shared_ptr<const void>(), ::fileno(fp), 8, 10);
+  BOOST_CHECK_EQUAL(queue.writeFd(fds[1], &savedErrno), 2);
+  BOOST_CHECK_EQUAL(queue.writeFd(fds[1], &savedErrno), -1);
+  BOOST_CHECK_EQUAL(savedErrno, EIO);
+
+  ::fclose(fp);
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
@@ -0,0 +1,197 @@
+// Migrates one connection among the IO loops every millisecond,
+// while another thread and the owning loop both send numbered lines.
+// Each sequence must arrive complete and in order.
+
+#include "muduo/base/Atomic.h"
+#include "muduo/base/CurrentThread.h"
+#include "muduo/base/Logging.h"
+#include "muduo/base/Mutex.h"
+#include "muduo/base/Thread.h"
+#include "muduo/net/EventLoop.h"
+#include "muduo/net/EventLoopThread.h"
+#include "muduo/net/EventLoopThreadPool.h"
+#include "muduo/net/TcpClient.h"
+#include "muduo/net/TcpServer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+const int kLines = 200 * 1000;
+const int kLineLen = 9;
+const uint16_t kPort = 2018;
+
+EventLoop* g_loop;
+TcpServer* g_server;
+MutexLock g_mutex;
+TcpConnectionPtr g_conn GUARDED_BY(g_mutex);
+std::unique_ptr<Thread> g_sender;
+AtomicInt32 g_migrations;
+bool g_failed = false;
+TimerId g_migrateTimer;
+
+// lets the last migration land before the loops go away
+void finish()
+{
+  g_loop->cancel(g_migrateTimer);
+  g_loop->runAfter(0.1, [] { g_loop->quit(); });
+}
+
+void sendLines()
+{
+  TcpConnectionPtr conn;
+  {
+    MutexLockGuard lock(g_mutex);
+    conn = g_conn;
+  }
+  for (int i = 0; i < kLines; ++i)
+  {
+    char buf[16];
+    snprintf(buf, sizeof buf, "S%07d\n", i);
+    conn->send(buf);
+  }
+}
+
+void onServerConnection(const TcpConnectionPtr& conn)
+{
+  if (conn->connected())
+  {
+    {
+      MutexLockGuard lock(g_mutex);
+      g_conn = conn;
+    }
+    g_sender.reset(new Thread(sendLines, "sender"));
+    g_sender->start();
+  }
+}
+
+// echoes the client's C lines from whichever loop owns the connection,
+// whole lines only, not to be split by the sender's S lines
+void onServerMessage(const TcpConnectionPtr& conn, Buffer* buf, Timestamp)
+{
+  size_t len = buf->readableBytes() / kLineLen * kLineLen;
+  conn->send(buf->peek(), static_cast<int>(len));
+  buf->retrieve(len);
+}
+
+void migrate()
+{
+  TcpConnectionPtr conn;
+  {
+    MutexLockGuard lock(g_mutex);
+    conn = g_conn;
+  }
+  if (conn)
+  {
+    std::vector<EventLoop*> loops = g_server->threadPool()->getAllLoops();
+    conn->migrateTo(loops[rand() % loops.size()],
+                    [](const TcpConnectionPtr&) { g_migrations.increment(); });
+  }
+}
+
+class Checker : noncopyable
+{
+ public:
+  Checker(EventLoop* loop, const InetAddress& serverAddr)
+    : client_(loop, serverAddr, "Checker"),
+      nextS_(0),
+      nextC_(0)
+  {
+    client_.setConnectionCallback(
+        std::bind(&Checker::onConnection, this, _1));
+    client_.setMessageCallback(
+        std::bind(&Checker::onMessage, this, _1, _2, _3));
+  }
+
+  void connect() { client_.connect(); }
+
+  // Closes the connection and returns once it is destroyed, so that its
+  // connectDestroyed() is not left in the queue of the client loop.
+  void close()
+  {
+    TcpConnectionPtr conn = client_.connection();
+    std::weak_ptr<TcpConnection> weakConn(conn);
+    if (conn)
+    {
+      conn->forceClose();
+      conn.reset();
+    }
+    while (!weakConn.expired())
+    {
+      CurrentThread::sleepUsec(1000);
+    }
+  }
+
+ private:
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      string lines;
+      for (int i = 0; i < kLines; ++i)
+      {
+        char buf[16];
+        snprintf(buf, sizeof buf, "C%07d\n", i);
+        lines += buf;
+      }
+      conn->send(std::move(lines));
+    }
+  }
+
+  void onMessage(const TcpConnectionPtr&, Buffer* buf, Timestamp)
+  {
+    while (buf->readableBytes() >= kLineLen)
+    {
+      int n = atoi(buf->peek() + 1);
+      int* next = buf->peek()[0] == 'S' ? &nextS_ : &nextC_;
+      if (n != *next || buf->peek()[kLineLen - 1] != '\n')
+      {
+        LOG_ERROR << "expect " << *next << " got " << string(buf->peek(), kLineLen);
+        g_failed = true;
+        g_loop->runInLoop(finish);
+        return;
+      }
+      ++*next;
+      buf->retrieve(kLineLen);
+    }
+    if (nextS_ == kLines && nextC_ == kLines)
+    {
+      g_loop->runInLoop(finish);
+    }
+  }
+
+  TcpClient client_;
+  int nextS_;
+  int nextC_;
+};
+
+int main()
+{
+  Logger::setLogLevel(Logger::WARN);
+  EventLoop loop;
+  g_loop = &loop;
+  TcpServer server(&loop, InetAddress(kPort, true), "Migrate");
+  g_server = &server;
+  server.setThreadNum(3);
+  server.setConnectionCallback(onServerConnection);
+  server.setMessageCallback(onServerMessage);
+  server.start();
+  g_migrateTimer = loop.runEvery(0.001, migrate);
+
+  EventLoopThread clientThread;
+  Checker checker(clientThread.startLoop(), InetAddress("127.0.0.1", kPort));
+  checker.connect();
+  loop.runAfter(30, [] { g_failed = true; LOG_ERROR << "timeout"; finish(); });
+  loop.loop();
+
+  checker.close();
+  g_sender->join();
+  {
+    MutexLockGuard lock(g_mutex);
+    g_conn.reset();
+  }
+  printf("%s, %d migrations\n", g_failed ? "FAILED" : "OK", g_migrations.get());
+  return g_failed || g_migrations.get() == 0;
+}
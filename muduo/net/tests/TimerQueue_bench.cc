@@ -0,0 +1,74 @@
+// Benchmark of the two TimerQueue backends, std::set and timing wheel,
+// with one idle timer per connection: add, cancel and expire 1M timers.
+
+#include "muduo/base/Timestamp.h"
+#include "muduo/net/EventLoop.h"
+
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+int g_fired = 0;
+int g_total = 0;
+EventLoop* g_loop = NULL;
+
+void onTimeout()
+{
+  if (++g_fired == g_total)
+  {
+    g_loop->quit();
+  }
+}
+
+void bench(bool useWheel, int numTimers)
+{
+  EventLoop loop;
+  g_loop = &loop;
+  if (useWheel)
+  {
+    loop.useTimingWheel();
+  }
+  const char* name = useWheel ? "wheel" : "set";
+
+  // idle timeouts spread over 10 to 70 seconds, then cancelled
+  std::vector<TimerId> timers;
+  timers.reserve(numTimers);
+  Timestamp start(Timestamp::now());
+  for (int i = 0; i < numTimers; ++i)
+  {
+    timers.push_back(loop.runAfter(10.0 + (i % 60000) * 0.001, onTimeout));
+  }
+  Timestamp added(Timestamp::now());
+  for (const TimerId& timer : timers)
+  {
+    loop.cancel(timer);
+  }
+  Timestamp cancelled(Timestamp::now());
+  printf("%5s add    %7.1f ns/timer\n", name,
+         timeDifference(added, start) * 1e9 / numTimers);
+  printf("%5s cancel %7.1f ns/timer\n", name,
+         timeDifference(cancelled, added) * 1e9 / numTimers);
+
+  // expire, spread over 0.5 seconds starting from 0.1 second
+  g_fired = 0;
+  g_total = numTimers;
+  for (int i = 0; i < numTimers; ++i)
+  {
+    loop.runAfter(0.1 + (i % 500) * 0.001, onTimeout);
+  }
+  Timestamp looping(Timestamp::now());
+  loop.loop();
+  printf("%5s expire %d timers in %.3f s\n", name, g_fired,
+         timeDifference(Timestamp::now(), looping));
+}
+
+int main(int argc, char* argv[])
+{
+  int numTimers = argc > 1 ? atoi(argv[1]) : 1000 * 1000;
+  bench(false, numTimers);
+  bench(true, numTimers);
+}
@@ -89,3 +89,37 @@ BOOST_AUTO_TEST_CASE(testZlibOutputStream5)
   printf("total %zd\n", output.readableBytes());
   BOOST_CHECK_EQUAL(stream.zlibErrorCode(), Z_STREAM_END);
 }
+
+BOOST_AUTO_TEST_CASE(testZlibOutputStreamGzipFlush)
+{
+  muduo::net::Buffer output;
+  muduo::net::ZlibOutputStream stream(&output, muduo::net::ZlibOutputStream::kGzip);
+  BOOST_CHECK_EQUAL(stream.zlibErrorCode(), Z_OK);
+  muduo::string input;
+  for (int i = 0; i < 1000; ++i)
+  {
+    input += "01234567890123456789012345678901234567890123456789";
+  }
+  BOOST_CHECK(stream.write(input));
+  BOOST_CHECK(stream.flush());
+  size_t flushed = output.readableBytes();
+  BOOST_CHECK(flushed > 10);
+  BOOST_CHECK_EQUAL(stream.inputBytes(), static_cast<int64_t>(input.size()));
+
+  // what has been flushed decompresses completely
+  unsigned char plain[64 * 1024];
+  z_stream zs;
+  muduo::memZero(&zs, sizeof zs);
+  BOOST_REQUIRE(inflateInit2(&zs, 15 + 16) == Z_OK);
+  zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(output.peek()));
+  zs.avail_in = static_cast<uInt>(flushed);
+  zs.next_out = plain;
+  zs.avail_out = sizeof plain;
+  BOOST_CHECK_EQUAL(inflate(&zs, Z_SYNC_FLUSH), Z_OK);
+  BOOST_CHECK_EQUAL(zs.total_out, input.size());
+  BOOST_CHECK(memcmp(plain, input.data(), input.size()) == 0);
+  inflateEnd(&zs);
+
+  BOOST_CHECK(stream.finish());
+  BOOST_CHECK(output.readableBytes() > flushed);
+}